@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_alloc.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Counts the arena blocks requested through configfile_allocator callbacks while loading a generated file.
+ * Usage: bench_alloc [keys]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libconfigfile.h"
+
+typedef struct {
+    size_t allocations;
+    size_t releases;
+    size_t bytes;
+} counters;
+
+static void *counting_allocate(size_t size, void *user_data) {
+    counters *count = user_data;
+
+    count->allocations++;
+    count->bytes += size;
+    return malloc(size);
+}
+
+static void counting_release(void *pointer, size_t size, void *user_data) {
+    counters *count = user_data;
+
+    (void) size;
+    count->releases++;
+    free(pointer);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(const char *label, const char *filename, unsigned int flags) {
+    configfile_allocator allocator;
+    configfile_options options;
+    configfile *config;
+    counters count;
+    double start, load_time, kill_time;
+
+    memset(&count, 0, sizeof (count));
+    allocator.allocate = counting_allocate;
+    allocator.release = counting_release;
+    allocator.user_data = &count;
+
+    memset(&options, 0, sizeof (options));
+    options.allocator = &allocator;
+    options.flags = flags;
+
+    start = now_seconds();
+    config = configfile_init_ex(filename, &options);
+    load_time = now_seconds() - start;
+
+    if (config == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return -1;
+    }
+
+    start = now_seconds();
+    configfile_kill(config);
+    kill_time = now_seconds() - start;
+
+    printf("%-8s allocations=%zu releases=%zu bytes=%zu load=%.2f ms kill=%.3f ms\n", label, count.allocations,
+            count.releases, count.bytes, load_time * 1e3, kill_time * 1e3);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    char filename[] = "/tmp/bench_alloc_XXXXXX";
+    FILE *file;
+    size_t i;
+    int fd, result;
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    for (i = 0; i < keys; i++) {
+        fprintf(file, "section%zu.key%zu = value_%zu\n", i % 50, i, i);
+    }
+    fclose(file);
+
+    printf("keys=%zu\n", keys);
+    result = run("getline", filename, 0);
+    if (result == 0) {
+        result = run("mmap", filename, CONFIGFILE_MMAP);
+    }
+
+    unlink(filename);
+
+    return result == 0 ? (EXIT_SUCCESS) : (EXIT_FAILURE);
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_bind.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * A request handler reading five settings of a reloaded file on every request: by name with the typed getters,
+ * through interned handles, and as members of the structure bound to each version. Every request enters and
+ * leaves the reader. Also reports the time of a reload with and without the binding.
+ * Usage: bench_bind [keys] [requests]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libconfigfile.h"
+
+typedef struct _backend_settings {
+    int port;
+    int workers;
+    int64_t timeout;
+    uint64_t buffer;
+    int debug;
+} backend_settings;
+
+static const configfile_field backend_fields[] = {
+    CONFIGFILE_FIELD("service1.backend.port", CONFIGFILE_FIELD_INT, backend_settings, port, NULL, 1, 65535),
+    CONFIGFILE_FIELD("service2.backend.workers", CONFIGFILE_FIELD_INT, backend_settings, workers, "4", 1, 1024),
+    CONFIGFILE_FIELD("service3.backend.timeout", CONFIGFILE_FIELD_DURATION, backend_settings, timeout, "5s", 0, 0),
+    CONFIGFILE_FIELD("service4.backend.buffer", CONFIGFILE_FIELD_SIZE, backend_settings, buffer, "64KiB", 0, 0),
+    CONFIGFILE_FIELD("service5.backend.debug", CONFIGFILE_FIELD_BOOL, backend_settings, debug, "no", 0, 0)
+};
+
+#define BACKEND_FIELDS (sizeof (backend_fields) / sizeof (backend_fields[0]))
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const configfile_field *field, configfile_status status, configfile *module, void *user_data) {
+    (void) module;
+    (void) user_data;
+    printf("Error: %s: %s\n", field->module_name, configfile_status_string(status));
+}
+
+static double time_reload(configfile_reloader *reloader, int count) {
+    double start = now_seconds();
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (configfile_reloader_reload(reloader) != 0) {
+            return -1;
+        }
+    }
+
+    return (now_seconds() - start) / count;
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    size_t requests = argc > 2 ? strtoul(argv[2], NULL, 10) : 5000000;
+    char filename[] = "/tmp/bench_bind_XXXXXX";
+    configfile_key handles[BACKEND_FIELDS];
+    const backend_settings *settings;
+    configfile_reloader *reloader;
+    configfile_reader *reader;
+    double start, by_name, by_key, bound, plain_reload, bound_reload;
+    uint64_t total_name = 0, total_key = 0, total_bound = 0, bytes;
+    int64_t number, nanoseconds;
+    configfile *config;
+    size_t i;
+    FILE *file;
+    int flag, fd;
+
+    if (keys < 5 || requests == 0) {
+        fprintf(stderr, "Usage: %s [keys] [requests]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+    for (i = 0; i < keys; i++) {
+        fprintf(file, "service%zu.backend.port = %zu\n", i, 8000 + i % 1000);
+        fprintf(file, "service%zu.backend.workers = %zu\n", i, 1 + i % 32);
+        fprintf(file, "service%zu.backend.timeout = %zums\n", i, 100 + i % 900);
+        fprintf(file, "service%zu.backend.buffer = %zuKiB\n", i, 4 + i % 60);
+        fprintf(file, "service%zu.backend.debug = %s\n", i, i % 2 ? "yes" : "no");
+    }
+    fclose(file);
+
+    reloader = configfile_reloader_new(filename, NULL, 60000);
+    reader = reloader != NULL ? configfile_reader_new(reloader) : NULL;
+    if (reader == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        unlink(filename);
+        return (EXIT_FAILURE);
+    }
+
+    for (i = 0; i < BACKEND_FIELDS; i++) {
+        configfile_reloader_key(reloader, backend_fields[i].module_name, &handles[i]);
+    }
+    plain_reload = time_reload(reloader, 5);
+
+    if (configfile_reloader_bind(reloader, backend_fields, BACKEND_FIELDS, sizeof (backend_settings), report, NULL) != 0) {
+        unlink(filename);
+        return (EXIT_FAILURE);
+    }
+    bound_reload = time_reload(reloader, 5);
+    unlink(filename);
+
+    start = now_seconds();
+    for (i = 0; i < requests; i++) {
+        config = configfile_reader_enter(reader);
+        configfile_get_int64(config, "service1.backend.port", &number);
+        total_name += number;
+        configfile_get_int64(config, "service2.backend.workers", &number);
+        total_name += number;
+        configfile_get_duration(config, "service3.backend.timeout", &nanoseconds);
+        total_name += nanoseconds;
+        configfile_get_size(config, "service4.backend.buffer", &bytes);
+        total_name += bytes;
+        configfile_get_bool(config, "service5.backend.debug", &flag);
+        total_name += flag;
+        configfile_reader_leave(reader);
+    }
+    by_name = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < requests; i++) {
+        config = configfile_reader_enter(reader);
+        configfile_value_int64(configfile_key_get(config, handles[0]), &number);
+        total_key += number;
+        configfile_value_int64(configfile_key_get(config, handles[1]), &number);
+        total_key += number;
+        configfile_value_duration(configfile_key_get(config, handles[2]), &nanoseconds);
+        total_key += nanoseconds;
+        configfile_value_size(configfile_key_get(config, handles[3]), &bytes);
+        total_key += bytes;
+        configfile_value_bool(configfile_key_get(config, handles[4]), &flag);
+        total_key += flag;
+        configfile_reader_leave(reader);
+    }
+    by_key = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < requests; i++) {
+        settings = configfile_bound(configfile_reader_enter(reader));
+        total_bound += settings->port;
+        total_bound += settings->workers;
+        total_bound += settings->timeout;
+        total_bound += settings->buffer;
+        total_bound += settings->debug;
+        configfile_reader_leave(reader);
+    }
+    bound = now_seconds() - start;
+
+    configfile_reader_kill(reader);
+    configfile_reloader_kill(reloader);
+
+    if (total_name != total_key || total_name != total_bound) {
+        printf("Error: readers disagree\n");
+        return (EXIT_FAILURE);
+    }
+
+    printf("keys=%zu requests=%zu fields=%zu\n", keys * 5, requests, BACKEND_FIELDS);
+    printf("%-8s %14s\n", "", "request ns");
+    printf("%-8s %14.1f\n", "name", by_name * 1e9 / requests);
+    printf("%-8s %14.1f\n", "key", by_key * 1e9 / requests);
+    printf("%-8s %14.1f\n", "bound", bound * 1e9 / requests);
+    printf("reload ms: %.2f unbound, %.2f bound\n", plain_reload * 1e3, bound_reload * 1e3);
+
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_cpp.cpp
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * libconfigfile.hpp compared with the wrapper C++ code usually writes by hand: a class copying values into
+ * std::string and parsing numbers with std::stol() on every read, and iteration copying every name and value.
+ * Reads cycle through a fixed set of settings named by literals, as a request handler does.
+ * Usage: bench_cpp [keys] [reads]
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "libconfigfile.hpp"
+
+using namespace libconfigfile::literals;
+
+namespace {
+
+    class hand_config {
+    public:
+
+        explicit hand_config(const std::string &filename) : list_(configfile_init(filename.c_str())) {
+        }
+
+        ~hand_config() {
+            configfile_kill(list_);
+        }
+
+        std::string get(const std::string &name) const {
+            configfile *module = configfile_get(list_, name.c_str());
+
+            return module != nullptr ? std::string(module->module_value) : std::string();
+        }
+
+        long get_int(const std::string &name) const {
+            return std::stol(get(name));
+        }
+
+        std::vector<std::pair<std::string, std::string>> entries() const {
+            std::vector<std::pair<std::string, std::string>> result;
+
+            for (configfile *module = list_; module != nullptr; module = module->next) {
+                result.emplace_back(module->module_name, module->module_value);
+            }
+            return result;
+        }
+
+    private:
+        configfile *list_;
+    };
+
+    constexpr libconfigfile::key timeout_key = "service1.backend.timeout_ms"_key;
+    constexpr libconfigfile::key retries_key = "service2.backend.retries"_key;
+    constexpr libconfigfile::key host_key = "service3.backend.host"_key;
+    constexpr libconfigfile::key pool_key = "service4.backend.pool_size"_key;
+
+    double now_seconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+    size_t reads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5000000;
+    char filename[] = "/tmp/bench_cpp_XXXXXX";
+    double start, hand_string, hand_int, wrapper_string, wrapper_int, hand_iterate, wrapper_iterate;
+    size_t i, hand_total = 0, wrapper_total = 0;
+    std::FILE *file;
+    int fd;
+
+    if (keys < 5 || reads == 0) {
+        std::fprintf(stderr, "Usage: %s [keys] [reads]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == nullptr) {
+        std::printf("Error (%d): %s\n", errno, std::strerror(errno));
+        return (EXIT_FAILURE);
+    }
+    for (i = 0; i < keys; i++) {
+        std::fprintf(file, "service%zu.backend.timeout_ms = %zu\n", i, i * 31);
+        std::fprintf(file, "service%zu.backend.retries = %zu\n", i, i % 7);
+        std::fprintf(file, "service%zu.backend.host = backend%zu.internal\n", i, i);
+        std::fprintf(file, "service%zu.backend.pool_size = %zu\n", i, 16 + i % 48);
+    }
+    std::fclose(file);
+
+    hand_config hand(filename);
+    libconfigfile::config wrapper(filename);
+    unlink(filename);
+
+    start = now_seconds();
+    for (i = 0; i < reads; i += 2) {
+        hand_total += hand.get("service3.backend.host").size();
+        hand_total += hand.get("service1.backend.timeout_ms").size();
+    }
+    hand_string = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < reads; i += 2) {
+        wrapper_total += wrapper.get<std::string_view>(host_key)->size();
+        wrapper_total += wrapper.get<std::string_view>(timeout_key)->size();
+    }
+    wrapper_string = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < reads; i += 3) {
+        hand_total += hand.get_int("service1.backend.timeout_ms");
+        hand_total += hand.get_int("service2.backend.retries");
+        hand_total += hand.get_int("service4.backend.pool_size");
+    }
+    hand_int = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < reads; i += 3) {
+        wrapper_total += *wrapper.get<long>(timeout_key);
+        wrapper_total += *wrapper.get<long>(retries_key);
+        wrapper_total += *wrapper.get<long>(pool_key);
+    }
+    wrapper_int = now_seconds() - start;
+
+    start = now_seconds();
+    for (const auto &entry : hand.entries()) {
+        hand_total += entry.first.size() + entry.second.size();
+    }
+    hand_iterate = now_seconds() - start;
+
+    start = now_seconds();
+    for (const auto &[name, value] : wrapper) {
+        wrapper_total += name.size() + value.size();
+    }
+    wrapper_iterate = now_seconds() - start;
+
+    if (hand_total != wrapper_total) {
+        std::printf("Error: wrappers disagree\n");
+        return (EXIT_FAILURE);
+    }
+
+    std::printf("keys=%zu reads=%zu\n", keys * 4, reads);
+    std::printf("%-8s %14s %14s %14s\n", "", "string ns", "int ns", "iterate ns");
+    std::printf("%-8s %14.1f %14.1f %14.1f\n", "hand", hand_string * 1e9 / reads, hand_int * 1e9 / reads,
+            hand_iterate * 1e9 / (keys * 4));
+    std::printf("%-8s %14.1f %14.1f %14.1f\n", "wrapper", wrapper_string * 1e9 / reads, wrapper_int * 1e9 / reads,
+            wrapper_iterate * 1e9 / (keys * 4));
+
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_freeze.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Compares a frozen list with the list it was frozen from: memory, counted through the allocator callbacks for the
+ * list, and lookup latency for hits and misses in random order. Every name is checked in the frozen list first.
+ * Usage: bench_freeze [keys] [lookups]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libconfigfile.h"
+
+static size_t allocated;
+
+static void *counting_allocate(size_t size, void *user_data) {
+    (void) user_data;
+    allocated += size;
+    return malloc(size);
+}
+
+static void counting_release(void *pointer, size_t size, void *user_data) {
+    (void) user_data;
+    allocated -= size;
+    free(pointer);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    size_t lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : 5000000;
+    configfile_allocator allocator = {counting_allocate, counting_release, NULL};
+    char filename[] = "/tmp/bench_freeze_XXXXXX";
+    const configfile_frozen *frozen;
+    configfile_options options;
+    configfile *config, *module;
+    char (*names)[48], (*missing)[48];
+    size_t *order, list_size, i, found;
+    double start, list_hit, list_miss, frozen_hit, frozen_miss, freeze_time;
+    configfile_view view;
+    uint64_t state = 88172645463325252ULL;
+    FILE *file;
+    int fd;
+
+    if (keys == 0 || lookups == 0) {
+        fprintf(stderr, "Usage: %s [keys] [lookups]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    names = malloc(keys * sizeof (*names));
+    missing = malloc(keys * sizeof (*missing));
+    order = malloc(lookups * sizeof (*order));
+    for (i = 0; i < keys; i++) {
+        snprintf(names[i], sizeof (names[i]), "service%zu.backend.timeout_ms", i);
+        snprintf(missing[i], sizeof (missing[i]), "service%zu.backend.retries", i);
+        fprintf(file, "%s = %zu\n", names[i], i * 31);
+    }
+    fclose(file);
+    for (i = 0; i < lookups; i++) {
+        order[i] = next_random(&state) % keys;
+    }
+
+    memset(&options, 0, sizeof (options));
+    options.allocator = &allocator;
+    config = configfile_init_ex(filename, &options);
+    unlink(filename);
+    if (config == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+    list_size = allocated;
+
+    start = now_seconds();
+    frozen = configfile_freeze(config);
+    freeze_time = now_seconds() - start;
+    if (frozen == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    for (i = 0; i < keys; i++) {
+        if (configfile_frozen_get(frozen, names[i], &view) != 0 || strcmp(view.module_value, configfile_get(config, names[i])->module_value) != 0 ||
+                configfile_frozen_get(frozen, missing[i], NULL) == 0) {
+            printf("Error: frozen list disagrees on %s\n", names[i]);
+            return (EXIT_FAILURE);
+        }
+    }
+
+    found = 0;
+    start = now_seconds();
+    for (i = 0; i < lookups; i++) {
+        module = configfile_get(config, names[order[i]]);
+        found += module->module_value_length;
+    }
+    list_hit = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < lookups; i++) {
+        found += configfile_get(config, missing[order[i]]) != NULL;
+    }
+    list_miss = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < lookups; i++) {
+        configfile_frozen_get(frozen, names[order[i]], &view);
+        found -= view.module_value_length;
+    }
+    frozen_hit = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < lookups; i++) {
+        found += configfile_frozen_get(frozen, missing[order[i]], NULL) == 0;
+    }
+    frozen_miss = now_seconds() - start;
+
+    if (found != 0) {
+        printf("Error: lookups disagree\n");
+        return (EXIT_FAILURE);
+    }
+
+    printf("keys=%zu lookups=%zu freeze=%.1f ms\n", keys, lookups, freeze_time * 1e3);
+    printf("%-8s %14s %12s %12s\n", "", "bytes", "hit ns", "miss ns");
+    printf("%-8s %14zu %12.1f %12.1f\n", "list", list_size, list_hit * 1e9 / lookups, list_miss * 1e9 / lookups);
+    printf("%-8s %14zu %12.1f %12.1f\n", "frozen", configfile_frozen_size(frozen), frozen_hit * 1e9 / lookups, frozen_miss * 1e9 / lookups);
+
+    configfile_frozen_kill(frozen);
+    configfile_kill(config);
+    free(names);
+    free(missing);
+    free(order);
+
+    return (EXIT_SUCCESS);
+}
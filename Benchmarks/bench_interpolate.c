@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_interpolate.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Measures interpolation: load time with and without CONFIGFILE_INTERPOLATE, then the cost of reading plain and
+ * templated values through configfile_value_expand(), the templated ones on first read and once kept. Every
+ * service has a host, a port and an url made of both.
+ * Usage: bench_interpolate [services] [reads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libconfigfile.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Reads the value of every module of an array reads times, returning the sum of their lengths.
+ */
+static size_t read_values(configfile **modules, size_t count, size_t reads) {
+    size_t sum = 0, length, i, j;
+
+    for (j = 0; j < reads; j++) {
+        for (i = 0; i < count; i++) {
+            if (configfile_value_expand(modules[i], &length) != NULL) {
+                sum += length;
+            }
+        }
+    }
+
+    return sum;
+}
+
+int main(int argc, char **argv) {
+    size_t services = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    size_t reads = argc > 2 ? strtoul(argv[2], NULL, 10) : 20;
+    char filename[] = "/tmp/bench_interpolate_XXXXXX", name[64];
+    configfile **plain, **templated;
+    configfile_options options;
+    configfile *config;
+    double start, plain_load, load, first, plain_read, templated_read;
+    size_t i, sum;
+    FILE *file;
+    int fd;
+
+    if (services == 0 || reads == 0) {
+        fprintf(stderr, "Usage: %s [services] [reads]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+    for (i = 0; i < services; i++) {
+        fprintf(file, "service%zu.host = host%zu.example.org\n", i, i);
+        fprintf(file, "service%zu.port = %zu\n", i, 1024 + i % 60000);
+        fprintf(file, "service%zu.url = https://${service%zu.host}:${service%zu.port}/api\n", i, i, i);
+    }
+    fclose(file);
+
+    memset(&options, 0, sizeof (options));
+    start = now_seconds();
+    config = configfile_init_ex(filename, &options);
+    plain_load = now_seconds() - start;
+    configfile_kill(config);
+
+    options.flags = CONFIGFILE_INTERPOLATE;
+    start = now_seconds();
+    config = configfile_init_ex(filename, &options);
+    load = now_seconds() - start;
+    unlink(filename);
+    if (config == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    plain = malloc(services * sizeof (configfile *));
+    templated = malloc(services * sizeof (configfile *));
+    for (i = 0; i < services; i++) {
+        snprintf(name, sizeof (name), "service%zu.host", i);
+        plain[i] = configfile_get(config, name);
+        snprintf(name, sizeof (name), "service%zu.url", i);
+        templated[i] = configfile_get(config, name);
+    }
+
+    start = now_seconds();
+    sum = read_values(templated, services, 1);
+    first = now_seconds() - start;
+
+    start = now_seconds();
+    sum += read_values(plain, services, reads);
+    plain_read = now_seconds() - start;
+
+    start = now_seconds();
+    sum += read_values(templated, services, reads);
+    templated_read = now_seconds() - start;
+
+    printf("services=%zu reads=%zu checksum=%zu\n", services, reads, sum);
+    printf("load: %.1f ms, %.1f ms with CONFIGFILE_INTERPOLATE\n", plain_load * 1e3, load * 1e3);
+    printf("%-22s %10s\n", "", "ns/read");
+    printf("%-22s %10.2f\n", "plain", plain_read * 1e9 / (services * reads));
+    printf("%-22s %10.2f\n", "templated, first read", first * 1e9 / services);
+    printf("%-22s %10.2f\n", "templated, kept", templated_read * 1e9 / (services * reads));
+
+    configfile_kill(config);
+    free(plain);
+    free(templated);
+
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_lazy.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * A process reading a small share of the names of a large file: configfile_init() against configfile_lazy_open().
+ * Each loader runs in its own child, which reports the load time, the time of the first and of a second lookup of
+ * every name it uses, and how much its resident set grew.
+ * Usage: bench_lazy [keys] [percent used]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "libconfigfile.h"
+
+typedef struct _lazy_result {
+    double load;
+    double first;
+    double again;
+    size_t resident;
+} lazy_result;
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static size_t resident_bytes(void) {
+    unsigned long size = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+
+    if (file != NULL) {
+        if (fscanf(file, "%lu %lu", &size, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(file);
+    }
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Loads the file with one of the loaders and reads every used name twice.
+ * @return Returns zero on success.
+ */
+static int run(int lazy_mode, const char *filename, char (*names)[48], size_t used, lazy_result *result) {
+    const configfile_lazy *lazy = NULL;
+    configfile *config = NULL, *module;
+    size_t i, resident, total = 0;
+    int64_t value;
+    double start;
+
+    resident = resident_bytes();
+    start = now_seconds();
+    if (lazy_mode) {
+        lazy = configfile_lazy_open(filename);
+    } else {
+        config = configfile_init(filename);
+    }
+    result->load = now_seconds() - start;
+    if (lazy == NULL && config == NULL) {
+        return -1;
+    }
+
+    start = now_seconds();
+    for (i = 0; i < used; i++) {
+        module = lazy_mode ? configfile_lazy_get(lazy, names[i]) : configfile_get(config, names[i]);
+        if (module == NULL || configfile_value_int64(module, &value) != CONFIGFILE_OK) {
+            return -1;
+        }
+        total += value;
+    }
+    result->first = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < used; i++) {
+        module = lazy_mode ? configfile_lazy_get(lazy, names[i]) : configfile_get(config, names[i]);
+        configfile_value_int64(module, &value);
+        total -= value;
+    }
+    result->again = now_seconds() - start;
+    result->resident = resident_bytes() - resident;
+
+    configfile_lazy_kill(lazy);
+    configfile_kill(config);
+
+    return total == 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 4000000;
+    size_t percent = argc > 2 ? strtoul(argv[2], NULL, 10) : 5;
+    const char *labels[] = {"init", "lazy"};
+    char filename[] = "/tmp/bench_lazy_XXXXXX";
+    char (*names)[48];
+    uint64_t state = 88172645463325252ULL;
+    lazy_result results[2];
+    size_t i, used, bytes;
+    int mode, status, pipes[2];
+    FILE *file;
+    pid_t pid;
+    int fd;
+
+    if (keys == 0 || percent == 0 || percent > 100) {
+        fprintf(stderr, "Usage: %s [keys] [percent used]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+    for (i = 0; i < keys; i++) {
+        fprintf(file, "service%zu.backend.timeout_ms = %zu\n", i, i * 31);
+    }
+    bytes = ftell(file);
+    fclose(file);
+
+    used = keys * percent / 100 > 0 ? keys * percent / 100 : 1;
+    names = malloc(used * sizeof (*names));
+    for (i = 0; i < used; i++) {
+        snprintf(names[i], sizeof (names[i]), "service%zu.backend.timeout_ms", (size_t) (next_random(&state) % keys));
+    }
+
+    for (mode = 0; mode < 2; mode++) {
+        if (pipe(pipes) != 0) {
+            printf("Error (%d): %s\n", errno, strerror(errno));
+            return (EXIT_FAILURE);
+        }
+
+        pid = fork();
+        if (pid == 0) {
+            close(pipes[0]);
+            _exit(run(mode, filename, names, used, &results[mode]) == 0 &&
+                    write(pipes[1], &results[mode], sizeof (results[mode])) == sizeof (results[mode]) ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        close(pipes[1]);
+
+        if (pid < 0 || read(pipes[0], &results[mode], sizeof (results[mode])) != sizeof (results[mode]) ||
+                waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            printf("Error: %s failed\n", labels[mode]);
+            unlink(filename);
+            return (EXIT_FAILURE);
+        }
+        close(pipes[0]);
+    }
+
+    unlink(filename);
+    free(names);
+
+    printf("keys=%zu bytes=%zu used=%zu (%zu%%)\n", keys, bytes, used, percent);
+    printf("%-6s %12s %14s %14s %14s\n", "", "load ms", "first ns", "again ns", "resident MB");
+    for (mode = 0; mode < 2; mode++) {
+        printf("%-6s %12.1f %14.1f %14.1f %14.1f\n", labels[mode], results[mode].load * 1e3, results[mode].first * 1e9 / used,
+                results[mode].again * 1e9 / used, results[mode].resident / 1048576.0);
+    }
+
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_lookup.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Compares configfile_get() through the hash index with the linear walk of the list and with interned key handles.
+ * Usage: bench_lookup [keys] [lookups]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libconfigfile.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The search configfile_get() performed before the hash index existed. */
+static configfile *linear_get(configfile *search_struct, const char *module_name) {
+    size_t module_name_length = strlen(module_name);
+    configfile *next;
+
+    for (next = search_struct; next != NULL; next = next->next) {
+        if (next->module_name_length == module_name_length && strncmp(next->module_name, module_name, module_name_length) == 0) {
+            return next;
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 50000;
+    size_t lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : 200000;
+    size_t linear_lookups, i, found;
+    char filename[] = "/tmp/bench_lookup_XXXXXX";
+    char (*names)[48];
+    configfile *config;
+    configfile_keys *registry;
+    configfile_key *handles;
+    double start, indexed_time, linear_time, handle_time;
+    FILE *file;
+    int fd;
+
+    if (keys == 0 || lookups == 0) {
+        fprintf(stderr, "Usage: %s [keys] [lookups]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    names = malloc(keys * sizeof (*names));
+    for (i = 0; i < keys; i++) {
+        snprintf(names[i], sizeof (names[i]), "service%zu.group%zu.option", i % 97, i);
+        fprintf(file, "%s = value%zu\n", names[i], i);
+    }
+    fclose(file);
+
+    config = configfile_init(filename);
+    unlink(filename);
+
+    if (config == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    srand(1);
+
+    found = 0;
+    start = now_seconds();
+    for (i = 0; i < lookups; i++) {
+        found += configfile_get(config, names[rand() % keys]) != NULL;
+    }
+    indexed_time = now_seconds() - start;
+
+    /* The linear walk is O(n) per lookup, keep its run time bounded on large configs. */
+    linear_lookups = lookups;
+    if (linear_lookups * keys > 2000000000ULL) {
+        linear_lookups = 2000000000ULL / keys;
+        if (linear_lookups == 0) {
+            linear_lookups = 1;
+        }
+    }
+
+    start = now_seconds();
+    for (i = 0; i < linear_lookups; i++) {
+        found += linear_get(config, names[rand() % keys]) != NULL;
+    }
+    linear_time = now_seconds() - start;
+
+    registry = configfile_keys_new();
+    handles = malloc(keys * sizeof (*handles));
+    for (i = 0; i < keys; i++) {
+        configfile_keys_intern(registry, names[i], &handles[i]);
+    }
+    configfile_keys_bind(config, registry);
+
+    start = now_seconds();
+    for (i = 0; i < lookups; i++) {
+        found += configfile_key_get(config, handles[rand() % keys]) != NULL;
+    }
+    handle_time = now_seconds() - start;
+
+    printf("keys=%zu found=%zu\n", keys, found);
+    printf("indexed: %zu lookups, %.1f ns/lookup\n", lookups, indexed_time * 1e9 / lookups);
+    printf("linear:  %zu lookups, %.1f ns/lookup\n", linear_lookups, linear_time * 1e9 / linear_lookups);
+    printf("handle:  %zu lookups, %.1f ns/lookup\n", lookups, handle_time * 1e9 / lookups);
+
+    configfile_kill(config);
+    configfile_keys_kill(registry);
+    free(handles);
+    free(names);
+
+    return (EXIT_SUCCESS);
+}
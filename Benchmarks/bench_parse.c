@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_parse.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Measures parse throughput of configfile_init() and configfile_init_mmap(), then with CONFIGFILE_EXTENDED, on a
+ * generated file and on a commented one, where three lines in four are comments or carry one.
+ * Usage: bench_parse [lines] [runs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "libconfigfile.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(const char *label, configfile *(*loader)(const char *), const char *filename, size_t bytes, size_t lines, int runs) {
+    configfile *config;
+    double start, elapsed, best;
+    int i;
+
+    best = 0;
+    for (i = 0; i < runs; i++) {
+        start = now_seconds();
+        config = loader(filename);
+        elapsed = now_seconds() - start;
+
+        if (config == NULL) {
+            printf("Error (%d): %s\n", errno, strerror(errno));
+            return -1;
+        }
+        configfile_kill(config);
+
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    printf("%-8s %.2f ms, %.1f MB/s, %.2f Mlines/s\n", label, best * 1e3, bytes / best / 1e6, lines / best / 1e6);
+    return 0;
+}
+
+static configfile *init_extended(const char *filename) {
+    configfile_options options;
+
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_EXTENDED;
+
+    return configfile_init_ex(filename, &options);
+}
+
+static configfile *init_extended_mmap(const char *filename) {
+    configfile_options options;
+
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_EXTENDED | CONFIGFILE_MMAP;
+
+    return configfile_init_ex(filename, &options);
+}
+
+/**
+ * Runs every loader on a file.
+ */
+static int run_all(const char *filename, size_t lines, int runs) {
+    struct stat file_stat;
+    int result;
+
+    stat(filename, &file_stat);
+    printf("lines=%zu bytes=%lld\n", lines, (long long) file_stat.st_size);
+
+    result = run("getline", configfile_init, filename, file_stat.st_size, lines, runs);
+    if (result == 0) {
+        result = run("mmap", configfile_init_mmap, filename, file_stat.st_size, lines, runs);
+    }
+    if (result == 0) {
+        result = run("extended", init_extended, filename, file_stat.st_size, lines, runs);
+    }
+    if (result == 0) {
+        result = run("ext+mmap", init_extended_mmap, filename, file_stat.st_size, lines, runs);
+    }
+
+    return result;
+}
+
+int main(int argc, char **argv) {
+    size_t lines = argc > 1 ? strtoul(argv[1], NULL, 10) : 500000;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+    char filename[] = "/tmp/bench_parse_XXXXXX";
+    FILE *file;
+    size_t i;
+    int fd, result;
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    /* A mix of spacing styles, long values and lines without a delimiter. */
+    for (i = 0; i < lines; i++) {
+        switch (i % 8) {
+            case 0:
+                fprintf(file, "\n");
+                break;
+            case 1:
+                fprintf(file, "server%zu.hostname=host%zu.example.com\n", i, i);
+                break;
+            case 2:
+                fprintf(file, "    client[%zu].name   =    Some Longer Value With Spaces %zu   \n", i, i);
+                break;
+            case 3:
+                fprintf(file, "section header %zu\n", i);
+                break;
+            default:
+                fprintf(file, "service%zu.group.option%zu = %zu\n", i % 97, i, i * 31);
+                break;
+        }
+    }
+    fclose(file);
+
+    result = run_all(filename, lines, runs);
+
+    /* Comment lines, inline comments and quoted values, the layout of a documented configuration file. */
+    if (result == 0 && (file = fopen(filename, "w")) != NULL) {
+        for (i = 0; i < lines; i++) {
+            switch (i % 4) {
+                case 0:
+                    fprintf(file, "# Timeout of service %zu in milliseconds, raise it for slow backends = see docs\n", i);
+                    break;
+                case 1:
+                    fprintf(file, "; option%zu = disabled by default\n", i);
+                    break;
+                case 2:
+                    fprintf(file, "service%zu.timeout_ms = %zu    # per request\n", i, i * 31);
+                    break;
+                default:
+                    fprintf(file, "service%zu.banner = \"Welcome to %zu; enjoy\"\n", i, i);
+                    break;
+            }
+        }
+        fclose(file);
+
+        printf("commented:\n");
+        result = run_all(filename, lines, runs);
+    }
+
+    unlink(filename);
+
+    return result == 0 ? (EXIT_SUCCESS) : (EXIT_FAILURE);
+}
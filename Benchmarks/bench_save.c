@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_save.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * A few names of a large file changed and saved: configfile_save() against writing every module of the list to a
+ * temporary file, synced and renamed, as a program without it would. Both write the same file, in /tmp and in
+ * /dev/shm, where fsync(2) costs nothing. Times are averaged over the rounds, the first save taking the offsets
+ * of the lines included.
+ * Usage: bench_save [keys] [changes] [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libconfigfile.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * Writes every module of a list to a temporary file and renames it over filename.
+ * @return Returns zero on success.
+ */
+static int rewrite(configfile *config, const char *filename) {
+    char temporary[272];
+    FILE *file;
+    int fd;
+
+    snprintf(temporary, sizeof (temporary), "%s.XXXXXX", filename);
+    fd = mkstemp(temporary);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        return -1;
+    }
+
+    for (; config != NULL; config = config->next) {
+        fprintf(file, "%s = %s\n", config->module_name, config->module_value);
+    }
+
+    if (fflush(file) != 0 || fsync(fd) != 0 || fclose(file) != 0) {
+        unlink(temporary);
+        return -1;
+    }
+
+    return rename(temporary, filename);
+}
+
+/**
+ * Changes random names of a list and saves it with either method, rounds times.
+ * @return Returns the average time of a save, or a negative value on failure.
+ */
+static double run(const char *directory, size_t keys, size_t changes, size_t rounds, int incremental) {
+    char filename[256], name[48], value[32];
+    uint64_t state = 88172645463325252ULL;
+    configfile *config;
+    double start, total = 0;
+    size_t i, round;
+    FILE *file;
+    int fd;
+
+    snprintf(filename, sizeof (filename), "%s/bench_save_XXXXXX", directory);
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        return -1;
+    }
+    for (i = 0; i < keys; i++) {
+        fprintf(file, "service%zu.backend.timeout_ms = %zu\n", i, i * 31);
+    }
+    fclose(file);
+
+    config = configfile_init(filename);
+    if (config == NULL) {
+        unlink(filename);
+        return -1;
+    }
+
+    for (round = 0; round < rounds; round++) {
+        for (i = 0; i < changes; i++) {
+            snprintf(name, sizeof (name), "service%zu.backend.timeout_ms", (size_t) (next_random(&state) % keys));
+            snprintf(value, sizeof (value), "%zu", round * changes + i);
+            if (configfile_set(config, name, value) != 0) {
+                total = -1;
+                break;
+            }
+        }
+
+        start = now_seconds();
+        if (total < 0 || (incremental ? configfile_save(config) : rewrite(config, filename)) != 0) {
+            total = -1;
+            break;
+        }
+        total += now_seconds() - start;
+    }
+
+    configfile_kill(config);
+    unlink(filename);
+
+    return total < 0 ? total : total / rounds;
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    size_t changes = argc > 2 ? strtoul(argv[2], NULL, 10) : 10;
+    size_t rounds = argc > 3 ? strtoul(argv[3], NULL, 10) : 10;
+    const char *directories[] = {"/tmp", "/dev/shm"};
+    double times[2][2];
+    size_t directory;
+    int incremental;
+
+    if (keys == 0 || changes == 0 || rounds == 0) {
+        fprintf(stderr, "Usage: %s [keys] [changes] [rounds]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    for (directory = 0; directory < 2; directory++) {
+        for (incremental = 0; incremental < 2; incremental++) {
+            times[directory][incremental] = run(directories[directory], keys, changes, rounds, incremental);
+            if (times[directory][incremental] < 0) {
+                printf("Error (%d): %s\n", errno, strerror(errno));
+                return (EXIT_FAILURE);
+            }
+        }
+    }
+
+    printf("keys=%zu changes=%zu rounds=%zu\n", keys, changes, rounds);
+    printf("%-10s %14s %14s\n", "", "/tmp ms", "/dev/shm ms");
+    printf("%-10s %14.2f %14.2f\n", "rewrite", times[0][0] * 1e3, times[1][0] * 1e3);
+    printf("%-10s %14.2f %14.2f\n", "save", times[0][1] * 1e3, times[1][1] * 1e3);
+
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_shared.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Pre-fork workers loading their own list compared with workers attaching to one published in shared memory:
+ * start-up time and private bytes allocated, then lookup latency with the generation checked before every shared
+ * lookup. Times are the CPU time of each worker, averaged.
+ * Once every worker reported, a second version is published and each worker waits until it sees it.
+ * Usage: bench_shared [keys] [workers] [lookups]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "libconfigfile.h"
+
+typedef struct _worker_result {
+    double parse;
+    double attach;
+    double list_lookup;
+    double shared_lookup;
+    size_t private_bytes;
+} worker_result;
+
+static size_t allocated;
+
+static void *counting_allocate(size_t size, void *user_data) {
+    (void) user_data;
+    allocated += size;
+    return malloc(size);
+}
+
+static void counting_release(void *pointer, size_t size, void *user_data) {
+    (void) user_data;
+    allocated -= size;
+    free(pointer);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Workers share the CPUs, each measures its own time. */
+static double cpu_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int write_config(char *filename, size_t keys, size_t step) {
+    FILE *file;
+    size_t i;
+    int fd;
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < keys; i++) {
+        fprintf(file, "service%zu.backend.timeout_ms = %zu\n", i, i * step);
+    }
+
+    return fclose(file);
+}
+
+static int worker(const char *filename, const char *shared_name, char (*names)[48], size_t keys, size_t lookups, int output) {
+    configfile_allocator allocator = {counting_allocate, counting_release, NULL};
+    const configfile_snapshot *snapshot;
+    configfile_options options;
+    configfile_shared *shared;
+    configfile *config, *module;
+    worker_result result;
+    configfile_view view;
+    uint64_t state = 88172645463325252ULL ^ (uint64_t) getpid(), generation;
+    size_t i, found = 0;
+    double start;
+
+    memset(&options, 0, sizeof (options));
+    options.allocator = &allocator;
+    start = cpu_seconds();
+    config = configfile_init_ex(filename, &options);
+    result.parse = cpu_seconds() - start;
+    result.private_bytes = allocated;
+    if (config == NULL) {
+        return -1;
+    }
+
+    start = cpu_seconds();
+    for (i = 0; i < lookups; i++) {
+        module = configfile_get(config, names[next_random(&state) % keys]);
+        found += module->module_value_length;
+    }
+    result.list_lookup = cpu_seconds() - start;
+    configfile_kill(config);
+
+    start = cpu_seconds();
+    shared = configfile_shared_open(shared_name);
+    snapshot = configfile_shared_snapshot(shared, NULL);
+    result.attach = cpu_seconds() - start;
+    if (snapshot == NULL) {
+        return -1;
+    }
+
+    start = cpu_seconds();
+    for (i = 0; i < lookups; i++) {
+        snapshot = configfile_shared_snapshot(shared, NULL);
+        configfile_snapshot_get(snapshot, names[next_random(&state) % keys], &view);
+        found += view.module_value_length;
+    }
+    result.shared_lookup = cpu_seconds() - start;
+
+    if (found == 0 || write(output, &result, sizeof (result)) != sizeof (result)) {
+        return -1;
+    }
+
+    /* The parent publishes the second version once every worker reported. */
+    do {
+        usleep(1000);
+        snapshot = configfile_shared_snapshot(shared, &generation);
+    } while (snapshot != NULL && generation < 2);
+
+    if (snapshot == NULL || configfile_snapshot_get(snapshot, "service1.backend.timeout_ms", &view) != 0 ||
+            strcmp(view.module_value, "32") != 0) {
+        return -1;
+    }
+
+    configfile_shared_close(shared);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    size_t workers = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+    size_t lookups = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000000;
+    char first[] = "/tmp/bench_shared_XXXXXX", second[] = "/tmp/bench_shared_XXXXXX", shared_name[64];
+    worker_result result, total;
+    char (*names)[48];
+    configfile *config;
+    uint64_t generation;
+    double start, publish;
+    size_t i, failed;
+    int status, pipes[2];
+    pid_t pid;
+
+    if (keys == 0 || workers == 0 || lookups == 0) {
+        fprintf(stderr, "Usage: %s [keys] [workers] [lookups]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    snprintf(shared_name, sizeof (shared_name), "/bench_shared_%d", (int) getpid());
+    if (write_config(first, keys, 31) != 0 || write_config(second, keys, 32) != 0 || pipe(pipes) != 0) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    names = malloc(keys * sizeof (*names));
+    for (i = 0; i < keys; i++) {
+        snprintf(names[i], sizeof (names[i]), "service%zu.backend.timeout_ms", i);
+    }
+
+    config = configfile_init(first);
+    start = now_seconds();
+    if (config == NULL || configfile_shared_publish(config, shared_name, &generation) != 0) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+    publish = now_seconds() - start;
+    configfile_kill(config);
+
+    for (i = 0; i < workers; i++) {
+        pid = fork();
+        if (pid == 0) {
+            close(pipes[0]);
+            _exit(worker(first, shared_name, names, keys, lookups, pipes[1]) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+    close(pipes[1]);
+
+    memset(&total, 0, sizeof (total));
+    for (i = 0; i < workers && read(pipes[0], &result, sizeof (result)) == sizeof (result); i++) {
+        total.parse += result.parse;
+        total.attach += result.attach;
+        total.list_lookup += result.list_lookup;
+        total.shared_lookup += result.shared_lookup;
+        total.private_bytes += result.private_bytes;
+    }
+    close(pipes[0]);
+
+    config = configfile_init(second);
+    if (i < workers || config == NULL || configfile_shared_publish(config, shared_name, &generation) != 0) {
+        printf("Error: %zu of %zu workers reported\n", i, workers);
+    }
+    configfile_kill(config);
+
+    failed = 0;
+    while (wait(&status) > 0) {
+        failed += !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS;
+    }
+
+    configfile_shared_unlink(shared_name);
+    unlink(first);
+    unlink(second);
+    free(names);
+
+    if (i < workers || failed != 0) {
+        printf("Error: %zu workers failed\n", failed);
+        return (EXIT_FAILURE);
+    }
+
+    printf("keys=%zu workers=%zu lookups=%zu publish=%.1f ms generation=%" PRIu64 "\n", keys, workers, lookups,
+            publish * 1e3, generation);
+    printf("%-8s %14s %14s %12s\n", "", "start ms", "private bytes", "lookup ns");
+    printf("%-8s %14.2f %14zu %12.1f\n", "parse", total.parse * 1e3 / workers, total.private_bytes / workers,
+            total.list_lookup * 1e9 / workers / lookups);
+    printf("%-8s %14.2f %14d %12.1f\n", "shared", total.attach * 1e3 / workers, 0,
+            total.shared_lookup * 1e9 / workers / lookups);
+
+    return (EXIT_SUCCESS);
+}
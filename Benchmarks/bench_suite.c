@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_suite.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Regression suite. Generates configs of every profile from 1k keys up to the given maximum, growing tenfold, and
+ * measures for each one the load throughput, configfile_get() latency percentiles for hits and misses, peak RSS and
+ * the arena allocations of a load. Every case runs in its own child process so peak RSS covers that case alone.
+ * Results are written as CSV or JSON, one record per case.
+ * Usage: bench_suite [-f csv|json] [-k max_keys] [-m] [-o output]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "libconfigfile.h"
+
+/* Lookups are timed in batches, a single lookup is too close to the resolution of the clock. */
+#define BATCH 32
+#define SAMPLES 20000
+#define NAME_MAX_LENGTH 128
+
+typedef struct {
+    const char *name;
+    /* Length every key is padded to. */
+    size_t key_length;
+    /* Length every value is padded to. */
+    size_t value_length;
+    /* Whether lines are indented and '=' is surrounded by spaces. */
+    int spaced;
+    /* Comment lines per 100 key lines. */
+    int comment_percent;
+} profile;
+
+static const profile profiles[] = {
+    {"compact", 12, 8, 0, 0},
+    {"long_keys", 64, 32, 0, 0},
+    {"spaced", 24, 16, 1, 0},
+    {"commented", 24, 16, 0, 50},
+    {"mixed", 40, 24, 1, 25},
+};
+
+typedef struct {
+    size_t keys;
+    size_t lines;
+    size_t bytes;
+    double parse_seconds;
+    double hit_ns[4];
+    double miss_ns[4];
+    long peak_rss_kb;
+    size_t allocations;
+    size_t allocated_bytes;
+    int error;
+} result;
+
+typedef struct {
+    size_t allocations;
+    size_t bytes;
+} counters;
+
+static const double percentiles[4] = {0.50, 0.90, 0.99, 0.999};
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *counting_allocate(size_t size, void *user_data) {
+    counters *count = user_data;
+
+    count->allocations++;
+    count->bytes += size;
+    return malloc(size);
+}
+
+static void counting_release(void *pointer, size_t size, void *user_data) {
+    (void) size;
+    (void) user_data;
+    free(pointer);
+}
+
+/**
+ * Writes the name of key i of a profile, padded to the profile's key length. Misses get a prefix no key has.
+ */
+static size_t key_name(char *buffer, const profile *prof, size_t i, int miss) {
+    size_t length;
+
+    length = snprintf(buffer, NAME_MAX_LENGTH, "%sgroup%zu.key%zu", miss ? "missing" : "", i % 64, i);
+    while (length < prof->key_length && length < NAME_MAX_LENGTH - 1) {
+        buffer[length] = 'a' + length % 26;
+        length++;
+    }
+    buffer[length] = '\0';
+
+    return length;
+}
+
+static int generate(const char *filename, const profile *prof, size_t keys, result *res) {
+    char name[NAME_MAX_LENGTH], value[NAME_MAX_LENGTH];
+    size_t i, length, comments;
+    struct stat file_stat;
+    FILE *file;
+
+    file = fopen(filename, "w");
+    if (file == NULL) {
+        return -1;
+    }
+
+    comments = 0;
+    res->lines = 0;
+    for (i = 0; i < keys; i++) {
+        /* Spreads the comments evenly between the keys. */
+        while (comments * 100 < (i + 1) * prof->comment_percent) {
+            fprintf(file, "%s# comment line %zu describing the next option\n", prof->spaced ? "    " : "", comments);
+            comments++;
+            res->lines++;
+        }
+
+        key_name(name, prof, i, 0);
+        length = snprintf(value, sizeof (value), "value%zu", i * 7919);
+        while (length < prof->value_length && length < sizeof (value) - 1) {
+            value[length++] = 'v';
+        }
+        value[length] = '\0';
+
+        if (prof->spaced) {
+            fprintf(file, "    %s   =   %s   \n", name, value);
+        } else {
+            fprintf(file, "%s=%s\n", name, value);
+        }
+        res->lines++;
+    }
+
+    if (fclose(file) != 0 || stat(filename, &file_stat) != 0) {
+        return -1;
+    }
+    res->bytes = file_stat.st_size;
+
+    return 0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Times SAMPLES batches of lookups of random keys and stores the percentiles of the time per lookup.
+ */
+static void measure_lookups(configfile *config, const profile *prof, size_t keys, int miss, double out[4]) {
+    char (*names)[NAME_MAX_LENGTH];
+    double *samples, start;
+    size_t i, j, found;
+    int p;
+
+    names = malloc(BATCH * sizeof (*names));
+    samples = malloc(SAMPLES * sizeof (*samples));
+    if (names == NULL || samples == NULL) {
+        free(names);
+        free(samples);
+        out[0] = out[1] = out[2] = out[3] = -1;
+        return;
+    }
+
+    found = 0;
+    for (i = 0; i < SAMPLES; i++) {
+        for (j = 0; j < BATCH; j++) {
+            key_name(names[j], prof, (size_t) rand() % keys, miss);
+        }
+
+        start = now_seconds();
+        for (j = 0; j < BATCH; j++) {
+            found += configfile_get(config, names[j]) != NULL;
+        }
+        samples[i] = (now_seconds() - start) * 1e9 / BATCH;
+    }
+
+    if (found != (miss ? 0 : (size_t) SAMPLES * BATCH)) {
+        fprintf(stderr, "Error: %zu of %zu lookups found\n", found, (size_t) SAMPLES * BATCH);
+    }
+
+    qsort(samples, SAMPLES, sizeof (*samples), compare_doubles);
+    for (p = 0; p < 4; p++) {
+        out[p] = samples[(size_t) (percentiles[p] * (SAMPLES - 1))];
+    }
+
+    free(names);
+    free(samples);
+}
+
+/**
+ * Runs one case, called in a child process.
+ */
+static void run_case(const char *filename, const profile *prof, unsigned int flags, result *res) {
+    configfile_allocator allocator;
+    configfile_options options;
+    struct rusage usage;
+    configfile *config;
+    counters count;
+    double start, elapsed;
+    int runs, i;
+
+    /* Small files are loaded more often, the best run is kept. */
+    runs = res->keys <= 10000 ? 20 : res->keys <= 100000 ? 5 : res->keys <= 1000000 ? 3 : 1;
+
+    allocator.allocate = counting_allocate;
+    allocator.release = counting_release;
+    allocator.user_data = &count;
+
+    memset(&options, 0, sizeof (options));
+    options.allocator = &allocator;
+    options.flags = flags;
+
+    config = NULL;
+    for (i = 0; i < runs; i++) {
+        if (config != NULL) {
+            configfile_kill(config);
+        }
+        memset(&count, 0, sizeof (count));
+
+        start = now_seconds();
+        config = configfile_init_ex(filename, &options);
+        elapsed = now_seconds() - start;
+
+        if (config == NULL) {
+            res->error = errno;
+            return;
+        }
+        if (i == 0 || elapsed < res->parse_seconds) {
+            res->parse_seconds = elapsed;
+        }
+    }
+
+    /* Taken before the lookups so their buffers are not counted. */
+    getrusage(RUSAGE_SELF, &usage);
+    res->peak_rss_kb = usage.ru_maxrss;
+    res->allocations = count.allocations;
+    res->allocated_bytes = count.bytes;
+
+    srand(1);
+    measure_lookups(config, prof, res->keys, 0, res->hit_ns);
+    measure_lookups(config, prof, res->keys, 1, res->miss_ns);
+
+    configfile_kill(config);
+}
+
+static int run_forked(const char *filename, const profile *prof, unsigned int flags, result *res) {
+    ssize_t got;
+    pid_t child;
+    int fds[2], status;
+
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+
+    fflush(NULL);
+    child = fork();
+    if (child < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if (child == 0) {
+        close(fds[0]);
+        run_case(filename, prof, flags, res);
+        if (write(fds[1], res, sizeof (*res)) != (ssize_t) sizeof (*res)) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    got = read(fds[0], res, sizeof (*res));
+    close(fds[0]);
+    waitpid(child, &status, 0);
+
+    if (got != (ssize_t) sizeof (*res) || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+        errno = ECHILD;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void print_header(FILE *out, int json) {
+    if (json) {
+        fprintf(out, "{\n  \"benchmark\": \"libconfigfile\",\n  \"results\": [");
+        return;
+    }
+
+    fprintf(out, "profile,loader,keys,lines,bytes,parse_ms,mb_per_s,lines_per_s,"
+            "hit_p50_ns,hit_p90_ns,hit_p99_ns,hit_p999_ns,miss_p50_ns,miss_p90_ns,miss_p99_ns,miss_p999_ns,"
+            "peak_rss_kb,allocations,allocated_bytes\n");
+}
+
+static void print_result(FILE *out, int json, int first, const profile *prof, const char *loader, const result *res) {
+    double mb_per_s = res->bytes / res->parse_seconds / 1e6;
+    double lines_per_s = res->lines / res->parse_seconds;
+
+    if (json) {
+        fprintf(out, "%s\n    {\"profile\": \"%s\", \"loader\": \"%s\", \"keys\": %zu, \"lines\": %zu, \"bytes\": %zu, "
+                "\"parse_ms\": %.3f, \"mb_per_s\": %.1f, \"lines_per_s\": %.0f, "
+                "\"hit_ns\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f}, "
+                "\"miss_ns\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f}, "
+                "\"peak_rss_kb\": %ld, \"allocations\": %zu, \"allocated_bytes\": %zu}",
+                first ? "" : ",", prof->name, loader, res->keys, res->lines, res->bytes,
+                res->parse_seconds * 1e3, mb_per_s, lines_per_s,
+                res->hit_ns[0], res->hit_ns[1], res->hit_ns[2], res->hit_ns[3],
+                res->miss_ns[0], res->miss_ns[1], res->miss_ns[2], res->miss_ns[3],
+                res->peak_rss_kb, res->allocations, res->allocated_bytes);
+        return;
+    }
+
+    fprintf(out, "%s,%s,%zu,%zu,%zu,%.3f,%.1f,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%ld,%zu,%zu\n",
+            prof->name, loader, res->keys, res->lines, res->bytes, res->parse_seconds * 1e3, mb_per_s, lines_per_s,
+            res->hit_ns[0], res->hit_ns[1], res->hit_ns[2], res->hit_ns[3],
+            res->miss_ns[0], res->miss_ns[1], res->miss_ns[2], res->miss_ns[3],
+            res->peak_rss_kb, res->allocations, res->allocated_bytes);
+}
+
+int main(int argc, char **argv) {
+    char filename[] = "/tmp/bench_suite_XXXXXX";
+    const char *output = NULL, *loader = "getline";
+    size_t max_keys = 1000000, keys, p;
+    unsigned int flags = 0;
+    int json = 0, first = 1, option, fd;
+    FILE *out;
+    result res;
+
+    while ((option = getopt(argc, argv, "f:k:mo:")) != -1) {
+        switch (option) {
+            case 'f':
+                json = strcmp(optarg, "json") == 0;
+                if (!json && strcmp(optarg, "csv") != 0) {
+                    fprintf(stderr, "Unknown format: %s\n", optarg);
+                    return (EXIT_FAILURE);
+                }
+                break;
+            case 'k':
+                max_keys = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                flags |= CONFIGFILE_MMAP;
+                loader = "mmap";
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-f csv|json] [-k max_keys] [-m] [-o output]\n", argv[0]);
+                return (EXIT_FAILURE);
+        }
+    }
+
+    out = output != NULL ? fopen(output, "w") : stdout;
+    fd = mkstemp(filename);
+    if (out == NULL || fd < 0) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+    close(fd);
+
+    print_header(out, json);
+    for (keys = 1000; keys <= max_keys; keys *= 10) {
+        for (p = 0; p < sizeof (profiles) / sizeof (profiles[0]); p++) {
+            memset(&res, 0, sizeof (res));
+            res.keys = keys;
+
+            if (generate(filename, &profiles[p], keys, &res) != 0 || run_forked(filename, &profiles[p], flags, &res) != 0) {
+                printf("Error (%d): %s\n", errno, strerror(errno));
+                unlink(filename);
+                return (EXIT_FAILURE);
+            }
+            if (res.error != 0) {
+                printf("Error (%d): %s\n", res.error, strerror(res.error));
+                unlink(filename);
+                return (EXIT_FAILURE);
+            }
+
+            print_result(out, json, first, &profiles[p], loader, &res);
+            fflush(out);
+            first = 0;
+        }
+    }
+    if (json) {
+        fprintf(out, "\n  ]\n}\n");
+    }
+
+    unlink(filename);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_table.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Compares a list with a table loaded from the same file: memory, counted through the allocator callbacks for the
+ * list, load time, and the time to iterate every module reading its name and value, through the list nodes, through
+ * an iterator on the list and through an iterator on the table. Both are checked to hold the same modules first.
+ * Usage: bench_table [keys] [passes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libconfigfile.h"
+
+static size_t allocated;
+
+static void *counting_allocate(size_t size, void *user_data) {
+    (void) user_data;
+    allocated += size;
+    return malloc(size);
+}
+
+static void counting_release(void *pointer, size_t size, void *user_data) {
+    (void) user_data;
+    allocated -= size;
+    free(pointer);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Walks every module of an iterator, returning a sum of its bytes so the reads are not optimized away.
+ */
+static size_t iterate(configfile_iterator *iterator) {
+    configfile_view view;
+    size_t sum = 0;
+
+    while (configfile_iterator_next(iterator, &view) == 0) {
+        sum += view.module_name_length + view.module_value_length + (unsigned char) view.module_name[0] +
+                (unsigned char) view.module_value[0];
+    }
+
+    return sum;
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    size_t passes = argc > 2 ? strtoul(argv[2], NULL, 10) : 20;
+    configfile_allocator allocator = {counting_allocate, counting_release, NULL};
+    char filename[] = "/tmp/bench_table_XXXXXX";
+    configfile_iterator list_iterator, table_iterator;
+    configfile_view list_view, table_view;
+    configfile_options options;
+    configfile_table *table;
+    configfile *config, *module;
+    size_t i, list_size, expected, sum;
+    double start, list_load, table_load, list_walk, list_iterate, table_iterate;
+    FILE *file;
+    int fd;
+
+    if (keys == 0 || passes == 0) {
+        fprintf(stderr, "Usage: %s [keys] [passes]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+    for (i = 0; i < keys; i++) {
+        fprintf(file, "service%zu.backend.timeout_ms = %zu\n", i, i * 31);
+    }
+    fclose(file);
+
+    memset(&options, 0, sizeof (options));
+    options.allocator = &allocator;
+    start = now_seconds();
+    config = configfile_init_ex(filename, &options);
+    list_load = now_seconds() - start;
+    list_size = allocated;
+
+    start = now_seconds();
+    table = configfile_table_load(filename);
+    table_load = now_seconds() - start;
+    unlink(filename);
+    if (config == NULL || table == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    configfile_iterate(&list_iterator, config);
+    configfile_table_iterate(&table_iterator, table);
+    for (i = 0; configfile_iterator_next(&list_iterator, &list_view) == 0; i++) {
+        if (configfile_iterator_next(&table_iterator, &table_view) != 0 || strcmp(list_view.module_name, table_view.module_name) != 0 ||
+                strcmp(list_view.module_value, table_view.module_value) != 0 ||
+                configfile_table_get(table, list_view.module_name, &table_view) != 0 ||
+                strcmp(list_view.module_value, table_view.module_value) != 0) {
+            printf("Error: table disagrees on %s\n", list_view.module_name);
+            return (EXIT_FAILURE);
+        }
+    }
+    if (i != keys || configfile_iterator_next(&table_iterator, &table_view) == 0) {
+        printf("Error: table holds %zu modules, expected %zu\n", configfile_table_count(table), keys);
+        return (EXIT_FAILURE);
+    }
+
+    configfile_iterate(&list_iterator, config);
+    expected = iterate(&list_iterator) * passes;
+
+    sum = 0;
+    start = now_seconds();
+    for (i = 0; i < passes; i++) {
+        for (module = config; module != NULL; module = module->next) {
+            sum += module->module_name_length + module->module_value_length + (unsigned char) module->module_name[0] +
+                    (unsigned char) module->module_value[0];
+        }
+    }
+    list_walk = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < passes; i++) {
+        configfile_iterate(&list_iterator, config);
+        sum += iterate(&list_iterator);
+    }
+    list_iterate = now_seconds() - start;
+
+    start = now_seconds();
+    for (i = 0; i < passes; i++) {
+        configfile_table_iterate(&table_iterator, table);
+        sum += iterate(&table_iterator);
+    }
+    table_iterate = now_seconds() - start;
+
+    if (sum != expected * 3) {
+        printf("Error: iterations disagree\n");
+        return (EXIT_FAILURE);
+    }
+
+    printf("keys=%zu passes=%zu\n", keys, passes);
+    printf("%-8s %14s %12s %14s %16s\n", "", "bytes", "load ms", "walk ns/key", "iterate ns/key");
+    printf("%-8s %14zu %12.1f %14.2f %16.2f\n", "list", list_size, list_load * 1e3, list_walk * 1e9 / (keys * passes),
+            list_iterate * 1e9 / (keys * passes));
+    printf("%-8s %14zu %12.1f %14s %16.2f\n", "table", configfile_table_size(table), table_load * 1e3, "-",
+            table_iterate * 1e9 / (keys * passes));
+
+    configfile_table_kill(table);
+    configfile_kill(config);
+
+    return (EXIT_SUCCESS);
+}
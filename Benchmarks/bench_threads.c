@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_threads.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Measures how configfile_init_ex() scales with the threads option on a generated file, doubling the threads up to
+ * the given maximum. Loads are timed with and without the section tree, which is built on one thread after the
+ * parse, as is the index.
+ * Usage: bench_threads [lines] [max_threads] [runs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "libconfigfile.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double best_load(const char *filename, unsigned int threads, unsigned int flags, int runs) {
+    configfile_options options;
+    configfile *config;
+    double start, elapsed, best;
+    int i;
+
+    memset(&options, 0, sizeof (options));
+    options.threads = threads;
+    options.flags = flags;
+
+    best = 0;
+    for (i = 0; i < runs; i++) {
+        start = now_seconds();
+        config = configfile_init_ex(filename, &options);
+        elapsed = now_seconds() - start;
+
+        if (config == NULL) {
+            printf("Error (%d): %s\n", errno, strerror(errno));
+            return -1;
+        }
+        configfile_kill(config);
+
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char **argv) {
+    size_t lines = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+    unsigned int max_threads = argc > 2 ? strtoul(argv[2], NULL, 10) : 8;
+    int runs = argc > 3 ? atoi(argv[3]) : 3;
+    char filename[] = "/tmp/bench_threads_XXXXXX";
+    double full[2], flat[2], base_full, base_flat;
+    struct stat file_stat;
+    unsigned int threads;
+    FILE *file;
+    size_t i;
+    int fd;
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    /* Routing table like keys with repeated names, so the first-occurrence rule is exercised. */
+    for (i = 0; i < lines; i++) {
+        if (i % 16 == 0) {
+            fprintf(file, "# block %zu\n", i / 16);
+        } else {
+            fprintf(file, "route%zu.region%zu.upstream = 10.%zu.%zu.%zu:%zu\n", (i * 7) % (lines / 2 + 1), i % 13,
+                    i % 256, (i / 256) % 256, (i / 65536) % 256, 1024 + i % 50000);
+        }
+    }
+    fclose(file);
+    stat(filename, &file_stat);
+
+    printf("lines=%zu bytes=%lld cpus=%ld\n", lines, (long long) file_stat.st_size, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-8s %12s %12s %8s %14s %8s\n", "threads", "getline ms", "mmap ms", "speedup", "no sections ms", "speedup");
+
+    base_full = base_flat = 0;
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        full[0] = best_load(filename, threads, 0, runs);
+        full[1] = best_load(filename, threads, CONFIGFILE_MMAP, runs);
+        flat[0] = best_load(filename, threads, CONFIGFILE_NO_SECTIONS, runs);
+        flat[1] = best_load(filename, threads, CONFIGFILE_NO_SECTIONS | CONFIGFILE_MMAP, runs);
+        if (full[0] < 0 || full[1] < 0 || flat[0] < 0 || flat[1] < 0) {
+            unlink(filename);
+            return (EXIT_FAILURE);
+        }
+
+        if (threads == 1) {
+            base_full = full[0];
+            base_flat = flat[0];
+        }
+
+        printf("%-8u %12.1f %12.1f %7.2fx %14.1f %7.2fx\n", threads, full[0] * 1e3, full[1] * 1e3, base_full / full[0],
+                flat[0] * 1e3, base_flat / flat[0]);
+    }
+
+    unlink(filename);
+
+    return (EXIT_SUCCESS);
+}
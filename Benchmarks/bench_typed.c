@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   bench_typed.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Compares the cached typed getters with converting module_value on every read, as callers did before them. Each
+ * conversion is timed on an already found module, then with the lookup included.
+ * Usage: bench_typed [keys] [reads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libconfigfile.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    size_t keys = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+    size_t reads = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000;
+    char filename[] = "/tmp/bench_typed_XXXXXX";
+    char (*names)[48];
+    configfile **modules, *config;
+    double start, elapsed;
+    long long sum_strtol, sum_cached, sum_get;
+    int64_t value;
+    size_t i, k;
+    FILE *file;
+    int fd;
+
+    if (keys == 0 || reads == 0) {
+        fprintf(stderr, "Usage: %s [keys] [reads]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    names = malloc(keys * sizeof (*names));
+    for (i = 0; i < keys; i++) {
+        snprintf(names[i], sizeof (names[i]), "worker%zu.max_connections", i);
+        fprintf(file, "%s = %zu\n", names[i], 1000000 + i * 7919);
+    }
+    fclose(file);
+
+    config = configfile_init(filename);
+    unlink(filename);
+
+    if (config == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    modules = malloc(keys * sizeof (*modules));
+    for (i = 0; i < keys; i++) {
+        modules[i] = configfile_get(config, names[i]);
+    }
+
+    /* Reads cycle through the keys with a stride, so consecutive reads hit different modules. */
+    sum_strtol = 0;
+    start = now_seconds();
+    for (i = 0, k = 0; i < reads; i++, k = (k + 7) % keys) {
+        sum_strtol += strtol(modules[k]->module_value, NULL, 10);
+    }
+    elapsed = now_seconds() - start;
+    printf("keys=%zu reads=%zu\n", keys, reads);
+    printf("strtol(module_value):         %6.2f ns/read\n", elapsed * 1e9 / reads);
+
+    sum_cached = 0;
+    start = now_seconds();
+    for (i = 0, k = 0; i < reads; i++, k = (k + 7) % keys) {
+        configfile_value_int64(modules[k], &value);
+        sum_cached += value;
+    }
+    elapsed = now_seconds() - start;
+    printf("configfile_value_int64():     %6.2f ns/read\n", elapsed * 1e9 / reads);
+
+    sum_get = 0;
+    start = now_seconds();
+    for (i = 0, k = 0; i < reads; i++, k = (k + 7) % keys) {
+        sum_get += strtol(configfile_get(config, names[k])->module_value, NULL, 10);
+    }
+    elapsed = now_seconds() - start;
+    printf("strtol(configfile_get()):     %6.2f ns/read\n", elapsed * 1e9 / reads);
+
+    start = now_seconds();
+    for (i = 0, k = 0; i < reads; i++, k = (k + 7) % keys) {
+        configfile_get_int64(config, names[k], &value);
+        sum_get -= value;
+    }
+    elapsed = now_seconds() - start;
+    printf("configfile_get_int64():       %6.2f ns/read\n", elapsed * 1e9 / reads);
+
+    if (sum_strtol != sum_cached || sum_get != 0) {
+        printf("Error: conversions disagree\n");
+        return (EXIT_FAILURE);
+    }
+
+    configfile_kill(config);
+    free(modules);
+    free(names);
+
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   stress_reload.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Reader threads look keys up through a configfile_reloader while the file is rewritten and reloaded as fast as
+ * possible. Every version of the file holds a single generation number in all of its values, so a reader seeing
+ * two generations in one section, or a freed list, means the snapshot changed under it. Build with
+ * -fsanitize=address to catch early reclamation.
+ * Usage: stress_reload [readers] [seconds] [keys]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "libconfigfile.h"
+
+typedef struct {
+    configfile_reloader *reloader;
+    size_t keys;
+    atomic_int *stop;
+    unsigned long sections;
+    unsigned long lookups;
+    unsigned long failures;
+} reader_state;
+
+static int write_version(const char *filename, unsigned long generation, size_t keys) {
+    char temporary[4096];
+    FILE *file;
+    size_t i;
+
+    /* Written aside and renamed, as editors and deployment tools do, so a load never sees a partial file. */
+    snprintf(temporary, sizeof (temporary), "%s.tmp", filename);
+    file = fopen(temporary, "w");
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "generation = %lu\n", generation);
+    for (i = 0; i < keys; i++) {
+        fprintf(file, "key%zu = %lu\n", i, generation);
+    }
+    fclose(file);
+
+    return rename(temporary, filename);
+}
+
+static void *reader_thread(void *argument) {
+    reader_state *state = argument;
+    configfile_reader *reader;
+    configfile *config, *entry;
+    const char *generation;
+    char name[32];
+    unsigned int seed = (unsigned int) (uintptr_t) argument;
+    size_t i;
+
+    reader = configfile_reader_new(state->reloader);
+    if (reader == NULL) {
+        state->failures++;
+        return NULL;
+    }
+
+    while (!atomic_load_explicit(state->stop, memory_order_relaxed)) {
+        config = configfile_reader_enter(reader);
+
+        entry = configfile_get(config, "generation");
+        generation = entry != NULL ? entry->module_value : "";
+
+        for (i = 0; i < 16; i++) {
+            snprintf(name, sizeof (name), "key%u", rand_r(&seed) % (unsigned int) state->keys);
+            entry = configfile_get(config, name);
+            if (entry == NULL || strcmp(entry->module_value, generation) != 0) {
+                state->failures++;
+            }
+            state->lookups++;
+        }
+
+        configfile_reader_leave(reader);
+        state->sections++;
+    }
+
+    configfile_reader_kill(reader);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int readers = argc > 1 ? atoi(argv[1]) : 8;
+    int seconds = argc > 2 ? atoi(argv[2]) : 5;
+    size_t keys = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000;
+    char directory[] = "/tmp/stress_reload_XXXXXX", filename[4096];
+    unsigned long generation, sections, lookups, failures;
+    configfile_reloader *reloader;
+    reader_state *states;
+    pthread_t *threads;
+    atomic_int stop;
+    time_t end;
+    int i;
+
+    if (readers <= 0 || seconds <= 0 || keys == 0 || mkdtemp(directory) == NULL) {
+        fprintf(stderr, "Usage: %s [readers] [seconds] [keys]\n", argv[0]);
+        return (EXIT_FAILURE);
+    }
+
+    snprintf(filename, sizeof (filename), "%s/stress.conf", directory);
+    generation = 1;
+    if (write_version(filename, generation, keys) != 0) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    reloader = configfile_reloader_new(filename, NULL, 10);
+    if (reloader == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    atomic_init(&stop, 0);
+    states = calloc(readers, sizeof (reader_state));
+    threads = calloc(readers, sizeof (pthread_t));
+    for (i = 0; i < readers; i++) {
+        states[i].reloader = reloader;
+        states[i].keys = keys;
+        states[i].stop = &stop;
+        pthread_create(&threads[i], NULL, reader_thread, &states[i]);
+    }
+
+    /* Half of the versions are picked up by the watcher, the other half are forced. */
+    end = time(NULL) + seconds;
+    while (time(NULL) < end) {
+        generation++;
+        write_version(filename, generation, keys);
+        if (generation % 2 == 0) {
+            configfile_reloader_reload(reloader);
+        }
+    }
+
+    atomic_store(&stop, 1);
+    sections = lookups = failures = 0;
+    for (i = 0; i < readers; i++) {
+        pthread_join(threads[i], NULL);
+        sections += states[i].sections;
+        lookups += states[i].lookups;
+        failures += states[i].failures;
+    }
+
+    printf("readers=%d seconds=%d keys=%zu\n", readers, seconds, keys);
+    printf("files written=%lu versions published=%lu\n", generation, configfile_reloader_version(reloader));
+    printf("read sections=%lu lookups=%lu (%.1f M/s) failures=%lu\n", sections, lookups, lookups / 1e6 / seconds, failures);
+
+    configfile_reloader_kill(reloader);
+    unlink(filename);
+    rmdir(directory);
+    free(states);
+    free(threads);
+
+    return failures == 0 ? (EXIT_SUCCESS) : (EXIT_FAILURE);
+}
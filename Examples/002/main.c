@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   main.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Compiles a configuration file into a binary snapshot, then reads modules back from the snapshot.
+ * Usage: build [input] [output] [module...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libconfigfile.h"
+
+void print_view(const configfile_view *view) {
+    printf("%s (%zd bytes) = %s (%zd bytes)\n", view->module_name, view->module_name_length, view->module_value, view->module_value_length);
+}
+
+int main(int argc, char **argv) {
+    const char *input = argc > 1 ? argv[1] : "../001/test.conf";
+    const char *output = argc > 2 ? argv[2] : "test.snapshot";
+    const configfile_snapshot *snapshot;
+    configfile *global_config;
+    configfile_view view;
+    size_t i;
+    int j;
+
+    global_config = configfile_init(input);
+
+    if (global_config == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    if (configfile_snapshot_write(global_config, output, input) != 0) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        configfile_kill(global_config);
+        return (EXIT_FAILURE);
+    }
+
+    configfile_kill(global_config);
+
+    snapshot = configfile_snapshot_open(output, input);
+
+    if (snapshot == NULL) {
+        printf("Error (%d): %s\n", errno, strerror(errno));
+        return (EXIT_FAILURE);
+    }
+
+    printf("%s: %zu modules\n", output, configfile_snapshot_count(snapshot));
+
+    if (argc > 3) {
+        for (j = 3; j < argc; j++) {
+            if (configfile_snapshot_get(snapshot, argv[j], &view) == 0) {
+                print_view(&view);
+            } else {
+                printf("%s not found\n", argv[j]);
+            }
+        }
+    } else {
+        for (i = 0; configfile_snapshot_at(snapshot, i, &view) == 0; i++) {
+            print_view(&view);
+        }
+    }
+
+    configfile_snapshot_close(snapshot);
+
+    return (EXIT_SUCCESS);
+}
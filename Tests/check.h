@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check.h
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Helpers shared by the checks: CHECK() reports a failed condition with its line and counts it, check_file()
+ * writes a configuration to a temporary file.
+ */
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int check_failures;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            check_failures++; \
+        } \
+    } while (0)
+
+/**
+ * Writes a configuration to a new temporary file.
+ * @param filename Receives the name of the file, "/tmp/check_XXXXXX" to be filled in.
+ * @return Returns zero on success.
+ */
+static inline int check_file(char *filename, const char *content) {
+    FILE *file;
+    int fd;
+
+    fd = mkstemp(filename);
+    if (fd < 0 || (file = fdopen(fd, "w")) == NULL) {
+        return -1;
+    }
+    fputs(content, file);
+
+    return fclose(file);
+}
+
+/**
+ * Reports the result of a check program, for its exit status.
+ */
+static inline int check_done(const char *name) {
+    printf("%s: %s\n", name, check_failures == 0 ? "ok" : "FAILED");
+    return check_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif /* CHECK_H */
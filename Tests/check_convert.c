@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_convert.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Typed getters: signed and fractional values read as written, from a file and as bound defaults alike, and the
+ * conversion guessed by CONFIGFILE_CONVERT gives way to the first read as another type.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+typedef struct _check_settings {
+    int64_t offset;
+    int64_t fallback;
+    double ratio;
+} check_settings;
+
+static void check_signs(void) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile *config;
+    int64_t integer;
+    double number;
+
+    CHECK(check_file(filename, "offset = -5\nplus = +7\nratio = -1.5\nhalf = .5\nsmall = -.25\nword = -abc\n"
+            "range = 1-5\ndouble = --5\nparenthesized = (-5)\nspaced = \t -5\nquoted = \"-5\"\n") == 0);
+    config = configfile_init(filename);
+    unlink(filename);
+    CHECK(config != NULL);
+
+    CHECK(configfile_get_int64(config, "offset", &integer) == CONFIGFILE_OK && integer == -5);
+    CHECK(configfile_get_int64(config, "plus", &integer) == CONFIGFILE_OK && integer == 7);
+    CHECK(configfile_get_double(config, "ratio", &number) == CONFIGFILE_OK && number == -1.5);
+    CHECK(configfile_get_double(config, "half", &number) == CONFIGFILE_OK && number == 0.5);
+    CHECK(configfile_get_double(config, "small", &number) == CONFIGFILE_OK && number == -0.25);
+    /* Only numbers keep their sign, other values are trimmed as before. */
+    CHECK(strcmp(configfile_get(config, "word")->module_value, "abc") == 0);
+    CHECK(configfile_get_int64(config, "range", &integer) == CONFIGFILE_INVALID);
+    /* Only a sign or a dot leading the value is kept, junk in front of them makes it no number. */
+    CHECK(configfile_get_int64(config, "double", &integer) == CONFIGFILE_INVALID);
+    CHECK(configfile_get_int64(config, "parenthesized", &integer) == CONFIGFILE_INVALID);
+    CHECK(configfile_get_int64(config, "spaced", &integer) == CONFIGFILE_OK && integer == -5);
+    CHECK(configfile_get_int64(config, "quoted", &integer) == CONFIGFILE_INVALID);
+
+    configfile_kill(config);
+}
+
+static void check_bind(void) {
+    static const configfile_field fields[] = {
+        CONFIGFILE_FIELD("offset", CONFIGFILE_FIELD_INT64, check_settings, offset, NULL, -10, 0),
+        CONFIGFILE_FIELD("missing", CONFIGFILE_FIELD_INT64, check_settings, fallback, "-5", -10, 0),
+        CONFIGFILE_FIELD("ratio", CONFIGFILE_FIELD_DOUBLE, check_settings, ratio, NULL, -2, 2)
+    };
+    char filename[] = "/tmp/check_XXXXXX";
+    check_settings settings;
+    configfile *config;
+
+    CHECK(check_file(filename, "offset = -5\nratio = -1.5\n") == 0);
+    config = configfile_init(filename);
+    unlink(filename);
+    CHECK(config != NULL);
+
+    memset(&settings, 0, sizeof (settings));
+    CHECK(configfile_bind(config, fields, 3, &settings, NULL, NULL) == 0);
+    CHECK(settings.offset == -5 && settings.fallback == -5 && settings.ratio == -1.5);
+
+    configfile_kill(config);
+}
+
+static void check_convert_flag(void) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile_options options;
+    configfile *config, *module;
+    int64_t integer, nanoseconds;
+    int flag;
+
+    CHECK(check_file(filename, "enabled = 1\ntimeout = 30\n") == 0);
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_CONVERT;
+    config = configfile_init_ex(filename, &options);
+    unlink(filename);
+    CHECK(config != NULL);
+
+    /*
+     * The first read as bool replaces the int64 guessed at load and the next one is served from the cache, which
+     * changing the value behind it shows.
+     */
+    module = configfile_get(config, "enabled");
+    CHECK(configfile_value_bool(module, &flag) == CONFIGFILE_OK && flag == 1);
+    module->module_value = "0";
+    CHECK(configfile_value_bool(module, &flag) == CONFIGFILE_OK && flag == 1);
+    CHECK(configfile_value_int64(module, &integer) == CONFIGFILE_OK && integer == 0);
+
+    module = configfile_get(config, "timeout");
+    CHECK(configfile_value_int64(module, &integer) == CONFIGFILE_OK && integer == 30);
+    CHECK(configfile_value_duration(module, &nanoseconds) == CONFIGFILE_OK && nanoseconds == 30000000000LL);
+    module->module_value = "40";
+    CHECK(configfile_value_duration(module, &nanoseconds) == CONFIGFILE_OK && nanoseconds == 30000000000LL);
+    CHECK(configfile_value_int64(module, &integer) == CONFIGFILE_OK && integer == 40);
+
+    configfile_kill(config);
+}
+
+int main(void) {
+    check_signs();
+    check_bind();
+    check_convert_flag();
+
+    return check_done("check_convert");
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_cpp.cpp
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * libconfigfile.hpp: typed reads are range checked, "name"_key hashes as configfile_hash() does, iterators compare
+ * equal at the end, and a file holding no module loads as an empty config while a missing one throws.
+ */
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "check.h"
+#include "libconfigfile.hpp"
+
+using namespace libconfigfile::literals;
+
+namespace {
+
+    std::string check_path(const char *content) {
+        char filename[] = "/tmp/check_XXXXXX";
+
+        CHECK(check_file(filename, content) == 0);
+        return filename;
+    }
+
+    void check_get() {
+        std::string filename = check_path(
+                "small = 42\n"
+                "big = 3000000000\n"
+                "negative = -1\n"
+                "low = -32768\n"
+                "byte = 256\n"
+                "text = words\n"
+                "flag = yes\n"
+                "ratio = 1e300\n");
+        libconfigfile::config config(filename);
+        unlink(filename.c_str());
+        int value = 7;
+
+        CHECK(!config.empty());
+        CHECK(config.get<int>("small") == 42);
+        CHECK(!config.get<int>("big").has_value());
+        CHECK(config.get("big", value) == CONFIGFILE_RANGE && value == 7);
+        CHECK(config.get<std::int64_t>("big") == INT64_C(3000000000));
+        CHECK(config.get<unsigned int>("big") == 3000000000U);
+        CHECK(!config.get<unsigned int>("negative").has_value());
+        CHECK(config.get<short>("low") == -32768);
+        CHECK(!config.get<std::uint8_t>("byte").has_value());
+        CHECK(config.get<std::uint16_t>("byte") == 256);
+        CHECK(config.get("text", value) == CONFIGFILE_INVALID && value == 7);
+        CHECK(config.get("missing", value) == CONFIGFILE_NOT_FOUND && value == 7);
+        CHECK(config.get<std::string_view>("text") == "words");
+        CHECK(config.get<bool>("flag") == true);
+        CHECK(!config.get<float>("ratio").has_value());
+        CHECK(config.get<double>("ratio") == 1e300);
+    }
+
+    void check_keys() {
+        static constexpr libconfigfile::key folded = "server.port"_key;
+        static_assert(folded.hash() == libconfigfile::hash("server.port"), "keys are hashed by the compiler");
+
+        const char *names[] = {"", "x", "server.port", "a rather longer name, well past the sixty-four bytes a literal folds"};
+
+        CHECK(folded.hash() == configfile_hash("server.port", 11));
+        CHECK("x"_key.hash() == configfile_hash("x", 1));
+        for (const char *name : names) {
+            libconfigfile::key key(name);
+
+            CHECK(key.hash() == configfile_hash(name, std::strlen(name)));
+            CHECK(key.name() == name);
+        }
+    }
+
+    void check_iterators() {
+        std::string filename = check_path("a = 1\nb = 2\na = 3\n");
+        libconfigfile::config config(filename);
+        unlink(filename.c_str());
+        std::vector<std::pair<std::string_view, std::string_view>> modules;
+        libconfigfile::config::iterator it, last;
+
+        CHECK(libconfigfile::config::iterator() == config.end());
+        CHECK(config.begin() != config.end());
+        CHECK(config.begin() == config.begin());
+
+        for (const auto &module : config) {
+            modules.push_back(module);
+        }
+        CHECK(modules.size() == 3);
+        CHECK(modules[0].first == "a" && modules[0].second == "1");
+        CHECK(modules[1].first == "b" && modules[1].second == "2");
+        CHECK(modules[2].first == "a" && modules[2].second == "3");
+
+        it = config.begin();
+        ++it;
+        CHECK(it != config.begin() && it != config.end() && it->first == "b");
+        ++it;
+        last = it++;
+        CHECK(last != config.end() && last->second == "3");
+        CHECK(it == config.end() && config.end() == it);
+    }
+
+    void check_empty() {
+        std::string filename = check_path("# only a comment\n\n");
+        bool thrown = false;
+
+        try {
+            libconfigfile::config config(filename);
+
+            CHECK(config.empty());
+            CHECK(config.begin() == config.end());
+            CHECK(!config.contains("anything"));
+            CHECK(!config.get<int>("anything").has_value());
+        } catch (const std::system_error &) {
+            thrown = true;
+        }
+        CHECK(!thrown);
+        unlink(filename.c_str());
+
+        try {
+            libconfigfile::config config(filename);
+        } catch (const std::system_error &error) {
+            thrown = error.code().value() == ENOENT;
+        }
+        CHECK(thrown);
+    }
+}
+
+int main() {
+    check_get();
+    check_keys();
+    check_iterators();
+    check_empty();
+
+    return check_done("check_cpp");
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_diff.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Differences: configfile_diff() reports added, modified and removed names in their documented order, counting only
+ * the first of repeated names and comparing expanded values, and reloader subscribers are called for the changed
+ * names they match, exactly or by prefix.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+typedef struct _check_record {
+    char text[512];
+    /* Difference after which the callback stops, zero never. */
+    int stop;
+    int count;
+} check_record;
+
+/**
+ * Appends "kind name old new;" for every difference, values expanded and "-" for a missing module.
+ */
+static int check_callback(configfile_change change, configfile *old_module, configfile *new_module, void *user_data) {
+    configfile *module = new_module != NULL ? new_module : old_module;
+    check_record *record = user_data;
+    size_t length = strlen(record->text), value_length;
+
+    snprintf(&record->text[length], sizeof (record->text) - length, "%c %s %s %s;",
+            change == CONFIGFILE_ADDED ? 'A' : change == CONFIGFILE_MODIFIED ? 'M' : 'R', module->module_name,
+            old_module != NULL ? configfile_value_expand(old_module, &value_length) : "-",
+            new_module != NULL ? configfile_value_expand(new_module, &value_length) : "-");
+
+    return ++record->count == record->stop;
+}
+
+static configfile *check_load(const char *content, unsigned int flags) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile_options options;
+    configfile *config;
+
+    CHECK(check_file(filename, content) == 0);
+    memset(&options, 0, sizeof (options));
+    options.flags = flags;
+    config = configfile_init_ex(filename, &options);
+    unlink(filename);
+    CHECK(config != NULL);
+
+    return config;
+}
+
+/**
+ * Replaces a file at once, so a watcher never reads it half written.
+ */
+static void check_replace(const char *filename, const char *content) {
+    char temporary[] = "/tmp/check_XXXXXX";
+
+    CHECK(check_file(temporary, content) == 0 && rename(temporary, filename) == 0);
+}
+
+static void check_lists(void) {
+    configfile *old_config, *new_config;
+    check_record record;
+
+    old_config = check_load("a = 1\nb = 2\nc = 3\nc = 30\nd = 4\nx = 9\n", 0);
+    new_config = check_load("b = 2\nd = 5\nc = 3\nc = 99\ne = 6\n", 0);
+
+    /* Added and modified in the order of the new list, then removed in the order of the old one. */
+    memset(&record, 0, sizeof (record));
+    CHECK(configfile_diff(old_config, new_config, check_callback, &record) == 0);
+    CHECK(strcmp(record.text, "M d 4 5;A e - 6;R a 1 -;R x 9 -;") == 0);
+
+    memset(&record, 0, sizeof (record));
+    record.stop = 2;
+    CHECK(configfile_diff(old_config, new_config, check_callback, &record) == 1 && record.count == 2);
+
+    memset(&record, 0, sizeof (record));
+    CHECK(configfile_diff(old_config, old_config, check_callback, &record) == 0 && record.count == 0);
+    CHECK(configfile_diff(NULL, new_config, check_callback, &record) == 0);
+    CHECK(strcmp(record.text, "A b - 2;A d - 5;A c - 3;A e - 6;") == 0);
+    memset(&record, 0, sizeof (record));
+    CHECK(configfile_diff(new_config, NULL, check_callback, &record) == 0);
+    CHECK(strcmp(record.text, "R b 2 -;R d 5 -;R c 3 -;R e 6 -;") == 0);
+    CHECK(configfile_diff(old_config, new_config, NULL, NULL) == -1 && errno == EINVAL);
+
+    configfile_kill(old_config);
+    configfile_kill(new_config);
+
+    /* A value whose references expand differently changed, though its text did not. */
+    old_config = check_load("host = a\nurl = ${host}/x\nplain = ${port}\nport = 1\n", CONFIGFILE_INTERPOLATE);
+    new_config = check_load("host = b\nurl = ${host}/x\nplain = ${port}\nport = 1\n", CONFIGFILE_INTERPOLATE);
+    memset(&record, 0, sizeof (record));
+    CHECK(configfile_diff(old_config, new_config, check_callback, &record) == 0);
+    CHECK(strcmp(record.text, "M host a b;M url a/x b/x;") == 0);
+    configfile_kill(old_config);
+    configfile_kill(new_config);
+}
+
+static void check_subscribers(void) {
+    char filename[] = "/tmp/check_XXXXXX";
+    check_record exact, prefix, section, url;
+    configfile_reloader *reloader;
+    configfile_options options;
+    int subscription;
+
+    CHECK(check_file(filename, "server.port = 1\nserver.host = a\nserverless = 1\nhost = a\nurl = ${host}/x\n") == 0);
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_INTERPOLATE;
+    reloader = configfile_reloader_new(filename, &options, 60000);
+    CHECK(reloader != NULL);
+
+    memset(&exact, 0, sizeof (exact));
+    memset(&prefix, 0, sizeof (prefix));
+    memset(&section, 0, sizeof (section));
+    memset(&url, 0, sizeof (url));
+    CHECK(configfile_reloader_subscribe(reloader, "server.port", 0, check_callback, &exact) >= 0);
+    subscription = configfile_reloader_subscribe(reloader, "server.", 1, check_callback, &prefix);
+    CHECK(subscription >= 0);
+    CHECK(configfile_reloader_subscribe(reloader, "server", 0, check_callback, &section) >= 0);
+    CHECK(configfile_reloader_subscribe(reloader, "url", 0, check_callback, &url) >= 0);
+
+    /*
+     * The watcher may notice the change first, reloads are serialized so its callbacks are done when ours returns,
+     * and the second one finds nothing changed.
+     */
+    check_replace(filename, "server.port = 2\nserver.host = a\nserver.name = n\nserverless = 2\nhost = b\nurl = ${host}/x\n");
+    CHECK(configfile_reloader_reload(reloader) == 0);
+    CHECK(strcmp(exact.text, "M server.port 1 2;") == 0);
+    CHECK(strcmp(prefix.text, "M server.port 1 2;A server.name - n;") == 0);
+    CHECK(strcmp(section.text, "") == 0);
+    CHECK(strcmp(url.text, "M url a/x b/x;") == 0);
+
+    /* Once unsubscribed a callback is not called anymore. */
+    CHECK(configfile_reloader_unsubscribe(reloader, subscription) == 0);
+    CHECK(configfile_reloader_unsubscribe(reloader, subscription) == -1 && errno == ENOENT);
+    memset(&exact, 0, sizeof (exact));
+    memset(&prefix, 0, sizeof (prefix));
+    check_replace(filename, "server.port = 3\nhost = b\nurl = ${host}/x\n");
+    CHECK(configfile_reloader_reload(reloader) == 0);
+    CHECK(strcmp(exact.text, "M server.port 2 3;") == 0);
+    CHECK(strcmp(prefix.text, "") == 0);
+
+    configfile_reloader_kill(reloader);
+    unlink(filename);
+}
+
+int main(void) {
+    check_lists();
+    check_subscribers();
+
+    return check_done("check_diff");
+}
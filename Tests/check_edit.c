@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_edit.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Edits: configfile_set() and configfile_delete() keep lookups and section walks in step with the list, and
+ * configfile_save() writes a file that reads back as the edited list, comments and line numbers kept.
+ */
+
+#include <errno.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+/**
+ * Appends "name=value;" for every module walked.
+ */
+static int check_collect(configfile *module, void *user_data) {
+    char *walked = user_data;
+
+    snprintf(walked + strlen(walked), 256 - strlen(walked), "%s=%s;", module->module_name, module->module_value);
+    return 0;
+}
+
+static const char *check_walk(configfile *config, const char *section_name) {
+    static char walked[256];
+
+    walked[0] = '\0';
+    configfile_section_foreach(configfile_section_find(config, section_name), check_collect, walked);
+    return walked;
+}
+
+static const char *check_value(configfile *config, const char *module_name) {
+    configfile *module = configfile_get(config, module_name);
+
+    return module != NULL ? module->module_value : "";
+}
+
+int main(void) {
+    char filename[] = "/tmp/check_XXXXXX", content[256];
+    configfile *config, *saved, *module;
+    FILE *file;
+
+    CHECK(check_file(filename, "a.x = 1\na.y = 2\n# comment\nb = 3\nc.z = 4\nb = 33\nlast = 5") == 0);
+    config = configfile_init(filename);
+    CHECK(config != NULL);
+
+    /* Deleting the head moves the second module into it, its section must not see it twice. */
+    CHECK(configfile_delete(config, "a.x") == 0);
+    CHECK(strcmp(check_walk(config, "a"), "a.y=2;") == 0);
+    CHECK(configfile_get(config, "a.x") == NULL);
+
+    CHECK(configfile_set(config, "c.w", "5") == 0);
+    CHECK(configfile_set(config, "d.e[0].f", "-6") == 0);
+    CHECK(strcmp(check_walk(config, "c"), "c.z=4;c.w=5;") == 0);
+    CHECK(configfile_section_length(configfile_section_find(config, "d.e")) == 1);
+    CHECK(strcmp(check_walk(config, "d.e[0]"), "d.e[0].f=-6;") == 0);
+
+    CHECK(configfile_delete(config, "c.z") == 0);
+    CHECK(strcmp(check_walk(config, "c"), "c.w=5;") == 0);
+
+    /* The next module of a repeated name takes the place of the deleted one. */
+    CHECK(configfile_delete(config, "b") == 0);
+    CHECK(strcmp(check_value(config, "b"), "33") == 0);
+    CHECK(strstr(check_walk(config, NULL), "b=33;") != NULL);
+
+    CHECK(configfile_set(config, "a.y", "22") == 0);
+    CHECK(configfile_delete(config, "missing") == -1 && errno == ENOENT);
+    CHECK(configfile_set(config, "bad=name", "1") == -1 && errno == EINVAL);
+    CHECK(configfile_set(config, "blank", " -1") == -1 && errno == EINVAL);
+    CHECK(configfile_set(config, "junk", "-x") == -1 && errno == EINVAL);
+
+    CHECK(configfile_save(config) == 0);
+    file = fopen(filename, "r");
+    CHECK(file != NULL && fread(content, 1, sizeof (content) - 1, file) > 0);
+    content[file != NULL ? ftell(file) : 0] = '\0';
+    fclose(file);
+    CHECK(strcmp(content, "\na.y = 22\n# comment\n\n\nb = 33\nlast = 5\nc.w = 5\nd.e[0].f = -6\n") == 0);
+
+    saved = configfile_init(filename);
+    CHECK(saved != NULL);
+    for (module = saved; module != NULL; module = module->next) {
+        CHECK(strcmp(check_value(config, module->module_name), module->module_value) == 0);
+        CHECK(configfile_get(config, module->module_name)->module_line == module->module_line);
+    }
+    CHECK(strcmp(check_walk(saved, NULL), check_walk(config, NULL)) == 0);
+    configfile_kill(saved);
+
+    /* A file changed behind the list is not overwritten. */
+    file = fopen(filename, "a");
+    fputs("other = 1\n", file);
+    fclose(file);
+    CHECK(configfile_set(config, "last", "6") == 0);
+    CHECK(configfile_save(config) == -1 && errno == ESTALE);
+
+    configfile_kill(config);
+    unlink(filename);
+
+    return check_done("check_edit");
+}
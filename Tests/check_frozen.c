@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_frozen.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Frozen lists: every name of a list, of a layered list and of an interpolated one is found with the value
+ * configfile_get() gives, expanded, absent names are not found, and every name is frozen once.
+ */
+
+#include <errno.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+#define CHECK_NAMES 5000
+
+/**
+ * Compares a frozen list with the list it was frozen from: lookups of every name, of absent names, and the count.
+ */
+static int check_same(configfile *config, const configfile_frozen *frozen) {
+    const char *value;
+    configfile_view view;
+    configfile *next, *module;
+    size_t count = 0, length, i;
+    char name[32];
+
+    for (next = config; next != NULL; next = next->next) {
+        module = configfile_get(config, next->module_name);
+        value = configfile_value_expand(module, &length);
+        if (configfile_frozen_get(frozen, next->module_name, &view) != 0 || strcmp(view.module_name, next->module_name) != 0 ||
+                view.module_value_length != length || strcmp(view.module_value, value) != 0) {
+            return 0;
+        }
+        count += module == next;
+    }
+
+    for (i = 0; i < 2 * CHECK_NAMES; i++) {
+        snprintf(name, sizeof (name), "absent%zu", i);
+        if (configfile_frozen_get(frozen, name, NULL) == 0) {
+            return 0;
+        }
+    }
+
+    /* Positions follow the hash, every name appears at one of them. */
+    for (i = 0; configfile_frozen_at(frozen, i, &view) == 0; i++) {
+        module = configfile_get(config, view.module_name);
+        if (module == NULL || strcmp(configfile_value_expand(module, &length), view.module_value) != 0) {
+            return 0;
+        }
+    }
+
+    return count == configfile_frozen_count(frozen) && i == count && configfile_frozen_get(frozen, "", NULL) != 0;
+}
+
+static configfile *check_load(char *filename, const char *content, unsigned int flags) {
+    configfile_options options;
+
+    CHECK(check_file(filename, content) == 0);
+    memset(&options, 0, sizeof (options));
+    options.flags = flags;
+
+    return configfile_init_ex(filename, &options);
+}
+
+int main(void) {
+    char filename[] = "/tmp/check_XXXXXX", base[] = "/tmp/check_XXXXXX", layer[] = "/tmp/check_XXXXXX";
+    char interpolated[] = "/tmp/check_XXXXXX";
+    const configfile_frozen *frozen;
+    const char *paths[2];
+    configfile_view view;
+    configfile *config;
+    FILE *file;
+    int fd, i;
+
+    /* Many names, every third one repeated with another value. */
+    fd = mkstemp(filename);
+    CHECK(fd >= 0 && (file = fdopen(fd, "w")) != NULL);
+    for (i = 0; i < CHECK_NAMES; i++) {
+        fprintf(file, "name%d = value%d\n", i, i);
+    }
+    for (i = 0; i < CHECK_NAMES; i += 3) {
+        fprintf(file, "name%d = later%d\n", i, i);
+    }
+    fclose(file);
+    config = configfile_init(filename);
+    frozen = configfile_freeze(config);
+    CHECK(config != NULL && frozen != NULL && check_same(config, frozen));
+    CHECK(configfile_frozen_get_hashed(frozen, "name3", 5, CONFIGFILE_HASH_LITERAL("name3"), &view) == 0 &&
+            strcmp(view.module_value, "value3") == 0);
+    configfile_frozen_kill(frozen);
+    configfile_kill(config);
+    unlink(filename);
+
+    /* Layered: the last layer defining a name wins. */
+    CHECK(check_file(base, "a = 1\nb = 2\nb = 3\n") == 0 && check_file(layer, "b = 4\nc = 5\nc = 6\n") == 0);
+    paths[0] = base;
+    paths[1] = layer;
+    config = configfile_init_layers(paths, 2, NULL);
+    frozen = configfile_freeze(config);
+    CHECK(config != NULL && frozen != NULL && check_same(config, frozen));
+    CHECK(configfile_frozen_get(frozen, "b", &view) == 0 && strcmp(view.module_value, "4") == 0);
+    CHECK(configfile_frozen_get(frozen, "c", &view) == 0 && strcmp(view.module_value, "5") == 0);
+    configfile_frozen_kill(frozen);
+    configfile_kill(config);
+    unlink(base);
+    unlink(layer);
+
+    /* Interpolated values are frozen expanded, the list may be killed first. */
+    config = check_load(interpolated, "host = example\nurl = ${host}/path\nurl = ${host}/other\n", CONFIGFILE_INTERPOLATE);
+    unlink(interpolated);
+    frozen = configfile_freeze(config);
+    CHECK(config != NULL && frozen != NULL && check_same(config, frozen));
+    configfile_kill(config);
+    CHECK(configfile_frozen_get(frozen, "url", &view) == 0 && strcmp(view.module_value, "example/path") == 0);
+    configfile_frozen_kill(frozen);
+
+    CHECK(configfile_freeze(NULL) == NULL && errno == EINVAL);
+
+    return check_done("check_frozen");
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_include.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Layers: includes load after the file holding them, relative to it, conf.d directories in strcmp(3) order without
+ * dotfiles or other extensions, the last layer defining a name wins for lookups, sections and diffs, every module
+ * knows its file and line, and a file including itself through its includes fails with ELOOP.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+static char check_directory[] = "/tmp/check_XXXXXX";
+
+static void check_write(const char *name, const char *content) {
+    char path[64];
+    FILE *file;
+
+    snprintf(path, sizeof (path), "%s/%s", check_directory, name);
+    file = fopen(path, "w");
+    CHECK(file != NULL);
+    fputs(content, file);
+    fclose(file);
+}
+
+static const char *check_path(const char *name) {
+    static char path[64];
+
+    snprintf(path, sizeof (path), "%s/%s", check_directory, name);
+    return path;
+}
+
+/**
+ * Returns the file of a module relative to the directory of the check, "" if there is no such module.
+ */
+static const char *check_file_of(configfile *config, const char *module_name) {
+    configfile *module = configfile_get(config, module_name);
+
+    return module != NULL && module->module_file != NULL ? module->module_file + strlen(check_directory) + 1 : "";
+}
+
+static const char *check_value(configfile *config, const char *module_name) {
+    configfile *module = configfile_get(config, module_name);
+
+    return module != NULL ? module->module_value : "";
+}
+
+static int check_collect(configfile *module, void *user_data) {
+    char *walked = user_data;
+
+    snprintf(walked + strlen(walked), 256 - strlen(walked), "%s=%s;", module->module_name, module->module_value);
+    return 0;
+}
+
+static int check_changes(configfile_change change, configfile *old_module, configfile *new_module, void *user_data) {
+    configfile *module = new_module != NULL ? new_module : old_module;
+    char *changes = user_data;
+
+    snprintf(changes + strlen(changes), 256 - strlen(changes), "%c %s %s %s;",
+            change == CONFIGFILE_ADDED ? 'A' : change == CONFIGFILE_MODIFIED ? 'M' : 'R', module->module_name,
+            old_module != NULL ? old_module->module_value : "-", new_module != NULL ? new_module->module_value : "-");
+    return 0;
+}
+
+static void check_layers(void) {
+    const char *paths[2] = {NULL, NULL};
+    char walked[256] = "", changes[256] = "", main_path[64];
+    configfile *config, *included, *next;
+    configfile_options options;
+
+    snprintf(main_path, sizeof (main_path), "%s", check_path("main.conf"));
+    paths[0] = main_path;
+    paths[1] = check_path("conf.d");
+
+    config = configfile_init_layers(paths, 2, NULL);
+    CHECK(config != NULL);
+
+    /* Main, the file it includes, then conf.d in strcmp(3) order: digits sort before capitals. */
+    walked[0] = '\0';
+    for (next = config; next != NULL; next = next->next) {
+        snprintf(walked + strlen(walked), sizeof (walked) - strlen(walked), "%s=%s;", next->module_name, next->module_value);
+    }
+    CHECK(strcmp(walked, "a=main;b=main;s.x=main;c=main;b=sub;s.x=sub;s.y=sub;a=y;d=y;a=z;e=B;") == 0);
+
+    CHECK(strcmp(check_value(config, "a"), "z") == 0 && strcmp(check_file_of(config, "a"), "conf.d/20-z.conf") == 0);
+    CHECK(strcmp(check_value(config, "b"), "sub") == 0 && strcmp(check_file_of(config, "b"), "sub.conf") == 0);
+    CHECK(strcmp(check_value(config, "c"), "main") == 0 && strcmp(check_file_of(config, "c"), "main.conf") == 0);
+    CHECK(configfile_get(config, "c")->module_line == 5 && configfile_get(config, "s.y")->module_line == 3);
+    CHECK(configfile_get(config, "a")->module_line == 2 && configfile_get(config, "d")->module_line == 2);
+    CHECK(strcmp(check_value(config, "e"), "B") == 0);
+    CHECK(configfile_get(config, "hidden") == NULL && configfile_get(config, "txt") == NULL);
+
+    /* Sections see the module configfile_get() finds. */
+    CHECK(strcmp(configfile_section_get(configfile_section_find(config, "s"), "x")->module_value, "sub") == 0);
+    walked[0] = '\0';
+    configfile_section_foreach(configfile_section_find(config, "s"), check_collect, walked);
+    CHECK(strcmp(walked, "s.x=sub;s.y=sub;") == 0);
+
+    /* So does a diff, against the main file alone with its include. */
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_INCLUDE;
+    included = configfile_init_ex(main_path, &options);
+    CHECK(included != NULL && strcmp(check_value(included, "b"), "sub") == 0 && strcmp(check_value(included, "a"), "main") == 0);
+    CHECK(configfile_diff(included, config, check_changes, changes) == 0);
+    CHECK(strcmp(changes, "A d - y;M a main z;A e - B;") == 0);
+    configfile_kill(included);
+
+    /* Without the flag the directive is a line without a delimiter like any other. */
+    included = configfile_init(main_path);
+    CHECK(included != NULL && strcmp(check_value(included, "b"), "main") == 0 && configfile_get(included, "s.y") == NULL);
+    configfile_kill(included);
+
+    configfile_kill(config);
+}
+
+static void check_loops(void) {
+    const char *paths[1];
+    configfile_options options;
+    configfile *config;
+
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_INCLUDE;
+
+    check_write("self.conf", "a = 1\ninclude self.conf\n");
+    CHECK(configfile_init_ex(check_path("self.conf"), &options) == NULL && errno == ELOOP);
+
+    check_write("loop1.conf", "a = 1\ninclude loop2.conf\n");
+    check_write("loop2.conf", "b = 2\ninclude loop1.conf\n");
+    paths[0] = check_path("loop1.conf");
+    CHECK(configfile_init_layers(paths, 1, NULL) == NULL && errno == ELOOP);
+
+    /* Including the same file twice is no loop, only an ancestor is. */
+    check_write("twice.conf", "include sub.conf\ninclude sub.conf\n");
+    config = configfile_init_ex(check_path("twice.conf"), &options);
+    CHECK(config != NULL && strcmp(check_value(config, "b"), "sub") == 0);
+    configfile_kill(config);
+
+    check_write("missing.conf", "a = 1\ninclude nowhere.conf\n");
+    CHECK(configfile_init_ex(check_path("missing.conf"), &options) == NULL && errno == ENOENT);
+}
+
+int main(void) {
+    static const char *const files[] = {"main.conf", "sub.conf", "conf.d/10-y.conf", "conf.d/20-z.conf", "conf.d/B.conf",
+        "conf.d/.hidden.conf", "conf.d/30-skip.txt", "self.conf", "loop1.conf", "loop2.conf", "twice.conf", "missing.conf"};
+    size_t i;
+
+    CHECK(mkdtemp(check_directory) != NULL && mkdir(check_path("conf.d"), 0700) == 0);
+    check_write("main.conf", "a = main\nb = main\ns.x = main\ninclude sub.conf\nc = main\n");
+    check_write("sub.conf", "b = sub\ns.x = sub\ns.y = sub\n");
+    check_write("conf.d/20-z.conf", "\na = z\n");
+    check_write("conf.d/10-y.conf", "a = y\nd = y\n");
+    check_write("conf.d/B.conf", "e = B\n");
+    check_write("conf.d/.hidden.conf", "hidden = 1\n");
+    check_write("conf.d/30-skip.txt", "txt = 1\n");
+
+    /* Includes are relative to the file holding them, not to the working directory. */
+    CHECK(chdir("/") == 0);
+    check_layers();
+    check_loops();
+
+    for (i = 0; i < sizeof (files) / sizeof (files[0]); i++) {
+        unlink(check_path(files[i]));
+    }
+    rmdir(check_path("conf.d"));
+    rmdir(check_directory);
+
+    return check_done("check_include");
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_interpolate.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Interpolation: references survive the trim only for CONFIGFILE_INTERPOLATE loads, and a chain of references
+ * longer than the stack could follow expands on first read and is inherited on reload.
+ */
+
+#include "check.h"
+#include "libconfigfile.h"
+
+/* Deep enough to overflow the default stack if references were followed by recursion. */
+#define CHECK_CHAIN 200000
+
+static void check_trim(void) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile_options options;
+    configfile *config;
+    size_t length;
+
+    CHECK(check_file(filename, "x = 1\nbraces = {abc}\nreference = ${x}\n") == 0);
+
+    /* Without the flag the bytes of a reference are trimmed like any other punctuation. */
+    config = configfile_init(filename);
+    CHECK(config != NULL);
+    CHECK(strcmp(configfile_get(config, "braces")->module_value, "abc") == 0);
+    CHECK(strcmp(configfile_get(config, "reference")->module_value, "x") == 0);
+    configfile_kill(config);
+
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_INTERPOLATE;
+    config = configfile_init_ex(filename, &options);
+    unlink(filename);
+    CHECK(config != NULL);
+    CHECK(strcmp(configfile_get(config, "braces")->module_value, "{abc}") == 0);
+    CHECK(strcmp(configfile_value_expand(configfile_get(config, "reference"), &length), "1") == 0 && length == 1);
+    configfile_kill(config);
+}
+
+static void check_chain(void) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile_options options;
+    configfile_reloader *reloader;
+    configfile_reader *reader;
+    configfile *config;
+    const char *value;
+    FILE *file;
+    size_t i;
+    int fd;
+
+    fd = mkstemp(filename);
+    CHECK(fd >= 0 && (file = fdopen(fd, "w")) != NULL);
+    for (i = 0; i < CHECK_CHAIN; i++) {
+        fprintf(file, "a%zu = ${a%zu}\n", i, i + 1);
+    }
+    fprintf(file, "a%d = end\n", CHECK_CHAIN);
+    fclose(file);
+
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_INTERPOLATE;
+    reloader = configfile_reloader_new(filename, &options, 60000);
+    CHECK(reloader != NULL);
+    reader = configfile_reader_new(reloader);
+
+    config = configfile_reader_enter(reader);
+    value = configfile_value_expand(configfile_get(config, "a0"), NULL);
+    CHECK(value != NULL && strcmp(value, "end") == 0);
+    configfile_reader_leave(reader);
+
+    /* The new version inherits every expanded value, deciding the whole chain is unchanged. */
+    CHECK(configfile_reloader_reload(reloader) == 0);
+    config = configfile_reader_enter(reader);
+    value = configfile_value_expand(configfile_get(config, "a0"), NULL);
+    CHECK(value != NULL && strcmp(value, "end") == 0);
+    configfile_reader_leave(reader);
+
+    configfile_reader_kill(reader);
+    configfile_reloader_kill(reloader);
+    unlink(filename);
+}
+
+int main(void) {
+    check_trim();
+    check_chain();
+
+    return check_done("check_interpolate");
+}
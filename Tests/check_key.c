@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_key.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Key handles: a handle taken from a reloader resolves in every version loaded after it, whenever the version holds
+ * the name, and a released handle stops matching in lists bound afterwards while the name interned again does.
+ */
+
+#include "check.h"
+#include "libconfigfile.h"
+
+static void check_rewrite(const char *filename, const char *content) {
+    FILE *file = fopen(filename, "w");
+
+    CHECK(file != NULL);
+    fputs(content, file);
+    fclose(file);
+}
+
+/**
+ * Returns the value a handle resolves to in the current version of a reloader, "" if it does not resolve.
+ */
+static const char *check_resolve(configfile_reader *reader, configfile_key key) {
+    static char value[32];
+    configfile *module;
+
+    module = configfile_key_get(configfile_reader_enter(reader), key);
+    snprintf(value, sizeof (value), "%s", module != NULL ? module->module_value : "");
+    configfile_reader_leave(reader);
+
+    return value;
+}
+
+static void check_reloads(void) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile_key port, later, again;
+    configfile_reloader *reloader;
+    configfile_reader *reader;
+
+    CHECK(check_file(filename, "host = a\nport = 1\nport = 2\n") == 0);
+    reloader = configfile_reloader_new(filename, NULL, 60000);
+    CHECK(reloader != NULL);
+    reader = configfile_reader_new(reloader);
+
+    CHECK(configfile_reloader_key(reloader, "port", &port) == 0);
+    CHECK(configfile_reloader_key(reloader, "later", &later) == 0);
+    CHECK(configfile_reloader_key(reloader, "port", &again) == 0 && again.slot == port.slot && again.generation == port.generation);
+    CHECK(strcmp(check_resolve(reader, port), "1") == 0);
+    CHECK(strcmp(check_resolve(reader, later), "") == 0);
+
+    /* Handles taken before a reload resolve in the new version, to its first module of the name. */
+    check_rewrite(filename, "later = x\nport = 3\nport = 4\n");
+    CHECK(configfile_reloader_reload(reloader) == 0);
+    CHECK(strcmp(check_resolve(reader, port), "3") == 0);
+    CHECK(strcmp(check_resolve(reader, later), "x") == 0);
+
+    /* A version without the name resolves nothing, the next one holding it again does. */
+    check_rewrite(filename, "later = y\n");
+    CHECK(configfile_reloader_reload(reloader) == 0);
+    CHECK(strcmp(check_resolve(reader, port), "") == 0);
+    check_rewrite(filename, "port = 5\n");
+    CHECK(configfile_reloader_reload(reloader) == 0);
+    CHECK(strcmp(check_resolve(reader, port), "5") == 0);
+    CHECK(strcmp(check_resolve(reader, later), "") == 0);
+
+    configfile_reader_kill(reader);
+    configfile_reloader_kill(reloader);
+    unlink(filename);
+}
+
+static void check_release(void) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile_key key, stale, other, zero;
+    configfile *before, *after;
+    configfile_keys *keys;
+
+    CHECK(check_file(filename, "a = 1\nb = 2\n") == 0);
+    before = configfile_init(filename);
+    after = configfile_init(filename);
+    unlink(filename);
+    keys = configfile_keys_new();
+    CHECK(before != NULL && after != NULL && keys != NULL);
+
+    CHECK(configfile_keys_intern(keys, "a", &key) == 0 && configfile_keys_intern(keys, "b", &other) == 0);
+    CHECK(configfile_keys_bind(before, keys) == 0);
+    CHECK(strcmp(configfile_key_get(before, key)->module_value, "1") == 0);
+
+    /* Lists bound after the release no longer resolve the handle, the ones bound before still do. */
+    stale = key;
+    configfile_keys_release(keys, key);
+    CHECK(configfile_keys_bind(after, keys) == 0);
+    CHECK(configfile_key_get(after, stale) == NULL);
+    CHECK(configfile_key_get(before, stale) == configfile_get(before, "a"));
+    CHECK(strcmp(configfile_key_get(after, other)->module_value, "2") == 0);
+
+    /* Interned again, the name gets the same slot and a new generation, found before and after a bind. */
+    CHECK(configfile_keys_intern(keys, "a", &key) == 0 && key.slot == stale.slot && key.generation != stale.generation);
+    CHECK(configfile_key_get(after, key) == configfile_get(after, "a"));
+    CHECK(configfile_key_get(after, stale) == NULL);
+    CHECK(configfile_keys_bind(after, keys) == 0);
+    CHECK(configfile_key_get(after, key) == configfile_get(after, "a"));
+    CHECK(configfile_key_get(after, stale) == NULL);
+
+    /* Releasing a stale handle does not release the name interned again. */
+    configfile_keys_release(keys, stale);
+    CHECK(configfile_keys_bind(after, keys) == 0);
+    CHECK(configfile_key_get(after, key) == configfile_get(after, "a"));
+
+    memset(&zero, 0, sizeof (zero));
+    CHECK(configfile_key_get(after, zero) == NULL);
+    zero.slot = 1000;
+    zero.generation = 1;
+    CHECK(configfile_key_get(after, zero) == NULL);
+
+    configfile_kill(before);
+    configfile_kill(after);
+    configfile_keys_kill(keys);
+}
+
+int main(void) {
+    check_reloads();
+    check_release();
+
+    return check_done("check_key");
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_lazy.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Lazy files: every name is found with the module configfile_get() finds, the first of repeated names, whether its
+ * line fits the first read or has to be read again in larger blocks, up to a last line without newline.
+ */
+
+#include <stdint.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+/* Around the size of the first read of a line back, 256 bytes, and well past it. */
+static const int check_lengths[] = {1, 200, 240, 250, 255, 256, 257, 300, 511, 512, 513, 1000, 5000, 70000};
+
+/**
+ * Compares the lookup of every name of a list in a lazy file of the same file, twice to read modules built.
+ */
+static int check_same(configfile *config, const configfile_lazy *lazy) {
+    configfile *next, *module, *lazy_module;
+    size_t count = 0;
+    int pass;
+
+    for (pass = 0; pass < 2; pass++) {
+        for (next = config; next != NULL; next = next->next) {
+            module = configfile_get(config, next->module_name);
+            lazy_module = configfile_lazy_get(lazy, next->module_name);
+            if (lazy_module == NULL || lazy_module->module_name_length != module->module_name_length ||
+                    lazy_module->module_value_length != module->module_value_length ||
+                    strcmp(lazy_module->module_name, module->module_name) != 0 ||
+                    strcmp(lazy_module->module_value, module->module_value) != 0) {
+                return 0;
+            }
+            count += pass == 0;
+        }
+    }
+
+    return count == configfile_lazy_count(lazy) && configfile_lazy_get(lazy, "missing") == NULL &&
+            configfile_lazy_get(lazy, "name") == NULL;
+}
+
+int main(void) {
+    char filename[] = "/tmp/check_XXXXXX", last[] = "/tmp/check_XXXXXX";
+    size_t i;
+    const configfile_lazy *lazy;
+    configfile *config, *module;
+    int64_t integer;
+    FILE *file;
+    int fd, j;
+
+    /* Values of every length, each name repeated later with another value; long names as well. */
+    fd = mkstemp(filename);
+    CHECK(fd >= 0 && (file = fdopen(fd, "w")) != NULL);
+    for (i = 0; i < sizeof (check_lengths) / sizeof (check_lengths[0]); i++) {
+        fprintf(file, "   name%zu   =   %0*d   \n", i, check_lengths[i], check_lengths[i]);
+        fprintf(file, "no delimiter\n\n");
+        for (j = 0; j < check_lengths[i]; j++) {
+            fputc('n', file);
+        }
+        fprintf(file, "%zu = long name\n", i);
+    }
+    for (i = 0; i < sizeof (check_lengths) / sizeof (check_lengths[0]); i++) {
+        fprintf(file, "name%zu = repeated\n", i);
+    }
+    fprintf(file, "integer = -42\nlast = %0*d", 1000, 7);
+    fclose(file);
+
+    config = configfile_init(filename);
+    lazy = configfile_lazy_open(filename);
+    CHECK(config != NULL && lazy != NULL);
+    CHECK(configfile_lazy_loaded(lazy) == 0);
+    CHECK(check_same(config, lazy));
+    CHECK(configfile_lazy_loaded(lazy) > 0 && configfile_lazy_loaded(lazy) <= configfile_lazy_count(lazy));
+
+    module = configfile_lazy_get_hashed(lazy, "integer", 7, CONFIGFILE_HASH_LITERAL("integer"));
+    CHECK(module != NULL && configfile_value_int64(module, &integer) == CONFIGFILE_OK && integer == -42);
+    configfile_lazy_kill(lazy);
+    configfile_kill(config);
+    unlink(filename);
+
+    /* A last line without newline shorter than the first read, which reaches the end of the file. */
+    CHECK(check_file(last, "a = 1\na = 2\nb = 3") == 0);
+    config = configfile_init(last);
+    lazy = configfile_lazy_open(last);
+    CHECK(config != NULL && lazy != NULL && check_same(config, lazy));
+    configfile_lazy_kill(lazy);
+    configfile_kill(config);
+    unlink(last);
+
+    return check_done("check_lazy");
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_load.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Loading: the copying, mapping and arena loaders give the same list in file order, with names and values trimmed
+ * wherever they fall relative to the scanner's blocks, configfile_get() finds the first of repeated names, custom
+ * allocators get back every block, and a reloader publishes new versions and keeps the last good one.
+ */
+
+#include <errno.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+#define CHECK_NAMES 3000
+
+typedef struct _check_allocations {
+    size_t allocated;
+    size_t released;
+} check_allocations;
+
+static void *check_allocate(size_t size, void *user_data) {
+    ((check_allocations *) user_data)->allocated += size;
+    return malloc(size);
+}
+
+static void check_release(void *pointer, size_t size, void *user_data) {
+    ((check_allocations *) user_data)->released += size;
+    free(pointer);
+}
+
+/**
+ * Writes names padded by a varying number of blanks on both sides of the delimiter and of the value, so names,
+ * delimiters and values start and end at every offset of a scanner block. Every tenth name is repeated at the end
+ * with another value, some lines carry no module, and the last one has no newline.
+ */
+static void check_names(char *filename) {
+    FILE *file;
+    int fd, i;
+
+    fd = mkstemp(filename);
+    CHECK(fd >= 0 && (file = fdopen(fd, "w")) != NULL);
+    for (i = 0; i < CHECK_NAMES; i++) {
+        fprintf(file, "%*skey%d%*s=%*s\"v%d\"%*s\n", i % 7, "", i, i % 70, "", i % 131, "", i, i % 3, "");
+        if (i % 100 == 0) {
+            fputs("# no delimiter here\n\n= no name\n", file);
+        }
+    }
+    for (i = 0; i < CHECK_NAMES; i += 10) {
+        fprintf(file, "key%d = dup%d\n", i, i);
+    }
+    fputs("last = end", file);
+    fclose(file);
+}
+
+/**
+ * Checks a list loaded from check_names().
+ */
+static int check_list(configfile *config) {
+    char name[32], value[32];
+    configfile *next = config;
+    int i;
+
+    for (i = 0; i < CHECK_NAMES; i++, next = next->next) {
+        snprintf(name, sizeof (name), "key%d", i);
+        snprintf(value, sizeof (value), "v%d", i);
+        if (next == NULL || strcmp(next->module_name, name) != 0 || strcmp(next->module_value, value) != 0 ||
+                next->module_name_length != strlen(name) || next->module_value_length != strlen(value) ||
+                configfile_get(config, name) != next) {
+            return 0;
+        }
+    }
+    for (i = 0; i < CHECK_NAMES; i += 10, next = next->next) {
+        snprintf(value, sizeof (value), "dup%d", i);
+        if (next == NULL || strcmp(next->module_value, value) != 0) {
+            return 0;
+        }
+    }
+
+    return next != NULL && strcmp(next->module_value, "end") == 0 && next->next == NULL &&
+            configfile_get(config, "missing") == NULL && configfile_get(config, "key") == NULL &&
+            CONFIGFILE_GET_LITERAL(config, "key7") == configfile_get(config, "key7");
+}
+
+static void check_loaders(void) {
+    char filename[] = "/tmp/check_XXXXXX";
+    check_allocations allocations = {0, 0};
+    configfile_allocator allocator;
+    configfile_options options;
+    configfile *config;
+
+    check_names(filename);
+
+    config = configfile_init(filename);
+    CHECK(config != NULL && check_list(config));
+    CHECK(config != NULL && config->module_line == 1 && config->next->module_line == 5 && config->next->next->module_line == 6);
+    configfile_kill(config);
+
+    config = configfile_init_mmap(filename);
+    CHECK(config != NULL && check_list(config));
+    configfile_kill(config);
+
+    /* Small blocks make the arena grow many times. */
+    allocator.allocate = check_allocate;
+    allocator.release = check_release;
+    allocator.user_data = &allocations;
+    memset(&options, 0, sizeof (options));
+    options.allocator = &allocator;
+    options.arena_block_size = 256;
+    config = configfile_init_ex(filename, &options);
+    CHECK(config != NULL && check_list(config));
+    configfile_kill(config);
+    CHECK(allocations.allocated > 0 && allocations.allocated == allocations.released);
+
+    unlink(filename);
+    CHECK(configfile_init(filename) == NULL && errno == ENOENT);
+}
+
+static void check_reloader(void) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile_reloader *reloader;
+    configfile_reader *reader;
+    unsigned long version;
+    configfile *config;
+    FILE *file;
+
+    CHECK(check_file(filename, "version = 1\n") == 0);
+    reloader = configfile_reloader_new(filename, NULL, 60000);
+    CHECK(reloader != NULL && configfile_reloader_version(reloader) == 1);
+    reader = configfile_reader_new(reloader);
+    CHECK(reader != NULL);
+
+    config = configfile_reader_enter(reader);
+    CHECK(strcmp(configfile_get(config, "version")->module_value, "1") == 0);
+    configfile_reader_leave(reader);
+
+    file = fopen(filename, "w");
+    fputs("version = 2\n", file);
+    fclose(file);
+    /* The watcher may publish the change first, reloading anyway publishes one more version. */
+    version = configfile_reloader_version(reloader);
+    CHECK(configfile_reloader_reload(reloader) == 0 && configfile_reloader_version(reloader) > version);
+    config = configfile_reader_enter(reader);
+    CHECK(strcmp(configfile_get(config, "version")->module_value, "2") == 0);
+    configfile_reader_leave(reader);
+
+    /* A version that does not load leaves the last one published. */
+    unlink(filename);
+    version = configfile_reloader_version(reloader);
+    CHECK(configfile_reloader_reload(reloader) == -1 && configfile_reloader_version(reloader) == version);
+    config = configfile_reader_enter(reader);
+    CHECK(strcmp(configfile_get(config, "version")->module_value, "2") == 0);
+    configfile_reader_leave(reader);
+
+    configfile_reader_kill(reader);
+    configfile_reloader_kill(reloader);
+}
+
+int main(void) {
+    check_loaders();
+    check_reloader();
+
+    return check_done("check_load");
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_parallel.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Parallel parsing: a file large enough to be split between threads loads as the same list, on the same lines, for
+ * any number of threads and in copy and mmap modes alike, and configfile_get() finds the first of repeated names
+ * through the index filled in shards. Threads are capped at the number of online processors, on a single processor
+ * every load is serial and the check only compares the two modes.
+ */
+
+#include "check.h"
+#include "libconfigfile.h"
+
+/* Over 3 MiB, well above the smallest file split between threads. */
+#define CHECK_LINES 170000
+#define CHECK_NAMES 40000
+
+/**
+ * Writes names repeated every CHECK_NAMES lines with the line number as value, mixed with lines holding no module,
+ * long lines and a last line without newline.
+ */
+static void check_large(char *filename) {
+    FILE *file;
+    int fd, i;
+
+    fd = mkstemp(filename);
+    CHECK(fd >= 0 && (file = fdopen(fd, "w")) != NULL);
+    for (i = 0; i < CHECK_LINES; i++) {
+        if (i % 7 == 3) {
+            fputs("no delimiter on this line\n", file);
+        } else if (i % 11 == 5) {
+            fputs("\n", file);
+        } else if (i % 101 == 0) {
+            fprintf(file, "name%d = %0200d\n", i % CHECK_NAMES, i + 1);
+        } else {
+            fprintf(file, "name%d = %d\n", i % CHECK_NAMES, i + 1);
+        }
+    }
+    fputs("last = end", file);
+    fclose(file);
+}
+
+/**
+ * Compares two lists node by node, then the lookup of every name.
+ */
+static int check_same(configfile *expected, configfile *config) {
+    configfile *left, *right;
+    char name[32];
+    int i;
+
+    for (left = expected, right = config; left != NULL && right != NULL; left = left->next, right = right->next) {
+        if (strcmp(left->module_name, right->module_name) != 0 || strcmp(left->module_value, right->module_value) != 0 ||
+                left->module_line != right->module_line) {
+            return 0;
+        }
+    }
+    if (left != NULL || right != NULL) {
+        return 0;
+    }
+
+    for (i = 0; i < CHECK_NAMES; i++) {
+        snprintf(name, sizeof (name), "name%d", i);
+        left = configfile_get(expected, name);
+        right = configfile_get(config, name);
+        if ((left == NULL) != (right == NULL) || (left != NULL && left->module_line != right->module_line)) {
+            return 0;
+        }
+    }
+
+    return configfile_get(config, "last") != NULL && configfile_get(config, "missing") == NULL;
+}
+
+/**
+ * Checks that the lookup of every name of a list is the first module of the name.
+ */
+static int check_first(configfile *config) {
+    configfile *next, *found;
+
+    for (next = config; next != NULL; next = next->next) {
+        found = configfile_get(config, next->module_name);
+        if (found == NULL || found->module_line > next->module_line ||
+                strcmp(found->module_name, next->module_name) != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int main(void) {
+    static const unsigned int threads[] = {1, 2, 3, 5, 9, 17};
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile_options options;
+    configfile *expected, *config;
+    size_t i;
+    int mode;
+
+    check_large(filename);
+    expected = configfile_init(filename);
+    CHECK(expected != NULL && check_first(expected));
+
+    for (mode = 0; mode < 2; mode++) {
+        for (i = 0; i < sizeof (threads) / sizeof (threads[0]); i++) {
+            memset(&options, 0, sizeof (options));
+            options.flags = mode ? CONFIGFILE_MMAP : 0;
+            options.threads = threads[i];
+            config = configfile_init_ex(filename, &options);
+            if (config == NULL || !check_same(expected, config) || !check_first(config)) {
+                printf("%s: differs with %u threads%s\n", __FILE__, threads[i], mode ? " and mmap" : "");
+                check_failures++;
+            }
+            configfile_kill(config);
+        }
+    }
+
+    configfile_kill(expected);
+    unlink(filename);
+
+    return check_done("check_parallel");
+}
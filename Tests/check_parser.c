@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_parser.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Streaming parser: feeding the input in chunks of any size, or split at any byte, reports the same modules on the
+ * same lines as parsing it whole, and a callback returning non-zero stops every later call.
+ */
+
+#include <errno.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+static const char check_input[] =
+        "name = value\n"
+        "\n"
+        "no delimiter\n"
+        "= no name\n"
+        "  spaced   =   out  \n"
+        "a.long.name.crossing.a.scanner.block = and a value long enough to cross the next one as well\n"
+        "name = repeated\n"
+        "empty =\n"
+        "x=1\n"
+        "last = without newline";
+
+typedef struct _check_record {
+    char text[1024];
+    size_t length;
+    /* Module after which the callback stops the parse, zero never. */
+    int stop;
+    int count;
+} check_record;
+
+static int check_callback(const char *module_name, size_t module_name_length, const char *module_value, size_t module_value_length,
+        size_t line, void *user_data) {
+    check_record *record = user_data;
+
+    record->length += snprintf(&record->text[record->length], sizeof (record->text) - record->length, "%.*s|%.*s|%zu\n",
+            (int) module_name_length, module_name, (int) module_value_length, module_value, line);
+    record->count++;
+
+    return record->count == record->stop;
+}
+
+static void check_reset(check_record *record, int stop) {
+    memset(record, 0, sizeof (check_record));
+    record->stop = stop;
+}
+
+/**
+ * Feeds the input in chunks of size bytes.
+ */
+static int check_chunks(check_record *record, size_t size) {
+    configfile_parser *parser;
+    size_t position, length = sizeof (check_input) - 1;
+    int result = 0;
+
+    parser = configfile_parser_new(check_callback, record);
+    for (position = 0; position < length && result == 0; position += size) {
+        result = configfile_parser_feed(parser, &check_input[position], position + size < length ? size : length - position);
+    }
+    if (result == 0) {
+        result = configfile_parser_finish(parser);
+    }
+    configfile_parser_kill(parser);
+
+    return result;
+}
+
+/**
+ * Feeds the input in two chunks split at a byte, with an empty chunk between them.
+ */
+static int check_split(check_record *record, size_t split) {
+    configfile_parser *parser;
+    int result;
+
+    parser = configfile_parser_new(check_callback, record);
+    result = configfile_parser_feed(parser, check_input, split);
+    result |= configfile_parser_feed(parser, NULL, 0);
+    result |= configfile_parser_feed(parser, &check_input[split], sizeof (check_input) - 1 - split);
+    result |= configfile_parser_finish(parser);
+    configfile_parser_kill(parser);
+
+    return result;
+}
+
+int main(void) {
+    check_record whole, record;
+    configfile_parser *parser;
+    int fds[2];
+    size_t i;
+
+    check_reset(&whole, 0);
+    CHECK(configfile_parse_buffer(check_input, sizeof (check_input) - 1, check_callback, &whole) == 0);
+    CHECK(whole.count == 6 && strncmp(whole.text, "name|value|1\nspaced|out|5\n", 26) == 0);
+    CHECK(strstr(whole.text, "\nlast|without newline|10\n") != NULL);
+
+    for (i = 1; i <= sizeof (check_input); i++) {
+        check_reset(&record, 0);
+        CHECK(check_chunks(&record, i) == 0 && strcmp(record.text, whole.text) == 0);
+    }
+    for (i = 0; i < sizeof (check_input); i++) {
+        check_reset(&record, 0);
+        CHECK(check_split(&record, i) == 0 && strcmp(record.text, whole.text) == 0);
+    }
+
+    /* The same input read from a pipe. */
+    CHECK(pipe(fds) == 0 && write(fds[1], check_input, sizeof (check_input) - 1) == sizeof (check_input) - 1);
+    close(fds[1]);
+    check_reset(&record, 0);
+    CHECK(configfile_parse_fd(fds[0], check_callback, &record) == 0 && strcmp(record.text, whole.text) == 0);
+    close(fds[0]);
+
+    /* Stopping after the third module reports the first three modules only, whatever the chunks. */
+    check_reset(&whole, 3);
+    CHECK(configfile_parse_buffer(check_input, sizeof (check_input) - 1, check_callback, &whole) == 1 && whole.count == 3);
+    for (i = 1; i <= sizeof (check_input); i++) {
+        check_reset(&record, 3);
+        CHECK(check_chunks(&record, i) == 1 && strcmp(record.text, whole.text) == 0);
+    }
+
+    check_reset(&record, 1);
+    parser = configfile_parser_new(check_callback, &record);
+    CHECK(configfile_parser_feed(parser, check_input, sizeof (check_input) - 1) == 1);
+    CHECK(configfile_parser_feed(parser, "more = lines\n", 13) == 1);
+    CHECK(configfile_parser_finish(parser) == 1 && record.count == 1);
+    configfile_parser_kill(parser);
+
+    CHECK(configfile_parser_new(NULL, NULL) == NULL && errno == EINVAL);
+    CHECK(configfile_parse_buffer(NULL, 1, check_callback, &record) == -1 && errno == EINVAL);
+
+    return check_done("check_parser");
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_section.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Sections: array elements are found the same way whether stored densely or looked up by name, relative lookups
+ * cross '.' and '[' alike, and walks visit modules before subsections, each in file order.
+ */
+
+#include "check.h"
+#include "libconfigfile.h"
+
+static int check_collect(configfile *module, void *user_data) {
+    char *walked = user_data;
+
+    snprintf(walked + strlen(walked), 256 - strlen(walked), "%s=%s;", module->module_name, module->module_value);
+    return 0;
+}
+
+static int check_stop(configfile *module, void *user_data) {
+    return ++*(int *) user_data == 2 ? 7 : 0;
+}
+
+/**
+ * Returns the value of the module "name" below a section.
+ */
+static const char *check_value(const configfile_section *section, const char *module_name) {
+    configfile *module = configfile_section_get(section, module_name);
+
+    return module != NULL ? module->module_value : "";
+}
+
+static void check_arrays(configfile *config) {
+    const configfile_section *client, *sparse;
+    const char *segment;
+    size_t length;
+
+    /* Dense: [01] comes before [1] and wins index 1. */
+    client = configfile_section_find(config, "client");
+    CHECK(configfile_section_length(client) == 3);
+    CHECK(strcmp(check_value(configfile_section_at(client, 0), "user"), "a") == 0);
+    segment = configfile_section_name(configfile_section_at(client, 1), &length);
+    CHECK(segment != NULL && length == 4 && memcmp(segment, "[01]", 4) == 0);
+    CHECK(strcmp(check_value(configfile_section_at(client, 1), "user"), "b") == 0);
+    CHECK(configfile_section_at(client, 2) == configfile_section_find(config, "client[2]"));
+    CHECK(configfile_section_at(client, 3) == NULL);
+    CHECK(configfile_section_child(client, "[1]") != configfile_section_at(client, 1));
+
+    /* Sparse: far apart indices are looked up by name, with the same answer for [0100] before [100]. */
+    sparse = configfile_section_find(config, "sparse");
+    CHECK(configfile_section_length(sparse) == 1001);
+    CHECK(strcmp(check_value(configfile_section_at(sparse, 0), "x"), "0") == 0);
+    CHECK(strcmp(check_value(configfile_section_at(sparse, 100), "x"), "0100") == 0);
+    CHECK(strcmp(check_value(configfile_section_at(sparse, 1000), "x"), "1000") == 0);
+    CHECK(configfile_section_at(sparse, 50) == NULL);
+    CHECK(configfile_section_at(sparse, 1001) == NULL);
+
+    /* Without padding the sparse lookup goes by name only. */
+    sparse = configfile_section_find(config, "plain");
+    CHECK(configfile_section_length(sparse) == 501);
+    CHECK(strcmp(check_value(configfile_section_at(sparse, 500), "x"), "500") == 0);
+    CHECK(configfile_section_at(sparse, 499) == NULL);
+}
+
+static void check_children(configfile *config) {
+    const configfile_section *a, *b;
+
+    a = configfile_section_find(config, "a");
+    b = configfile_section_find(config, "a.b");
+    CHECK(a != NULL && b != NULL && configfile_section_child(a, "b") == b);
+    CHECK(configfile_section_child(a, "b[2]") == configfile_section_find(config, "a.b[2]"));
+    CHECK(configfile_section_child(b, "[2].c") == configfile_section_find(config, "a.b[2].c"));
+    CHECK(configfile_section_child(configfile_section_child(b, "[2]"), "c") != NULL);
+    CHECK(configfile_section_child(configfile_section_find(config, NULL), "a.b") == b);
+    CHECK(strcmp(check_value(b, "[2].c.d"), "1") == 0);
+    CHECK(strcmp(check_value(configfile_section_child(b, "[2].c"), "d"), "1") == 0);
+
+    /* A module is not a section, and a segment only matches whole. */
+    CHECK(configfile_section_find(config, "a.b[2].c.d") == NULL);
+    CHECK(configfile_section_child(a, "[2]") == NULL);
+    CHECK(configfile_section_child(b, "[3]") == NULL);
+    CHECK(configfile_section_child(a, ".b") == NULL);
+    CHECK(configfile_section_find(config, "a.") == NULL);
+}
+
+static void check_walk(configfile *config) {
+    const configfile_section *s;
+    char walked[256] = "";
+    size_t length;
+    int count = 0;
+
+    s = configfile_section_find(config, "s");
+    CHECK(configfile_section_foreach(s, check_collect, walked) == 0);
+    CHECK(strcmp(walked, "s.z=1;s.y=3;s.t.a=2;s.t.c=6;s.u.b=5;") == 0);
+    CHECK(configfile_section_foreach(s, check_stop, &count) == 7 && count == 2);
+
+    CHECK(memcmp(configfile_section_name(configfile_section_first(s), &length), "t", 1) == 0 && length == 1);
+    CHECK(memcmp(configfile_section_name(configfile_section_next(configfile_section_first(s)), &length), "u", 1) == 0);
+    CHECK(configfile_section_next(configfile_section_next(configfile_section_first(s))) == NULL);
+}
+
+int main(void) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile_options options;
+    configfile *config;
+
+    CHECK(check_file(filename, "client[0].user = a\nclient[01].user = b\nclient[1].user = c\nclient[2].user = d\n"
+            "sparse[0].x = 0\nsparse[0100].x = 0100\nsparse[100].x = 100\nsparse[1000].x = 1000\n"
+            "plain[0].x = 0\nplain[500].x = 500\n"
+            "a.b[2].c.d = 1\n"
+            "s.z = 1\ns.t.a = 2\ns.y = 3\ns.t.a = 4\ns.u.b = 5\ns.t.c = 6\n") == 0);
+    config = configfile_init(filename);
+    CHECK(config != NULL);
+
+    check_arrays(config);
+    check_children(config);
+    check_walk(config);
+    configfile_kill(config);
+
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_NO_SECTIONS;
+    config = configfile_init_ex(filename, &options);
+    unlink(filename);
+    CHECK(config != NULL && configfile_section_find(config, "client") == NULL);
+    configfile_kill(config);
+
+    return check_done("check_section");
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_shared.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Shared snapshots: a published list reads back through another handle, a republication is picked up, a reader
+ * racing the publisher always finds an image, a damaged image is rejected, and nothing is left behind in /dev/shm.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <dlfcn.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+#define CHECK_PUBLICATIONS 2000
+
+static char check_name[64];
+static configfile *check_first, *check_second;
+static int check_publishing, check_racing;
+
+static configfile *check_load(const char *content) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile *config;
+
+    CHECK(check_file(filename, content) == 0);
+    config = configfile_init(filename);
+    unlink(filename);
+    CHECK(config != NULL);
+
+    return config;
+}
+
+static int check_value(const configfile_snapshot *snapshot, const char *module_name, const char *value) {
+    configfile_view view;
+
+    return configfile_snapshot_get(snapshot, module_name, &view) == 0 && view.module_value_length == strlen(value) &&
+            memcmp(view.module_value, value, view.module_value_length) == 0;
+}
+
+/**
+ * Counts the objects of /dev/shm published under check_name: the control and the images.
+ */
+static size_t check_objects(void) {
+    size_t count = 0, length = strlen(&check_name[1]);
+    struct dirent *entry;
+    DIR *directory;
+
+    directory = opendir("/dev/shm");
+    if (directory == NULL) {
+        return 0;
+    }
+    while ((entry = readdir(directory)) != NULL) {
+        if (strncmp(entry->d_name, &check_name[1], length) == 0 && (entry->d_name[length] == '\0' || entry->d_name[length] == '.')) {
+            count++;
+        }
+    }
+    closedir(directory);
+
+    return count;
+}
+
+/**
+ * Stands in for shm_open(3): while check_racing is set, opening an image for reading first publishes a newer
+ * generation, which unlinks the image about to be opened, as a publisher running between a reader loading the
+ * generation and opening its image would.
+ */
+int shm_open(const char *name, int oflag, mode_t mode) {
+    static int (*real_shm_open)(const char *, int, mode_t);
+
+    if (real_shm_open == NULL) {
+        real_shm_open = (int (*)(const char *, int, mode_t)) dlsym(RTLD_NEXT, "shm_open");
+    }
+
+    if (check_racing && (oflag & O_ACCMODE) == O_RDONLY && strchr(name, '.') != NULL) {
+        check_racing = 0;
+        CHECK(configfile_shared_publish(check_second, check_name, NULL) == 0);
+    }
+
+    return real_shm_open(name, oflag, mode);
+}
+
+static void check_image_name(char *image_name, size_t size, uint64_t generation) {
+    snprintf(image_name, size, "%s.%llu", check_name, (unsigned long long) generation);
+}
+
+static void check_publish(void) {
+    const configfile_snapshot *snapshot, *first;
+    configfile_shared *shared;
+    configfile_view view;
+    uint64_t generation, seen;
+    char image_name[96];
+
+    errno = 0;
+    CHECK(configfile_shared_open(check_name) == NULL && errno == ENOENT);
+    CHECK(configfile_shared_publish(NULL, check_name, NULL) == -1 && errno == EINVAL);
+    CHECK(configfile_shared_publish(check_first, "no_slash", NULL) == -1 && errno == EINVAL);
+    CHECK(configfile_shared_publish(check_first, "/a/b", NULL) == -1 && errno == EINVAL);
+
+    CHECK(configfile_shared_publish(check_first, check_name, &generation) == 0 && generation == 1);
+    CHECK(check_objects() == 2);
+
+    shared = configfile_shared_open(check_name);
+    CHECK(shared != NULL);
+    first = snapshot = configfile_shared_snapshot(shared, &seen);
+    CHECK(snapshot != NULL && seen == 1);
+    CHECK(configfile_snapshot_count(snapshot) == 3);
+    CHECK(check_value(snapshot, "a", "1") && check_value(snapshot, "b", "two"));
+    CHECK(configfile_snapshot_at(snapshot, 2, &view) == 0 && view.module_value_length == 1 && view.module_value[0] == '3');
+    CHECK(configfile_snapshot_get(snapshot, "c", NULL) == -1);
+
+    /* Nothing changed: the same mapping comes back. */
+    CHECK(configfile_shared_snapshot(shared, &seen) == first && seen == 1);
+
+    /* A republication replaces the image and unlinks the previous one. */
+    CHECK(configfile_shared_publish(check_second, check_name, &generation) == 0 && generation == 2);
+    CHECK(check_objects() == 2);
+    snapshot = configfile_shared_snapshot(shared, &seen);
+    CHECK(snapshot != NULL && seen == 2);
+    CHECK(configfile_snapshot_count(snapshot) == 2);
+    CHECK(check_value(snapshot, "a", "10") && check_value(snapshot, "c", "new"));
+    CHECK(configfile_snapshot_get(snapshot, "b", NULL) == -1);
+
+    /* An image unlinked with no newer generation to move to is reported, the next publication recovers. */
+    CHECK(configfile_shared_publish(check_first, check_name, &generation) == 0 && generation == 3);
+    check_image_name(image_name, sizeof (image_name), 3);
+    CHECK(shm_unlink(image_name) == 0);
+    errno = 0;
+    CHECK(configfile_shared_snapshot(shared, &seen) == NULL && errno == ENOENT);
+    CHECK(configfile_shared_publish(check_first, check_name, &generation) == 0 && generation == 4);
+    snapshot = configfile_shared_snapshot(shared, &seen);
+    CHECK(snapshot != NULL && seen == 4 && check_value(snapshot, "b", "two"));
+
+    configfile_shared_close(shared);
+}
+
+static void *check_publisher(void *arg) {
+    int i;
+
+    (void) arg;
+    for (i = 0; i < CHECK_PUBLICATIONS; i++) {
+        CHECK(configfile_shared_publish(i % 2 == 0 ? check_first : check_second, check_name, NULL) == 0);
+    }
+    __atomic_store_n(&check_publishing, 0, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+/**
+ * A reader that opens an image the publisher just unlinked moves on to the newer one instead of failing: once
+ * with the publication forced into that window, then while another thread publishes.
+ */
+static void check_race(void) {
+    const configfile_snapshot *snapshot;
+    configfile_shared *shared;
+    uint64_t generation, seen, last = 0;
+    pthread_t publisher;
+    size_t reads = 0;
+
+    shared = configfile_shared_open(check_name);
+    CHECK(shared != NULL);
+
+    CHECK(configfile_shared_publish(check_first, check_name, &generation) == 0 && generation == 5);
+    check_racing = 1;
+    snapshot = configfile_shared_snapshot(shared, &seen);
+    CHECK(check_racing == 0);
+    CHECK(snapshot != NULL && seen == 6 && check_value(snapshot, "c", "new"));
+    CHECK(check_objects() == 2);
+
+    check_publishing = 1;
+    CHECK(pthread_create(&publisher, NULL, check_publisher, NULL) == 0);
+    while (__atomic_load_n(&check_publishing, __ATOMIC_ACQUIRE)) {
+        snapshot = configfile_shared_snapshot(shared, &seen);
+        if (snapshot == NULL) {
+            printf("check_shared.c: snapshot failed after %zu reads: %s\n", reads, strerror(errno));
+            check_failures++;
+            break;
+        }
+        CHECK(seen >= last);
+        CHECK(configfile_snapshot_count(snapshot) == (seen % 2 == 1 ? 3 : 2));
+        CHECK(check_value(snapshot, "a", seen % 2 == 1 ? "1" : "10"));
+        last = seen;
+        reads++;
+    }
+    pthread_join(publisher, NULL);
+
+    snapshot = configfile_shared_snapshot(shared, &seen);
+    CHECK(snapshot != NULL && seen == 6 + CHECK_PUBLICATIONS);
+    CHECK(check_objects() == 2);
+
+    configfile_shared_close(shared);
+}
+
+static void check_damaged(void) {
+    configfile_shared *shared;
+    struct stat file_stat;
+    uint64_t generation;
+    char image_name[96];
+    char *image;
+    int fd;
+
+    shared = configfile_shared_open(check_name);
+    CHECK(shared != NULL);
+    CHECK(configfile_shared_snapshot(shared, NULL) != NULL);
+
+    /* Flips a byte of the first entry of the next image, which no longer matches its checksum. */
+    CHECK(configfile_shared_publish(check_first, check_name, &generation) == 0);
+    check_image_name(image_name, sizeof (image_name), generation);
+    fd = shm_open(image_name, O_RDWR, 0);
+    CHECK(fd >= 0 && fstat(fd, &file_stat) == 0 && file_stat.st_size > 100);
+    image = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    CHECK(image != MAP_FAILED);
+    image[96] ^= 0x5a;
+    munmap(image, file_stat.st_size);
+    close(fd);
+
+    errno = 0;
+    CHECK(configfile_shared_snapshot(shared, NULL) == NULL && errno == EINVAL);
+    configfile_shared_close(shared);
+
+    shared = configfile_shared_open(check_name);
+    CHECK(shared != NULL);
+    errno = 0;
+    CHECK(configfile_shared_snapshot(shared, NULL) == NULL && errno == EINVAL);
+
+    /* The next publication replaces it. */
+    CHECK(configfile_shared_publish(check_second, check_name, &generation) == 0);
+    CHECK(configfile_shared_snapshot(shared, NULL) != NULL);
+    configfile_shared_close(shared);
+}
+
+static void check_unlink(void) {
+    const configfile_snapshot *snapshot;
+    configfile_shared *shared;
+
+    shared = configfile_shared_open(check_name);
+    CHECK(shared != NULL);
+    snapshot = configfile_shared_snapshot(shared, NULL);
+    CHECK(snapshot != NULL);
+
+    /* An attached reader keeps what it mapped. */
+    CHECK(configfile_shared_unlink(check_name) == 0);
+    CHECK(check_objects() == 0);
+    CHECK(check_value(snapshot, "c", "new"));
+    configfile_shared_close(shared);
+
+    errno = 0;
+    CHECK(configfile_shared_open(check_name) == NULL && errno == ENOENT);
+    CHECK(configfile_shared_unlink(check_name) == -1 && errno == ENOENT);
+}
+
+int main(void) {
+    snprintf(check_name, sizeof (check_name), "/check_shared_%ld", (long) getpid());
+    check_first = check_load("a = 1\nb = two\na = 3\n");
+    check_second = check_load("a = 10\nc = new\n");
+
+    check_publish();
+    check_race();
+    check_damaged();
+    check_unlink();
+
+    /* Whatever failed above, leave nothing behind. */
+    configfile_shared_unlink(check_name);
+    configfile_kill(check_first);
+    configfile_kill(check_second);
+
+    return check_done("check_shared");
+}
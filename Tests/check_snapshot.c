@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_snapshot.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Snapshots: an image reads back as the list it was compiled from, a stale or damaged file is rejected by
+ * configfile_snapshot_open() and rebuilt by configfile_snapshot_load(), and an image whose checksum matches but
+ * whose offsets lead out of it is rejected as well.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+/* Layout of the image, see libconfigfile_snapshot.c. */
+#define CHECK_CHECKSUM 24
+#define CHECK_ENTRY_COUNT 56
+#define CHECK_SLOT_COUNT 60
+#define CHECK_SLOTS_OFFSET 72
+#define CHECK_STRINGS_SIZE 88
+#define CHECK_HEADER 96
+#define CHECK_ENTRY 24
+#define CHECK_NAME_LENGTH 12
+#define CHECK_VALUE_OFFSET 16
+
+static char *check_read(const char *filename, size_t *size) {
+    struct stat file_stat;
+    char *data;
+    FILE *file;
+
+    file = fopen(filename, "r");
+    if (file == NULL || fstat(fileno(file), &file_stat) != 0 || (data = malloc(file_stat.st_size)) == NULL) {
+        return NULL;
+    }
+    *size = fread(data, 1, file_stat.st_size, file);
+    fclose(file);
+
+    return data;
+}
+
+static void check_write(const char *filename, const char *data, size_t size) {
+    FILE *file = fopen(filename, "w");
+
+    CHECK(file != NULL && fwrite(data, 1, size, file) == size);
+    fclose(file);
+}
+
+/**
+ * The checksum of the image, recomputed so a forged image passes it.
+ */
+static void check_seal(char *image, size_t size) {
+    uint64_t checksum = configfile_hash(NULL, 0), word;
+    size_t i;
+
+    for (i = CHECK_HEADER; i + sizeof (word) <= size; i += sizeof (word)) {
+        memcpy(&word, &image[i], sizeof (word));
+        checksum = (checksum ^ word) * 0x100000001b3ULL;
+    }
+    checksum ^= configfile_hash(&image[i], size - i);
+    memcpy(&image[CHECK_CHECKSUM], &checksum, sizeof (checksum));
+}
+
+static int check_same(const configfile_snapshot *snapshot, configfile *config) {
+    configfile_view view;
+    configfile *next;
+    size_t index = 0;
+
+    for (next = config; next != NULL; next = next->next, index++) {
+        if (configfile_snapshot_at(snapshot, index, &view) != 0 || strcmp(view.module_name, next->module_name) != 0 ||
+                strcmp(view.module_value, next->module_value) != 0) {
+            return 0;
+        }
+        if (configfile_snapshot_get(snapshot, next->module_name, &view) != 0 ||
+                strcmp(view.module_value, configfile_get(config, next->module_name)->module_value) != 0) {
+            return 0;
+        }
+    }
+
+    return index == configfile_snapshot_count(snapshot) && configfile_snapshot_get(snapshot, "missing", NULL) != 0;
+}
+
+/**
+ * Opens a forged image, which must be refused.
+ */
+static int check_forged(const char *snapshot_filename, const char *image, size_t size, size_t offset, uint32_t field) {
+    const configfile_snapshot *snapshot;
+    char *forged = malloc(size);
+
+    memcpy(forged, image, size);
+    memcpy(&forged[offset], &field, sizeof (field));
+    check_seal(forged, size);
+    check_write(snapshot_filename, forged, size);
+    free(forged);
+
+    snapshot = configfile_snapshot_open(snapshot_filename, NULL);
+    configfile_snapshot_close(snapshot);
+    return snapshot == NULL && errno == EINVAL;
+}
+
+int main(void) {
+    char filename[] = "/tmp/check_XXXXXX", snapshot_filename[32];
+    const configfile_snapshot *snapshot;
+    uint32_t entry_count, slot_count, one = 1;
+    uint64_t slots, strings_size;
+    configfile *config;
+    size_t size, i;
+    char *image;
+
+    CHECK(check_file(filename, "a = 1\nb = 2\na = 3\nlong.name = some value\n") == 0);
+    snprintf(snapshot_filename, sizeof (snapshot_filename), "%s.snap", filename);
+    config = configfile_init(filename);
+    CHECK(config != NULL);
+
+    CHECK(configfile_snapshot_write(config, snapshot_filename, filename) == 0);
+    snapshot = configfile_snapshot_open(snapshot_filename, filename);
+    CHECK(snapshot != NULL && check_same(snapshot, config));
+    configfile_snapshot_close(snapshot);
+
+    image = check_read(snapshot_filename, &size);
+    CHECK(image != NULL && size > CHECK_HEADER);
+    memcpy(&entry_count, &image[CHECK_ENTRY_COUNT], sizeof (entry_count));
+    memcpy(&slot_count, &image[CHECK_SLOT_COUNT], sizeof (slot_count));
+    memcpy(&slots, &image[CHECK_SLOTS_OFFSET], sizeof (slots));
+    memcpy(&strings_size, &image[CHECK_STRINGS_SIZE], sizeof (strings_size));
+    CHECK(entry_count == 4);
+
+    /* A flipped byte fails the checksum, the load falls back to the text and rewrites the file. */
+    image[size - 2] ^= 1;
+    check_write(snapshot_filename, image, size);
+    image[size - 2] ^= 1;
+    CHECK(configfile_snapshot_open(snapshot_filename, filename) == NULL && errno == EINVAL);
+    snapshot = configfile_snapshot_load(filename, snapshot_filename);
+    CHECK(snapshot != NULL && check_same(snapshot, config));
+    configfile_snapshot_close(snapshot);
+    snapshot = configfile_snapshot_open(snapshot_filename, filename);
+    CHECK(snapshot != NULL);
+    configfile_snapshot_close(snapshot);
+
+    /* Offsets that pass the checksum but leave the string table or the entries. */
+    CHECK(check_forged(snapshot_filename, image, size, CHECK_HEADER + CHECK_VALUE_OFFSET, strings_size));
+    CHECK(check_forged(snapshot_filename, image, size, CHECK_HEADER + CHECK_VALUE_OFFSET, UINT32_MAX));
+    CHECK(check_forged(snapshot_filename, image, size, CHECK_HEADER + CHECK_NAME_LENGTH, 2));
+    CHECK(check_forged(snapshot_filename, image, size, slots, entry_count + 1));
+    CHECK(check_forged(snapshot_filename, image, size, slots + 4 * (slot_count - 1), UINT32_MAX));
+    /* A table without an empty slot would never end a probe for a missing name. */
+    for (i = 0; i < slot_count - 1; i++) {
+        memcpy(&image[slots + 4 * i], &one, sizeof (one));
+    }
+    CHECK(check_forged(snapshot_filename, image, size, slots + 4 * (slot_count - 1), 1));
+    free(image);
+
+    /* A changed source makes the file stale, the load reads the new text. */
+    CHECK(configfile_snapshot_write(config, snapshot_filename, filename) == 0);
+    configfile_kill(config);
+    check_write(filename, "a = 4\nb = 5\n", 12);
+    config = configfile_init(filename);
+    CHECK(config != NULL);
+    CHECK(configfile_snapshot_open(snapshot_filename, filename) == NULL && errno == ESTALE);
+    snapshot = configfile_snapshot_load(filename, snapshot_filename);
+    CHECK(snapshot != NULL && check_same(snapshot, config));
+    configfile_snapshot_close(snapshot);
+
+    /* A missing file is built and written. */
+    unlink(snapshot_filename);
+    snapshot = configfile_snapshot_load(filename, snapshot_filename);
+    CHECK(snapshot != NULL && check_same(snapshot, config));
+    configfile_snapshot_close(snapshot);
+    snapshot = configfile_snapshot_open(snapshot_filename, filename);
+    CHECK(snapshot != NULL && check_same(snapshot, config));
+    configfile_snapshot_close(snapshot);
+
+    configfile_kill(config);
+    unlink(snapshot_filename);
+    unlink(filename);
+
+    return check_done("check_snapshot");
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_table.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Tables: a table loaded from a file and one built from its list hold the modules of the list in its order and find
+ * the same first module of each name, and iterators give the same views over the list and over either table,
+ * values of interpolated lists expanded.
+ */
+
+#include <errno.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+static int check_view(const configfile_view *left, const configfile_view *right) {
+    return left->module_name_length == right->module_name_length && left->module_value_length == right->module_value_length &&
+            strcmp(left->module_name, right->module_name) == 0 && strcmp(left->module_value, right->module_value) == 0;
+}
+
+/**
+ * Compares a table with the list it holds, by position, by lookup and through iterators.
+ */
+static int check_same(configfile *config, const configfile_table *table) {
+    configfile_iterator list_iterator, table_iterator;
+    configfile_view list_view, table_view;
+    configfile *next, *module;
+    size_t index = 0;
+
+    for (next = config; next != NULL; next = next->next, index++) {
+        if (configfile_table_at(table, index, &table_view) != 0 || strcmp(table_view.module_name, next->module_name) != 0 ||
+                strcmp(table_view.module_value, next->module_value) != 0) {
+            return 0;
+        }
+        module = configfile_get(config, next->module_name);
+        if (configfile_table_get(table, next->module_name, &table_view) != 0 || strcmp(table_view.module_value, module->module_value) != 0) {
+            return 0;
+        }
+    }
+    if (index != configfile_table_count(table) || configfile_table_at(table, index, &table_view) == 0 ||
+            configfile_table_get(table, "missing", NULL) == 0) {
+        return 0;
+    }
+
+    configfile_iterate(&list_iterator, config);
+    configfile_table_iterate(&table_iterator, table);
+    for (index = 0; configfile_iterator_next(&list_iterator, &list_view) == 0; index++) {
+        if (configfile_iterator_next(&table_iterator, &table_view) != 0 || !check_view(&list_view, &table_view)) {
+            return 0;
+        }
+    }
+
+    return index == configfile_table_count(table) && configfile_iterator_next(&table_iterator, &table_view) != 0;
+}
+
+int main(void) {
+    char filename[] = "/tmp/check_XXXXXX", interpolated[] = "/tmp/check_XXXXXX", empty[] = "/tmp/check_XXXXXX";
+    configfile_iterator iterator, table_iterator;
+    configfile_table *loaded, *built;
+    configfile_view view, table_view;
+    configfile_options options;
+    configfile *config;
+    FILE *file;
+    int fd, i;
+
+    /* Repeated names, lines without modules, long values and no final newline. */
+    fd = mkstemp(filename);
+    CHECK(fd >= 0 && (file = fdopen(fd, "w")) != NULL);
+    for (i = 0; i < 2000; i++) {
+        fprintf(file, "name%d = value%d\n", i % 700, i);
+        if (i % 50 == 0) {
+            fprintf(file, "no delimiter\n\nlong%d = %0300d\n", i, i);
+        }
+    }
+    fputs("last = end", file);
+    fclose(file);
+
+    config = configfile_init(filename);
+    loaded = configfile_table_load(filename);
+    built = configfile_table_build(config);
+    CHECK(config != NULL && loaded != NULL && built != NULL);
+    CHECK(check_same(config, loaded) && check_same(config, built));
+    CHECK(configfile_table_get(loaded, "name5", &view) == 0 && strcmp(view.module_value, "value5") == 0);
+    CHECK(configfile_table_get_hashed(built, "name5", 5, CONFIGFILE_HASH_LITERAL("name5"), &view) == 0 &&
+            strcmp(view.module_value, "value5") == 0);
+    configfile_table_kill(loaded);
+    configfile_table_kill(built);
+    configfile_kill(config);
+    unlink(filename);
+
+    /* Iterators over an interpolated list read expanded values, as stored by a table built from it. */
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_INTERPOLATE;
+    CHECK(check_file(interpolated, "host = example\nurl = ${host}/path\n") == 0);
+    config = configfile_init_ex(interpolated, &options);
+    unlink(interpolated);
+    built = configfile_table_build(config);
+    CHECK(config != NULL && built != NULL);
+    configfile_iterate(&iterator, config);
+    configfile_table_iterate(&table_iterator, built);
+    while (configfile_iterator_next(&iterator, &view) == 0) {
+        CHECK(configfile_iterator_next(&table_iterator, &table_view) == 0 && check_view(&view, &table_view));
+    }
+    CHECK(configfile_table_at(built, 1, &view) == 0 && strcmp(view.module_value, "example/path") == 0);
+    configfile_table_kill(built);
+    configfile_kill(config);
+
+    /* A file without modules is an empty table, and an empty iteration. */
+    CHECK(check_file(empty, "\nno delimiter\n") == 0);
+    loaded = configfile_table_load(empty);
+    unlink(empty);
+    CHECK(loaded != NULL && configfile_table_count(loaded) == 0 && configfile_table_get(loaded, "a", NULL) != 0);
+    configfile_table_iterate(&iterator, loaded);
+    CHECK(configfile_iterator_next(&iterator, &view) != 0);
+    configfile_iterate(&iterator, NULL);
+    CHECK(configfile_iterator_next(&iterator, &view) != 0);
+    configfile_table_kill(loaded);
+
+    CHECK(configfile_table_load(empty) == NULL && errno == ENOENT);
+    CHECK(configfile_table_build(NULL) == NULL && errno == EINVAL);
+
+    return check_done("check_table");
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   check_tokenize.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Extended syntax: comments, quotes, escapes, continued lines with LF and CRLF newlines, stray returns after a
+ * backslash, malformed lines, and include directives followed by a comment.
+ */
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include "check.h"
+#include "libconfigfile.h"
+
+static configfile *check_load(const char *content, unsigned int flags) {
+    char filename[] = "/tmp/check_XXXXXX";
+    configfile_options options;
+    configfile *config;
+
+    CHECK(check_file(filename, content) == 0);
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_EXTENDED | flags;
+    config = configfile_init_ex(filename, &options);
+    unlink(filename);
+    CHECK(config != NULL);
+
+    return config;
+}
+
+/**
+ * Tells whether a module has exactly the value given, which may hold any byte.
+ */
+static int check_value(configfile *config, const char *module_name, const char *value, size_t length) {
+    configfile *module = configfile_get(config, module_name);
+
+    return module != NULL && module->module_value_length == length && memcmp(module->module_value, value, length) == 0 &&
+            module->module_value[length] == '\0';
+}
+
+#define CHECK_VALUE(config, name, value) CHECK(check_value((config), (name), (value), sizeof (value) - 1))
+
+static void check_syntax(void) {
+    configfile *config;
+
+    config = check_load(
+            "# comment = no\n"
+            "; comment = no\n"
+            "   # indented = no\n"
+            "plain = value # comment\n"
+            "semicolon = a;b ; comment\n"
+            "hash = a#b\n"
+            "  spaced name  =  spaced value  \n"
+            "double = \"a \\\"b\\\" \\n\\t\\r\\\\ \\x # kept\"\n"
+            "single = 'a \\n \"b\" # kept'\n"
+            "escaped = 'it''s'\n"
+            "quoted = \"v\"   # after the quote\n"
+            "empty_double = \"\"\n"
+            "empty_single = ''\n"
+            "after = \"v\" text\n"
+            "unterminated = \"abc\n"
+            "windows = crlf\r\n"
+            "continued = first \\\n"
+            "     second\\\n"
+            "third\n"
+            "continued_crlf = one\\\r\n"
+            "  two\r\n"
+            "stray = a\\\rb\n"
+            "stray_end = a\\\r\r\n"
+            "backslash = a\\b\n"
+            "last = end", 0);
+
+    CHECK(configfile_get(config, "# comment") == NULL && configfile_get(config, "; comment") == NULL);
+    CHECK(configfile_get(config, "# indented") == NULL);
+    CHECK_VALUE(config, "plain", "value");
+    CHECK_VALUE(config, "semicolon", "a;b");
+    CHECK_VALUE(config, "hash", "a#b");
+    CHECK_VALUE(config, "spaced name", "spaced value");
+    CHECK_VALUE(config, "double", "a \"b\" \n\t\r\\ x # kept");
+    CHECK_VALUE(config, "single", "a \\n \"b\" # kept");
+    CHECK_VALUE(config, "quoted", "v");
+    CHECK_VALUE(config, "empty_double", "");
+    CHECK_VALUE(config, "empty_single", "");
+    CHECK_VALUE(config, "windows", "crlf");
+    CHECK_VALUE(config, "continued", "first secondthird");
+    CHECK_VALUE(config, "continued_crlf", "onetwo");
+    CHECK_VALUE(config, "backslash", "a\\b");
+    CHECK_VALUE(config, "last", "end");
+
+    /* A return after a backslash that does not end a CRLF newline is kept, like any other byte. */
+    CHECK_VALUE(config, "stray", "a\\\rb");
+    CHECK_VALUE(config, "stray_end", "a\\\r");
+
+    /* Quotes are not doubled to escape them, text after a closing quote makes the line malformed. */
+    CHECK(configfile_get(config, "escaped") == NULL);
+    CHECK(configfile_get(config, "after") == NULL);
+    CHECK(configfile_get(config, "unterminated") == NULL);
+
+    /* A continued module is on the line of its name, the lines after it count as usual. */
+    CHECK(configfile_get(config, "continued")->module_line == 17);
+    CHECK(configfile_get(config, "continued_crlf")->module_line == 20);
+    CHECK(configfile_get(config, "stray")->module_line == 22);
+    CHECK(configfile_get(config, "last")->module_line == 25);
+
+    configfile_kill(config);
+}
+
+static void check_directives(void) {
+    char directory[] = "/tmp/check_XXXXXX", path[64], content[128];
+    static const char *const comments[] = {"   # overrides", "\t; overrides", " #"};
+    configfile *config;
+    FILE *file;
+    size_t i;
+
+    CHECK(mkdtemp(directory) != NULL);
+    snprintf(path, sizeof (path), "%s/sub.conf", directory);
+    file = fopen(path, "w");
+    CHECK(file != NULL);
+    fputs("included = yes # from sub\n", file);
+    fclose(file);
+
+    for (i = 0; i < sizeof (comments) / sizeof (comments[0]); i++) {
+        snprintf(content, sizeof (content), "main = yes\ninclude %s%s\n", path, comments[i]);
+        config = check_load(content, CONFIGFILE_INCLUDE);
+        CHECK(config != NULL);
+        CHECK_VALUE(config, "included", "yes");
+        configfile_kill(config);
+    }
+
+    unlink(path);
+    rmdir(directory);
+}
+
+int main(void) {
+    check_syntax();
+    check_directives();
+
+    return check_done("check_tokenize");
+}
@@ -35,7 +35,23 @@ OBJECTDIR=${CND_BUILDDIR}/${CND_CONF}/${CND_PLATFORM}
 
 # Object Files
 OBJECTFILES= \
-	${OBJECTDIR}/src/libconfigfile.o
+	${OBJECTDIR}/src/libconfigfile.o \
+	${OBJECTDIR}/src/libconfigfile_reload.o \
+	${OBJECTDIR}/src/libconfigfile_snapshot.o \
+	${OBJECTDIR}/src/libconfigfile_section.o \
+	${OBJECTDIR}/src/libconfigfile_convert.o \
+	${OBJECTDIR}/src/libconfigfile_key.o \
+	${OBJECTDIR}/src/libconfigfile_diff.o \
+	${OBJECTDIR}/src/libconfigfile_include.o \
+	${OBJECTDIR}/src/libconfigfile_stats.o \
+	${OBJECTDIR}/src/libconfigfile_frozen.o \
+	${OBJECTDIR}/src/libconfigfile_table.o \
+	${OBJECTDIR}/src/libconfigfile_interpolate.o \
+	${OBJECTDIR}/src/libconfigfile_tokenize.o \
+	${OBJECTDIR}/src/libconfigfile_shared.o \
+	${OBJECTDIR}/src/libconfigfile_lazy.o \
+	${OBJECTDIR}/src/libconfigfile_bind.o \
+	${OBJECTDIR}/src/libconfigfile_edit.o
 
 
 # C Compiler Flags
@@ -52,7 +68,7 @@ FFLAGS=
 ASFLAGS=
 
 # Link Libraries and Options
-LDLIBSOPTIONS=
+LDLIBSOPTIONS=-lpthread -lrt
 
 # Build Targets
 .build-conf: ${BUILD_SUBPROJECTS}
@@ -69,6 +85,86 @@ ${OBJECTDIR}/src/libconfigfile.o: src/libconfigfile.c
 	${RM} "$@.d"
 	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile.o src/libconfigfile.c
 
+${OBJECTDIR}/src/libconfigfile_reload.o: src/libconfigfile_reload.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_reload.o src/libconfigfile_reload.c
+
+${OBJECTDIR}/src/libconfigfile_snapshot.o: src/libconfigfile_snapshot.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_snapshot.o src/libconfigfile_snapshot.c
+
+${OBJECTDIR}/src/libconfigfile_section.o: src/libconfigfile_section.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_section.o src/libconfigfile_section.c
+
+${OBJECTDIR}/src/libconfigfile_convert.o: src/libconfigfile_convert.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_convert.o src/libconfigfile_convert.c
+
+${OBJECTDIR}/src/libconfigfile_key.o: src/libconfigfile_key.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_key.o src/libconfigfile_key.c
+
+${OBJECTDIR}/src/libconfigfile_diff.o: src/libconfigfile_diff.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_diff.o src/libconfigfile_diff.c
+
+${OBJECTDIR}/src/libconfigfile_include.o: src/libconfigfile_include.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_include.o src/libconfigfile_include.c
+
+${OBJECTDIR}/src/libconfigfile_stats.o: src/libconfigfile_stats.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_stats.o src/libconfigfile_stats.c
+
+${OBJECTDIR}/src/libconfigfile_frozen.o: src/libconfigfile_frozen.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_frozen.o src/libconfigfile_frozen.c
+
+${OBJECTDIR}/src/libconfigfile_table.o: src/libconfigfile_table.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_table.o src/libconfigfile_table.c
+
+${OBJECTDIR}/src/libconfigfile_interpolate.o: src/libconfigfile_interpolate.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_interpolate.o src/libconfigfile_interpolate.c
+
+${OBJECTDIR}/src/libconfigfile_tokenize.o: src/libconfigfile_tokenize.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_tokenize.o src/libconfigfile_tokenize.c
+
+${OBJECTDIR}/src/libconfigfile_shared.o: src/libconfigfile_shared.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_shared.o src/libconfigfile_shared.c
+
+${OBJECTDIR}/src/libconfigfile_lazy.o: src/libconfigfile_lazy.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_lazy.o src/libconfigfile_lazy.c
+
+${OBJECTDIR}/src/libconfigfile_bind.o: src/libconfigfile_bind.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_bind.o src/libconfigfile_bind.c
+
+${OBJECTDIR}/src/libconfigfile_edit.o: src/libconfigfile_edit.c
+	${MKDIR} -p ${OBJECTDIR}/src
+	${RM} "$@.d"
+	$(COMPILE.c) -O2 -MMD -MP -MF "$@.d" -o ${OBJECTDIR}/src/libconfigfile_edit.o src/libconfigfile_edit.c
+
 # Subprojects
 .build-subprojects:
 
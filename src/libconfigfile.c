@@ -27,8 +27,91 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#include "libconfigfile.h"
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <immintrin.h>
+#define CONFIGFILE_SCAN_X86
+#endif
+
+#include "libconfigfile_private.h"
+
+#define CONFIGFILE_ARENA_BLOCK_SIZE (64 * 1024)
+#define CONFIGFILE_ARENA_BLOCK_MAX (4 * 1024 * 1024)
+#define CONFIGFILE_READ_SIZE (64 * 1024)
+/* Smallest file split between threads, and smallest share of it per chunk. */
+#define CONFIGFILE_PARALLEL_MIN (1024 * 1024)
+#define CONFIGFILE_PARALLEL_CHUNK (256 * 1024)
+/* Chunks per thread, so threads finishing early take more of them. */
+#define CONFIGFILE_PARALLEL_SPLIT 8
+/* Smallest range of the hash index filled by one thread. */
+#define CONFIGFILE_INDEX_SHARD_MIN (64 * 1024)
+
+/* Byte classes reported by the scanner, one bit per byte of a 64 byte block and per class. */
+#define CONFIGFILE_SCAN_NEWLINE 0x1
+#define CONFIGFILE_SCAN_DELIMITER 0x2
+#define CONFIGFILE_SCAN_TOKEN 0x4
+/* '$', '{' and '}', kept by the trim along with tokens when references are resolved, see CONFIGFILE_INTERPOLATE. */
+#define CONFIGFILE_SCAN_REFERENCE 0x8
+#define CONFIGFILE_SCAN_BLOCK 64
+
+/*
+ * Class masks of the two most recently scanned blocks. Consecutive blocks land in different entries, so a line
+ * crossing a block boundary never scans a block twice.
+ */
+typedef struct _configfile_scanner {
+    const char *buffer;
+    size_t length;
+    /* Classes kept by the trim, CONFIGFILE_SCAN_TOKEN with or without CONFIGFILE_SCAN_REFERENCE. */
+    int token;
+    size_t block[2];
+    uint64_t masks[2][4];
+} configfile_scanner;
+
+/*
+ * A file parsed by several threads. The buffer is split at line boundaries into chunks, each with its own builder,
+ * taken in turn by the workers. Every worker allocates from its own arena, whose blocks join the root's arena once
+ * all chunks are parsed.
+ */
+typedef struct _configfile_parallel {
+    const char *buffer;
+    size_t *bounds;
+    /* Lines before each chunk, counted by the workers before they parse. */
+    size_t *lines;
+    int counting;
+    configfile_builder *chunks;
+    size_t chunk_count;
+    atomic_size_t next_chunk;
+    atomic_int failed;
+    /* The allocator of the root, called with the lock held so user callbacks never run concurrently. */
+    configfile_locked_allocator allocator;
+} configfile_parallel;
+
+typedef struct _configfile_worker {
+    configfile_parallel *parallel;
+    configfile_arena arena;
+    pthread_t thread;
+} configfile_worker;
+
+struct _configfile_parser {
+    configfile_callback callback;
+    void *user_data;
+    /* Start of a line split across chunks. */
+    char *pending;
+    size_t pending_length;
+    size_t pending_size;
+    /* Lines parsed so far. */
+    size_t line;
+    /* CONFIGFILE_* flags of the load, zero for the public parsers. */
+    unsigned int flags;
+    /* Set once the callback stopped the parse. */
+    int stopped;
+};
 
 //#ifdef DISABLE_PRINT_MACROS
 //#define PRINTF_WARNING(FORMAT, ...) ;
@@ -42,44 +125,145 @@
 //#define PRINTF_ERRNO_WARNING() if (errno) PRINTF_WARNING("(%d): %s\n", errno, strerror(errno))
 //#endif
 
-/**
- * Rearranges the string and removes trailing whitespace.
- * @param string String to be modified.
- * @return If successful, it returns the number of bytes in the string, if not, it returns zero.
- */
-size_t configfile_trim_and_move(char *string) {
-    size_t string_length, left_size, right_size;
+static void *configfile_default_allocate(size_t size, void *user_data) {
+    (void) user_data;
+    return malloc(size);
+}
 
-    if (string == NULL) {
-        return 0;
+static void configfile_default_release(void *pointer, size_t size, void *user_data) {
+    (void) size;
+    (void) user_data;
+    free(pointer);
+}
+
+void *configfile_arena_alloc(configfile_arena *arena, size_t size, size_t align) {
+    configfile_arena_block *block = arena->blocks;
+    size_t offset, block_size;
+
+    CONFIGFILE_STATS_ADD(arena_allocations, 1);
+
+    if (block != NULL) {
+        offset = (block->used + align - 1) & ~(align - 1);
+        if (offset + size <= block->size) {
+            block->used = offset + size;
+            return (char *) block + offset;
+        }
     }
 
-    string_length = strlen(string);
+    /* Blocks grow geometrically so large files still end up in a handful of them. */
+    block_size = arena->block_size;
+    if (block != NULL && block->size < CONFIGFILE_ARENA_BLOCK_MAX) {
+        block_size = block->size * 2;
+    } else if (block != NULL) {
+        block_size = block->size;
+    }
 
-    if (string_length == 0) {
-        return 0;
+    offset = (sizeof (configfile_arena_block) + CONFIGFILE_ARENA_ALIGN - 1) & ~((size_t) CONFIGFILE_ARENA_ALIGN - 1);
+    if (block_size < offset + size) {
+        block_size = offset + size;
     }
 
-    left_size = 0;
-    right_size = 0;
+    block = arena->allocator.allocate(block_size, arena->allocator.user_data);
+    if (block == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    CONFIGFILE_STATS_ADD(allocations, 1);
+    CONFIGFILE_STATS_ADD(allocated_bytes, block_size);
 
-    for (left_size = 0; !isalnum(string[left_size]) && left_size < string_length; left_size++);
-    if (left_size == string_length) {
-        return 0;
+    block->next = arena->blocks;
+    block->size = block_size;
+    block->used = offset + size;
+    arena->blocks = block;
+
+    return (char *) block + offset;
+}
+
+void configfile_arena_kill(configfile_arena *arena) {
+    configfile_allocator allocator = arena->allocator;
+    configfile_arena_block *block = arena->blocks, *next;
+
+    while (block != NULL) {
+        next = block->next;
+        allocator.release(block, block->size, allocator.user_data);
+        block = next;
+    }
+}
+
+void configfile_arena_splice(configfile_arena *arena, configfile_arena *other) {
+    configfile_arena_block *block;
+
+    if (other->blocks == NULL) {
+        return;
     }
 
-    for (right_size = 0; !isalnum(string[string_length - (right_size + 1)]) && right_size < string_length; right_size++);
+    for (block = other->blocks; block->next != NULL; block = block->next);
+    block->next = arena->blocks->next;
+    arena->blocks->next = other->blocks;
+    other->blocks = NULL;
+}
+
+static void *configfile_locked_allocate(size_t size, void *user_data) {
+    configfile_locked_allocator *locked = user_data;
+    void *pointer;
 
-    string_length = string_length - left_size - right_size;
+    pthread_mutex_lock(&locked->lock);
+    pointer = locked->allocator.allocate(size, locked->allocator.user_data);
+    pthread_mutex_unlock(&locked->lock);
+
+    return pointer;
+}
+
+static void configfile_locked_release(void *pointer, size_t size, void *user_data) {
+    configfile_locked_allocator *locked = user_data;
+
+    pthread_mutex_lock(&locked->lock);
+    locked->allocator.release(pointer, size, locked->allocator.user_data);
+    pthread_mutex_unlock(&locked->lock);
+}
+
+void configfile_locked_init(configfile_locked_allocator *locked, const configfile_allocator *allocator) {
+    locked->allocator = *allocator;
+    pthread_mutex_init(&locked->lock, NULL);
+}
+
+void configfile_locked_arena(configfile_arena *arena, configfile_locked_allocator *locked, size_t block_size) {
+    memset(arena, 0, sizeof (configfile_arena));
+    arena->allocator.allocate = configfile_locked_allocate;
+    arena->allocator.release = configfile_locked_release;
+    arena->allocator.user_data = locked;
+    arena->block_size = block_size;
+}
 
-    if (left_size > 0) {
-        memmove(string, &string[left_size], string_length);
-        memset(&string[string_length + 1], ' ', left_size - 1);
+configfile_root *configfile_root_new(const configfile_options *options) {
+    configfile_arena arena;
+    configfile_root *root;
+
+    memset(&arena, 0, sizeof (arena));
+    arena.allocator.allocate = configfile_default_allocate;
+    arena.allocator.release = configfile_default_release;
+    arena.block_size = CONFIGFILE_ARENA_BLOCK_SIZE;
+
+    if (options != NULL && options->allocator != NULL) {
+        arena.allocator = *options->allocator;
+    }
+    if (options != NULL && options->arena_block_size > 0) {
+        arena.block_size = options->arena_block_size;
     }
 
-    string[string_length] = '\0';
+    root = configfile_arena_alloc(&arena, sizeof (configfile_root), CONFIGFILE_ARENA_ALIGN);
+    if (root == NULL) {
+        return NULL;
+    }
+
+    memset(root, 0, sizeof (configfile_root));
+    root->arena = arena;
+    root->flags = options != NULL ? options->flags : 0;
+#ifdef CONFIGFILE_STATS
+    pthread_mutex_init(&root->stats.hot_lock, NULL);
+#endif
 
-    return string_length;
+    return root;
 }
 
 /**
@@ -111,28 +295,348 @@ configfile *configfile_new(char *module_name, char *module_value) {
     allocated_configfile->module_value = module_value;
     allocated_configfile->module_value_length = value_length;
     allocated_configfile->next = NULL;
+    allocated_configfile->module_hash = configfile_hash(module_name, name_length);
+    allocated_configfile->root = NULL;
+    allocated_configfile->module_cache = 0;
+    allocated_configfile->module_cache_state = 0;
+    allocated_configfile->module_line = 0;
+    allocated_configfile->module_file = NULL;
+    allocated_configfile->module_expansion = NULL;
 
     return allocated_configfile;
 }
 
+uint64_t configfile_hash(const char *string, size_t length) {
+    return configfile_hash_update(CONFIGFILE_FNV_OFFSET, string, length);
+}
+
+/*
+ * One range of the hash index, filled by one thread.
+ */
+typedef struct _configfile_index_shard {
+    configfile_root *root;
+    configfile *const *layers;
+    size_t layer_count;
+    size_t shard;
+    size_t entries;
+    /* Set if the range filled up before the list was done, the index is then built again by one thread. */
+    int overflow;
+    pthread_t thread;
+} configfile_index_shard;
+
+/**
+ * Inserts the modules whose first probe falls in a range of the index, walking the whole list so the first module
+ * of each name is the one kept, as with one thread. Layers are walked from the last one, so a name found in a
+ * later layer hides the same name in earlier ones.
+ * @param argument Range to fill.
+ * @return Returns NULL.
+ */
+static void *configfile_index_fill(void *argument) {
+    configfile_index_shard *shard = argument;
+    configfile_root *root = shard->root;
+    size_t position, shift, layer;
+    configfile *next, *end;
+
+    shift = __builtin_popcountll(root->slots_shard_mask);
+    shard->entries = 0;
+
+    for (layer = shard->layer_count; layer-- > 0 && !shard->overflow;) {
+        end = layer + 1 < shard->layer_count ? shard->layers[layer + 1] : NULL;
+        for (next = shard->layers[layer]; next != end; next = next->next) {
+            position = next->module_hash & root->slots_mask;
+            if (position >> shift != shard->shard) {
+                continue;
+            }
+
+            while (root->slots[position].entry != NULL) {
+                configfile *stored = root->slots[position].entry;
+
+                if (root->slots[position].hash == next->module_hash && stored->module_name_length == next->module_name_length &&
+                        memcmp(stored->module_name, next->module_name, next->module_name_length) == 0) {
+                    break;
+                }
+                position = configfile_index_next(root, position);
+            }
+
+            if (root->slots[position].entry == NULL) {
+                /* One slot of the range always stays empty so probes end. Only skewed hashes get here. */
+                if (shard->entries == root->slots_shard_mask) {
+                    shard->overflow = 1;
+                    break;
+                }
+                root->slots[position].hash = next->module_hash;
+                root->slots[position].entry = next;
+                shard->entries++;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+int configfile_index_build(configfile *config_struct, configfile *const *layers, size_t layer_count, unsigned int threads) {
+    configfile_index_shard single, *shards;
+    size_t entries, capacity, count, started, i;
+    configfile_root *root;
+    configfile *next;
+    int overflow;
+
+    if (config_struct == NULL) {
+        return -1;
+    }
+
+    if (layers == NULL) {
+        layers = &config_struct;
+        layer_count = 1;
+    }
+
+    entries = 0;
+    for (next = config_struct; next != NULL; next = next->next) {
+        entries++;
+    }
+
+    /* Keep the load factor at or below one half so probe sequences stay short. */
+    for (capacity = 16; capacity < entries * 2; capacity <<= 1);
+
+    root = config_struct->root;
+    if (root == NULL) {
+        return -1;
+    }
+
+    root->slots = configfile_arena_alloc(&root->arena, capacity * sizeof (configfile_slot), CONFIGFILE_ARENA_ALIGN);
+    if (root->slots == NULL) {
+        return -1;
+    }
+    memset(root->slots, 0, capacity * sizeof (configfile_slot));
+
+    /* A power of two ranges, each large enough that the end of a range is rarely reached by a probe. */
+    for (count = 1; count * 2 <= threads && capacity / (count * 2) >= CONFIGFILE_INDEX_SHARD_MIN; count *= 2);
+
+    root->slots_mask = capacity - 1;
+    root->slots_shard_mask = capacity / count - 1;
+    root->entries = 0;
+    root->modules = entries;
+
+    shards = count > 1 ? calloc(count, sizeof (configfile_index_shard)) : NULL;
+    if (shards == NULL) {
+        count = 1;
+        root->slots_shard_mask = root->slots_mask;
+        shards = &single;
+    }
+
+    memset(shards, 0, count * sizeof (configfile_index_shard));
+    for (i = 0; i < count; i++) {
+        shards[i].root = root;
+        shards[i].layers = layers;
+        shards[i].layer_count = layer_count;
+        shards[i].shard = i;
+    }
+    overflow = 0;
+
+    /* Ranges whose thread cannot be started are filled by the calling thread. */
+    for (started = 1; started < count; started++) {
+        if (pthread_create(&shards[started].thread, NULL, configfile_index_fill, &shards[started]) != 0) {
+            break;
+        }
+    }
+    configfile_index_fill(&shards[0]);
+    for (i = started; i < count; i++) {
+        configfile_index_fill(&shards[i]);
+    }
+    for (i = 0; i < count; i++) {
+        if (i > 0 && i < started) {
+            pthread_join(shards[i].thread, NULL);
+        }
+        root->entries += shards[i].entries;
+        overflow |= shards[i].overflow;
+    }
+
+    if (shards != &single) {
+        free(shards);
+    }
+
+    if (overflow) {
+        memset(root->slots, 0, capacity * sizeof (configfile_slot));
+        root->slots_shard_mask = root->slots_mask;
+        memset(&single, 0, sizeof (single));
+        single.root = root;
+        single.layers = layers;
+        single.layer_count = layer_count;
+        configfile_index_fill(&single);
+        root->entries = single.entries;
+    }
+
+    return 0;
+}
+
+void configfile_root_discard(configfile_root *root) {
+    configfile_mapping *mapping;
+
+    if (root->mapping != NULL) {
+        munmap(root->mapping, root->mapping_length);
+    }
+    for (mapping = root->mappings; mapping != NULL; mapping = mapping->next) {
+        munmap(mapping->address, mapping->length);
+    }
+    configfile_interpolate_release(root);
+    configfile_edits_release(root);
+
+    configfile_arena_kill(&root->arena);
+}
+
+int configfile_root_kill(configfile *config_struct) {
+    if (config_struct == NULL || config_struct->root == NULL) {
+        return 0;
+    }
+
+    configfile_root_discard(config_struct->root);
+    return 1;
+}
+
+configfile *configfile_index_find(const configfile_root *root, const char *module_name, size_t module_name_length, uint64_t hash) {
+    size_t position = hash & root->slots_mask;
+    const configfile_slot *slot;
+
+    for (slot = &root->slots[position]; slot->entry != NULL; slot = &root->slots[position]) {
+        if (slot->hash == hash && slot->entry->module_name_length == module_name_length &&
+                memcmp(slot->entry->module_name, module_name, module_name_length) == 0) {
+            return slot->entry;
+        }
+        position = configfile_index_next(root, position);
+    }
+
+    return NULL;
+}
+
+/**
+ * Moves the entries of the hash index to a new table probed as a single range.
+ * @param root Index to move.
+ * @param capacity Number of slots of the new table, a power of two larger than twice the number of entries.
+ * @return Returns zero on success, on failure returns -1 and the index is unchanged. errno is set to ENOMEM.
+ */
+static int configfile_index_resize(configfile_root *root, size_t capacity) {
+    configfile_slot *slots;
+    size_t position, i;
+
+    slots = configfile_arena_alloc(&root->arena, capacity * sizeof (configfile_slot), CONFIGFILE_ARENA_ALIGN);
+    if (slots == NULL) {
+        return -1;
+    }
+    memset(slots, 0, capacity * sizeof (configfile_slot));
+
+    /* The old table stays in the arena until the list is killed, tables only grow by doubling. */
+    for (i = 0; i <= root->slots_mask; i++) {
+        if (root->slots[i].entry == NULL) {
+            continue;
+        }
+        for (position = root->slots[i].hash & (capacity - 1); slots[position].entry != NULL; position = (position + 1) & (capacity - 1));
+        slots[position] = root->slots[i];
+    }
+
+    root->slots = slots;
+    root->slots_mask = capacity - 1;
+    root->slots_shard_mask = capacity - 1;
+
+    return 0;
+}
+
+int configfile_index_insert(configfile_root *root, configfile *module) {
+    size_t position, capacity;
+    configfile_slot *slot;
+
+    position = module->module_hash & root->slots_mask;
+    for (slot = &root->slots[position]; slot->entry != NULL; slot = &root->slots[position]) {
+        if (slot->hash == module->module_hash && slot->entry->module_name_length == module->module_name_length &&
+                memcmp(slot->entry->module_name, module->module_name, module->module_name_length) == 0) {
+            slot->entry = module;
+            return 0;
+        }
+        position = configfile_index_next(root, position);
+    }
+
+    /* Ranges filled by separate threads may be full, a new name goes to a table probed as a single range. */
+    capacity = root->slots_mask + 1;
+    if ((root->entries + 1) * 2 > capacity || root->slots_shard_mask != root->slots_mask) {
+        while ((root->entries + 1) * 2 > capacity) {
+            capacity <<= 1;
+        }
+        if (configfile_index_resize(root, capacity) != 0) {
+            return -1;
+        }
+        for (position = module->module_hash & root->slots_mask; root->slots[position].entry != NULL;
+                position = (position + 1) & root->slots_mask);
+    }
+
+    root->slots[position].hash = module->module_hash;
+    root->slots[position].entry = module;
+    root->entries++;
+
+    return 0;
+}
+
+void configfile_index_remove(configfile_root *root, configfile *module) {
+    size_t hole, position, home;
+
+    position = module->module_hash & root->slots_mask;
+    while (root->slots[position].entry != NULL && root->slots[position].entry != module) {
+        position = configfile_index_next(root, position);
+    }
+    if (root->slots[position].entry == NULL) {
+        return;
+    }
+
+    /*
+     * Entries following the hole within its range move back into it unless their first probe lies between the
+     * hole and their slot, so every probe sequence still reaches its entry before an empty slot.
+     */
+    hole = position;
+    root->slots[hole].entry = NULL;
+    for (position = configfile_index_next(root, hole); root->slots[position].entry != NULL; position = configfile_index_next(root, position)) {
+        home = root->slots[position].hash & root->slots_mask;
+        if (((position - home) & root->slots_shard_mask) < ((position - hole) & root->slots_shard_mask)) {
+            continue;
+        }
+        root->slots[hole] = root->slots[position];
+        root->slots[position].entry = NULL;
+        hole = position;
+    }
+
+    root->entries--;
+}
+
 configfile *configfile_get(configfile *search_struct, const char *module_name) {
     size_t module_name_length;
-    configfile *next;
 
     if (module_name == NULL) {
         return NULL;
     }
 
-    next = search_struct;
     module_name_length = strlen(module_name);
 
-    while (next != NULL) {
-        if (next->module_name_length == module_name_length) {
-            if (strncmp(next->module_name, module_name, module_name_length) == 0) {
-                return next;
-            }
+    return configfile_get_hashed(search_struct, module_name, module_name_length, configfile_hash(module_name, module_name_length));
+}
+
+configfile *configfile_get_hashed(configfile *search_struct, const char *module_name, size_t module_name_length, uint64_t hash) {
+    configfile *next;
+
+    if (module_name == NULL) {
+        return NULL;
+    }
+
+#ifdef CONFIGFILE_STATS
+    if (search_struct != NULL && search_struct->root != NULL) {
+        return configfile_stats_find(search_struct, module_name, module_name_length, hash);
+    }
+#endif
+
+    if (search_struct != NULL && search_struct->root != NULL && search_struct->root->slots != NULL) {
+        return configfile_index_find(search_struct->root, module_name, module_name_length, hash);
+    }
+
+    for (next = search_struct; next != NULL; next = next->next) {
+        if (next->module_name_length == module_name_length && memcmp(next->module_name, module_name, module_name_length) == 0) {
+            return next;
         }
-        next = next->next;
     }
 
     return NULL;
@@ -141,6 +645,10 @@ configfile *configfile_get(configfile *search_struct, const char *module_name) {
 void configfile_kill(configfile *config_struct_to_kill) {
     configfile *next = config_struct_to_kill;
 
+    if (configfile_root_kill(config_struct_to_kill)) {
+        return;
+    }
+
     while (next != NULL) {
         config_struct_to_kill = next;
         next = next->next;
@@ -159,125 +667,954 @@ void configfile_kill(configfile *config_struct_to_kill) {
 }
 
 /**
- * Executes and analyzes all lines of the file, removing white spaces both in the module and in the value.
- * @param open_file FILE pointer with an open file with read permissions.
- * @return Returns a structure containing modules and their values according to the configuration file defined in filename.
+ * Appends a module to a list under construction. The node comes from the root's arena.
+ * @param builder List to append to.
+ * @param module_name Name, must be terminated at module_name_length unless copy is set.
+ * @param module_name_length Number of bytes in module_name.
+ * @param module_value Value, must be terminated at module_value_length unless copy is set.
+ * @param module_value_length Number of bytes in module_value.
+ * @param line Line of the module, recorded with the file of the builder.
+ * @param copy If set, name and value are copied into the arena, otherwise the node points to them.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOMEM.
  */
-configfile *configfile_run(FILE *open_file) {
-    char *line_contents, *delimiter;
-    char *module_name, *module_value;
-    size_t n, line_number, line_length, module_name_length, module_value_length;
-    configfile *configfile_struct_return, *new_configfile, **configfile_struct_next;
-    int errno_backup;
+static int configfile_builder_append(configfile_builder *builder, char *module_name, size_t module_name_length,
+        char *module_value, size_t module_value_length, size_t line, int copy) {
+    configfile_arena *arena = builder->arena;
+    configfile *node;
+    char *strings;
 
-    if (open_file == NULL) {
-        return NULL;
+    if (copy) {
+        /* Name and value share one allocation, the same layout the line buffer had. */
+        strings = configfile_arena_alloc(arena, module_name_length + module_value_length + 2, 1);
+        if (strings == NULL) {
+            return -1;
+        }
+        memcpy(strings, module_name, module_name_length);
+        strings[module_name_length] = '\0';
+        memcpy(&strings[module_name_length + 1], module_value, module_value_length);
+        strings[module_name_length + module_value_length + 1] = '\0';
+        module_name = strings;
+        module_value = &strings[module_name_length + 1];
     }
 
-    line_contents = NULL;
-    n = 0;
-    line_number = 0;
-    configfile_struct_return = NULL;
+    node = configfile_arena_alloc(arena, sizeof (configfile), CONFIGFILE_ARENA_ALIGN);
+    if (node == NULL) {
+        return -1;
+    }
 
-    errno_backup = errno;
-    errno = 0;
+    node->module_name = module_name;
+    node->module_name_length = module_name_length;
+    node->module_value = module_value;
+    node->module_value_length = module_value_length;
+    node->module_hash = configfile_hash(module_name, module_name_length);
+    node->root = NULL;
+    node->next = NULL;
+    node->module_cache = 0;
+    node->module_cache_state = 0;
+    node->module_line = line;
+    node->module_file = builder->file;
+    node->module_expansion = NULL;
 
-    while (getline(&line_contents, &n, open_file) > 0 && !errno) {
-        line_length = strlen(line_contents);
-        line_number++;
+    if (builder->head == NULL) {
+        builder->head = node;
+    } else {
+        *builder->next = node;
+    }
+    builder->next = &node->next;
 
-        module_name = line_contents;
-        delimiter = strchr(module_name, '=');
+    return 0;
+}
 
-repeat_delimiter:
-        if (delimiter != NULL) {
-            delimiter[0] = '\0';
-            module_name_length = configfile_trim_and_move(module_name);
+/*
+ * Class of every byte for the scalar scanner. Tokens are the ASCII letters and digits, the bytes kept when a name
+ * or a value is trimmed, along with the sign or the dot of a number, so the result does not depend on the locale.
+ * Loads resolving references keep '$', '{' and '}' too, so "${name}" survives the trim.
+ */
+static const unsigned char configfile_scan_classes[256] = {
+    ['\n'] = CONFIGFILE_SCAN_NEWLINE,
+    ['='] = CONFIGFILE_SCAN_DELIMITER,
+    ['0' ... '9'] = CONFIGFILE_SCAN_TOKEN,
+    ['A' ... 'Z'] = CONFIGFILE_SCAN_TOKEN,
+    ['a' ... 'z'] = CONFIGFILE_SCAN_TOKEN,
+    ['$'] = CONFIGFILE_SCAN_REFERENCE,
+    ['{'] = CONFIGFILE_SCAN_REFERENCE,
+    ['}'] = CONFIGFILE_SCAN_REFERENCE,
+};
 
-            if (!module_name_length) {
-                delimiter = NULL;
-                goto repeat_delimiter;
-            }
+static void configfile_scan_bytes(const char *block, size_t size, uint64_t masks[4]) {
+    unsigned char byte_class;
+    size_t i;
 
-            delimiter[0] = ' ';
-            module_value = &module_name[module_name_length + 1];
-            module_value_length = configfile_trim_and_move(module_value);
+    masks[0] = masks[1] = masks[2] = masks[3] = 0;
+    for (i = 0; i < size; i++) {
+        byte_class = configfile_scan_classes[(unsigned char) block[i]];
+        masks[0] |= (uint64_t) (byte_class & CONFIGFILE_SCAN_NEWLINE) << i;
+        masks[1] |= (uint64_t) ((byte_class & CONFIGFILE_SCAN_DELIMITER) >> 1) << i;
+        masks[2] |= (uint64_t) ((byte_class & CONFIGFILE_SCAN_TOKEN) >> 2) << i;
+        masks[3] |= (uint64_t) ((byte_class & CONFIGFILE_SCAN_REFERENCE) >> 3) << i;
+    }
+}
 
-            if (!module_value_length) {
-                delimiter = NULL;
-                goto repeat_delimiter;
-            }
+#ifndef CONFIGFILE_SCAN_X86
+static void configfile_scan_block_scalar(const char *block, uint64_t masks[4]) {
+    configfile_scan_bytes(block, CONFIGFILE_SCAN_BLOCK, masks);
+}
+#else
+static void configfile_scan_block_sse2(const char *block, uint64_t masks[4]) {
+    const __m128i newline = _mm_set1_epi8('\n'), delimiter = _mm_set1_epi8('=');
+    const __m128i digit = _mm_set1_epi8('0'), letter = _mm_set1_epi8('a'), lower = _mm_set1_epi8(0x20);
+    const __m128i digits = _mm_set1_epi8(9), letters = _mm_set1_epi8(25);
+    const __m128i dollar = _mm_set1_epi8('$'), opening = _mm_set1_epi8('{'), closing = _mm_set1_epi8('}');
+    __m128i bytes, offset, token, reference;
+    int i;
+
+    masks[0] = masks[1] = masks[2] = masks[3] = 0;
+    for (i = 0; i < CONFIGFILE_SCAN_BLOCK; i += 16) {
+        bytes = _mm_loadu_si128((const __m128i *) &block[i]);
+
+        /* x - lo is at most hi - lo, unsigned, exactly for the bytes in [lo, hi]. */
+        offset = _mm_sub_epi8(bytes, digit);
+        token = _mm_cmpeq_epi8(_mm_min_epu8(offset, digits), offset);
+        offset = _mm_sub_epi8(_mm_or_si128(bytes, lower), letter);
+        token = _mm_or_si128(token, _mm_cmpeq_epi8(_mm_min_epu8(offset, letters), offset));
+        reference = _mm_or_si128(_mm_cmpeq_epi8(bytes, dollar), _mm_or_si128(_mm_cmpeq_epi8(bytes, opening),
+                _mm_cmpeq_epi8(bytes, closing)));
+
+        masks[0] |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)) << i;
+        masks[1] |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, delimiter)) << i;
+        masks[2] |= (uint64_t) (uint16_t) _mm_movemask_epi8(token) << i;
+        masks[3] |= (uint64_t) (uint16_t) _mm_movemask_epi8(reference) << i;
+    }
+}
+
+__attribute__((target("avx2")))
+static void configfile_scan_block_avx2(const char *block, uint64_t masks[4]) {
+    const __m256i newline = _mm256_set1_epi8('\n'), delimiter = _mm256_set1_epi8('=');
+    const __m256i digit = _mm256_set1_epi8('0'), letter = _mm256_set1_epi8('a'), lower = _mm256_set1_epi8(0x20);
+    const __m256i digits = _mm256_set1_epi8(9), letters = _mm256_set1_epi8(25);
+    const __m256i dollar = _mm256_set1_epi8('$'), opening = _mm256_set1_epi8('{'), closing = _mm256_set1_epi8('}');
+    __m256i bytes, offset, token, reference;
+    int i;
+
+    masks[0] = masks[1] = masks[2] = masks[3] = 0;
+    for (i = 0; i < CONFIGFILE_SCAN_BLOCK; i += 32) {
+        bytes = _mm256_loadu_si256((const __m256i *) &block[i]);
+
+        offset = _mm256_sub_epi8(bytes, digit);
+        token = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, digits), offset);
+        offset = _mm256_sub_epi8(_mm256_or_si256(bytes, lower), letter);
+        token = _mm256_or_si256(token, _mm256_cmpeq_epi8(_mm256_min_epu8(offset, letters), offset));
+        reference = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, dollar), _mm256_or_si256(_mm256_cmpeq_epi8(bytes, opening),
+                _mm256_cmpeq_epi8(bytes, closing)));
+
+        masks[0] |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline)) << i;
+        masks[1] |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, delimiter)) << i;
+        masks[2] |= (uint64_t) (uint32_t) _mm256_movemask_epi8(token) << i;
+        masks[3] |= (uint64_t) (uint32_t) _mm256_movemask_epi8(reference) << i;
+    }
+}
+#endif
+
+static void configfile_scan_block_detect(const char *block, uint64_t masks[4]);
+
+/*
+ * Selected on first use, AVX2 when the processor has it, SSE2 on any other x86 and the scalar loop elsewhere.
+ * Threads parsing the first file may select it concurrently, so it is only accessed atomically.
+ */
+static void (*configfile_scan_block)(const char *block, uint64_t masks[4]) = configfile_scan_block_detect;
+
+static void configfile_scan_block_detect(const char *block, uint64_t masks[4]) {
+#ifdef CONFIGFILE_SCAN_X86
+    if (__builtin_cpu_supports("avx2")) {
+        __atomic_store_n(&configfile_scan_block, configfile_scan_block_avx2, __ATOMIC_RELAXED);
+    } else {
+        __atomic_store_n(&configfile_scan_block, configfile_scan_block_sse2, __ATOMIC_RELAXED);
+    }
+#else
+    __atomic_store_n(&configfile_scan_block, configfile_scan_block_scalar, __ATOMIC_RELAXED);
+#endif
+    __atomic_load_n(&configfile_scan_block, __ATOMIC_RELAXED)(block, masks);
+}
+
+static void configfile_scanner_init(configfile_scanner *scanner, const char *buffer, size_t length, unsigned int flags) {
+    scanner->buffer = buffer;
+    scanner->length = length;
+    scanner->token = (flags & CONFIGFILE_INTERPOLATE) ? CONFIGFILE_SCAN_TOKEN | CONFIGFILE_SCAN_REFERENCE : CONFIGFILE_SCAN_TOKEN;
+    scanner->block[0] = SIZE_MAX;
+    scanner->block[1] = SIZE_MAX;
+}
+
+/**
+ * Returns the bytes of the requested classes in a block, scanning it if it is not cached.
+ * @param scanner Scanner over the buffer.
+ * @param block Index of the block, must start inside the buffer.
+ * @param classes Bitwise OR of CONFIGFILE_SCAN_* classes.
+ * @return Returns a mask with bit i set if byte i of the block belongs to one of the classes.
+ */
+static inline uint64_t configfile_scanner_mask(configfile_scanner *scanner, size_t block, int classes) {
+    uint64_t *masks = scanner->masks[block & 1];
+    size_t offset = block * CONFIGFILE_SCAN_BLOCK;
+
+    if (scanner->block[block & 1] != block) {
+        CONFIGFILE_STATS_START(start);
+        if (offset + CONFIGFILE_SCAN_BLOCK <= scanner->length) {
+            __atomic_load_n(&configfile_scan_block, __ATOMIC_RELAXED)(&scanner->buffer[offset], masks);
+        } else {
+            /* The last block is partial, bits past the end of the buffer stay clear. */
+            configfile_scan_bytes(&scanner->buffer[offset], scanner->length - offset, masks);
+        }
+        scanner->block[block & 1] = block;
+        CONFIGFILE_STATS_STOP(scan_ns, start);
+    }
+
+    return ((classes & CONFIGFILE_SCAN_NEWLINE) ? masks[0] : 0) | ((classes & CONFIGFILE_SCAN_DELIMITER) ? masks[1] : 0) |
+            ((classes & CONFIGFILE_SCAN_TOKEN) ? masks[2] : 0) | ((classes & CONFIGFILE_SCAN_REFERENCE) ? masks[3] : 0);
+}
+
+/**
+ * Finds the first byte of the given classes at or after a position.
+ * @return Returns its position, or the length of the buffer if there is none.
+ */
+static inline size_t configfile_scanner_next(configfile_scanner *scanner, size_t from, int classes) {
+    size_t block = from / CONFIGFILE_SCAN_BLOCK;
+    uint64_t mask;
+
+    if (from >= scanner->length) {
+        return scanner->length;
+    }
+
+    mask = configfile_scanner_mask(scanner, block, classes) & (~0ULL << (from % CONFIGFILE_SCAN_BLOCK));
+    while (mask == 0) {
+        block++;
+        if (block * CONFIGFILE_SCAN_BLOCK >= scanner->length) {
+            return scanner->length;
+        }
+        mask = configfile_scanner_mask(scanner, block, classes);
+    }
+
+    return block * CONFIGFILE_SCAN_BLOCK + __builtin_ctzll(mask);
+}
+
+/**
+ * Finds the end of the trimmed region [start, end), one past its last token byte.
+ * @return Returns that position, or start if the region holds no token.
+ */
+static inline size_t configfile_scanner_trim_end(configfile_scanner *scanner, size_t start, size_t end) {
+    size_t block, position;
+    uint64_t mask;
+
+    if (end <= start) {
+        return start;
+    }
+
+    position = end - 1;
+    block = position / CONFIGFILE_SCAN_BLOCK;
+    mask = configfile_scanner_mask(scanner, block, scanner->token) & (~0ULL >> (63 - position % CONFIGFILE_SCAN_BLOCK));
+
+    while (mask == 0) {
+        if (block * CONFIGFILE_SCAN_BLOCK <= start) {
+            return start;
+        }
+        block--;
+        mask = configfile_scanner_mask(scanner, block, scanner->token);
+    }
 
-            if ((module_name_length + module_value_length + 2) != line_length) {
-                line_contents = realloc(line_contents, module_name_length + module_value_length + 2);
-                module_name = line_contents;
-                module_value = &module_name[module_name_length + 1];
+    position = block * CONFIGFILE_SCAN_BLOCK + 63 - __builtin_clzll(mask);
+    return position >= start ? position + 1 : start;
+}
+
+int configfile_parse_lines(const char *buffer, size_t length, size_t *line, unsigned int flags, configfile_callback callback,
+        configfile_directive_callback directive, void *user_data) {
+    size_t position, name, name_end, delimiter, value, value_end;
+    configfile_scanner scanner;
+
+    configfile_scanner_init(&scanner, buffer, length, flags);
+    CONFIGFILE_STATS_ADD(bytes, length);
+#ifdef CONFIGFILE_STATS
+    size_t first_line = *line;
+#endif
+
+    /* Every iteration consumes one line, position ends on its newline. */
+    for (position = 0; position < length; position++) {
+        (*line)++;
+
+        /* Every query below moves forward, except the trims which step back from a position just found. */
+        name = configfile_scanner_next(&scanner, position, CONFIGFILE_SCAN_NEWLINE | CONFIGFILE_SCAN_DELIMITER | scanner.token);
+        if (name == length || buffer[name] == '\n') {
+            position = name;
+            continue;
+        }
+
+        if (buffer[name] == '=') {
+            position = configfile_scanner_next(&scanner, name, CONFIGFILE_SCAN_NEWLINE);
+            continue;
+        }
+
+        delimiter = configfile_scanner_next(&scanner, name, CONFIGFILE_SCAN_NEWLINE | CONFIGFILE_SCAN_DELIMITER);
+        if (delimiter == length || buffer[delimiter] == '\n') {
+            if (directive != NULL && directive(&buffer[name], delimiter - name, *line, user_data) != 0) {
+                CONFIGFILE_STATS_ADD(lines, *line - first_line);
+                return 1;
             }
+            position = delimiter;
+            continue;
+        }
+        CONFIGFILE_STATS_START(trim);
+        name_end = configfile_scanner_trim_end(&scanner, name, delimiter);
+        CONFIGFILE_STATS_STOP(trim_ns, trim);
+
+        value = configfile_scanner_next(&scanner, delimiter + 1, CONFIGFILE_SCAN_NEWLINE | scanner.token);
+        if (value == length || buffer[value] == '\n') {
+            position = value;
+            continue;
+        }
+
+        /*
+         * A sign or a dot before the first digit belongs to the number, "-5" and ".5" must not read as "5". Anything
+         * else in front of them is kept too, "--5" and "(-5" must not read as a number either.
+         */
+        if (buffer[value] >= '0' && buffer[value] <= '9' && value > delimiter + 1 &&
+                (buffer[value - 1] == '.' || buffer[value - 1] == '-' || buffer[value - 1] == '+')) {
+            for (value = delimiter + 1; buffer[value] == ' ' || buffer[value] == '\t'; value++);
+        }
+
+        position = configfile_scanner_next(&scanner, value, CONFIGFILE_SCAN_NEWLINE);
+        CONFIGFILE_STATS_START(trim_value);
+        value_end = configfile_scanner_trim_end(&scanner, value, position);
+        CONFIGFILE_STATS_STOP(trim_ns, trim_value);
+
+        if (callback(&buffer[name], name_end - name, &buffer[value], value_end - value, *line, user_data) != 0) {
+            CONFIGFILE_STATS_ADD(lines, *line - first_line);
+            return 1;
+        }
+    }
+
+    CONFIGFILE_STATS_ADD(lines, *line - first_line);
+    return 0;
+}
+
+int configfile_parse_buffer(const char *buffer, size_t length, configfile_callback callback, void *user_data) {
+    size_t line = 0;
+
+    if ((buffer == NULL && length > 0) || callback == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return configfile_parse_lines(buffer, length, &line, 0, callback, NULL, user_data);
+}
+
+static void configfile_parser_init(configfile_parser *parser, unsigned int flags, configfile_callback callback, void *user_data) {
+    memset(parser, 0, sizeof (configfile_parser));
+    parser->callback = callback;
+    parser->user_data = user_data;
+    parser->flags = flags;
+}
+
+configfile_parser *configfile_parser_new(configfile_callback callback, void *user_data) {
+    configfile_parser *parser;
+
+    if (callback == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    parser = malloc(sizeof (configfile_parser));
+    if (parser == NULL) {
+        return NULL;
+    }
+    configfile_parser_init(parser, 0, callback, user_data);
+
+    return parser;
+}
+
+/**
+ * Appends bytes to the pending line of a parser, growing it if needed.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOMEM.
+ */
+static int configfile_parser_keep(configfile_parser *parser, const char *bytes, size_t length) {
+    size_t size;
+    char *grown;
+
+    if (length == 0) {
+        return 0;
+    }
+
+    if (parser->pending_length + length > parser->pending_size) {
+        for (size = parser->pending_size > 0 ? parser->pending_size : 256; size < parser->pending_length + length; size *= 2);
+        grown = realloc(parser->pending, size);
+        if (grown == NULL) {
+            return -1;
+        }
+        parser->pending = grown;
+        parser->pending_size = size;
+    }
+
+    memcpy(&parser->pending[parser->pending_length], bytes, length);
+    parser->pending_length += length;
+
+    return 0;
+}
+
+int configfile_parser_feed(configfile_parser *parser, const char *chunk, size_t length) {
+    const char *newline;
+    size_t complete;
+
+    if (parser == NULL || (chunk == NULL && length > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (parser->stopped) {
+        return 1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    /* The line split by the previous chunk is completed and parsed on its own. */
+    if (parser->pending_length > 0) {
+        newline = memchr(chunk, '\n', length);
+        if (newline == NULL) {
+            return configfile_parser_keep(parser, chunk, length);
+        }
+
+        if (configfile_parser_keep(parser, chunk, newline + 1 - chunk) != 0) {
+            return -1;
+        }
+        length -= newline + 1 - chunk;
+        chunk = newline + 1;
 
-            new_configfile = configfile_new(module_name, module_value);
+        parser->stopped = configfile_parse_lines(parser->pending, parser->pending_length, &parser->line, parser->flags, parser->callback, NULL, parser->user_data);
+        parser->pending_length = 0;
+        if (parser->stopped) {
+            return 1;
+        }
+    }
+
+    /* Complete lines are parsed where they are, only the trailing partial line is copied. */
+    for (complete = length; complete > 0 && chunk[complete - 1] != '\n'; complete--);
+
+    if (complete > 0) {
+        parser->stopped = configfile_parse_lines(chunk, complete, &parser->line, parser->flags, parser->callback, NULL, parser->user_data);
+        if (parser->stopped) {
+            return 1;
+        }
+    }
+
+    return configfile_parser_keep(parser, &chunk[complete], length - complete);
+}
+
+int configfile_parser_finish(configfile_parser *parser) {
+    int result;
+
+    if (parser == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (parser->stopped) {
+        return 1;
+    }
+
+    result = configfile_parse_lines(parser->pending, parser->pending_length, &parser->line, parser->flags, parser->callback, NULL, parser->user_data);
+    parser->pending_length = 0;
+    parser->stopped = result;
+
+    return result;
+}
 
-            if (new_configfile == NULL) {
-                delimiter = NULL;
-                goto repeat_delimiter;
+void configfile_parser_kill(configfile_parser *parser) {
+    if (parser == NULL) {
+        return;
+    }
+
+    free(parser->pending);
+    free(parser);
+}
+
+/**
+ * Same as configfile_parse_fd() for a load with the given CONFIGFILE_* flags.
+ */
+static int configfile_parse_fd_flags(int fd, unsigned int flags, configfile_callback callback, void *user_data) {
+    configfile_parser parser;
+    ssize_t count;
+    char *chunk;
+    int result;
+
+    if (fd < 0 || callback == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    chunk = malloc(CONFIGFILE_READ_SIZE);
+    if (chunk == NULL) {
+        return -1;
+    }
+
+    configfile_parser_init(&parser, flags, callback, user_data);
+    result = 0;
+
+    while (result == 0) {
+        CONFIGFILE_STATS_START(start);
+        count = read(fd, chunk, CONFIGFILE_READ_SIZE);
+        CONFIGFILE_STATS_STOP(io_ns, start);
+        if (count == 0) {
+            break;
+        }
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            result = -1;
+            break;
+        }
+        result = configfile_parser_feed(&parser, chunk, count);
+    }
+
+    if (result == 0) {
+        result = configfile_parser_finish(&parser);
+    }
+
+    free(parser.pending);
+    free(chunk);
+    return result;
+}
+
+int configfile_parse_fd(int fd, configfile_callback callback, void *user_data) {
+    return configfile_parse_fd_flags(fd, 0, callback, user_data);
+}
+
+int configfile_builder_callback(const char *module_name, size_t module_name_length, const char *module_value,
+        size_t module_value_length, size_t line, void *user_data) {
+    configfile_builder *builder = user_data;
+    CONFIGFILE_STATS_START(start);
 
-            if (configfile_struct_return == NULL) {
-                configfile_struct_return = new_configfile;
+    if (!builder->copy) {
+        ((char *) module_name)[module_name_length] = '\0';
+        ((char *) module_value)[module_value_length] = '\0';
+    }
+
+    if (configfile_builder_append(builder, (char *) module_name, module_name_length, (char *) module_value, module_value_length,
+            line, builder->copy) != 0) {
+        builder->error = errno;
+        return 1;
+    }
+
+    CONFIGFILE_STATS_STOP(build_ns, start);
+    return 0;
+}
+
+/**
+ * Counts the newlines of a buffer with the scanner.
+ */
+static size_t configfile_count_lines(const char *buffer, size_t length) {
+    configfile_scanner scanner;
+    size_t block, count;
+
+    configfile_scanner_init(&scanner, buffer, length, 0);
+
+    count = 0;
+    for (block = 0; block * CONFIGFILE_SCAN_BLOCK < length; block++) {
+        count += __builtin_popcountll(configfile_scanner_mask(&scanner, block, CONFIGFILE_SCAN_NEWLINE));
+    }
+
+    return count;
+}
+
+/**
+ * Counts the lines of chunks or parses them, until none is left or one fails.
+ * @param argument Worker.
+ * @return Returns NULL.
+ */
+static void *configfile_parallel_work(void *argument) {
+    configfile_worker *worker = argument;
+    configfile_parallel *parallel = worker->parallel;
+    configfile_builder *builder;
+    size_t chunk, line, length;
+    const char *start;
+
+    CONFIGFILE_STATS_BIND(parallel->chunks[0].root);
+
+    while (!atomic_load_explicit(&parallel->failed, memory_order_relaxed)) {
+        chunk = atomic_fetch_add_explicit(&parallel->next_chunk, 1, memory_order_relaxed);
+        if (chunk >= parallel->chunk_count) {
+            break;
+        }
+
+        start = &parallel->buffer[parallel->bounds[chunk]];
+        length = parallel->bounds[chunk + 1] - parallel->bounds[chunk];
+        if (parallel->counting) {
+            parallel->lines[chunk + 1] = configfile_count_lines(start, length);
+            continue;
+        }
+
+        builder = &parallel->chunks[chunk];
+        builder->arena = &worker->arena;
+        line = parallel->lines[chunk];
+        if (configfile_parse_lines(start, length, &line, builder->root->flags, configfile_builder_callback, NULL, builder) != 0) {
+            atomic_store_explicit(&parallel->failed, 1, memory_order_relaxed);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Runs the workers over every chunk, the calling thread as the first one. Threads that cannot be started leave
+ * their share to the others.
+ */
+static void configfile_parallel_run(configfile_parallel *parallel, configfile_worker *workers, unsigned int threads) {
+    unsigned int started, i;
+
+    atomic_store(&parallel->next_chunk, 0);
+
+    for (started = 1; started < threads; started++) {
+        if (pthread_create(&workers[started].thread, NULL, configfile_parallel_work, &workers[started]) != 0) {
+            break;
+        }
+    }
+    configfile_parallel_work(&workers[0]);
+    for (i = 1; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+}
+
+/**
+ * Parses a buffer with several threads and appends its modules to a builder in file order, so the list is the one
+ * the serial parse builds. Names and values are copied or terminated in place, as set in the builder.
+ * @param buffer Whole contents of the file, writable past its end unless the builder copies.
+ * @param length Number of bytes in buffer.
+ * @param builder List to append to, its arena receives the blocks of the workers.
+ * @param threads Number of threads, the calling one included.
+ * @return Returns zero on success, on failure returns -1 and errno is set.
+ */
+static int configfile_parse_parallel(char *buffer, size_t length, configfile_builder *builder, unsigned int threads) {
+    configfile_parallel parallel;
+    configfile_worker *workers;
+    const char *newline;
+    size_t chunk, target;
+    unsigned int i;
+    int result;
+
+    parallel.chunk_count = (size_t) threads * CONFIGFILE_PARALLEL_SPLIT;
+    if (parallel.chunk_count > length / CONFIGFILE_PARALLEL_CHUNK) {
+        parallel.chunk_count = length / CONFIGFILE_PARALLEL_CHUNK + 1;
+    }
+
+    parallel.bounds = malloc((parallel.chunk_count + 1) * sizeof (size_t));
+    parallel.lines = malloc((parallel.chunk_count + 1) * sizeof (size_t));
+    parallel.chunks = calloc(parallel.chunk_count, sizeof (configfile_builder));
+    workers = calloc(threads, sizeof (configfile_worker));
+    if (parallel.bounds == NULL || parallel.lines == NULL || parallel.chunks == NULL || workers == NULL) {
+        free(parallel.bounds);
+        free(parallel.lines);
+        free(parallel.chunks);
+        free(workers);
+        return -1;
+    }
+
+    /* Chunks end just past a newline, so every line belongs to exactly one of them. */
+    parallel.bounds[0] = 0;
+    for (chunk = 1; chunk < parallel.chunk_count; chunk++) {
+        target = length / parallel.chunk_count * chunk;
+        if (target < parallel.bounds[chunk - 1]) {
+            target = parallel.bounds[chunk - 1];
+        }
+        newline = memchr(&buffer[target], '\n', length - target);
+        parallel.bounds[chunk] = newline != NULL ? (size_t) (newline - buffer) + 1 : length;
+    }
+    parallel.bounds[parallel.chunk_count] = length;
+
+    for (chunk = 0; chunk < parallel.chunk_count; chunk++) {
+        parallel.chunks[chunk].root = builder->root;
+        parallel.chunks[chunk].next = &parallel.chunks[chunk].head;
+        parallel.chunks[chunk].copy = builder->copy;
+        parallel.chunks[chunk].file = builder->file;
+    }
+
+    parallel.buffer = buffer;
+    configfile_locked_init(&parallel.allocator, &builder->arena->allocator);
+    atomic_init(&parallel.next_chunk, 0);
+    atomic_init(&parallel.failed, 0);
+
+    for (i = 0; i < threads; i++) {
+        workers[i].parallel = &parallel;
+        configfile_locked_arena(&workers[i].arena, &parallel.allocator, builder->arena->block_size);
+    }
+
+    /* Lines are counted first so every chunk knows the number of its first line. */
+    parallel.counting = 1;
+    parallel.lines[0] = 0;
+    configfile_parallel_run(&parallel, workers, threads);
+    for (chunk = 1; chunk <= parallel.chunk_count; chunk++) {
+        parallel.lines[chunk] += parallel.lines[chunk - 1];
+    }
+
+    parallel.counting = 0;
+    configfile_parallel_run(&parallel, workers, threads);
+
+    result = 0;
+    for (chunk = 0; chunk < parallel.chunk_count; chunk++) {
+        if (parallel.chunks[chunk].error != 0) {
+            errno = parallel.chunks[chunk].error;
+            result = -1;
+        }
+    }
+
+    if (result == 0) {
+        for (chunk = 0; chunk < parallel.chunk_count; chunk++) {
+            if (parallel.chunks[chunk].head == NULL) {
+                continue;
+            }
+            if (builder->head == NULL) {
+                builder->head = parallel.chunks[chunk].head;
             } else {
-                *configfile_struct_next = new_configfile;
+                *builder->next = parallel.chunks[chunk].head;
             }
+            builder->next = parallel.chunks[chunk].next;
+        }
+    }
 
-            configfile_struct_next = &new_configfile->next;
+    for (i = 0; i < threads; i++) {
+        if (result != 0) {
+            configfile_arena_kill(&workers[i].arena);
         } else {
-            free(line_contents);
+            configfile_arena_splice(builder->arena, &workers[i].arena);
         }
+    }
 
+    pthread_mutex_destroy(&parallel.allocator.lock);
+    free(parallel.bounds);
+    free(parallel.lines);
+    free(parallel.chunks);
+    free(workers);
 
-        line_contents = NULL;
-        n = 0;
+    return result;
+}
+
+char *configfile_map(int fd, size_t *length, size_t *mapping_length) {
+    struct stat file_stat;
+    size_t page_size;
+    char *mapping;
+    int errno_backup;
+    CONFIGFILE_STATS_START(start);
+
+    if (fstat(fd, &file_stat) != 0) {
+        return NULL;
     }
 
-    module_name = NULL;
-    module_value = NULL;
+    page_size = sysconf(_SC_PAGESIZE);
+    *length = file_stat.st_size;
+    *mapping_length = ((size_t) file_stat.st_size + page_size) & ~(page_size - 1);
 
-    if (errno) {
-        goto error_00;
+    mapping = mmap(NULL, *mapping_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return NULL;
     }
 
-    if (line_contents != NULL) {
-        free(line_contents);
-        line_contents = NULL;
+    if (*length > 0 && mmap(mapping, *length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        errno_backup = errno;
+        munmap(mapping, *mapping_length);
+        errno = errno_backup;
+        return NULL;
     }
 
-    errno = errno_backup;
-    return configfile_struct_return;
+    madvise(mapping, *length, MADV_SEQUENTIAL);
+    CONFIGFILE_STATS_STOP(io_ns, start);
 
-error_00:
-    configfile_kill(configfile_struct_return);
+    return mapping;
+}
+
+unsigned int configfile_threads(const configfile_options *options) {
+    unsigned int threads;
+    long processors;
 
-    if (line_contents != NULL) {
-        free(line_contents);
-        line_contents = NULL;
+    /* More threads than processors only add chunks and walks of the list. */
+    threads = options != NULL ? options->threads : 0;
+    processors = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > 1 && processors > 0 && threads > (unsigned long) processors) {
+        threads = processors;
     }
-    return NULL;
+
+    return threads > 0 ? threads : 1;
 }
 
-configfile *configfile_init(const char *filename) {
-    FILE *open_file;
-    configfile *return_config_struct;
+int configfile_root_finish(configfile_root *root, configfile *head, configfile *const *layers, size_t layer_count,
+        const configfile_options *options, unsigned int threads) {
+    int indexed;
+
+    head->root = root;
+
+    /* Without an index configfile_get() falls back to walking the list, so a failure here is not fatal. */
+    CONFIGFILE_STATS_START(start);
+    indexed = configfile_index_build(head, layers, layer_count, threads) == 0;
+    CONFIGFILE_STATS_STOP(index_ns, start);
+    CONFIGFILE_STATS_ADD(entries, root->modules);
+    CONFIGFILE_STATS_ADD(unique_entries, root->entries);
 
-    if (filename == NULL)
+    if (indexed && (options == NULL || !(options->flags & CONFIGFILE_NO_SECTIONS))) {
+        CONFIGFILE_STATS_START(sections);
+        configfile_sections_build(head);
+        CONFIGFILE_STATS_STOP(sections_ns, sections);
+    }
+
+    /* References are resolved through the index, and converted values are expanded ones. */
+    if (options != NULL && (options->flags & CONFIGFILE_INTERPOLATE) && configfile_interpolate_build(head) != 0) {
+        return -1;
+    }
+
+    if (options != NULL && (options->flags & CONFIGFILE_CONVERT)) {
+        configfile_convert_all(head);
+    }
+
+    return 0;
+}
+
+configfile *configfile_init_ex(const char *filename, const configfile_options *options) {
+    configfile_builder builder;
+    struct stat file_stat;
+    size_t length, line, mapping_length;
+    unsigned int threads;
+    int fd, result, errno_backup, errno_parse;
+    char *mapping, *file;
+
+    if (filename == NULL) {
         return NULL;
+    }
+
+    if (options != NULL && (options->flags & CONFIGFILE_INCLUDE)) {
+        return configfile_init_layers(&filename, 1, options);
+    }
 
-    open_file = fopen(filename, "r");
-    if (open_file == NULL) {
+    errno_backup = errno;
+
+    builder.root = configfile_root_new(options);
+    if (builder.root == NULL) {
         return NULL;
     }
+    CONFIGFILE_STATS_BIND(builder.root);
+    CONFIGFILE_STATS_START(start);
+    builder.arena = &builder.root->arena;
+    builder.head = NULL;
+    builder.next = &builder.head;
+    builder.error = 0;
+    builder.file = NULL;
+    result = -1;
+    length = 0;
 
-    return_config_struct = configfile_run(open_file);
+    threads = configfile_threads(options);
 
-    fclose(open_file);
-    open_file = NULL;
+    file = configfile_arena_alloc(builder.arena, strlen(filename) + 1, 1);
+    if (file == NULL) {
+        goto error_00;
+    }
+    strcpy(file, filename);
+    builder.file = file;
+
+    fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        goto error_00;
+    }
+    /* Recorded for configfile_save(), which refuses to overwrite a file that changed since. */
+    if (fstat(fd, &builder.root->file_stat) == 0) {
+        builder.root->file = file;
+    }
+
+    if (options != NULL && (options->flags & CONFIGFILE_EXTENDED)) {
+        /* The tokenizer writes values back into the file, it is mapped privately and only kept with CONFIGFILE_MMAP. */
+        mapping = configfile_map(fd, &length, &mapping_length);
+        close(fd);
+        if (mapping == NULL) {
+            goto error_00;
+        }
 
-    return return_config_struct;
-}
\ No newline at end of file
+        builder.copy = !(options->flags & CONFIGFILE_MMAP);
+        line = 0;
+        result = configfile_tokenize(mapping, length, &line, configfile_builder_callback, NULL, &builder);
+
+        if (builder.copy) {
+            errno_parse = errno;
+            munmap(mapping, mapping_length);
+            errno = errno_parse;
+        } else {
+            builder.root->mapping = mapping;
+            builder.root->mapping_length = mapping_length;
+        }
+    } else if (options != NULL && (options->flags & CONFIGFILE_MMAP)) {
+        builder.root->mapping = configfile_map(fd, &length, &builder.root->mapping_length);
+        close(fd);
+        if (builder.root->mapping == NULL) {
+            goto error_00;
+        }
+
+        /* The mapping is writable and one byte longer than the file, so modules are terminated in place. */
+        builder.copy = 0;
+        if (threads > 1 && length >= CONFIGFILE_PARALLEL_MIN) {
+            result = configfile_parse_parallel(builder.root->mapping, length, &builder, threads);
+        } else {
+            line = 0;
+            result = configfile_parse_lines(builder.root->mapping, length, &line, builder.root->flags, configfile_builder_callback, NULL, &builder);
+        }
+    } else if (threads > 1 && fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size >= CONFIGFILE_PARALLEL_MIN) {
+        /* Threads need the whole file at once, it is mapped for the parse only and modules are copied out of it. */
+        mapping = configfile_map(fd, &length, &mapping_length);
+        close(fd);
+        if (mapping == NULL) {
+            goto error_00;
+        }
+
+        builder.copy = 1;
+        result = configfile_parse_parallel(mapping, length, &builder, threads);
+
+        errno_parse = errno;
+        munmap(mapping, mapping_length);
+        errno = errno_parse;
+    } else {
+        builder.copy = 1;
+        result = configfile_parse_fd_flags(fd, builder.root->flags, configfile_builder_callback, &builder);
+
+        close(fd);
+    }
+
+    /* Only a failed append stops the parse. */
+    if (result == 1) {
+        errno = builder.error;
+        result = -1;
+    }
+
+    if (result != 0 || builder.head == NULL) {
+        goto error_00;
+    }
+
+    result = configfile_root_finish(builder.root, builder.head, NULL, 0, options, threads);
+    if (result != 0) {
+        goto error_00;
+    }
+    CONFIGFILE_STATS_STOP(load_ns, start);
+    CONFIGFILE_STATS_UNBIND();
+
+    errno = errno_backup;
+    return builder.head;
+
+error_00:
+    /* A file without modules is not an error, errno is left as it was. */
+    if (result != 0) {
+        errno_backup = errno;
+    }
+    CONFIGFILE_STATS_UNBIND();
+    configfile_root_discard(builder.root);
+    errno = errno_backup;
+    return NULL;
+}
+
+configfile *configfile_init(const char *filename) {
+    return configfile_init_ex(filename, NULL);
+}
+
+configfile *configfile_init_mmap(const char *filename) {
+    configfile_options options;
+
+    memset(&options, 0, sizeof (options));
+    options.flags = CONFIGFILE_MMAP;
+
+    return configfile_init_ex(filename, &options);
+}
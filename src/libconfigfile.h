@@ -25,7 +25,43 @@
 #ifndef LIBCONFIGFILE_H
 #define LIBCONFIGFILE_H
 
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct _configfile configfile;
+typedef struct _configfile_root configfile_root;
+typedef struct _configfile_allocator configfile_allocator;
+typedef struct _configfile_options configfile_options;
+typedef struct _configfile_reloader configfile_reloader;
+typedef struct _configfile_reader configfile_reader;
+typedef struct _configfile_snapshot configfile_snapshot;
+typedef struct _configfile_view configfile_view;
+typedef struct _configfile_section configfile_section;
+typedef struct _configfile_keys configfile_keys;
+typedef struct _configfile_parser configfile_parser;
+typedef struct _configfile_stats configfile_stats;
+typedef struct _configfile_frozen configfile_frozen;
+typedef struct _configfile_table configfile_table;
+typedef struct _configfile_iterator configfile_iterator;
+typedef struct _configfile_expansion configfile_expansion;
+typedef struct _configfile_shared configfile_shared;
+typedef struct _configfile_lazy configfile_lazy;
+typedef struct _configfile_field configfile_field;
+
+/**
+ * Called by the streaming parsers for every module, in file order. Name and value are slices of the parsed input,
+ * trimmed like the modules of configfile_init() and not terminated, valid only during the call.
+ * @param line Line of the module, starting at 1.
+ * @param user_data Pointer given to the parser.
+ * @return Returns zero to continue, anything else stops the parse.
+ */
+typedef int (*configfile_callback)(const char *module_name, size_t module_name_length, const char *module_value,
+        size_t module_value_length, size_t line, void *user_data);
 
 struct _configfile {
     char *module_name;
@@ -33,8 +69,174 @@ struct _configfile {
     size_t module_name_length;
     size_t module_value_length;
     configfile *next;
+    /** FNV-1a hash of module_name, cached so lookups never rehash stored keys. */
+    uint64_t module_hash;
+    /** Lookup index shared by the whole list, only set on the head returned by configfile_init(). */
+    configfile_root *root;
+    /** Value converted by the typed getters, see configfile_value_int64(). Owned by the library. */
+    uint64_t module_cache;
+    /** Type and status of module_cache, only accessed atomically by the library. */
+    uint32_t module_cache_state;
+    /** Line the module was read from, starting at 1, or zero for modules not read from a file. */
+    uint32_t module_line;
+    /** Path of the file the module was read from as it was opened, owned by the list. NULL if not read from a file. */
+    const char *module_file;
+    /** References of module_value and their memoized expansion, see configfile_value_expand(). NULL if none. */
+    configfile_expansion *module_expansion;
+};
+
+/**
+ * Result of the typed getters. errno is not used by them.
+ */
+typedef enum _configfile_status {
+    /** The value was converted. */
+    CONFIGFILE_OK = 0,
+    /** No module has that name. */
+    CONFIGFILE_NOT_FOUND,
+    /** The value is not written as the requested type. */
+    CONFIGFILE_INVALID,
+    /** The value is written as the requested type but does not fit in it. */
+    CONFIGFILE_RANGE
+} configfile_status;
+
+/**
+ * Kind of difference reported by configfile_diff().
+ */
+typedef enum _configfile_change {
+    /** The name is only in the new list. */
+    CONFIGFILE_ADDED = 0,
+    /** The name is only in the old list. */
+    CONFIGFILE_REMOVED,
+    /** The name is in both lists with different values. */
+    CONFIGFILE_MODIFIED
+} configfile_change;
+
+/**
+ * Called by configfile_diff() and on reload for every name that changed.
+ * @param change Kind of change.
+ * @param old_module Module of the old list, NULL if added.
+ * @param new_module Module of the new list, NULL if removed.
+ * @param user_data Pointer given with the callback.
+ * @return Returns zero to continue, anything else stops configfile_diff(). Ignored on reload.
+ */
+typedef int (*configfile_diff_callback)(configfile_change change, configfile *old_module, configfile *new_module, void *user_data);
+
+/**
+ * A module read from a structure that is not a list, such as a snapshot. Strings are terminated and belong to
+ * the structure they were read from.
+ */
+struct _configfile_view {
+    const char *module_name;
+    const char *module_value;
+    size_t module_name_length;
+    size_t module_value_length;
+};
+
+/**
+ * Position in a list or a table, see configfile_iterator_next(). Set up by configfile_iterate() or
+ * configfile_table_iterate(), its members are not meant to be used directly.
+ */
+struct _configfile_iterator {
+    configfile *module;
+    const configfile_table *table;
+    size_t index;
+};
+
+/**
+ * Handle of an interned module name, see configfile_keys_intern(). Copied by value, a zeroed handle is never valid.
+ */
+typedef struct _configfile_key {
+    /** Slot of the name in its registry, also its index in the tables of bound lists. */
+    uint32_t slot;
+    /** Changes when the name is released, so handles obtained before do not resolve anymore. */
+    uint32_t generation;
+} configfile_key;
+
+/**
+ * Memory callbacks used for the arena holding a parsed list. Only large blocks are requested, the nodes and
+ * strings of the list are carved out of them and every block is released at once by configfile_kill().
+ */
+struct _configfile_allocator {
+    /** Returns at least size bytes aligned for any type, or NULL on failure. */
+    void *(*allocate)(size_t size, void *user_data);
+    /** Releases a block returned by allocate, size is the size it was requested with. */
+    void (*release)(void *pointer, size_t size, void *user_data);
+    /** Passed unchanged to both callbacks. */
+    void *user_data;
 };
 
+/** Map the file with mmap(2) and point names and values into the mapping instead of copying them. */
+#define CONFIGFILE_MMAP 0x1
+/** Skip the section tree, configfile_section_find() then finds nothing. For files whose sections are never queried. */
+#define CONFIGFILE_NO_SECTIONS 0x2
+/**
+ * Convert every value at load time to the type it looks like, so the first read as that type is as cheap as the
+ * next. A module caches one type: the first read as another type replaces the guess, reads as the guessed type then
+ * convert the string each time.
+ */
+#define CONFIGFILE_CONVERT 0x4
+/** Follow include directives, see configfile_init_layers(). */
+#define CONFIGFILE_INCLUDE 0x8
+/**
+ * Resolve references in values, "${name}" to the value of another module and "${ENV:NAME}" to an environment
+ * variable, see configfile_value_expand(). The load fails if a reference names no module or references loop.
+ * Names and values then keep '$', '{' and '}' when trimmed, other loads trim them away like any byte other than a
+ * letter or a digit. Chains of references may be as long as the file.
+ */
+#define CONFIGFILE_INTERPOLATE 0x10
+/**
+ * Read the extended syntax: lines starting with '#' or ';' are comments, names and values are trimmed of blanks
+ * only, and a value is either quoted or runs up to a '#' or ';' following a blank. Double quoted values take the
+ * escapes \n, \t, \r and a backslash before any other byte, single quoted ones are taken as written, and
+ * either may be empty. An unquoted value ending in a backslash continues on the next line. Lines with an
+ * unterminated quote or text after the closing one are skipped. A line without a delimiter, such as an include
+ * directive, ends at a '#' or ';' following a blank like a value. Files are parsed on one thread.
+ */
+#define CONFIGFILE_EXTENDED 0x20
+
+/**
+ * Options for configfile_init_ex(). Zero-initialized options give the behavior of configfile_init().
+ */
+struct _configfile_options {
+    /** Callbacks for the arena, NULL uses malloc(3) and free(3). The structure is copied. */
+    const configfile_allocator *allocator;
+    /** Size of the first arena block, zero uses 64 KiB. Following blocks double up to 4 MiB. */
+    size_t arena_block_size;
+    /** Bitwise OR of CONFIGFILE_* flags. */
+    unsigned int flags;
+    /**
+     * Threads parsing the file, the calling one included. Zero or one parses on the calling thread. Files of at
+     * least 1 MiB are split at line boundaries and the parts are joined in file order, so the list, and which of
+     * repeated names configfile_get() finds, is the same as with one thread. The hash index is filled by the same
+     * threads. Capped at the number of online processors. The allocator callbacks are still called one at a time.
+     */
+    unsigned int threads;
+};
+
+#define CONFIGFILE_HASH_STEP_(literal, i, hash) \
+    (((hash) ^ ((i) < sizeof (literal) - 1 ? (uint64_t) (unsigned char) (literal)[(i) < sizeof (literal) ? (i) : 0] : 0)) * \
+    ((i) < sizeof (literal) - 1 ? 0x100000001b3ULL : 1))
+#define CONFIGFILE_HASH_8_(literal, i, hash) \
+    CONFIGFILE_HASH_STEP_(literal, (i) + 7, CONFIGFILE_HASH_STEP_(literal, (i) + 6, CONFIGFILE_HASH_STEP_(literal, (i) + 5, \
+    CONFIGFILE_HASH_STEP_(literal, (i) + 4, CONFIGFILE_HASH_STEP_(literal, (i) + 3, CONFIGFILE_HASH_STEP_(literal, (i) + 2, \
+    CONFIGFILE_HASH_STEP_(literal, (i) + 1, CONFIGFILE_HASH_STEP_(literal, (i), hash))))))))
+#define CONFIGFILE_HASH_64_(literal, hash) \
+    CONFIGFILE_HASH_8_(literal, 56, CONFIGFILE_HASH_8_(literal, 48, CONFIGFILE_HASH_8_(literal, 40, CONFIGFILE_HASH_8_(literal, 32, \
+    CONFIGFILE_HASH_8_(literal, 24, CONFIGFILE_HASH_8_(literal, 16, CONFIGFILE_HASH_8_(literal, 8, CONFIGFILE_HASH_8_(literal, 0, hash))))))))
+
+/**
+ * configfile_hash() of a string literal, folded into a constant by the compiler for literals of up to 64 bytes.
+ * Longer literals are hashed at run time.
+ */
+#define CONFIGFILE_HASH_LITERAL(literal) \
+    (sizeof (literal) - 1 > 64 ? configfile_hash((literal), sizeof (literal) - 1) : CONFIGFILE_HASH_64_(literal, 0xcbf29ce484222325ULL))
+
+/**
+ * configfile_get() for a string literal, whose hash is computed at compile time.
+ */
+#define CONFIGFILE_GET_LITERAL(search_struct, literal) \
+    configfile_get_hashed((search_struct), (literal), sizeof (literal) - 1, CONFIGFILE_HASH_LITERAL(literal))
+
 /**
  * Function to initialize and run configuration file analysis.
  * @param filename String containing the name of the configuration file to perform the structure analysis and assembly.
@@ -42,8 +244,100 @@ struct _configfile {
  */
 configfile *configfile_init(const char *filename);
 
+/**
+ * Same as configfile_init() with explicit options. Every node and string of the result is allocated from an arena
+ * owned by its head, so loading performs a handful of allocations and configfile_kill() releases a handful of
+ * blocks regardless of the number of modules.
+ * @param filename String containing the name of the configuration file to perform the structure analysis and assembly.
+ * @param options Allocator and flags to use, may be NULL.
+ * @return Returns a structure containing modules and their values according to the configuration file defined in filename.
+ */
+configfile *configfile_init_ex(const char *filename, const configfile_options *options);
+
+/**
+ * Same as configfile_init(), but the file is mapped with mmap(2) instead of being read line by line. Names and
+ * values point into a private mapping of the file instead of being copied. Pages holding modules are copied on
+ * write when their terminators are stored, the file itself is never modified.
+ * The result is used exactly like the one of configfile_init() and must be freed with configfile_kill() on its
+ * head, which unmaps the file. Equivalent to configfile_init_ex() with the CONFIGFILE_MMAP flag.
+ * @param filename String containing the name of the configuration file to perform the structure analysis and assembly.
+ * @return Returns a structure containing modules and their values according to the configuration file defined in filename.
+ */
+configfile *configfile_init_mmap(const char *filename);
+
+/**
+ * Loads several files as layers of one list, such as a main file followed by a conf.d directory. A path naming a
+ * directory stands for the regular files in it whose names end in ".conf" and do not start with a dot, in strcmp(3)
+ * order. A line "include <path>" without a delimiter loads another file or directory right after the one holding
+ * it, relative paths being resolved against the directory of that file. Include paths cannot contain '='.
+ * Files are parsed concurrently by options->threads threads. Their lists are joined in layer order: each file,
+ * then the files it includes in the order of their directives. configfile_get() finds the module of the last layer
+ * defining a name, and within one file its first occurrence, as configfile_init() does. Every module records its
+ * file and line, see module_file and module_line.
+ * configfile_init_ex() with the CONFIGFILE_INCLUDE flag is this function with one path.
+ * @param paths Files and directories, in increasing order of precedence.
+ * @param count Number of paths.
+ * @param options Allocator, flags and threads to use, may be NULL. CONFIGFILE_MMAP keeps every file mapped.
+ * @return Returns the joined list, freed with configfile_kill() on its head. Returns NULL if no file holds a module,
+ * or on failure with errno set, to ELOOP if a file includes itself through its own includes.
+ */
+configfile *configfile_init_layers(const char *const *paths, size_t count, const configfile_options *options);
+
+/**
+ * Parses a buffer in memory and calls callback for every module, without allocating or modifying the buffer.
+ * configfile_init() is this parser appending to a list.
+ * @param buffer Contents of a configuration file, need not be terminated.
+ * @param length Number of bytes in buffer.
+ * @param callback Called for every module.
+ * @param user_data Passed unchanged to callback.
+ * @return Returns zero once the whole buffer is parsed, 1 if the callback stopped the parse, or -1 with errno set
+ * to EINVAL if an argument is NULL.
+ */
+int configfile_parse_buffer(const char *buffer, size_t length, configfile_callback callback, void *user_data);
+
+/**
+ * Same as configfile_parse_buffer() for everything read from a file descriptor until end of file, such as a pipe.
+ * Reading stops as soon as the callback stops the parse. Lines are parsed in the read buffer, only a line split
+ * between two reads is copied.
+ * @param fd File descriptor open for reading, not closed.
+ * @return Returns zero at end of file, 1 if the callback stopped the parse, or -1 with errno set by read(2) or malloc(3).
+ */
+int configfile_parse_fd(int fd, configfile_callback callback, void *user_data);
+
+/**
+ * Creates a parser fed with chunks of any size, for input that arrives piece by piece.
+ * @param callback Called for every module.
+ * @param user_data Passed unchanged to callback.
+ * @return Returns the parser or NULL on failure, errno is set according to malloc(3).
+ */
+configfile_parser *configfile_parser_new(configfile_callback callback, void *user_data);
+
+/**
+ * Parses every line completed by a chunk. The chunk is not kept, the trailing bytes of a line it leaves unfinished
+ * are copied until the chunk finishing it arrives.
+ * @param parser Parser.
+ * @param chunk Next bytes of the input.
+ * @param length Number of bytes in chunk.
+ * @return Returns zero, 1 if the callback stopped the parse, now or during an earlier call, or -1 with errno set
+ * to ENOMEM.
+ */
+int configfile_parser_feed(configfile_parser *parser, const char *chunk, size_t length);
+
+/**
+ * Parses the last line of the input when it has no newline. Called once after the last chunk.
+ * @return Returns zero, or 1 if the callback stopped the parse.
+ */
+int configfile_parser_finish(configfile_parser *parser);
+
+/**
+ * Frees a parser. Modules of a line left unfinished without configfile_parser_finish() are never reported.
+ */
+void configfile_parser_kill(configfile_parser *parser);
+
 /**
  * Searches for a module defined by module_name and returns a structure for the module found, if not, returns NULL.
+ * When search_struct is the head returned by configfile_init() the search uses the hash index, otherwise the list
+ * is walked from search_struct onwards. In both cases the first module with a matching name is returned.
  * @param search_struct Structure where the search will be performed.
  * @param module_name String to search for.
  * @return Returns a pointer to the found structure or NULL if not found.
@@ -51,9 +345,845 @@ configfile *configfile_init(const char *filename);
 configfile *configfile_get(configfile *search_struct, const char *module_name);
 
 /**
- * Frees any and all memory allocated in the configfile type structure.
+ * Returns the value of a module with its references expanded, for lists loaded with CONFIGFILE_INTERPOLATE. A
+ * reference is "${" followed by a module name or ENV: and a variable name, up to the next '}'. Modules are
+ * expanded the first time they are read and the result is kept, so following reads cost a load. Environment
+ * variables are read at that time, an unset one expands to nothing. The typed getters convert the expanded value.
+ * Safe to call from several threads on the same list.
+ * @param module Module to read.
+ * @param length Receives the length of the value, may be NULL.
+ * @return Returns the terminated value, module_value itself if it references nothing. Owned by the list. On
+ * failure returns NULL and errno is set to EINVAL if module is NULL, or ENOMEM.
+ */
+const char *configfile_value_expand(configfile *module, size_t *length);
+
+/**
+ * Converts the value of a module to a signed 64-bit integer: decimal, or hexadecimal with a 0x prefix, optionally
+ * signed. When the first digit of a value follows a sign or a dot the trim keeps the value from its first
+ * non-blank byte, so "-5" reads as -5 and "--5" is invalid. The first conversion of a module is cached in
+ * it, following reads of the same type are a single load, reads as other types convert the string each time.
+ * Safe to call from several threads on the same list, such as readers of a configfile_reloader.
+ * @param module Module to convert, may be NULL.
+ * @param value Receives the value on success, left unchanged otherwise.
+ * @return Returns CONFIGFILE_OK, CONFIGFILE_NOT_FOUND if module is NULL, CONFIGFILE_INVALID or CONFIGFILE_RANGE.
+ */
+configfile_status configfile_value_int64(configfile *module, int64_t *value);
+
+/**
+ * Same as configfile_value_int64() for a floating point value, as read by strtod(3).
+ */
+configfile_status configfile_value_double(configfile *module, double *value);
+
+/**
+ * Same as configfile_value_int64() for a boolean: true, yes, on and 1 give 1, false, no, off and 0 give 0. Case is
+ * ignored.
+ */
+configfile_status configfile_value_bool(configfile *module, int *value);
+
+/**
+ * Same as configfile_value_int64() for a duration, converted to nanoseconds. A number, possibly with a fraction, is
+ * followed by one of the units ns, us, ms, s, m (or min), h and d. A number without a unit is in seconds.
+ * Examples: "30s", "1.5h", "250ms".
+ */
+configfile_status configfile_value_duration(configfile *module, int64_t *nanoseconds);
+
+/**
+ * Same as configfile_value_int64() for a size, converted to bytes. A number, possibly with a fraction, is followed by
+ * one of the units B, K, M, G, T and P, each optionally followed by B or iB. All units are powers of 1024 and case is
+ * ignored. A number without a unit is in bytes. Examples: "512MB", "4k", "1.5GiB".
+ */
+configfile_status configfile_value_size(configfile *module, uint64_t *bytes);
+
+/**
+ * Searches for a module as configfile_get() does and converts its value as configfile_value_int64() does.
+ * @param search_struct Structure where the search will be performed.
+ * @param module_name String to search for.
+ * @param value Receives the value on success, left unchanged otherwise.
+ * @return Returns CONFIGFILE_OK, CONFIGFILE_NOT_FOUND, CONFIGFILE_INVALID or CONFIGFILE_RANGE.
+ */
+configfile_status configfile_get_int64(configfile *search_struct, const char *module_name, int64_t *value);
+
+/**
+ * Searches for a module as configfile_get() does and converts its value as configfile_value_double() does.
+ */
+configfile_status configfile_get_double(configfile *search_struct, const char *module_name, double *value);
+
+/**
+ * Searches for a module as configfile_get() does and converts its value as configfile_value_bool() does.
+ */
+configfile_status configfile_get_bool(configfile *search_struct, const char *module_name, int *value);
+
+/**
+ * Searches for a module as configfile_get() does and converts its value as configfile_value_duration() does.
+ */
+configfile_status configfile_get_duration(configfile *search_struct, const char *module_name, int64_t *nanoseconds);
+
+/**
+ * Searches for a module as configfile_get() does and converts its value as configfile_value_size() does.
+ */
+configfile_status configfile_get_size(configfile *search_struct, const char *module_name, uint64_t *bytes);
+
+/**
+ * Returns a short description of a status, such as "invalid value".
+ */
+const char *configfile_status_string(configfile_status status);
+
+/**
+ * Same as configfile_get() with a name that is not necessarily terminated and its hash already computed, typically
+ * by CONFIGFILE_HASH_LITERAL().
+ * @param search_struct Structure where the search will be performed.
+ * @param module_name Name to search for.
+ * @param module_name_length Number of bytes in module_name.
+ * @param hash configfile_hash() of module_name.
+ * @return Returns a pointer to the found structure or NULL if not found.
+ */
+configfile *configfile_get_hashed(configfile *search_struct, const char *module_name, size_t module_name_length, uint64_t hash);
+
+/**
+ * Creates an empty registry of interned module names. A registry outlives every list bound to it.
+ * @return Returns the registry or NULL on failure, errno is set according to malloc(3).
+ */
+configfile_keys *configfile_keys_new(void);
+
+/**
+ * Interns a module name, interning the same name again returns the same handle. Names are copied and kept until
+ * the registry is killed. Thread safe, meant for startup rather than for the lookup path.
+ * @param keys Registry to intern into.
+ * @param module_name Name to intern.
+ * @param key Receives the handle.
+ * @return Returns zero on success, on failure returns -1 and errno is set.
+ */
+int configfile_keys_intern(configfile_keys *keys, const char *module_name, configfile_key *key);
+
+/**
+ * Invalidates a handle. Lists bound after this call do not resolve it anymore, interning the name again returns a
+ * new handle in the same slot.
+ * @param keys Registry the handle comes from.
+ * @param key Handle to release.
+ */
+void configfile_keys_release(configfile_keys *keys, configfile_key key);
+
+/**
+ * Resolves every name of a registry in a list, so configfile_key_get() on the list is an array access. May be
+ * called again after more names are interned, the new table is published atomically so readers of the list may use
+ * it meanwhile. A list is bound to a single registry.
+ * @param config Head of a list returned by the configfile_init functions.
+ * @param keys Registry to bind.
+ * @return Returns zero on success, on failure returns -1 and errno is set. Handles still resolve without a table.
+ */
+int configfile_keys_bind(configfile *config, configfile_keys *keys);
+
+/**
+ * Frees a registry. Lists bound to it must be killed first.
+ * @param keys Registry to be freed from memory.
+ */
+void configfile_keys_kill(configfile_keys *keys);
+
+/**
+ * Searches a list for the module of a handle. For a list bound to the handle's registry this is an array access
+ * and a generation check, names interned after the last bind fall back to a hashed lookup.
+ * @param config Head of a list bound to the registry of key.
+ * @param key Handle returned by configfile_keys_intern() or configfile_reloader_key().
+ * @return Returns the first module with the interned name, or NULL if the list has none or the handle is stale.
+ */
+configfile *configfile_key_get(configfile *config, configfile_key key);
+
+/**
+ * Computes the hash used by the lookup index (64-bit FNV-1a).
+ * @param string Bytes to hash.
+ * @param length Number of bytes in string.
+ * @return Returns the hash of the first length bytes of string.
+ */
+uint64_t configfile_hash(const char *string, size_t length);
+
+/**
+ * Returns a section of a list: the modules sharing a name prefix, as a scoped view. Names are split into segments
+ * before each '.' and each '[', so "client[0].user" belongs to the sections "client" and "client[0]". The tree of
+ * sections is built when the list is loaded, finding one costs a single hash lookup whatever its depth.
+ * Sections belong to the list and are freed by configfile_kill().
+ * @param config Head of a list returned by the configfile_init functions.
+ * @param section_name Full name of the section, such as "server" or "client[0]". NULL or "" returns the root
+ * section, which holds every module.
+ * @return Returns the section or NULL if no module name starts with section_name.
+ */
+const configfile_section *configfile_section_find(configfile *config, const char *section_name);
+
+/**
+ * Same as configfile_section_find(), relative to a section: the hash of the section's name is reused and only
+ * section_name is hashed. A name starting with '[' is appended as is, any other name after a '.'.
+ * @param section Section to search in.
+ * @param section_name Name relative to section, such as "[0]" in "client" or "user" in "client[0]".
+ * @return Returns the section or NULL if not found.
+ */
+const configfile_section *configfile_section_child(const configfile_section *section, const char *section_name);
+
+/**
+ * Same as configfile_get() with a name relative to a section, joined as by configfile_section_child().
+ * @param section Section to search in.
+ * @param module_name Name relative to section, such as "port" in "server".
+ * @return Returns the first module with the full name or NULL if not found.
+ */
+configfile *configfile_section_get(const configfile_section *section, const char *module_name);
+
+/**
+ * Returns the last segment of the name of a section, such as "user", "[0]" or "" for the root section. The string
+ * is part of a module name and is not terminated.
+ * @param section Section to query.
+ * @param length Receives the number of bytes in the segment, may be NULL.
+ */
+const char *configfile_section_name(const configfile_section *section, size_t *length);
+
+/**
+ * Returns the first direct subsection of a section, subsections are kept in the order their names first appear
+ * in the file. Together with configfile_section_next() enumerates subsections in time proportional to their number.
+ * @return Returns the subsection or NULL if section has none.
+ */
+const configfile_section *configfile_section_first(const configfile_section *section);
+
+/**
+ * Returns the subsection following section in its parent, or NULL if it is the last one.
+ */
+const configfile_section *configfile_section_next(const configfile_section *section);
+
+/**
+ * Returns the length of the array formed by the subsections named "[n]" of a section: one more than the largest
+ * index, or zero if there is none. Indices without a module, such as [1] between [0] and [2], are gaps.
+ */
+size_t configfile_section_length(const configfile_section *section);
+
+/**
+ * Returns the subsection "[index]" of a section. Arrays are stored densely, so this is a single array access
+ * unless the indices are too sparse for it, in which case "[index]" is looked up by name. An index written with
+ * leading zeros, such as "[01]", is the same element as "[1]" and the first of them in the file is returned.
+ * @param section Section holding the array.
+ * @param index Index of the element.
+ * @return Returns the element or NULL for a gap or an index out of range.
+ */
+const configfile_section *configfile_section_at(const configfile_section *section, size_t index);
+
+/**
+ * Calls callback for every module of a section and of its subsections, depth first. The modules of a section come
+ * before its subsections, each in file order, and only the first module of each name is visited. Modules added by
+ * configfile_set() come after those read from the file. The cost is proportional to the size of the section, not
+ * of the file.
+ * @param section Section to walk.
+ * @param callback Function called with each module and user_data. Returning non-zero stops the walk.
+ * @param user_data Passed unchanged to callback.
+ * @return Returns zero after visiting every module, otherwise the value that stopped the walk.
+ */
+int configfile_section_foreach(const configfile_section *section, int (*callback)(configfile *module, void *user_data), void *user_data);
+
+/**
+ * Frees any and all memory allocated in the configfile type structure. For lists returned by the configfile_init
+ * functions this must be the head of the list, nodes are never freed individually.
  * @param config_struct_to_kill Structure to be freed from memory.
  */
 void configfile_kill(configfile *config_struct_to_kill);
 
+/**
+ * Loads a configuration file and keeps it up to date. A watcher thread is notified by inotify(7) of changes in the
+ * file's directory, or polls the file every interval milliseconds when inotify is not available, and parses the
+ * new version off the readers' path. Each version is a separate list published with an atomic pointer swap.
+ * Readers never lock: see configfile_reader_enter(). A version that fails to load is ignored and the previous one
+ * stays published.
+ * @param filename String containing the name of the configuration file.
+ * @param options Options for every load, may be NULL. The structure and its allocator are copied.
+ * @param interval Milliseconds between checks of the file, zero uses one second. With inotify this only bounds
+ * how late memory of old versions is freed.
+ * @return Returns the reloader or NULL on failure, errno is set. The file must load on the first attempt.
+ */
+configfile_reloader *configfile_reloader_new(const char *filename, const configfile_options *options, int interval);
+
+/**
+ * Parses and publishes the file now, whether it changed or not.
+ * @param reloader Reloader to update.
+ * @return Returns zero on success, on failure returns -1, errno is set and the current version stays published.
+ */
+int configfile_reloader_reload(configfile_reloader *reloader);
+
+/**
+ * Returns the number of versions published so far, including the first one. Useful to detect that a reload
+ * happened without entering.
+ * @param reloader Reloader to query.
+ */
+unsigned long configfile_reloader_version(configfile_reloader *reloader);
+
+/**
+ * Interns a module name in the registry of a reloader and binds it to the current version. Every version loaded
+ * afterwards is bound before being published, so the handle stays valid across reloads and resolves whenever the
+ * version holds the name.
+ * @param reloader Reloader to intern into.
+ * @param module_name Name to intern.
+ * @param key Receives the handle, to be used with configfile_key_get() on lists returned by configfile_reader_enter().
+ * @return Returns zero on success, on failure returns -1 and errno is set.
+ */
+int configfile_reloader_key(configfile_reloader *reloader, const char *module_name, configfile_key *key);
+
+/**
+ * Registers a callback called after every reload for the names that changed, as reported by configfile_diff(),
+ * and match name. Callbacks run on the thread that reloaded, after the new version is published and before the
+ * old one can be freed, so both modules are valid during the call. They must not call the other configfile_reloader
+ * functions.
+ * @param reloader Reloader to watch.
+ * @param name Name to match, copied.
+ * @param prefix If zero only the module named name matches, otherwise every module whose name starts with name,
+ * such as "server." for a section.
+ * @param callback Function to call, its return value is ignored.
+ * @param user_data Passed unchanged to callback.
+ * @return Returns an identifier for configfile_reloader_unsubscribe(), on failure returns -1 and errno is set.
+ */
+int configfile_reloader_subscribe(configfile_reloader *reloader, const char *name, int prefix, configfile_diff_callback callback, void *user_data);
+
+/**
+ * Removes a callback registered by configfile_reloader_subscribe(). It is not called anymore once this returns.
+ * @param reloader Reloader the callback was registered with.
+ * @param subscription Identifier returned by configfile_reloader_subscribe().
+ * @return Returns zero on success, -1 with errno set to ENOENT if there is no such subscription.
+ */
+int configfile_reloader_unsubscribe(configfile_reloader *reloader, int subscription);
+
+/**
+ * Stops the watcher thread and frees every version and reader. No reader may be inside when this is called.
+ * @param reloader Reloader to be freed from memory.
+ */
+void configfile_reloader_kill(configfile_reloader *reloader);
+
+/**
+ * Registers a reader of a reloader. A reader belongs to a single thread at a time, typically each worker thread
+ * creates one at startup. Released readers are reused by later registrations.
+ * @param reloader Reloader to read from.
+ * @return Returns the reader or NULL on failure, errno is set according to malloc(3).
+ */
+configfile_reader *configfile_reader_new(configfile_reloader *reloader);
+
+/**
+ * Releases a reader, which must not be inside. The memory is kept by the reloader for reuse.
+ * @param reader Reader to release.
+ */
+void configfile_reader_kill(configfile_reader *reader);
+
+/**
+ * Starts a read-side critical section and returns the current version. The returned list, and everything
+ * obtained from it, stays valid until configfile_reader_leave() even if newer versions are published meanwhile.
+ * Wait-free: two atomic stores and two atomic loads. Sections must not be nested on the same reader.
+ * @param reader Reader of the calling thread.
+ * @return Returns the head of the current version.
+ */
+configfile *configfile_reader_enter(configfile_reader *reader);
+
+/**
+ * Ends a read-side critical section, after which the version returned by configfile_reader_enter() may be freed.
+ * @param reader Reader of the calling thread.
+ */
+void configfile_reader_leave(configfile_reader *reader);
+
+/**
+ * Type of a member of a structure filled by configfile_bind(), converted as by the typed getter of the same name.
+ */
+typedef enum _configfile_field_type {
+    /** int64_t. */
+    CONFIGFILE_FIELD_INT64 = 0,
+    /** int, values that do not fit are out of range. */
+    CONFIGFILE_FIELD_INT,
+    /** double. */
+    CONFIGFILE_FIELD_DOUBLE,
+    /** int, zero or one. */
+    CONFIGFILE_FIELD_BOOL,
+    /** int64_t, nanoseconds. */
+    CONFIGFILE_FIELD_DURATION,
+    /** uint64_t, bytes. */
+    CONFIGFILE_FIELD_SIZE,
+    /** const char *, the expanded value, terminated and owned by the list. */
+    CONFIGFILE_FIELD_STRING
+} configfile_field_type;
+
+/**
+ * Describes how one member of a structure is filled from a module, see configfile_bind(). Tables of fields are
+ * usually static and built with CONFIGFILE_FIELD().
+ */
+struct _configfile_field {
+    /** Name of the module. */
+    const char *module_name;
+    /** Type of the member. */
+    configfile_field_type type;
+    /** Offset of the member in the structure, from offsetof(). */
+    size_t offset;
+    /** Value used when no module has the name, written as in a file and checked like one. NULL makes the name required. */
+    const char *default_value;
+    /**
+     * Inclusive bounds of the value, compared as double: the number for numeric types, nanoseconds, bytes, or the
+     * length of strings. Not checked when both are zero, booleans are never checked.
+     */
+    double minimum;
+    double maximum;
+};
+
+/** Initializer of a field filling member of struct_type. */
+#define CONFIGFILE_FIELD(module_name, type, struct_type, member, default_value, minimum, maximum) \
+    {(module_name), (type), offsetof(struct_type, member), (default_value), (minimum), (maximum)}
+
+/**
+ * Called by configfile_bind() for every field that could not be filled.
+ * @param field Field that failed.
+ * @param status CONFIGFILE_NOT_FOUND if the name is missing and has no default, CONFIGFILE_INVALID if the value is
+ * not written as the type of the field, CONFIGFILE_RANGE if it does not fit in the member or is out of bounds.
+ * @param module Module the value was read from, giving its file and line, or NULL if the default was used.
+ * @param user_data Pointer given with the callback.
+ */
+typedef void (*configfile_bind_callback)(const configfile_field *field, configfile_status status, configfile *module, void *user_data);
+
+/**
+ * Fills a structure from a list in one pass: every field is looked up, converted and checked against its bounds,
+ * so code reading the settings afterwards only reads members. Fields that fail are reported and left unchanged,
+ * the others are written, and every field is checked even after a failure so all problems are reported at once.
+ * @param config Head of the list to read.
+ * @param fields Fields to fill.
+ * @param count Number of fields.
+ * @param target Structure to fill. String members point into the list, which must outlive them, or to the default
+ * of their field.
+ * @param callback Called for every field that failed, may be NULL.
+ * @param user_data Passed unchanged to callback.
+ * @return Returns the number of fields that failed, zero if the whole structure was filled. Returns -1 with errno
+ * set to EINVAL if fields or target is NULL, or a field has an unknown type.
+ */
+int configfile_bind(configfile *config, const configfile_field *fields, size_t count, void *target,
+        configfile_bind_callback callback, void *user_data);
+
+/**
+ * Binds every version of a reloader to a structure: each version gets its own structure, allocated with the
+ * version and filled by configfile_bind() before it is published, so the structure is swapped atomically with
+ * the list and freed with it. A version with a field that fails is not published, the previous one stays and
+ * configfile_reloader_reload() fails with EINVAL. Readers get the structure with configfile_bound().
+ * @param reloader Reloader to bind.
+ * @param fields Fields to fill, not copied: the table must outlive the reloader.
+ * @param count Number of fields.
+ * @param size Size of the structure. Members not described by a field are zero.
+ * @param callback Called for every field that failed, on the thread loading the version, may be NULL. Must not
+ * call the other configfile_reloader functions.
+ * @param user_data Passed unchanged to callback.
+ * @return Returns zero once the current version is bound. If one of its fields failed returns their number and
+ * nothing is bound. On failure returns -1 and errno is set, EBUSY if the reloader is already bound.
+ */
+int configfile_reloader_bind(configfile_reloader *reloader, const configfile_field *fields, size_t count, size_t size,
+        configfile_bind_callback callback, void *user_data);
+
+/**
+ * Returns the structure of a version of a bound reloader, see configfile_reloader_bind(). Valid as long as the
+ * version is, for example until configfile_reader_leave().
+ * @param config Version returned by configfile_reader_enter().
+ * @return Returns the structure, or NULL if the reloader is not bound.
+ */
+const void *configfile_bound(configfile *config);
+
+/**
+ * Sets a name of a list loaded from a file to a value, in memory, until configfile_save() writes it. The module
+ * configfile_get() returns for the name takes the value, or a module is added at the end of the list and of its
+ * section, see configfile_section_find(). The hash index, the section tree, the conversion cache and the expansions
+ * referencing the name are updated in place.
+ * Replaced values stay allocated until the list is killed. No other thread may read the list meanwhile.
+ * @param config Head of a list returned by configfile_init() or configfile_init_ex() for one file.
+ * @param module_name Name to set, must read back as itself from a line of the file.
+ * @param module_value Value to set. Without CONFIGFILE_EXTENDED it must survive the trim and hold no newline:
+ * start on a letter or a digit, or on anything but a blank when its first digit follows a sign or a dot, and end
+ * on a letter or a digit, '$', '{' and '}' counting as letters with CONFIGFILE_INTERPOLATE.
+ * @return Returns zero on success. On failure returns -1 and errno is set, EINVAL if the name or value cannot be
+ * written as a line, ENOTSUP if the list was not loaded from a single file, ENOENT or ELOOP if the value holds a
+ * reference that does not expand, see CONFIGFILE_INTERPOLATE, or ENOMEM.
+ */
+int configfile_set(configfile *config, const char *module_name, const char *module_value);
+
+/**
+ * Removes the module configfile_get() returns for a name from a list loaded from a file, until configfile_save()
+ * replaces its line with an empty one, keeping the numbers of the following lines. A later module of the same
+ * name, if any, is returned for it from then on and takes its place in its section. Sections left without modules
+ * stay, empty. Same restrictions as configfile_set(). The head of the list is
+ * removed by moving the second module into it, so the head pointer stays valid.
+ * @param config Head of a list returned by configfile_init() or configfile_init_ex() for one file.
+ * @param module_name Name to remove.
+ * @return Returns zero on success. On failure returns -1 and errno is set, ENOENT if the name is not in the list,
+ * EBUSY if it is the only module or another value references it, EINVAL or ENOTSUP as configfile_set(), or ENOMEM.
+ */
+int configfile_delete(configfile *config, const char *module_name);
+
+/**
+ * Writes the changes made by configfile_set() and configfile_delete() since the list was loaded or last saved, all
+ * at once. The new version of the file is written next to it, synced and renamed over it, so readers of the file
+ * see either version whole. Lines not changed keep their bytes, comments and layout included; changed lines are
+ * written as "name = value", added modules are appended and get their module_line. Unchanged bytes are copied by
+ * the kernel and, after the first save, only the changed lines are read, so a save costs little more than its
+ * changes.
+ * @param config Head of a list returned by configfile_init() or configfile_init_ex() for one file.
+ * @return Returns zero on success, nothing being changed included. On failure returns -1, errno is set and the
+ * file is left as it was: ESTALE if it changed since the list was loaded or last saved, EIO if a changed line is
+ * no longer in it, ENOTSUP as configfile_set(), or as open(2), write(2), fsync(2) and rename(2).
+ */
+int configfile_save(configfile *config);
+
+/**
+ * Compares two lists name by name, considering only the module configfile_get() returns for repeated names.
+ * Reports added and modified names in the order of new_config, then removed names in the order of old_config.
+ * Values are compared byte for byte, after expansion for modules holding references, see CONFIGFILE_INTERPOLATE.
+ * Takes linear time on heads returned by configfile_init().
+ * @param old_config Head of the old list, may be NULL to report every name as added.
+ * @param new_config Head of the new list, may be NULL to report every name as removed.
+ * @param callback Called for every difference.
+ * @param user_data Passed unchanged to callback.
+ * @return Returns zero once every difference is reported, 1 if the callback stopped, or -1 with errno set to
+ * EINVAL if callback is NULL.
+ */
+int configfile_diff(configfile *old_config, configfile *new_config, configfile_diff_callback callback, void *user_data);
+
+/**
+ * Compiles a list into a binary snapshot file: a versioned, checksummed and position independent image holding
+ * the strings, the modules in list order and a prebuilt hash table. The file is written to a temporary file and
+ * renamed over snapshot_filename.
+ * @param config Head of the list to compile.
+ * @param snapshot_filename Name of the snapshot file to create or replace.
+ * @param source_filename Text file the list was loaded from, its size and modification time are recorded so a
+ * stale snapshot can be detected. May be NULL.
+ * @return Returns zero on success, on failure returns -1 and errno is set.
+ */
+int configfile_snapshot_write(configfile *config, const char *snapshot_filename, const char *source_filename);
+
+/**
+ * Maps a snapshot file read-only. Nothing is parsed or allocated, the image is verified against its checksum and
+ * its offsets checked to stay inside it, then used as mapped.
+ * @param snapshot_filename Name of the snapshot file.
+ * @param source_filename If not NULL, the snapshot is rejected when this file changed since it was compiled.
+ * @return Returns the snapshot or NULL on failure. errno is ESTALE for a stale snapshot, EINVAL for a damaged or
+ * incompatible one, or is set according to open(2) and mmap(2).
+ */
+const configfile_snapshot *configfile_snapshot_open(const char *snapshot_filename, const char *source_filename);
+
+/**
+ * Opens the snapshot of a text file, falling back to the text parser when the snapshot is missing, stale or
+ * damaged. In that case the image is built in memory and snapshot_filename is refreshed for the next process.
+ * @param source_filename Name of the configuration file.
+ * @param snapshot_filename Name of its snapshot file, NULL to always parse.
+ * @return Returns the snapshot or NULL on failure, errno is set as by configfile_init().
+ */
+const configfile_snapshot *configfile_snapshot_load(const char *source_filename, const char *snapshot_filename);
+
+/**
+ * Searches a snapshot for a module, like configfile_get(). Performs no allocation.
+ * @param snapshot Snapshot to search.
+ * @param module_name String to search for.
+ * @param view Receives the first module with that name, may be NULL to only test for it.
+ * @return Returns zero if the module was found, otherwise -1.
+ */
+int configfile_snapshot_get(const configfile_snapshot *snapshot, const char *module_name, configfile_view *view);
+
+/**
+ * Returns the number of modules in a snapshot, duplicates included.
+ */
+size_t configfile_snapshot_count(const configfile_snapshot *snapshot);
+
+/**
+ * Reads the module at a position of a snapshot, in the order of the list it was compiled from.
+ * @return Returns zero on success or -1 if index is out of range.
+ */
+int configfile_snapshot_at(const configfile_snapshot *snapshot, size_t index, configfile_view *view);
+
+/**
+ * Unmaps a snapshot returned by configfile_snapshot_open() or configfile_snapshot_load().
+ */
+void configfile_snapshot_close(const configfile_snapshot *snapshot);
+
+/**
+ * Publishes a list to other processes as a snapshot image in POSIX shared memory. Every version is a read-only
+ * object named after the generation that published it, and a small control object named shared_name holds the
+ * current generation. The new image is written in full before the generation is raised, then the image of the
+ * previous generation is unlinked: processes still mapping it keep it until they move on. Only one process may
+ * publish under a name at a time.
+ * @param config Head of the list to publish.
+ * @param shared_name Name of the control object, as given to shm_open(3): a slash followed by up to 200 bytes
+ * other than slashes.
+ * @param generation If not NULL, receives the generation published, counting from 1.
+ * @return Returns zero on success, on failure returns -1 and errno is set.
+ */
+int configfile_shared_publish(configfile *config, const char *shared_name, uint64_t *generation);
+
+/**
+ * Attaches to the images published under a name. Nothing is mapped until configfile_shared_snapshot().
+ * @param shared_name Name given to configfile_shared_publish().
+ * @return Returns the handle, freed with configfile_shared_close(). On failure returns NULL and errno is set,
+ * ENOENT if nothing was ever published under the name.
+ */
+configfile_shared *configfile_shared_open(const char *shared_name);
+
+/**
+ * Returns the image of the current generation, mapping it if a newer one was published since the last call. When
+ * nothing changed this only reads the generation, no system call is made. The previous image is unmapped, it must
+ * not be used after this call returns a newer one. Nothing is parsed or copied: every process reads the same pages.
+ * A handle is not safe to use from several threads at once.
+ * @param shared Handle returned by configfile_shared_open().
+ * @param generation If not NULL, receives the generation of the image returned.
+ * @return Returns the snapshot, read with configfile_snapshot_get() and configfile_snapshot_at() but never closed
+ * with configfile_snapshot_close(). On failure returns NULL and errno is set, EINVAL for a damaged image.
+ */
+const configfile_snapshot *configfile_shared_snapshot(configfile_shared *shared, uint64_t *generation);
+
+/**
+ * Unmaps every image of a handle and frees it.
+ */
+void configfile_shared_close(configfile_shared *shared);
+
+/**
+ * Unlinks the control object of a name and the image of its current generation. Attached processes keep what
+ * they mapped, but find nothing newer.
+ * @return Returns zero on success, on failure returns -1 and errno is set according to shm_unlink(3).
+ */
+int configfile_shared_unlink(const char *shared_name);
+
+/**
+ * Freezes a list into a read-only block aligned to a cache line, holding a copy of every name and value and a
+ * minimal perfect hash of the names: lookups read one slot and compare one name, hits and misses alike. The
+ * frozen list does not depend on the list, which may be killed, and is shared between threads without locking.
+ * Only the module configfile_get() returns for each name is kept, with its value expanded.
+ * @param config Head of the list to freeze.
+ * @return Returns the frozen list, freed with configfile_frozen_kill(). On failure returns NULL and errno is set
+ * to EINVAL if config is NULL, ENOMEM, or EEXIST if two names have the same configfile_hash().
+ */
+const configfile_frozen *configfile_freeze(configfile *config);
+
+/**
+ * Searches a frozen list for a module, like configfile_get(). Performs no allocation.
+ * @param frozen Frozen list to search.
+ * @param module_name String to search for.
+ * @param view Receives the module, may be NULL to only test for it.
+ * @return Returns zero if the module was found, otherwise -1.
+ */
+int configfile_frozen_get(const configfile_frozen *frozen, const char *module_name, configfile_view *view);
+
+/**
+ * Same as configfile_frozen_get() with the length and configfile_hash() of the name already known, see
+ * CONFIGFILE_HASH_LITERAL().
+ */
+int configfile_frozen_get_hashed(const configfile_frozen *frozen, const char *module_name, size_t module_name_length,
+        uint64_t hash, configfile_view *view);
+
+/**
+ * Returns the number of modules in a frozen list, one per name.
+ */
+size_t configfile_frozen_count(const configfile_frozen *frozen);
+
+/**
+ * Reads the module at a position of a frozen list. Positions follow the hash, not the order of the list.
+ * @return Returns zero on success or -1 if index is out of range.
+ */
+int configfile_frozen_at(const configfile_frozen *frozen, size_t index, configfile_view *view);
+
+/**
+ * Returns the number of bytes used by a frozen list, all in one block.
+ */
+size_t configfile_frozen_size(const configfile_frozen *frozen);
+
+/**
+ * Frees a frozen list returned by configfile_freeze().
+ */
+void configfile_frozen_kill(const configfile_frozen *frozen);
+
+/**
+ * Loads a configuration file into a table: the modules of configfile_init() in file order, stored as columns
+ * over one pool of strings instead of as nodes. A table takes less memory than a list and is iterated with
+ * sequential reads. Include directives are not followed and there is no section tree.
+ * @param filename Name of the configuration file.
+ * @return Returns the table, empty if the file holds no module, freed with configfile_table_kill(). On failure
+ * returns NULL and errno is set according to open(2) and read(2), to ENOMEM, or to EOVERFLOW if the strings of the
+ * file do not fit in 4 GiB.
+ */
+configfile_table *configfile_table_load(const char *filename);
+
+/**
+ * Copies a list into a table, every module in list order with its value expanded. The table does not depend on
+ * the list.
+ * @param config Head of the list.
+ * @return Returns the table or NULL on failure, errno is set as by configfile_table_load() or to EINVAL if config
+ * is NULL.
+ */
+configfile_table *configfile_table_build(configfile *config);
+
+/**
+ * Searches a table for a module, like configfile_get(). Performs no allocation.
+ * @param table Table to search.
+ * @param module_name String to search for.
+ * @param view Receives the module, may be NULL to only test for it.
+ * @return Returns zero if the module was found, otherwise -1.
+ */
+int configfile_table_get(const configfile_table *table, const char *module_name, configfile_view *view);
+
+/**
+ * Same as configfile_table_get() with the length and configfile_hash() of the name already known, see
+ * CONFIGFILE_HASH_LITERAL().
+ */
+int configfile_table_get_hashed(const configfile_table *table, const char *module_name, size_t module_name_length,
+        uint64_t hash, configfile_view *view);
+
+/**
+ * Returns the number of modules in a table, duplicates included.
+ */
+size_t configfile_table_count(const configfile_table *table);
+
+/**
+ * Reads the module at a position of a table, in file or list order.
+ * @return Returns zero on success or -1 if index is out of range.
+ */
+int configfile_table_at(const configfile_table *table, size_t index, configfile_view *view);
+
+/**
+ * Returns the number of bytes allocated for a table.
+ */
+size_t configfile_table_size(const configfile_table *table);
+
+/**
+ * Frees a table returned by configfile_table_load() or configfile_table_build().
+ */
+void configfile_table_kill(configfile_table *table);
+
+/**
+ * Opens a configuration file for lazy parsing, for programs reading few of its names. The file is mapped, scanned
+ * once and unmapped, indexing each module as the hash of its name and the offset of its line in eight bytes:
+ * nothing is copied or allocated per module. The first lookup of a name reads its line back, parses it and keeps
+ * the module built from it, so the memory used tracks the names looked up rather than the size of the file. The
+ * file stays open and must not change. Include directives are not followed.
+ * @param filename Name of the configuration file.
+ * @return Returns the lazy file, freed with configfile_lazy_kill(). On failure returns NULL and errno is set,
+ * EFBIG if the file is 512 GiB or more.
+ */
+const configfile_lazy *configfile_lazy_open(const char *filename);
+
+/**
+ * Searches a lazy file for a module, like configfile_get(): the first module of the name in the file. Safe to call
+ * from several threads at once.
+ * @param lazy Lazy file to search.
+ * @param module_name String to search for.
+ * @return Returns the module, owned by the lazy file and built on the first lookup of its name. Its typed getters
+ * such as configfile_value_int64() cache their conversion as for a list, module_line is zero and next is
+ * NULL. Returns NULL if not found, or on failure with errno set to ENOMEM, by pread(2), or to EIO if the file
+ * changed.
+ */
+configfile *configfile_lazy_get(const configfile_lazy *lazy, const char *module_name);
+
+/**
+ * Same as configfile_lazy_get() with the length and configfile_hash() of the name already known, see
+ * CONFIGFILE_HASH_LITERAL().
+ */
+configfile *configfile_lazy_get_hashed(const configfile_lazy *lazy, const char *module_name, size_t module_name_length, uint64_t hash);
+
+/**
+ * Returns the number of modules indexed in a lazy file, duplicates included.
+ */
+size_t configfile_lazy_count(const configfile_lazy *lazy);
+
+/**
+ * Returns the number of modules already built by lookups. Walks the whole index.
+ */
+size_t configfile_lazy_loaded(const configfile_lazy *lazy);
+
+/**
+ * Unmaps a lazy file and frees the modules built from it.
+ */
+void configfile_lazy_kill(const configfile_lazy *lazy);
+
+/**
+ * Sets an iterator on the first module of a list.
+ * @param iterator Iterator to set.
+ * @param config Head of the list, may be NULL for an empty iteration.
+ */
+void configfile_iterate(configfile_iterator *iterator, configfile *config);
+
+/**
+ * Sets an iterator on the first module of a table.
+ * @param iterator Iterator to set.
+ * @param table Table to iterate, may be NULL for an empty iteration.
+ */
+void configfile_table_iterate(configfile_iterator *iterator, const configfile_table *table);
+
+/**
+ * Reads the module at an iterator and advances it, so code walking a list through iterators works unchanged on
+ * a table. Values of lists are read with configfile_value_expand(). The list or table must outlive the iteration.
+ * @param iterator Iterator to advance.
+ * @param view Receives the module.
+ * @return Returns zero on success or -1 past the last module, or if a value cannot be expanded.
+ */
+int configfile_iterator_next(configfile_iterator *iterator, configfile_view *view);
+
+/** Number of hot keys kept by the lookup sampler. */
+#define CONFIGFILE_STATS_HOT 16
+
+/**
+ * Instrumentation of a list, only recorded by builds of the library compiled with CONFIGFILE_STATS defined, such
+ * as make CFLAGS=-DCONFIGFILE_STATS. Other builds compile none of it, configfile_get() included.
+ * Load counters cover the files read for the list, times are in nanoseconds summed over the loading threads and
+ * include the cost of reading the clock. Pages of mapped files are read while they are scanned.
+ */
+struct _configfile_stats {
+    /** Bytes parsed. */
+    uint64_t bytes;
+    /** Lines parsed. */
+    uint64_t lines;
+    /** Modules in the list and distinct names among them. */
+    uint64_t entries;
+    uint64_t unique_entries;
+    /** Lines without a module: blank lines, comments, directives and malformed lines. */
+    uint64_t skipped_lines;
+    /** Blocks requested from the allocator and their total size. */
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    /** Nodes and strings carved from those blocks. */
+    uint64_t arena_allocations;
+    /** Time reading or mapping files. */
+    uint64_t io_ns;
+    /** Time classifying bytes with the scanner. */
+    uint64_t scan_ns;
+    /** Time trimming names and values, blocks scanned while trimming included. */
+    uint64_t trim_ns;
+    /** Time appending nodes. */
+    uint64_t build_ns;
+    /** Time building the hash index and the section tree. */
+    uint64_t index_ns;
+    uint64_t sections_ns;
+    /** Time of the whole load, as seen by the calling thread. */
+    uint64_t load_ns;
+    /** Lookups by name or handle that found a module, and those that did not. */
+    uint64_t hits;
+    uint64_t misses;
+    /** Index slots or list nodes examined by lookups, divided by hits plus misses gives the average probe length. */
+    uint64_t comparisons;
+    /** Number of entries in hot. */
+    size_t hot_count;
+    /** Most looked up names, estimated from one lookup in 64 and sorted by decreasing count. */
+    struct {
+        const char *module_name;
+        uint64_t lookups;
+    } hot[CONFIGFILE_STATS_HOT];
+};
+
+/**
+ * Reads the instrumentation of a list. Counters keep changing while other threads use the list.
+ * @param config Head of a list returned by one of the loaders.
+ * @param stats Receives the counters. Hot names point into the list.
+ * @return Returns zero on success, on failure returns -1 and errno is set to EINVAL if config was not loaded from
+ * a file, or to ENOTSUP if the library was compiled without CONFIGFILE_STATS.
+ */
+int configfile_stats_get(configfile *config, configfile_stats *stats);
+
+/**
+ * Clears the lookup counters and hot keys of a list, load counters are kept.
+ * @param config Head of a list returned by one of the loaders.
+ */
+void configfile_stats_reset(configfile *config);
+
+/**
+ * Writes the instrumentation of a list in a human readable form.
+ * @param config Head of a list returned by one of the loaders.
+ * @param stream Stream to write to.
+ * @return Returns zero on success, on failure returns -1 and errno is set as by configfile_stats_get().
+ */
+int configfile_stats_dump(configfile *config, FILE *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* LIBCONFIGFILE_H */
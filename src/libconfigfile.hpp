@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile.hpp
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Header-only C++17 interface over libconfigfile.h. Nothing is copied: names and values are std::string_view into
+ * the list, typed reads go through the conversion cache of each module, and keys declared constexpr carry a hash
+ * computed by the compiler.
+ */
+
+#ifndef LIBCONFIGFILE_HPP
+#define LIBCONFIGFILE_HPP
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "libconfigfile.h"
+
+namespace libconfigfile {
+
+    /**
+     * Same as configfile_hash(), usable in constant expressions.
+     */
+    constexpr std::uint64_t hash(std::string_view name) noexcept {
+        std::uint64_t value = 0xcbf29ce484222325ULL;
+
+        for (char byte : name) {
+            value ^= static_cast<unsigned char> (byte);
+            value *= 0x100000001b3ULL;
+        }
+
+        return value;
+    }
+
+    /**
+     * A module name and its hash. A key declared constexpr is hashed by the compiler and lookups with it do no
+     * hashing at all, one built at run time is hashed once and may be reused. The name is not copied.
+     */
+    class key {
+    public:
+
+        constexpr key(std::string_view name) noexcept : name_(name), hash_(libconfigfile::hash(name)) {
+        }
+
+        constexpr key(const char *name) noexcept : key(std::string_view(name)) {
+        }
+
+        key(const std::string &name) noexcept : key(std::string_view(name)) {
+        }
+
+        constexpr std::string_view name() const noexcept {
+            return name_;
+        }
+
+        constexpr std::uint64_t hash() const noexcept {
+            return hash_;
+        }
+
+    private:
+        std::string_view name_;
+        std::uint64_t hash_;
+    };
+
+    namespace literals {
+
+        /**
+         * "name"_key, hashed by the compiler when used to initialize a constexpr key.
+         */
+        constexpr key operator""_key(const char *name, std::size_t length) noexcept {
+            return key(std::string_view(name, length));
+        }
+    }
+
+    /**
+     * Size in bytes, read as configfile_value_size() does. Durations are read into std::chrono::nanoseconds.
+     */
+    struct byte_size {
+        std::uint64_t bytes;
+    };
+
+    namespace detail {
+
+        template <typename T>
+        struct unsupported : std::false_type {
+        };
+
+        /**
+         * Converts the value of a module with the C getter matching T. The C getters cache the first type a module
+         * is read as, so repeated reads of a module as one type parse its value once.
+         */
+        template <typename T>
+        configfile_status convert(configfile *module, T &value) noexcept(!std::is_same_v<T, std::string>) {
+            configfile_status status;
+
+            if (module == nullptr) {
+                return CONFIGFILE_NOT_FOUND;
+            }
+
+            if constexpr (std::is_same_v<T, bool>) {
+                int flag;
+
+                status = configfile_value_bool(module, &flag);
+                if (status == CONFIGFILE_OK) {
+                    value = flag != 0;
+                }
+            } else if constexpr (std::is_integral_v<T>) {
+                std::int64_t number;
+
+                status = configfile_value_int64(module, &number);
+                if (status != CONFIGFILE_OK) {
+                    return status;
+                }
+
+                if constexpr (std::is_unsigned_v<T>) {
+                    if (number < 0 || static_cast<std::uint64_t> (number) > std::numeric_limits<T>::max()) {
+                        return CONFIGFILE_RANGE;
+                    }
+                } else {
+                    if (number < std::numeric_limits<T>::min() || number > std::numeric_limits<T>::max()) {
+                        return CONFIGFILE_RANGE;
+                    }
+                }
+                value = static_cast<T> (number);
+            } else if constexpr (std::is_floating_point_v<T>) {
+                double number;
+
+                status = configfile_value_double(module, &number);
+                if (status != CONFIGFILE_OK) {
+                    return status;
+                }
+
+                if (number > std::numeric_limits<T>::max() || number < -std::numeric_limits<T>::max()) {
+                    return CONFIGFILE_RANGE;
+                }
+                value = static_cast<T> (number);
+            } else if constexpr (std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+                std::size_t length;
+                const char *string = configfile_value_expand(module, &length);
+
+                if (string == nullptr) {
+                    return CONFIGFILE_INVALID;
+                }
+                value = T(string, length);
+                status = CONFIGFILE_OK;
+            } else if constexpr (std::is_same_v<T, std::chrono::nanoseconds>) {
+                std::int64_t nanoseconds;
+
+                status = configfile_value_duration(module, &nanoseconds);
+                if (status == CONFIGFILE_OK) {
+                    value = std::chrono::nanoseconds(nanoseconds);
+                }
+            } else if constexpr (std::is_same_v<T, byte_size>) {
+                status = configfile_value_size(module, &value.bytes);
+            } else {
+                static_assert(unsupported<T>::value, "libconfigfile: unsupported value type");
+            }
+
+            return status;
+        }
+    }
+
+    /**
+     * Owner of a list returned by configfile_init_ex(), killed with it. Movable, not copyable. Iterating yields
+     * the name and the expanded value of every module in list order, as std::string_view valid while the list
+     * lives.
+     */
+    class config {
+    public:
+        class iterator;
+        using value_type = std::pair<std::string_view, std::string_view>;
+
+        config() noexcept = default;
+
+        /**
+         * Takes ownership of a list, may be NULL.
+         */
+        explicit config(configfile *list) noexcept : list_(list) {
+        }
+
+        /**
+         * Loads a file with configfile_init_ex().
+         * @param flags Bitwise OR of CONFIGFILE_* flags.
+         * @throw std::system_error if the file cannot be loaded. A file holding no module gives an empty config.
+         */
+        explicit config(const char *filename, unsigned int flags = 0) : list_(load(filename, flags)) {
+        }
+
+        explicit config(const std::string &filename, unsigned int flags = 0) : config(filename.c_str(), flags) {
+        }
+
+        config(const config &) = delete;
+        config &operator=(const config &) = delete;
+
+        config(config &&other) noexcept : list_(std::exchange(other.list_, nullptr)) {
+        }
+
+        config &operator=(config &&other) noexcept {
+            if (this != &other) {
+                reset(std::exchange(other.list_, nullptr));
+            }
+            return *this;
+        }
+
+        ~config() {
+            reset();
+        }
+
+        /**
+         * Returns the list, still owned by this config.
+         */
+        configfile *handle() const noexcept {
+            return list_;
+        }
+
+        /**
+         * Gives up ownership of the list and returns it.
+         */
+        configfile *release() noexcept {
+            return std::exchange(list_, nullptr);
+        }
+
+        /**
+         * Kills the list and takes ownership of another one, may be NULL.
+         */
+        void reset(configfile *list = nullptr) noexcept {
+            if (list_ != nullptr) {
+                configfile_kill(list_);
+            }
+            list_ = list;
+        }
+
+        bool empty() const noexcept {
+            return list_ == nullptr;
+        }
+
+        /**
+         * Returns the module configfile_get() returns for the name of a key, or NULL.
+         */
+        configfile *find(const key &name) const noexcept {
+            return configfile_get_hashed(list_, name.name().data(), name.name().size(), name.hash());
+        }
+
+        bool contains(const key &name) const noexcept {
+            return find(name) != nullptr;
+        }
+
+        /**
+         * Reads a module as T: bool, an integer or floating point type, std::string_view, std::string,
+         * std::chrono::nanoseconds or byte_size. Integers narrower than 64 bits are range checked.
+         * @return Returns the value, or std::nullopt if the name is missing or the value does not convert.
+         */
+        template <typename T>
+        std::optional<T> get(const key &name) const noexcept(!std::is_same_v<T, std::string>) {
+            T value{};
+
+            if (detail::convert(find(name), value) != CONFIGFILE_OK) {
+                return std::nullopt;
+            }
+            return value;
+        }
+
+        /**
+         * Same as get(name) reporting why a read failed.
+         * @param value Receives the value on success, left unchanged otherwise.
+         * @return Returns CONFIGFILE_OK, CONFIGFILE_NOT_FOUND, CONFIGFILE_INVALID or CONFIGFILE_RANGE.
+         */
+        template <typename T>
+        configfile_status get(const key &name, T &value) const noexcept(!std::is_same_v<T, std::string>) {
+            return detail::convert(find(name), value);
+        }
+
+        iterator begin() const noexcept;
+        iterator end() const noexcept;
+
+    private:
+
+        static configfile *load(const char *filename, unsigned int flags) {
+            configfile_options options{};
+            configfile *list;
+
+            options.flags = flags;
+            errno = 0;
+            list = configfile_init_ex(filename, &options);
+            if (list == nullptr && errno != 0) {
+                throw std::system_error(errno, std::generic_category(), filename != nullptr ? filename : "");
+            }
+            return list;
+        }
+
+        configfile *list_ = nullptr;
+    };
+
+    /**
+     * Input iterator over a list, see configfile_iterator_next(). Stops early if a value cannot be expanded.
+     */
+    class config::iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = config::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+
+        iterator() noexcept = default;
+
+        explicit iterator(configfile *list) noexcept : done_(false) {
+            configfile_iterate(&state_, list);
+            next();
+        }
+
+        reference operator*() const noexcept {
+            return current_;
+        }
+
+        pointer operator->() const noexcept {
+            return &current_;
+        }
+
+        iterator &operator++() noexcept {
+            next();
+            return *this;
+        }
+
+        iterator operator++(int) noexcept {
+            iterator previous = *this;
+
+            next();
+            return previous;
+        }
+
+        friend bool operator==(const iterator &left, const iterator &right) noexcept {
+            return left.done_ == right.done_ && (left.done_ || left.state_.module == right.state_.module);
+        }
+
+        friend bool operator!=(const iterator &left, const iterator &right) noexcept {
+            return !(left == right);
+        }
+
+    private:
+
+        void next() noexcept {
+            configfile_view view;
+
+            if (configfile_iterator_next(&state_, &view) != 0) {
+                done_ = true;
+                return;
+            }
+            current_.first = std::string_view(view.module_name, view.module_name_length);
+            current_.second = std::string_view(view.module_value, view.module_value_length);
+        }
+
+        configfile_iterator state_{};
+        value_type current_;
+        bool done_ = true;
+    };
+
+    inline config::iterator config::begin() const noexcept {
+        return list_ != nullptr ? iterator(list_) : iterator();
+    }
+
+    inline config::iterator config::end() const noexcept {
+        return iterator();
+    }
+}
+
+#endif /* LIBCONFIGFILE_HPP */
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_bind.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Binding of lists to native structures. A table of fields describes the members of a structure, one pass looks
+ * every field up, converts it with the typed getters and writes it at its offset, so settings read on hot paths
+ * are plain loads instead of lookups by name.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "libconfigfile_private.h"
+
+/**
+ * Converts the value of a module for a field and checks it against the field's bounds.
+ * @param module Module to convert, a module of the list or one holding the default.
+ * @param member Receives the value on success, left unchanged otherwise.
+ * @return Returns the status of the conversion.
+ */
+static configfile_status configfile_bind_field(const configfile_field *field, configfile *module, char *member) {
+    const char *string = NULL;
+    configfile_status status;
+    uint64_t bytes = 0;
+    int64_t number = 0;
+    double value;
+    size_t length;
+    int flag = 0;
+
+    switch (field->type) {
+        case CONFIGFILE_FIELD_INT64:
+        case CONFIGFILE_FIELD_INT:
+            status = configfile_value_int64(module, &number);
+            value = (double) number;
+            break;
+        case CONFIGFILE_FIELD_DOUBLE:
+            status = configfile_value_double(module, &value);
+            break;
+        case CONFIGFILE_FIELD_BOOL:
+            status = configfile_value_bool(module, &flag);
+            value = 0;
+            break;
+        case CONFIGFILE_FIELD_DURATION:
+            status = configfile_value_duration(module, &number);
+            value = (double) number;
+            break;
+        case CONFIGFILE_FIELD_SIZE:
+            status = configfile_value_size(module, &bytes);
+            value = (double) bytes;
+            break;
+        default:
+            string = configfile_value_expand(module, &length);
+            status = string != NULL ? CONFIGFILE_OK : CONFIGFILE_INVALID;
+            value = (double) length;
+            break;
+    }
+
+    if (status != CONFIGFILE_OK) {
+        return status;
+    }
+
+    if (field->type != CONFIGFILE_FIELD_BOOL && (field->minimum != 0 || field->maximum != 0) &&
+            !(value >= field->minimum && value <= field->maximum)) {
+        return CONFIGFILE_RANGE;
+    }
+
+    /* Members may sit at any offset of a packed structure, they are written with memcpy(). */
+    switch (field->type) {
+        case CONFIGFILE_FIELD_INT64:
+        case CONFIGFILE_FIELD_DURATION:
+            memcpy(member, &number, sizeof (number));
+            break;
+        case CONFIGFILE_FIELD_INT:
+            if (number < INT_MIN || number > INT_MAX) {
+                return CONFIGFILE_RANGE;
+            }
+            flag = (int) number;
+            memcpy(member, &flag, sizeof (flag));
+            break;
+        case CONFIGFILE_FIELD_DOUBLE:
+            memcpy(member, &value, sizeof (value));
+            break;
+        case CONFIGFILE_FIELD_BOOL:
+            memcpy(member, &flag, sizeof (flag));
+            break;
+        case CONFIGFILE_FIELD_SIZE:
+            memcpy(member, &bytes, sizeof (bytes));
+            break;
+        default:
+            memcpy(member, &string, sizeof (string));
+            break;
+    }
+
+    return CONFIGFILE_OK;
+}
+
+int configfile_bind(configfile *config, const configfile_field *fields, size_t count, void *target,
+        configfile_bind_callback callback, void *user_data) {
+    configfile *module, default_module;
+    configfile_status status;
+    size_t i;
+    int failed = 0;
+
+    if ((fields == NULL && count > 0) || target == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (fields[i].module_name == NULL || (unsigned int) fields[i].type > CONFIGFILE_FIELD_STRING) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        module = config != NULL ? configfile_get(config, fields[i].module_name) : NULL;
+        if (module != NULL) {
+            status = configfile_bind_field(&fields[i], module, (char *) target + fields[i].offset);
+        } else if (fields[i].default_value != NULL) {
+            /* Defaults are converted by the same getters from a module that lives for this call only. */
+            memset(&default_module, 0, sizeof (default_module));
+            default_module.module_name = (char *) fields[i].module_name;
+            default_module.module_name_length = strlen(fields[i].module_name);
+            default_module.module_value = (char *) fields[i].default_value;
+            default_module.module_value_length = strlen(fields[i].default_value);
+            status = configfile_bind_field(&fields[i], &default_module, (char *) target + fields[i].offset);
+        } else {
+            status = CONFIGFILE_NOT_FOUND;
+        }
+
+        if (status != CONFIGFILE_OK) {
+            failed++;
+            if (callback != NULL) {
+                callback(&fields[i], status, module, user_data);
+            }
+        }
+    }
+
+    return failed;
+}
+
+int configfile_bind_version(configfile *config, const configfile_field *fields, size_t count, size_t size,
+        configfile_bind_callback callback, void *user_data) {
+    void *target;
+    int failed;
+
+    if (config == NULL || config->root == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    target = configfile_arena_alloc(&config->root->arena, size > 0 ? size : 1, CONFIGFILE_ARENA_ALIGN);
+    if (target == NULL) {
+        return -1;
+    }
+    memset(target, 0, size);
+
+    /* A structure that failed stays in the arena until the list is killed, versions rarely fail twice. */
+    failed = configfile_bind(config, fields, count, target, callback, user_data);
+    if (failed == 0) {
+        __atomic_store_n(&config->root->bound, target, __ATOMIC_RELEASE);
+    }
+
+    return failed;
+}
+
+const void *configfile_bound(configfile *config) {
+    if (config == NULL || config->root == NULL) {
+        return NULL;
+    }
+
+    return __atomic_load_n(&config->root->bound, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_convert.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Typed getters. A module caches the first type it is converted to in module_cache, with the type and the status
+ * of the conversion in module_cache_state. The state goes from zero to busy to final once, through atomic
+ * operations, so readers sharing a list never lock: a reader finding it busy or holding another type converts the
+ * string itself and does not cache the result. The type CONFIGFILE_CONVERT guessed at load is marked eager, and the
+ * first read as another type replaces it the same way, so readers of an eager cache check that the state did not
+ * change while they read the value.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <math.h>
+
+#include "libconfigfile_private.h"
+
+#define CONFIGFILE_TYPE_INT64 1
+#define CONFIGFILE_TYPE_DOUBLE 2
+#define CONFIGFILE_TYPE_BOOL 3
+#define CONFIGFILE_TYPE_DURATION 4
+#define CONFIGFILE_TYPE_SIZE 5
+
+#define CONFIGFILE_CACHE_TYPE 0x0f
+#define CONFIGFILE_CACHE_BUSY 0x10
+#define CONFIGFILE_CACHE_EAGER 0x20
+#define CONFIGFILE_CACHE_STATUS_SHIFT 8
+
+/*
+ * Converts a value into the 64 bits stored in module_cache. value is terminated at length.
+ */
+typedef configfile_status(*configfile_converter)(const char *value, size_t length, uint64_t *bits);
+
+typedef struct _configfile_unit {
+    const char *name;
+    uint64_t multiplier;
+} configfile_unit;
+
+static const configfile_unit configfile_duration_units[] = {
+    {"", 1000000000ULL},
+    {"ns", 1ULL},
+    {"us", 1000ULL},
+    {"ms", 1000000ULL},
+    {"s", 1000000000ULL},
+    {"m", 60000000000ULL},
+    {"min", 60000000000ULL},
+    {"h", 3600000000000ULL},
+    {"d", 86400000000000ULL},
+    {NULL, 0}
+};
+
+static const configfile_unit configfile_size_units[] = {
+    {"", 1ULL},
+    {"b", 1ULL},
+    {"k", 1ULL << 10}, {"kb", 1ULL << 10}, {"kib", 1ULL << 10},
+    {"m", 1ULL << 20}, {"mb", 1ULL << 20}, {"mib", 1ULL << 20},
+    {"g", 1ULL << 30}, {"gb", 1ULL << 30}, {"gib", 1ULL << 30},
+    {"t", 1ULL << 40}, {"tb", 1ULL << 40}, {"tib", 1ULL << 40},
+    {"p", 1ULL << 50}, {"pb", 1ULL << 50}, {"pib", 1ULL << 50},
+    {NULL, 0}
+};
+
+static const char *configfile_true_words[] = {"true", "yes", "on", "1", NULL};
+static const char *configfile_false_words[] = {"false", "no", "off", "0", NULL};
+
+static inline int configfile_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static configfile_status configfile_convert_int64(const char *value, size_t length, uint64_t *bits) {
+    const char *digits = value, *end;
+    long long result;
+    int base = 10;
+
+    if (*digits == '-' || *digits == '+') {
+        digits++;
+    }
+    if (!configfile_is_digit(*digits)) {
+        return CONFIGFILE_INVALID;
+    }
+    if (digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+        base = 16;
+    }
+
+    errno = 0;
+    result = strtoll(value, (char **) &end, base);
+    if (end != value + length) {
+        return CONFIGFILE_INVALID;
+    }
+    if (errno == ERANGE) {
+        return CONFIGFILE_RANGE;
+    }
+
+    *bits = (uint64_t) (int64_t) result;
+    return CONFIGFILE_OK;
+}
+
+static configfile_status configfile_convert_double(const char *value, size_t length, uint64_t *bits) {
+    const char *end;
+    double result;
+
+    if (!configfile_is_digit(*value) && *value != '-' && *value != '+' && *value != '.') {
+        return CONFIGFILE_INVALID;
+    }
+
+    errno = 0;
+    result = strtod(value, (char **) &end);
+    if (end != value + length || end == value) {
+        return CONFIGFILE_INVALID;
+    }
+    /* Underflow gives a usable value close to zero, only overflow is an error. */
+    if (errno == ERANGE && isinf(result)) {
+        return CONFIGFILE_RANGE;
+    }
+
+    memcpy(bits, &result, sizeof (result));
+    return CONFIGFILE_OK;
+}
+
+static int configfile_word_in(const char *value, size_t length, const char **words) {
+    size_t i;
+
+    for (i = 0; words[i] != NULL; i++) {
+        if (strlen(words[i]) == length && strncasecmp(value, words[i], length) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static configfile_status configfile_convert_bool(const char *value, size_t length, uint64_t *bits) {
+    if (configfile_word_in(value, length, configfile_true_words)) {
+        *bits = 1;
+        return CONFIGFILE_OK;
+    }
+    if (configfile_word_in(value, length, configfile_false_words)) {
+        *bits = 0;
+        return CONFIGFILE_OK;
+    }
+
+    return CONFIGFILE_INVALID;
+}
+
+/**
+ * Converts a non-negative number followed by an optional unit.
+ * @param value Value to convert, terminated at length.
+ * @param length Number of bytes in value.
+ * @param units Units accepted, the first one has an empty name and applies to bare numbers. Case is ignored.
+ * @param limit Largest result accepted.
+ * @param bits Receives the number multiplied by the unit, rounded to the nearest integer.
+ * @return Returns CONFIGFILE_OK, CONFIGFILE_INVALID or CONFIGFILE_RANGE.
+ */
+static configfile_status configfile_convert_scaled(const char *value, size_t length, const configfile_unit *units, uint64_t limit, uint64_t *bits) {
+    const char *number_end, *unit;
+    unsigned long long integer;
+    double number, scaled;
+    size_t unit_length, i;
+    int fraction;
+
+    if (!configfile_is_digit(*value)) {
+        return CONFIGFILE_INVALID;
+    }
+
+    for (number_end = value; configfile_is_digit(*number_end); number_end++);
+    fraction = *number_end == '.';
+    if (fraction) {
+        for (number_end++; configfile_is_digit(*number_end); number_end++);
+    }
+
+    for (unit = number_end; *unit == ' ' || *unit == '\t'; unit++);
+    unit_length = value + length - unit;
+
+    for (i = 0; units[i].name != NULL; i++) {
+        if (strlen(units[i].name) == unit_length && strncasecmp(unit, units[i].name, unit_length) == 0) {
+            break;
+        }
+    }
+    if (units[i].name == NULL) {
+        return CONFIGFILE_INVALID;
+    }
+
+    if (fraction) {
+        number = strtod(value, NULL);
+        scaled = number * (double) units[i].multiplier + 0.5;
+        if (scaled >= (double) limit) {
+            return CONFIGFILE_RANGE;
+        }
+        *bits = (uint64_t) scaled;
+        return CONFIGFILE_OK;
+    }
+
+    errno = 0;
+    integer = strtoull(value, NULL, 10);
+    if (errno == ERANGE || __builtin_mul_overflow((uint64_t) integer, units[i].multiplier, bits) || *bits > limit) {
+        return CONFIGFILE_RANGE;
+    }
+
+    return CONFIGFILE_OK;
+}
+
+static configfile_status configfile_convert_duration(const char *value, size_t length, uint64_t *bits) {
+    return configfile_convert_scaled(value, length, configfile_duration_units, INT64_MAX, bits);
+}
+
+static configfile_status configfile_convert_size(const char *value, size_t length, uint64_t *bits) {
+    return configfile_convert_scaled(value, length, configfile_size_units, UINT64_MAX, bits);
+}
+
+/**
+ * Converts the value of a module through its cache.
+ * @param module Module to convert, may be NULL.
+ * @param type CONFIGFILE_TYPE_* of the conversion.
+ * @param converter Conversion from the string, used on a cache miss.
+ * @param bits Receives the converted value on success.
+ * @return Returns the status of the conversion. errno is left unchanged.
+ */
+static configfile_status configfile_value_convert(configfile *module, uint32_t type, configfile_converter converter, uint64_t *bits) {
+    uint32_t state, expected;
+    configfile_status status;
+    const char *value;
+    size_t length;
+    int errno_backup;
+
+    if (module == NULL) {
+        return CONFIGFILE_NOT_FOUND;
+    }
+
+    state = __atomic_load_n(&module->module_cache_state, __ATOMIC_ACQUIRE);
+    if ((state & CONFIGFILE_CACHE_TYPE) == type) {
+        *bits = __atomic_load_n(&module->module_cache, __ATOMIC_RELAXED);
+        if (!(state & CONFIGFILE_CACHE_EAGER)) {
+            return (configfile_status) (state >> CONFIGFILE_CACHE_STATUS_SHIFT);
+        }
+
+        /* An eager state is only ever replaced by a final one, finding it again means the value read is its own. */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&module->module_cache_state, __ATOMIC_RELAXED) == state) {
+            return (configfile_status) (state >> CONFIGFILE_CACHE_STATUS_SHIFT);
+        }
+        state = CONFIGFILE_CACHE_BUSY;
+    }
+
+    /* A value that cannot be expanded is not converted, and not cached so a later read may succeed. */
+    errno_backup = errno;
+    value = configfile_value_expand(module, &length);
+    if (value == NULL) {
+        errno = errno_backup;
+        return CONFIGFILE_INVALID;
+    }
+    status = converter(value, length, bits);
+    errno = errno_backup;
+
+    /*
+     * Only the first type a module is read as is cached, the same setting is rarely read as two types. A type
+     * guessed at load counts as no read, the first one replaces it.
+     */
+    expected = state;
+    if ((state == 0 || (state & CONFIGFILE_CACHE_EAGER)) && __atomic_compare_exchange_n(&module->module_cache_state, &expected,
+            CONFIGFILE_CACHE_BUSY, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        /* Orders the busy state before the new value, for readers of the eager one. */
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&module->module_cache, status == CONFIGFILE_OK ? *bits : 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&module->module_cache_state, type | ((uint32_t) status << CONFIGFILE_CACHE_STATUS_SHIFT), __ATOMIC_RELEASE);
+    }
+
+    return status;
+}
+
+configfile_status configfile_value_int64(configfile *module, int64_t *value) {
+    configfile_status status;
+    uint64_t bits;
+
+    status = configfile_value_convert(module, CONFIGFILE_TYPE_INT64, configfile_convert_int64, &bits);
+    if (status == CONFIGFILE_OK && value != NULL) {
+        *value = (int64_t) bits;
+    }
+
+    return status;
+}
+
+configfile_status configfile_value_double(configfile *module, double *value) {
+    configfile_status status;
+    uint64_t bits;
+
+    status = configfile_value_convert(module, CONFIGFILE_TYPE_DOUBLE, configfile_convert_double, &bits);
+    if (status == CONFIGFILE_OK && value != NULL) {
+        memcpy(value, &bits, sizeof (*value));
+    }
+
+    return status;
+}
+
+configfile_status configfile_value_bool(configfile *module, int *value) {
+    configfile_status status;
+    uint64_t bits;
+
+    status = configfile_value_convert(module, CONFIGFILE_TYPE_BOOL, configfile_convert_bool, &bits);
+    if (status == CONFIGFILE_OK && value != NULL) {
+        *value = (int) bits;
+    }
+
+    return status;
+}
+
+configfile_status configfile_value_duration(configfile *module, int64_t *nanoseconds) {
+    configfile_status status;
+    uint64_t bits;
+
+    status = configfile_value_convert(module, CONFIGFILE_TYPE_DURATION, configfile_convert_duration, &bits);
+    if (status == CONFIGFILE_OK && nanoseconds != NULL) {
+        *nanoseconds = (int64_t) bits;
+    }
+
+    return status;
+}
+
+configfile_status configfile_value_size(configfile *module, uint64_t *bytes) {
+    configfile_status status;
+    uint64_t bits;
+
+    status = configfile_value_convert(module, CONFIGFILE_TYPE_SIZE, configfile_convert_size, &bits);
+    if (status == CONFIGFILE_OK && bytes != NULL) {
+        *bytes = bits;
+    }
+
+    return status;
+}
+
+configfile_status configfile_get_int64(configfile *search_struct, const char *module_name, int64_t *value) {
+    return configfile_value_int64(configfile_get(search_struct, module_name), value);
+}
+
+configfile_status configfile_get_double(configfile *search_struct, const char *module_name, double *value) {
+    return configfile_value_double(configfile_get(search_struct, module_name), value);
+}
+
+configfile_status configfile_get_bool(configfile *search_struct, const char *module_name, int *value) {
+    return configfile_value_bool(configfile_get(search_struct, module_name), value);
+}
+
+configfile_status configfile_get_duration(configfile *search_struct, const char *module_name, int64_t *nanoseconds) {
+    return configfile_value_duration(configfile_get(search_struct, module_name), nanoseconds);
+}
+
+configfile_status configfile_get_size(configfile *search_struct, const char *module_name, uint64_t *bytes) {
+    return configfile_value_size(configfile_get(search_struct, module_name), bytes);
+}
+
+const char *configfile_status_string(configfile_status status) {
+    switch (status) {
+        case CONFIGFILE_OK:
+            return "success";
+        case CONFIGFILE_NOT_FOUND:
+            return "module not found";
+        case CONFIGFILE_INVALID:
+            return "invalid value";
+        case CONFIGFILE_RANGE:
+            return "value out of range";
+    }
+
+    return "unknown status";
+}
+
+void configfile_convert_all(configfile *config_struct) {
+    /* Most specific first: "8080" is an integer before being a double, a size or a duration in seconds. */
+    static const struct {
+        uint32_t type;
+        configfile_converter converter;
+    } order[] = {
+        {CONFIGFILE_TYPE_INT64, configfile_convert_int64},
+        {CONFIGFILE_TYPE_DOUBLE, configfile_convert_double},
+        {CONFIGFILE_TYPE_BOOL, configfile_convert_bool},
+        {CONFIGFILE_TYPE_DURATION, configfile_convert_duration},
+        {CONFIGFILE_TYPE_SIZE, configfile_convert_size}
+    };
+    int errno_backup = errno;
+    size_t length, i;
+    const char *value;
+    configfile *next;
+    uint64_t bits;
+
+    for (next = config_struct; next != NULL; next = next->next) {
+        if (next->module_cache_state != 0 || (value = configfile_value_expand(next, &length)) == NULL) {
+            continue;
+        }
+
+        for (i = 0; i < sizeof (order) / sizeof (order[0]); i++) {
+            if (order[i].converter(value, length, &bits) == CONFIGFILE_OK) {
+                next->module_cache = bits;
+                next->module_cache_state = order[i].type | CONFIGFILE_CACHE_EAGER;
+                break;
+            }
+        }
+    }
+
+    errno = errno_backup;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_diff.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Differences between two lists. Each list is walked once and every name is looked up in the other one with the
+ * hash cached in its node, so comparing two indexed lists takes time proportional to their sizes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libconfigfile_private.h"
+
+/**
+ * Tells whether a module is the one configfile_get() returns for its name, repeated names only count once.
+ * @param head Head of the list holding module.
+ * @param module Module to check.
+ */
+static int configfile_diff_visible(configfile *head, configfile *module) {
+    if (head->root != NULL && head->root->slots != NULL && head->root->entries == head->root->modules) {
+        return 1;
+    }
+
+    return configfile_get_hashed(head, module->module_name, module->module_name_length, module->module_hash) == module;
+}
+
+/**
+ * Tells whether two modules of the same name have different values, comparing expanded values when either one
+ * holds references.
+ */
+static int configfile_diff_modified(configfile *old_module, configfile *new_module) {
+    const char *old_value = old_module->module_value, *new_value = new_module->module_value;
+    size_t old_length = old_module->module_value_length, new_length = new_module->module_value_length;
+
+    /* Values that cannot be expanded are compared as written. */
+    if ((old_module->module_expansion != NULL || new_module->module_expansion != NULL) &&
+            (old_value = configfile_value_expand(old_module, &old_length)) != NULL &&
+            (new_value = configfile_value_expand(new_module, &new_length)) == NULL) {
+        old_value = NULL;
+    }
+    if (old_value == NULL) {
+        old_value = old_module->module_value;
+        old_length = old_module->module_value_length;
+        new_value = new_module->module_value;
+        new_length = new_module->module_value_length;
+    }
+
+    return old_length != new_length || memcmp(old_value, new_value, new_length) != 0;
+}
+
+int configfile_diff(configfile *old_config, configfile *new_config, configfile_diff_callback callback, void *user_data) {
+    configfile *module, *other;
+
+    if (callback == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Added and modified modules in the order of the new list, then removed ones in the order of the old list. */
+    for (module = new_config; module != NULL; module = module->next) {
+        if (!configfile_diff_visible(new_config, module)) {
+            continue;
+        }
+
+        other = old_config != NULL ? configfile_get_hashed(old_config, module->module_name, module->module_name_length, module->module_hash) : NULL;
+        if (other == NULL) {
+            if (callback(CONFIGFILE_ADDED, NULL, module, user_data) != 0) {
+                return 1;
+            }
+        } else if (configfile_diff_modified(other, module)) {
+            if (callback(CONFIGFILE_MODIFIED, other, module, user_data) != 0) {
+                return 1;
+            }
+        }
+    }
+
+    for (module = old_config; module != NULL; module = module->next) {
+        if (!configfile_diff_visible(old_config, module)) {
+            continue;
+        }
+
+        other = new_config != NULL ? configfile_get_hashed(new_config, module->module_name, module->module_name_length, module->module_hash) : NULL;
+        if (other == NULL && callback(CONFIGFILE_REMOVED, module, NULL, user_data) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
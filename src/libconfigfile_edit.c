@@ -0,0 +1,935 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_edit.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Edits of a loaded list and their incremental save. configfile_set() and configfile_delete() change the list,
+ * its hash index, its sections and the expansions depending on the module in place, and record the line of the
+ * file each change concerns. configfile_save() writes a new version of the file next to it: the bytes between
+ * changed lines are copied by the kernel with copy_file_range(2), the changed lines are written, and the new
+ * version is renamed over the file once synced. Lines keep their numbers, a deleted module leaves an empty line, so module_line stays valid
+ * across saves. Every line is located through the offsets of one line in CONFIGFILE_EDIT_STRIDE, taken by the
+ * first save and moved by each one, so later saves only read the changed lines.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libconfigfile_private.h"
+
+#define CONFIGFILE_EDIT_STRIDE 64
+#define CONFIGFILE_EDIT_CAPACITY 16
+
+typedef struct _configfile_edit {
+    /* Line of the module in the file, zero for a module added since the last save. */
+    size_t line;
+    /* Module written on that line, NULL to empty it. */
+    configfile *module;
+    /* Order of the edit, the last edit of a line is the one saved. */
+    size_t order;
+    /* Filled by the save, see configfile_save_checkpoints(). */
+    size_t lines;
+    size_t new_start;
+    size_t first_length;
+    size_t old_end;
+} configfile_edit;
+
+struct _configfile_edits {
+    configfile_edit *edits;
+    size_t count;
+    size_t capacity;
+    size_t order;
+    /* Last module of the list, found by the first module added. */
+    configfile *tail;
+    /* Offset of every CONFIGFILE_EDIT_STRIDE-th line of the file as last saved, from the first save on. */
+    size_t *checkpoints;
+    size_t checkpoint_count;
+    size_t checkpoint_capacity;
+    /* Lines of the file, a last line without a newline included. */
+    size_t lines;
+};
+
+/**
+ * Bytes kept by the trim of the default syntax, see configfile_scan_classes in libconfigfile.c. Lists resolving
+ * references keep '$', '{' and '}' too.
+ */
+static int configfile_edit_token(const configfile_root *root, char byte) {
+    return (byte >= '0' && byte <= '9') || (byte >= 'A' && byte <= 'Z') || (byte >= 'a' && byte <= 'z') ||
+            ((root->flags & CONFIGFILE_INTERPOLATE) && (byte == '$' || byte == '{' || byte == '}'));
+}
+
+/**
+ * Tells whether a value of the default syntax starts where the trim starts it: on a token, or on anything but a
+ * blank when its first token is a digit right after a sign or a dot.
+ */
+static int configfile_edit_start(const configfile_root *root, const char *value, size_t length) {
+    size_t i;
+
+    for (i = 0; i < length && !configfile_edit_token(root, value[i]); i++);
+
+    return i < length && (i == 0 || (value[i] >= '0' && value[i] <= '9' && value[0] != ' ' && value[0] != '\t' &&
+            (value[i - 1] == '-' || value[i - 1] == '+' || value[i - 1] == '.')));
+}
+
+static int configfile_edit_blank(char byte) {
+    return byte == ' ' || byte == '\t' || byte == '\v' || byte == '\f' || byte == '\r';
+}
+
+/**
+ * Tells whether a module written as "name = value" reads back as the same name and value.
+ * @return Returns 1 if it does, otherwise 0.
+ */
+static int configfile_edit_valid(const configfile_root *root, const char *module_name, size_t module_name_length,
+        const char *module_value, size_t module_value_length) {
+    if (module_name_length == 0 || memchr(module_name, '=', module_name_length) != NULL ||
+            memchr(module_name, '\n', module_name_length) != NULL) {
+        return 0;
+    }
+
+    /* Extended values are quoted when they need to be, any value can be written. */
+    if (root->flags & CONFIGFILE_EXTENDED) {
+        return !configfile_edit_blank(module_name[0]) && !configfile_edit_blank(module_name[module_name_length - 1]) &&
+                module_name[0] != '#' && module_name[0] != ';';
+    }
+
+    return configfile_edit_token(root, module_name[0]) && configfile_edit_token(root, module_name[module_name_length - 1]) &&
+            configfile_edit_start(root, module_value, module_value_length) &&
+            configfile_edit_token(root, module_value[module_value_length - 1]) &&
+            memchr(module_value, '\n', module_value_length) == NULL;
+}
+
+/**
+ * Returns the edits of a list, created on the first one.
+ * @return Returns the edits, or NULL with errno set to ENOMEM.
+ */
+static configfile_edits *configfile_edits_get(configfile_root *root) {
+    if (root->edits == NULL) {
+        root->edits = calloc(1, sizeof (configfile_edits));
+        if (root->edits == NULL) {
+            errno = ENOMEM;
+        }
+    }
+
+    return root->edits;
+}
+
+static int configfile_edit_compare(const void *left, const void *right) {
+    const configfile_edit *a = left, *b = right;
+
+    /* Added modules, on line zero, go after the lines of the file. */
+    if (a->line != b->line) {
+        return a->line - 1 < b->line - 1 ? -1 : 1;
+    }
+    return a->order < b->order ? -1 : a->order > b->order;
+}
+
+/**
+ * Sorts the edits by line, added modules last, and keeps the last one of each line. Added modules keep their order, those deleted
+ * since are dropped.
+ */
+static void configfile_edits_compact(configfile_edits *edits) {
+    size_t kept, i;
+
+    qsort(edits->edits, edits->count, sizeof (configfile_edit), configfile_edit_compare);
+
+    kept = 0;
+    for (i = 0; i < edits->count; i++) {
+        if (edits->edits[i].line == 0) {
+            if (edits->edits[i].module != NULL) {
+                edits->edits[kept++] = edits->edits[i];
+            }
+        } else if (i + 1 == edits->count || edits->edits[i + 1].line != edits->edits[i].line) {
+            edits->edits[kept++] = edits->edits[i];
+        }
+    }
+    edits->count = kept;
+}
+
+/**
+ * Makes room for one more edit, compacting the edits before growing them.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOMEM.
+ */
+static int configfile_edits_reserve(configfile_edits *edits) {
+    configfile_edit *grown;
+    size_t capacity;
+
+    if (edits->count < edits->capacity) {
+        return 0;
+    }
+
+    /* Compacting pays off when it frees half the edits, repeated sets of the same names. */
+    if (edits->capacity > 0) {
+        configfile_edits_compact(edits);
+        if (edits->count * 2 < edits->capacity) {
+            return 0;
+        }
+    }
+
+    capacity = edits->capacity > 0 ? edits->capacity * 2 : CONFIGFILE_EDIT_CAPACITY;
+    grown = realloc(edits->edits, capacity * sizeof (configfile_edit));
+    if (grown == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    edits->edits = grown;
+    edits->capacity = capacity;
+
+    return 0;
+}
+
+/**
+ * Records an edit, room must have been reserved.
+ */
+static void configfile_edits_add(configfile_edits *edits, size_t line, configfile *module) {
+    configfile_edit *edit = &edits->edits[edits->count++];
+
+    edit->line = line;
+    edit->module = module;
+    edit->order = edits->order++;
+}
+
+/**
+ * Points the edits of a module at another one, or at nothing.
+ */
+static void configfile_edits_retarget(configfile_edits *edits, const configfile *from, configfile *to) {
+    size_t i;
+
+    for (i = 0; i < edits->count; i++) {
+        if (edits->edits[i].module == from) {
+            edits->edits[i].module = to;
+        }
+    }
+}
+
+/**
+ * Checks that a list can be edited.
+ * @return Returns zero if it can, otherwise -1 with errno set to EINVAL, or ENOTSUP for a list not read from a
+ * single file by configfile_init_ex().
+ */
+static int configfile_edit_check(configfile *config, const char *module_name) {
+    if (config == NULL || module_name == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (config->root == NULL || config->root->file == NULL || config->root->slots == NULL) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    return 0;
+}
+
+int configfile_set(configfile *config, const char *module_name, const char *module_value) {
+    size_t module_name_length, module_value_length;
+    configfile_expansion *expansion = NULL;
+    configfile *module, *node, *tail;
+    configfile_edits *edits;
+    configfile_root *root;
+    char *value, *name;
+    uint64_t hash;
+
+    if (configfile_edit_check(config, module_name) != 0) {
+        return -1;
+    }
+    if (module_value == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    root = config->root;
+    module_name_length = strlen(module_name);
+    module_value_length = strlen(module_value);
+    if (!configfile_edit_valid(root, module_name, module_name_length, module_value, module_value_length)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    edits = configfile_edits_get(root);
+    if (edits == NULL || configfile_edits_reserve(edits) != 0) {
+        return -1;
+    }
+
+    /* Replaced values stay in the arena until the list is killed. */
+    value = configfile_arena_alloc(&root->arena, module_value_length + 1, 1);
+    if (value == NULL) {
+        return -1;
+    }
+    memcpy(value, module_value, module_value_length + 1);
+
+    hash = configfile_hash(module_name, module_name_length);
+    module = configfile_index_find(root, module_name, module_name_length, hash);
+    node = module;
+
+    if (module == NULL) {
+        node = configfile_arena_alloc(&root->arena, sizeof (configfile), CONFIGFILE_ARENA_ALIGN);
+        name = configfile_arena_alloc(&root->arena, module_name_length + 1, 1);
+        if (node == NULL || name == NULL) {
+            return -1;
+        }
+        memcpy(name, module_name, module_name_length + 1);
+
+        memset(node, 0, sizeof (configfile));
+        node->module_name = name;
+        node->module_name_length = module_name_length;
+        node->module_hash = hash;
+        node->module_file = root->file;
+    }
+
+    if ((root->flags & CONFIGFILE_INTERPOLATE) &&
+            configfile_interpolate_prepare(config, node, value, module_value_length, &expansion) != 0) {
+        return -1;
+    }
+
+    if (module == NULL) {
+        /* The tail is found once, by the first module added. */
+        tail = edits->tail;
+        if (tail == NULL) {
+            for (tail = config; tail->next != NULL; tail = tail->next);
+        }
+        if (configfile_index_insert(root, node) != 0) {
+            return -1;
+        }
+        tail->next = node;
+        edits->tail = node;
+        root->modules++;
+        configfile_sections_add(root, node);
+        configfile_edits_add(edits, 0, node);
+    } else if (module->module_line != 0) {
+        configfile_edits_add(edits, module->module_line, module);
+    }
+
+    node->module_value = value;
+    node->module_value_length = module_value_length;
+    node->module_cache = 0;
+    node->module_cache_state = 0;
+    if (root->flags & CONFIGFILE_INTERPOLATE) {
+        configfile_interpolate_replace(config, node, expansion);
+    }
+
+    if (module == NULL && root->keys != NULL) {
+        configfile_keys_bind(config, root->keys);
+    }
+
+    return 0;
+}
+
+int configfile_delete(configfile *config, const char *module_name) {
+    configfile *module, *previous, *next, *successor;
+    size_t module_name_length;
+    configfile_edits *edits;
+    configfile_root *root;
+
+    if (configfile_edit_check(config, module_name) != 0) {
+        return -1;
+    }
+
+    root = config->root;
+    module_name_length = strlen(module_name);
+    module = configfile_index_find(root, module_name, module_name_length, configfile_hash(module_name, module_name_length));
+    if (module == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    /* A list is never empty, and a referenced module would leave its references dangling. */
+    if ((module == config && config->next == NULL) ||
+            ((root->flags & CONFIGFILE_INTERPOLATE) && configfile_interpolate_referenced(config, module))) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    edits = configfile_edits_get(root);
+    if (edits == NULL || configfile_edits_reserve(edits) != 0) {
+        return -1;
+    }
+
+    /* As when the file is read again without the line, the next module of a repeated name becomes the one found. */
+    successor = NULL;
+    if (root->entries != root->modules) {
+        for (next = module->next; next != NULL && successor == NULL; next = next->next) {
+            if (next->module_hash == module->module_hash && next->module_name_length == module->module_name_length &&
+                    memcmp(next->module_name, module->module_name, module->module_name_length) == 0) {
+                successor = next;
+            }
+        }
+    }
+    if (successor != NULL) {
+        configfile_index_insert(root, successor);
+    } else {
+        configfile_index_remove(root, module);
+    }
+    configfile_sections_replace(root, module, successor);
+
+    if (root->flags & CONFIGFILE_INTERPOLATE) {
+        configfile_interpolate_replace(config, module, NULL);
+    }
+
+    if (module->module_line != 0) {
+        configfile_edits_add(edits, module->module_line, NULL);
+    } else {
+        configfile_edits_retarget(edits, module, NULL);
+    }
+
+    if (module == config) {
+        /* The head is the handle of the list, it takes the place of the next node instead. */
+        next = config->next;
+        *config = *next;
+        config->root = root;
+        if (configfile_index_find(root, next->module_name, next->module_name_length, next->module_hash) == next) {
+            configfile_index_insert(root, config);
+        }
+        if (root->flags & CONFIGFILE_INTERPOLATE) {
+            configfile_interpolate_move(config, next, config);
+        }
+        configfile_sections_replace(root, next, config);
+        configfile_edits_retarget(edits, next, config);
+        if (edits->tail == next) {
+            edits->tail = config;
+        }
+    } else {
+        for (previous = config; previous->next != module; previous = previous->next);
+        previous->next = module->next;
+        if (edits->tail == module) {
+            edits->tail = previous;
+        }
+    }
+    root->modules--;
+
+    if (root->keys != NULL) {
+        configfile_keys_bind(config, root->keys);
+    }
+
+    return 0;
+}
+
+/**
+ * Writes a buffer whole.
+ * @return Returns zero on success, on failure returns -1 and errno is set according to write(2).
+ */
+static int configfile_save_write(int fd, const char *buffer, size_t length) {
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(fd, buffer, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buffer += written;
+        length -= written;
+    }
+
+    return 0;
+}
+
+/**
+ * Appends bytes of the old version of the file to the new one, letting the kernel copy them, or share their
+ * blocks on filesystems that can.
+ * @param from Old version, read at offset.
+ * @param to New version, written at its current position.
+ * @param mapping Old version mapped, written from when the kernel cannot copy between the files.
+ * @return Returns zero on success, on failure returns -1 and errno is set.
+ */
+static int configfile_save_copy(int from, int to, const char *mapping, size_t offset, size_t length) {
+    loff_t position = offset;
+    ssize_t copied;
+
+    while (length > 0) {
+        copied = copy_file_range(from, &position, to, NULL, length, 0);
+        if (copied < 0 && errno == EINTR) {
+            continue;
+        }
+        if (copied < 0 && errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) {
+            return -1;
+        }
+        if (copied <= 0) {
+            return configfile_save_write(to, &mapping[position], length);
+        }
+        length -= copied;
+    }
+
+    return 0;
+}
+
+/**
+ * Formats the line of a module into a buffer, growing it as needed. Values of extended lists are quoted when
+ * they would not read back as written otherwise.
+ * @return Returns the length of the line, its newline included, or zero with errno set to ENOMEM.
+ */
+static size_t configfile_save_format(const configfile_root *root, const configfile *module, char **buffer, size_t *capacity) {
+    const char *value = module->module_value;
+    size_t length, needed, i;
+    int quote = 0;
+    char *line;
+
+    if (root->flags & CONFIGFILE_EXTENDED) {
+        quote = module->module_value_length == 0 || configfile_edit_blank(value[0]) ||
+                configfile_edit_blank(value[module->module_value_length - 1]);
+        for (i = 0; i < module->module_value_length && !quote; i++) {
+            quote = strchr("\n\r\"'\\#;", value[i]) != NULL && value[i] != '\0';
+        }
+    }
+
+    /* An escaped byte takes two, quotes and the delimiter take six more. */
+    needed = module->module_name_length + 2 * module->module_value_length + 6;
+    if (needed > *capacity) {
+        line = realloc(*buffer, needed);
+        if (line == NULL) {
+            errno = ENOMEM;
+            return 0;
+        }
+        *buffer = line;
+        *capacity = needed;
+    }
+
+    line = *buffer;
+    memcpy(line, module->module_name, module->module_name_length);
+    length = module->module_name_length;
+    memcpy(&line[length], " = ", 3);
+    length += 3;
+
+    if (!quote) {
+        memcpy(&line[length], value, module->module_value_length);
+        length += module->module_value_length;
+    } else {
+        line[length++] = '"';
+        for (i = 0; i < module->module_value_length; i++) {
+            switch (value[i]) {
+                case '"':
+                case '\\':
+                    line[length++] = '\\';
+                    line[length++] = value[i];
+                    break;
+                case '\n':
+                    line[length++] = '\\';
+                    line[length++] = 'n';
+                    break;
+                case '\r':
+                    line[length++] = '\\';
+                    line[length++] = 'r';
+                    break;
+                case '\t':
+                    line[length++] = '\\';
+                    line[length++] = 't';
+                    break;
+                default:
+                    line[length++] = value[i];
+                    break;
+            }
+        }
+        line[length++] = '"';
+    }
+    line[length++] = '\n';
+
+    return length;
+}
+
+/**
+ * Records the offset of every CONFIGFILE_EDIT_STRIDE-th line of a file, reading it once.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOMEM.
+ */
+static int configfile_save_index(configfile_edits *edits, const char *mapping, size_t size) {
+    const char *newline;
+    size_t position, capacity;
+
+    capacity = size / 4096 + CONFIGFILE_EDIT_CAPACITY;
+    edits->checkpoints = malloc(capacity * sizeof (size_t));
+    if (edits->checkpoints == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    edits->checkpoint_capacity = capacity;
+    edits->checkpoint_count = 0;
+    edits->lines = 0;
+
+    for (position = 0; position < size; position = newline - mapping + 1) {
+        if (edits->lines % CONFIGFILE_EDIT_STRIDE == 0) {
+            if (edits->checkpoint_count == edits->checkpoint_capacity) {
+                size_t *grown = realloc(edits->checkpoints, 2 * edits->checkpoint_capacity * sizeof (size_t));
+
+                if (grown == NULL) {
+                    errno = ENOMEM;
+                    return -1;
+                }
+                edits->checkpoints = grown;
+                edits->checkpoint_capacity *= 2;
+            }
+            edits->checkpoints[edits->checkpoint_count++] = position;
+        }
+        edits->lines++;
+
+        newline = memchr(&mapping[position], '\n', size - position);
+        if (newline == NULL) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Returns the offset of a line of the file, starting from the checkpoint before it.
+ * @return Returns the offset, or size if the file has fewer lines.
+ */
+static size_t configfile_save_line(const configfile_edits *edits, const char *mapping, size_t size, size_t line) {
+    const char *newline;
+    size_t position, skip;
+
+    if (line == 0 || line > edits->lines) {
+        return size;
+    }
+
+    position = edits->checkpoints[(line - 1) / CONFIGFILE_EDIT_STRIDE];
+    for (skip = (line - 1) % CONFIGFILE_EDIT_STRIDE; skip > 0; skip--) {
+        newline = memchr(&mapping[position], '\n', size - position);
+        if (newline == NULL) {
+            return size;
+        }
+        position = newline - mapping + 1;
+    }
+
+    return position;
+}
+
+/**
+ * Returns the offset past the lines of a module starting at position, following the lines an unquoted extended
+ * value continues onto.
+ * @param lines Receives the number of lines.
+ */
+static size_t configfile_save_span(const configfile_root *root, const char *mapping, size_t size, size_t position, size_t *lines) {
+    const char *newline;
+    size_t end, last;
+
+    for (*lines = 1;; (*lines)++) {
+        newline = memchr(&mapping[position], '\n', size - position);
+        end = newline != NULL ? (size_t) (newline - mapping) : size;
+
+        last = end;
+        while (last > position && mapping[last - 1] == '\r') {
+            last--;
+        }
+        if (newline == NULL || !(root->flags & CONFIGFILE_EXTENDED) || last == position || mapping[last - 1] != '\\') {
+            return newline != NULL ? end + 1 : end;
+        }
+
+        /* Quoted values and comments do not continue. */
+        for (last = position; last < end && strchr("\"'#;", mapping[last]) == NULL; last++);
+        if (last < end) {
+            return end + 1;
+        }
+        position = end + 1;
+    }
+}
+
+/**
+ * Moves the checkpoints of a file to the offsets their lines have in the version just written, from the edits
+ * of the lines it replaced, sorted by line.
+ */
+static void configfile_save_checkpoints(configfile_edits *edits, size_t replaced) {
+    const configfile_edit *edit = NULL;
+    size_t checkpoint, line, next;
+
+    next = 0;
+    for (checkpoint = 0; checkpoint < edits->checkpoint_count; checkpoint++) {
+        line = checkpoint * CONFIGFILE_EDIT_STRIDE + 1;
+        while (next < replaced && edits->edits[next].line <= line) {
+            edit = &edits->edits[next++];
+        }
+        if (edit == NULL) {
+            continue;
+        }
+
+        if (line < edit->line + edit->lines) {
+            /* The first line of the module, or one of the empty lines it continued onto. */
+            edits->checkpoints[checkpoint] = edit->new_start + (line == edit->line ? 0 : edit->first_length + (line - edit->line - 1));
+        } else {
+            edits->checkpoints[checkpoint] += edit->new_start + edit->first_length + (edit->lines - 1) - edit->old_end;
+        }
+    }
+}
+
+/**
+ * Opens a temporary file next to another one, with the same permissions.
+ * @param path Receives the name of the temporary file, to be freed.
+ * @return Returns the descriptor, or -1 with errno set.
+ */
+static int configfile_save_temporary(const char *file, mode_t mode, char **path) {
+    int fd, errno_backup;
+
+    *path = malloc(strlen(file) + sizeof (".XXXXXX"));
+    if (*path == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    strcpy(*path, file);
+    strcat(*path, ".XXXXXX");
+
+    fd = mkostemp(*path, O_CLOEXEC);
+    if (fd < 0) {
+        free(*path);
+        return -1;
+    }
+
+    if (fchmod(fd, mode & 07777) != 0) {
+        errno_backup = errno;
+        close(fd);
+        unlink(*path);
+        free(*path);
+        errno = errno_backup;
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * Flushes the directory holding a file, so a rename into it survives a crash.
+ */
+static void configfile_save_directory(const char *file) {
+    char *directory, *slash;
+    int fd;
+
+    directory = strdup(file);
+    if (directory == NULL) {
+        return;
+    }
+
+    slash = strrchr(directory, '/');
+    if (slash == NULL) {
+        strcpy(directory, ".");
+    } else if (slash == directory) {
+        slash[1] = '\0';
+    } else {
+        slash[0] = '\0';
+    }
+
+    fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(directory);
+}
+
+int configfile_save(configfile *config) {
+    size_t size, copied, start, end, replaced, added, length, capacity, i;
+    configfile_edits *edits;
+    configfile_root *root;
+    struct stat file_stat;
+    char *mapping, *path, *line;
+    int fd, temporary, errno_backup;
+
+    if (config == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (config->root == NULL || config->root->file == NULL) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    root = config->root;
+    edits = root->edits;
+    if (edits == NULL || edits->count == 0) {
+        return 0;
+    }
+
+    fd = open(root->file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* The file must be the version the list was read from or last saved as, or changes made meanwhile would be lost. */
+    if (fstat(fd, &file_stat) != 0) {
+        goto error_00;
+    }
+    if (file_stat.st_dev != root->file_stat.st_dev || file_stat.st_ino != root->file_stat.st_ino ||
+            file_stat.st_size != root->file_stat.st_size || file_stat.st_mtim.tv_sec != root->file_stat.st_mtim.tv_sec ||
+            file_stat.st_mtim.tv_nsec != root->file_stat.st_mtim.tv_nsec) {
+        errno = ESTALE;
+        goto error_00;
+    }
+
+    size = file_stat.st_size;
+    mapping = NULL;
+    if (size > 0) {
+        mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            goto error_00;
+        }
+    }
+
+    if (edits->checkpoints == NULL && configfile_save_index(edits, mapping, size) != 0) {
+        goto error_01;
+    }
+
+    configfile_edits_compact(edits);
+    for (replaced = 0; replaced < edits->count && edits->edits[replaced].line != 0; replaced++);
+
+    temporary = configfile_save_temporary(root->file, file_stat.st_mode, &path);
+    if (temporary < 0) {
+        goto error_01;
+    }
+
+    line = NULL;
+    capacity = 0;
+    copied = 0;
+    for (i = 0; i < replaced; i++) {
+        configfile_edit *edit = &edits->edits[i];
+
+        start = configfile_save_line(edits, mapping, size, edit->line);
+        if (start == size || start < copied) {
+            errno = EIO;
+            goto error_02;
+        }
+        end = configfile_save_span(root, mapping, size, start, &edit->lines);
+
+        if (configfile_save_copy(fd, temporary, mapping, copied, start - copied) != 0) {
+            goto error_02;
+        }
+        edit->new_start = (i > 0 ? edits->edits[i - 1].new_start + edits->edits[i - 1].first_length +
+                edits->edits[i - 1].lines - 1 - edits->edits[i - 1].old_end : 0) + start;
+
+        /* A deleted module leaves an empty line, and the lines it continued onto stay as empty lines. */
+        length = 1;
+        if (edit->module != NULL) {
+            length = configfile_save_format(root, edit->module, &line, &capacity);
+            if (length == 0 || configfile_save_write(temporary, line, length) != 0) {
+                goto error_02;
+            }
+        } else if (configfile_save_write(temporary, "\n", 1) != 0) {
+            goto error_02;
+        }
+        for (added = 1; added < edit->lines; added++) {
+            if (configfile_save_write(temporary, "\n", 1) != 0) {
+                goto error_02;
+            }
+        }
+        edit->first_length = length;
+        edit->old_end = end;
+        copied = end;
+    }
+
+    if (configfile_save_copy(fd, temporary, mapping, copied, size - copied) != 0) {
+        goto error_02;
+    }
+
+    /* Added modules go at the end, on a line of their own. */
+    end = size + (replaced > 0 ? edits->edits[replaced - 1].new_start + edits->edits[replaced - 1].first_length +
+            edits->edits[replaced - 1].lines - 1 - edits->edits[replaced - 1].old_end : 0);
+    if (replaced < edits->count && size > 0 && mapping[size - 1] != '\n') {
+        if (configfile_save_write(temporary, "\n", 1) != 0) {
+            goto error_02;
+        }
+        end++;
+    }
+    for (i = replaced; i < edits->count; i++) {
+        length = configfile_save_format(root, edits->edits[i].module, &line, &capacity);
+        if (length == 0 || configfile_save_write(temporary, line, length) != 0) {
+            goto error_02;
+        }
+        edits->edits[i].new_start = end;
+        end += length;
+    }
+
+    if (fsync(temporary) != 0 || fstat(temporary, &file_stat) != 0 || close(temporary) != 0) {
+        temporary = -1;
+        goto error_02;
+    }
+    temporary = -1;
+    if (rename(path, root->file) != 0) {
+        goto error_02;
+    }
+    configfile_save_directory(root->file);
+
+    /* The file is replaced, what follows only brings the state of the list up to date and cannot fail. */
+    configfile_save_checkpoints(edits, replaced);
+    for (i = replaced; i < edits->count; i++) {
+        if (edits->lines % CONFIGFILE_EDIT_STRIDE == 0 && edits->checkpoint_count < edits->checkpoint_capacity) {
+            edits->checkpoints[edits->checkpoint_count++] = edits->edits[i].new_start;
+        } else if (edits->lines % CONFIGFILE_EDIT_STRIDE == 0) {
+            size_t *grown = realloc(edits->checkpoints, 2 * edits->checkpoint_capacity * sizeof (size_t));
+
+            /* Without room the checkpoints stop short of the file, they are taken again by the next save. */
+            if (grown == NULL) {
+                free(edits->checkpoints);
+                edits->checkpoints = NULL;
+                break;
+            }
+            edits->checkpoints = grown;
+            edits->checkpoint_capacity *= 2;
+            edits->checkpoints[edits->checkpoint_count++] = edits->edits[i].new_start;
+        }
+        edits->edits[i].module->module_line = ++edits->lines;
+    }
+    for (; i < edits->count; i++) {
+        edits->edits[i].module->module_line = ++edits->lines;
+    }
+
+    edits->count = 0;
+    root->file_stat = file_stat;
+    free(line);
+    free(path);
+    if (mapping != NULL) {
+        munmap(mapping, size);
+    }
+    close(fd);
+
+    return 0;
+
+error_02:
+    errno_backup = errno;
+    if (temporary >= 0) {
+        close(temporary);
+    }
+    unlink(path);
+    free(path);
+    free(line);
+    errno = errno_backup;
+error_01:
+    errno_backup = errno;
+    if (mapping != NULL) {
+        munmap(mapping, size);
+    }
+    errno = errno_backup;
+error_00:
+    errno_backup = errno;
+    close(fd);
+    errno = errno_backup;
+    return -1;
+}
+
+void configfile_edits_release(configfile_root *root) {
+    if (root->edits != NULL) {
+        free(root->edits->edits);
+        free(root->edits->checkpoints);
+        free(root->edits);
+    }
+}
@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_frozen.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Frozen lists. A frozen list is a single block aligned to a cache line:
+ *
+ *   header | seeds[bucket_count] | entries[entry_count] | strings
+ *
+ * Names are placed with a minimal perfect hash built by hash and displace: every name falls in a bucket of about
+ * CONFIGFILE_FROZEN_BUCKET names, and each bucket stores the seed that sends its names to slots no other name
+ * uses. Entries are the slots, so there are exactly as many as names and a lookup reads one seed and one entry.
+ * Entries are half a cache line and never straddle one, a name and its value are stored next to each other.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libconfigfile.h"
+
+#define CONFIGFILE_FROZEN_ALIGN 64
+/* Average names per bucket, the seeds take four bytes per bucket. */
+#define CONFIGFILE_FROZEN_BUCKET 4
+/* Seeds tried for one bucket, and seeds of the whole table tried, before giving up. */
+#define CONFIGFILE_FROZEN_TRIES (1U << 20)
+#define CONFIGFILE_FROZEN_ROUNDS 8
+
+typedef struct _configfile_frozen_entry {
+    uint64_t hash;
+    const char *name;
+    const char *value;
+    uint32_t name_length;
+    uint32_t value_length;
+} configfile_frozen_entry;
+
+struct _configfile_frozen {
+    /* Size of the whole block. */
+    size_t size;
+    size_t entry_count;
+    size_t bucket_count;
+    /* Mixed into every hash, changed when a table cannot be built. */
+    uint64_t seed;
+    const uint32_t *seeds;
+    const configfile_frozen_entry *entries;
+};
+
+/* A name of the list being frozen and the bucket it falls in. */
+typedef struct _configfile_frozen_key {
+    configfile *module;
+    size_t bucket;
+} configfile_frozen_key;
+
+/**
+ * Mixes the bits of a word, the finalizer of MurmurHash3. FNV-1a leaves the low bits of similar names correlated.
+ */
+static inline uint64_t configfile_frozen_mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/**
+ * Maps a word uniformly to [0, range) with a multiplication instead of a division.
+ */
+static inline size_t configfile_frozen_range(uint64_t hash, size_t range) {
+    return (size_t) (((unsigned __int128) hash * range) >> 64);
+}
+
+static inline size_t configfile_frozen_bucket(const configfile_frozen *frozen, uint64_t hash) {
+    return configfile_frozen_range(configfile_frozen_mix(hash ^ frozen->seed), frozen->bucket_count);
+}
+
+static inline size_t configfile_frozen_slot(const configfile_frozen *frozen, uint64_t hash, uint32_t seed) {
+    return configfile_frozen_range(configfile_frozen_mix(hash + frozen->seed + seed * 0x9e3779b97f4a7c15ULL), frozen->entry_count);
+}
+
+static size_t configfile_frozen_round_up(size_t size) {
+    return (size + CONFIGFILE_FROZEN_ALIGN - 1) & ~((size_t) CONFIGFILE_FROZEN_ALIGN - 1);
+}
+
+/**
+ * Finds a seed for every bucket, largest buckets first while most slots are free.
+ * @param frozen Table to fill, entry_count, bucket_count and seed set.
+ * @param keys Names sorted by bucket.
+ * @param starts Index in keys of the first name of every bucket, and the number of names at the end.
+ * @param seeds Receives the seed of every bucket.
+ * @param slots Receives the slot of every name.
+ * @return Returns zero on success or 1 if a bucket found no seed, on failure returns -1 and errno is set to ENOMEM.
+ */
+static int configfile_frozen_place(configfile_frozen *frozen, const configfile_frozen_key *keys, const size_t *starts,
+        uint32_t *seeds, size_t *slots) {
+    size_t *order, *sizes, largest, bucket, i, j, k;
+    uint64_t *taken;
+    uint32_t seed;
+    int result;
+
+    taken = calloc((frozen->entry_count + 63) / 64, sizeof (uint64_t));
+    order = malloc(frozen->bucket_count * sizeof (size_t));
+    if (taken == NULL || order == NULL) {
+        free(taken);
+        free(order);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* Buckets by decreasing size, with a counting sort. */
+    largest = 0;
+    for (bucket = 0; bucket < frozen->bucket_count; bucket++) {
+        if (starts[bucket + 1] - starts[bucket] > largest) {
+            largest = starts[bucket + 1] - starts[bucket];
+        }
+    }
+    sizes = calloc(largest + 2, sizeof (size_t));
+    if (sizes == NULL) {
+        free(taken);
+        free(order);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (bucket = 0; bucket < frozen->bucket_count; bucket++) {
+        sizes[largest - (starts[bucket + 1] - starts[bucket]) + 1]++;
+    }
+    for (i = 1; i <= largest + 1; i++) {
+        sizes[i] += sizes[i - 1];
+    }
+    for (bucket = 0; bucket < frozen->bucket_count; bucket++) {
+        order[sizes[largest - (starts[bucket + 1] - starts[bucket])]++] = bucket;
+    }
+    free(sizes);
+
+    result = 0;
+    for (i = 0; i < frozen->bucket_count && result == 0; i++) {
+        bucket = order[i];
+        if (starts[bucket] == starts[bucket + 1]) {
+            seeds[bucket] = 0;
+            continue;
+        }
+
+        for (seed = 0; seed < CONFIGFILE_FROZEN_TRIES; seed++) {
+            /* Every name of the bucket needs a free slot, distinct from those of the other names. */
+            for (j = starts[bucket]; j < starts[bucket + 1]; j++) {
+                slots[j] = configfile_frozen_slot(frozen, keys[j].module->module_hash, seed);
+                if (taken[slots[j] / 64] & (1ULL << (slots[j] % 64))) {
+                    break;
+                }
+                for (k = starts[bucket]; k < j && slots[k] != slots[j]; k++);
+                if (k < j) {
+                    break;
+                }
+            }
+            if (j == starts[bucket + 1]) {
+                break;
+            }
+        }
+
+        if (seed == CONFIGFILE_FROZEN_TRIES) {
+            result = 1;
+            break;
+        }
+
+        seeds[bucket] = seed;
+        for (j = starts[bucket]; j < starts[bucket + 1]; j++) {
+            taken[slots[j] / 64] |= 1ULL << (slots[j] % 64);
+        }
+    }
+
+    free(taken);
+    free(order);
+
+    return result;
+}
+
+const configfile_frozen *configfile_freeze(configfile *config) {
+    size_t entry_count, bucket_count, strings_size, seeds_offset, entries_offset, strings_offset, size, value_length, i;
+    configfile_frozen_entry *entries;
+    const char *value;
+    configfile_frozen_key *keys, *sorted;
+    configfile_frozen *frozen, header;
+    size_t *starts, *slots;
+    uint32_t *seeds;
+    configfile *next;
+    char *block, *strings;
+    int result, round;
+
+    if (config == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* Only the module configfile_get() returns for each name is kept. */
+    entry_count = 0;
+    strings_size = 0;
+    for (next = config; next != NULL; next = next->next) {
+        if (configfile_get_hashed(config, next->module_name, next->module_name_length, next->module_hash) == next) {
+            if (configfile_value_expand(next, &value_length) == NULL) {
+                return NULL;
+            }
+            entry_count++;
+            strings_size += next->module_name_length + value_length + 2;
+        }
+    }
+
+    bucket_count = (entry_count + CONFIGFILE_FROZEN_BUCKET - 1) / CONFIGFILE_FROZEN_BUCKET;
+    seeds_offset = configfile_frozen_round_up(sizeof (configfile_frozen));
+    entries_offset = seeds_offset + configfile_frozen_round_up(bucket_count * sizeof (uint32_t));
+    strings_offset = entries_offset + configfile_frozen_round_up(entry_count * sizeof (configfile_frozen_entry));
+    size = configfile_frozen_round_up(strings_offset + strings_size);
+
+    keys = malloc(entry_count * sizeof (configfile_frozen_key));
+    sorted = malloc(entry_count * sizeof (configfile_frozen_key));
+    starts = malloc((bucket_count + 1) * sizeof (size_t));
+    slots = malloc(entry_count * sizeof (size_t));
+    block = NULL;
+    if (keys == NULL || sorted == NULL || starts == NULL || slots == NULL || posix_memalign((void **) &block, CONFIGFILE_FROZEN_ALIGN, size) != 0) {
+        errno = ENOMEM;
+        goto error_00;
+    }
+
+    i = 0;
+    for (next = config; next != NULL; next = next->next) {
+        if (configfile_get_hashed(config, next->module_name, next->module_name_length, next->module_hash) == next) {
+            keys[i++].module = next;
+        }
+    }
+
+    memset(&header, 0, sizeof (header));
+    header.size = size;
+    header.entry_count = entry_count;
+    header.bucket_count = bucket_count;
+    seeds = (uint32_t *) &block[seeds_offset];
+
+    result = -1;
+    for (round = 0; round < CONFIGFILE_FROZEN_ROUNDS && result != 0; round++) {
+        header.seed = configfile_frozen_mix(round + 1);
+
+        /* Names sorted by bucket with a counting sort, starts ends up holding the first name of every bucket. */
+        memset(starts, 0, (bucket_count + 1) * sizeof (size_t));
+        for (i = 0; i < entry_count; i++) {
+            keys[i].bucket = configfile_frozen_bucket(&header, keys[i].module->module_hash);
+            starts[keys[i].bucket + 1]++;
+        }
+        for (i = 1; i <= bucket_count; i++) {
+            starts[i] += starts[i - 1];
+        }
+        for (i = 0; i < entry_count; i++) {
+            sorted[starts[keys[i].bucket]++] = keys[i];
+        }
+        memmove(&starts[1], starts, bucket_count * sizeof (size_t));
+        starts[0] = 0;
+
+        result = configfile_frozen_place(&header, sorted, starts, seeds, slots);
+        if (result < 0) {
+            goto error_00;
+        }
+    }
+
+    /* Names with the same configfile_hash() always share a slot, no seed separates them. */
+    if (result != 0) {
+        errno = EEXIST;
+        goto error_00;
+    }
+
+    frozen = (configfile_frozen *) block;
+    *frozen = header;
+    frozen->seeds = seeds;
+    entries = (configfile_frozen_entry *) &block[entries_offset];
+    frozen->entries = entries;
+    strings = &block[strings_offset];
+
+    /* Strings follow the order of the slots, so neighbouring entries have neighbouring strings. */
+    for (i = 0; i < entry_count; i++) {
+        keys[slots[i]] = sorted[i];
+    }
+    for (i = 0; i < entry_count; i++) {
+        next = keys[i].module;
+        entries[i].hash = next->module_hash;
+        entries[i].name = strings;
+        entries[i].name_length = next->module_name_length;
+        memcpy(strings, next->module_name, next->module_name_length);
+        strings[next->module_name_length] = '\0';
+        strings += next->module_name_length + 1;
+
+        /* Expanded in the first walk, this only reads the kept value. */
+        value = configfile_value_expand(next, &value_length);
+        entries[i].value = strings;
+        entries[i].value_length = value_length;
+        memcpy(strings, value, value_length);
+        strings[value_length] = '\0';
+        strings += value_length + 1;
+    }
+
+    free(keys);
+    free(sorted);
+    free(starts);
+    free(slots);
+
+    return frozen;
+
+error_00:
+    free(keys);
+    free(sorted);
+    free(starts);
+    free(slots);
+    free(block);
+    return NULL;
+}
+
+int configfile_frozen_get_hashed(const configfile_frozen *frozen, const char *module_name, size_t module_name_length,
+        uint64_t hash, configfile_view *view) {
+    const configfile_frozen_entry *entry;
+
+    if (frozen == NULL || module_name == NULL || frozen->entry_count == 0) {
+        return -1;
+    }
+
+    entry = &frozen->entries[configfile_frozen_slot(frozen, hash, frozen->seeds[configfile_frozen_bucket(frozen, hash)])];
+    if (entry->hash != hash || entry->name_length != module_name_length || memcmp(entry->name, module_name, module_name_length) != 0) {
+        return -1;
+    }
+
+    if (view != NULL) {
+        view->module_name = entry->name;
+        view->module_name_length = entry->name_length;
+        view->module_value = entry->value;
+        view->module_value_length = entry->value_length;
+    }
+
+    return 0;
+}
+
+int configfile_frozen_get(const configfile_frozen *frozen, const char *module_name, configfile_view *view) {
+    size_t module_name_length;
+
+    if (module_name == NULL) {
+        return -1;
+    }
+
+    module_name_length = strlen(module_name);
+
+    return configfile_frozen_get_hashed(frozen, module_name, module_name_length, configfile_hash(module_name, module_name_length), view);
+}
+
+size_t configfile_frozen_count(const configfile_frozen *frozen) {
+    return frozen != NULL ? frozen->entry_count : 0;
+}
+
+int configfile_frozen_at(const configfile_frozen *frozen, size_t index, configfile_view *view) {
+    const configfile_frozen_entry *entry;
+
+    if (frozen == NULL || index >= frozen->entry_count || view == NULL) {
+        return -1;
+    }
+
+    entry = &frozen->entries[index];
+    view->module_name = entry->name;
+    view->module_name_length = entry->name_length;
+    view->module_value = entry->value;
+    view->module_value_length = entry->value_length;
+
+    return 0;
+}
+
+size_t configfile_frozen_size(const configfile_frozen *frozen) {
+    return frozen != NULL ? frozen->size : 0;
+}
+
+void configfile_frozen_kill(const configfile_frozen *frozen) {
+    free((void *) frozen);
+}
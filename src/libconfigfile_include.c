@@ -0,0 +1,545 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_include.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Layered loading. Every file is a layer, a node of the tree formed by the given paths and the include directives.
+ * Layers are parsed by a pool of threads taking them from a queue, each into its own list allocated from the
+ * thread's arena, and includes are queued as soon as their directive is parsed. Once the queue is drained the lists
+ * are linked in a pre-order walk of the tree, so nothing is copied, and the index is told where each layer starts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libconfigfile_private.h"
+
+typedef struct _configfile_layer configfile_layer;
+typedef struct _configfile_layers configfile_layers;
+
+struct _configfile_layer {
+    /* First member, so the layer is the user data of configfile_builder_callback() as well. */
+    configfile_builder builder;
+    configfile_layers *layers;
+    /* NULL for the top of the tree, which only holds the given paths. */
+    char *path;
+    dev_t device;
+    ino_t inode;
+    configfile_layer *parent;
+    configfile_layer *first;
+    configfile_layer *last;
+    configfile_layer *sibling;
+    /* Next layer in the queue, then in the list of every layer. */
+    configfile_layer *queued;
+    configfile_layer *all;
+};
+
+struct _configfile_layers {
+    configfile_root *root;
+    int copy;
+    /* Whether files are read with configfile_tokenize(), see CONFIGFILE_EXTENDED. */
+    int extended;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    configfile_layer *queue;
+    configfile_layer **queue_tail;
+    /* Layers queued or being parsed, the load is done when none is left. */
+    size_t pending;
+    /* errno of the first failure, the remaining layers are then dropped. */
+    int error;
+    configfile_layer *all;
+    size_t count;
+};
+
+typedef struct _configfile_layers_worker {
+    configfile_layers *layers;
+    configfile_arena arena;
+    pthread_t thread;
+} configfile_layers_worker;
+
+/**
+ * Adds a file as the last child of a layer and queues it.
+ * @param layers State of the load.
+ * @param parent Layer including the file.
+ * @param path Path of the file, allocated with malloc(3) and owned by the layer from now on.
+ * @param file_stat Status of the file.
+ * @return Returns zero on success, on failure returns -1 and errno is set, to ELOOP if the file is the parent or
+ * one of its ancestors.
+ */
+static int configfile_layer_file(configfile_layers *layers, configfile_layer *parent, char *path, const struct stat *file_stat) {
+    configfile_layer *layer, *ancestor;
+
+    for (ancestor = parent; ancestor->path != NULL; ancestor = ancestor->parent) {
+        if (ancestor->device == file_stat->st_dev && ancestor->inode == file_stat->st_ino) {
+            free(path);
+            errno = ELOOP;
+            return -1;
+        }
+    }
+
+    layer = calloc(1, sizeof (configfile_layer));
+    if (layer == NULL) {
+        free(path);
+        return -1;
+    }
+
+    layer->layers = layers;
+    layer->path = path;
+    layer->device = file_stat->st_dev;
+    layer->inode = file_stat->st_ino;
+    layer->parent = parent;
+
+    /* Only the thread parsing the parent adds children to it. */
+    if (parent->last == NULL) {
+        parent->first = layer;
+    } else {
+        parent->last->sibling = layer;
+    }
+    parent->last = layer;
+
+    pthread_mutex_lock(&layers->lock);
+    layer->all = layers->all;
+    layers->all = layer;
+    layers->count++;
+    *layers->queue_tail = layer;
+    layers->queue_tail = &layer->queued;
+    layers->pending++;
+    pthread_cond_signal(&layers->cond);
+    pthread_mutex_unlock(&layers->lock);
+
+    return 0;
+}
+
+static int configfile_layer_compare(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/**
+ * Adds the ".conf" files of a directory as children of a layer, in strcmp(3) order of their names.
+ * @return Returns zero on success, on failure returns -1 and errno is set.
+ */
+static int configfile_layer_directory(configfile_layers *layers, configfile_layer *parent, const char *path) {
+    size_t count, size, length, path_length, i;
+    struct stat file_stat;
+    struct dirent *entry;
+    char **names, **grown, *file;
+    int result;
+    DIR *directory;
+
+    directory = opendir(path);
+    if (directory == NULL) {
+        return -1;
+    }
+
+    names = NULL;
+    count = size = 0;
+    result = 0;
+    while ((entry = readdir(directory)) != NULL) {
+        length = strlen(entry->d_name);
+        if (entry->d_name[0] == '.' || length < 5 || strcmp(&entry->d_name[length - 5], ".conf") != 0) {
+            continue;
+        }
+
+        if (count == size) {
+            size = size > 0 ? size * 2 : 16;
+            grown = realloc(names, size * sizeof (char *));
+            if (grown == NULL) {
+                result = -1;
+                break;
+            }
+            names = grown;
+        }
+
+        names[count] = strdup(entry->d_name);
+        if (names[count] == NULL) {
+            result = -1;
+            break;
+        }
+        count++;
+    }
+    closedir(directory);
+
+    if (result == 0) {
+        qsort(names, count, sizeof (char *), configfile_layer_compare);
+    }
+
+    path_length = strlen(path);
+    for (i = 0; i < count; i++) {
+        if (result != 0) {
+            free(names[i]);
+            continue;
+        }
+
+        length = strlen(names[i]);
+        file = malloc(path_length + length + 2);
+        if (file == NULL) {
+            result = -1;
+            free(names[i]);
+            continue;
+        }
+        memcpy(file, path, path_length);
+        file[path_length] = '/';
+        memcpy(&file[path_length + 1], names[i], length + 1);
+        free(names[i]);
+
+        /* Entries removed since they were listed are skipped, like entries that are not regular files. */
+        if (stat(file, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+            free(file);
+            continue;
+        }
+        if (configfile_layer_file(layers, parent, file, &file_stat) != 0) {
+            result = -1;
+        }
+    }
+    free(names);
+
+    return result;
+}
+
+/**
+ * Adds a file or the files of a directory as children of a layer.
+ * @param path Path to add, allocated with malloc(3) and owned by this function.
+ * @return Returns zero on success, on failure returns -1 and errno is set.
+ */
+static int configfile_layer_add(configfile_layers *layers, configfile_layer *parent, char *path) {
+    struct stat file_stat;
+    int result;
+
+    if (stat(path, &file_stat) != 0) {
+        free(path);
+        return -1;
+    }
+
+    if (!S_ISDIR(file_stat.st_mode)) {
+        return configfile_layer_file(layers, parent, path, &file_stat);
+    }
+
+    result = configfile_layer_directory(layers, parent, path);
+    free(path);
+
+    return result;
+}
+
+/**
+ * Handles a line without a delimiter of a layer, a configfile_directive_callback. Lines other than include
+ * directives are skipped, as configfile_init() does.
+ */
+static int configfile_layer_directive(const char *line, size_t length, size_t line_number, void *user_data) {
+    configfile_layer *layer = user_data;
+    size_t start, directory;
+    char *path, *slash;
+
+    (void) line_number;
+
+    while (length > 0 && isspace((unsigned char) line[length - 1])) {
+        length--;
+    }
+    if (length < 8 || memcmp(line, "include", 7) != 0 || !isspace((unsigned char) line[7])) {
+        return 0;
+    }
+    for (start = 8; isspace((unsigned char) line[start]); start++);
+
+    /* Relative paths are resolved against the directory of the including file. */
+    slash = strrchr(layer->path, '/');
+    directory = line[start] != '/' && slash != NULL ? (size_t) (slash - layer->path) + 1 : 0;
+
+    path = malloc(directory + length - start + 1);
+    if (path == NULL) {
+        layer->builder.error = errno;
+        return 1;
+    }
+    memcpy(path, layer->path, directory);
+    memcpy(&path[directory], &line[start], length - start);
+    path[directory + length - start] = '\0';
+
+    if (configfile_layer_add(layer->layers, layer, path) != 0) {
+        layer->builder.error = errno;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Parses the file of a layer into its own list, allocated from an arena of the calling thread.
+ * @return Returns zero on success, on failure returns -1 and errno is set.
+ */
+static int configfile_layer_parse(configfile_layer *layer, configfile_arena *arena) {
+    configfile_layers *layers = layer->layers;
+    size_t length, mapping_length, line;
+    configfile_mapping *mapping;
+    int fd, result, errno_parse;
+    char *address, *file;
+
+    layer->builder.root = layers->root;
+    layer->builder.arena = arena;
+    layer->builder.head = NULL;
+    layer->builder.next = &layer->builder.head;
+    layer->builder.copy = layers->copy;
+    layer->builder.error = 0;
+
+    file = configfile_arena_alloc(arena, strlen(layer->path) + 1, 1);
+    if (file == NULL) {
+        return -1;
+    }
+    strcpy(file, layer->path);
+    layer->builder.file = file;
+
+    fd = open(layer->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    address = configfile_map(fd, &length, &mapping_length);
+    close(fd);
+    if (address == NULL) {
+        return -1;
+    }
+
+    line = 0;
+    if (layers->extended) {
+        result = configfile_tokenize(address, length, &line, configfile_builder_callback, configfile_layer_directive, layer);
+    } else {
+        result = configfile_parse_lines(address, length, &line, layers->root->flags, configfile_builder_callback, configfile_layer_directive, layer);
+    }
+    if (result != 0) {
+        errno = layer->builder.error;
+        result = -1;
+    }
+
+    /* Copied modules no longer need the file, the others point into it until the list is killed. */
+    errno_parse = errno;
+    if (layers->copy) {
+        munmap(address, mapping_length);
+        errno = errno_parse;
+        return result;
+    }
+
+    mapping = configfile_arena_alloc(arena, sizeof (configfile_mapping), CONFIGFILE_ARENA_ALIGN);
+    if (mapping == NULL) {
+        munmap(address, mapping_length);
+        return -1;
+    }
+
+    mapping->address = address;
+    mapping->length = mapping_length;
+    pthread_mutex_lock(&layers->lock);
+    mapping->next = layers->root->mappings;
+    layers->root->mappings = mapping;
+    pthread_mutex_unlock(&layers->lock);
+
+    errno = errno_parse;
+    return result;
+}
+
+/**
+ * Parses queued layers until none is left or one fails.
+ * @param argument Worker.
+ * @return Returns NULL.
+ */
+static void *configfile_layers_work(void *argument) {
+    configfile_layers_worker *worker = argument;
+    configfile_layers *layers = worker->layers;
+    configfile_layer *layer;
+    int error;
+
+    CONFIGFILE_STATS_BIND(layers->root);
+
+    pthread_mutex_lock(&layers->lock);
+    for (;;) {
+        /* Layers being parsed may still queue includes, so workers wait until every queued layer is done. */
+        while (layers->queue == NULL && layers->pending > 0 && layers->error == 0) {
+            pthread_cond_wait(&layers->cond, &layers->lock);
+        }
+        if (layers->queue == NULL || layers->error != 0) {
+            break;
+        }
+
+        layer = layers->queue;
+        layers->queue = layer->queued;
+        if (layers->queue == NULL) {
+            layers->queue_tail = &layers->queue;
+        }
+        pthread_mutex_unlock(&layers->lock);
+
+        error = configfile_layer_parse(layer, &worker->arena) != 0 ? errno : 0;
+
+        pthread_mutex_lock(&layers->lock);
+        layers->pending--;
+        if (error != 0 && layers->error == 0) {
+            layers->error = error;
+        }
+        if (layers->pending == 0 || layers->error != 0) {
+            pthread_cond_broadcast(&layers->cond);
+        }
+    }
+    pthread_mutex_unlock(&layers->lock);
+
+    return NULL;
+}
+
+/**
+ * Links the lists of a layer and of its descendants in pre-order, recording the head of every non-empty list.
+ * @param layer Layer to link.
+ * @param tail Link to store the next list in, advanced to the end of the last list linked.
+ * @param heads Receives the heads.
+ * @param count Number of heads so far.
+ */
+static void configfile_layers_link(configfile_layer *layer, configfile ***tail, configfile **heads, size_t *count) {
+    configfile_layer *child;
+
+    if (layer->builder.head != NULL) {
+        **tail = layer->builder.head;
+        *tail = layer->builder.next;
+        heads[(*count)++] = layer->builder.head;
+    }
+
+    for (child = layer->first; child != NULL; child = child->sibling) {
+        configfile_layers_link(child, tail, heads, count);
+    }
+}
+
+configfile *configfile_init_layers(const char *const *paths, size_t count, const configfile_options *options) {
+    configfile_layers_worker *workers;
+    configfile_layer top, *layer;
+    configfile_layers layers;
+    configfile **heads, *head, **tail;
+    configfile_locked_allocator allocator;
+    unsigned int threads, started, i;
+    size_t layer_count;
+    int errno_backup;
+    char *path;
+
+    if (paths == NULL && count > 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    errno_backup = errno;
+
+    memset(&layers, 0, sizeof (layers));
+    layers.root = configfile_root_new(options);
+    if (layers.root == NULL) {
+        return NULL;
+    }
+    CONFIGFILE_STATS_BIND(layers.root);
+    CONFIGFILE_STATS_START(start);
+    layers.copy = options == NULL || !(options->flags & CONFIGFILE_MMAP);
+    layers.extended = options != NULL && (options->flags & CONFIGFILE_EXTENDED);
+    layers.queue_tail = &layers.queue;
+    pthread_mutex_init(&layers.lock, NULL);
+    pthread_cond_init(&layers.cond, NULL);
+
+    threads = configfile_threads(options);
+    workers = calloc(threads, sizeof (configfile_layers_worker));
+    if (workers == NULL) {
+        layers.error = ENOMEM;
+        threads = 0;
+    }
+
+    configfile_locked_init(&allocator, &layers.root->arena.allocator);
+    for (i = 0; i < threads; i++) {
+        workers[i].layers = &layers;
+        configfile_locked_arena(&workers[i].arena, &allocator, layers.root->arena.block_size);
+    }
+
+    /* The given paths are children of a top layer without a file, added before any thread runs. */
+    memset(&top, 0, sizeof (top));
+    for (i = 0; i < count && layers.error == 0; i++) {
+        path = paths[i] != NULL ? strdup(paths[i]) : NULL;
+        if (path == NULL) {
+            layers.error = paths[i] != NULL ? ENOMEM : EINVAL;
+        } else if (configfile_layer_add(&layers, &top, path) != 0) {
+            layers.error = errno;
+        }
+    }
+
+    if (layers.error == 0 && threads > 0) {
+        for (started = 1; started < threads; started++) {
+            if (pthread_create(&workers[started].thread, NULL, configfile_layers_work, &workers[started]) != 0) {
+                break;
+            }
+        }
+        configfile_layers_work(&workers[0]);
+        for (i = 1; i < started; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+
+    /* Blocks of the workers join the root's arena either way, the mappings of failed loads live in them. */
+    for (i = 0; i < threads; i++) {
+        configfile_arena_splice(&layers.root->arena, &workers[i].arena);
+    }
+    free(workers);
+    pthread_mutex_destroy(&allocator.lock);
+
+    head = NULL;
+    heads = NULL;
+    layer_count = 0;
+    if (layers.error == 0) {
+        heads = malloc((layers.count > 0 ? layers.count : 1) * sizeof (configfile *));
+        if (heads == NULL) {
+            layers.error = ENOMEM;
+        } else {
+            tail = &head;
+            configfile_layers_link(&top, &tail, heads, &layer_count);
+        }
+    }
+
+    while (layers.all != NULL) {
+        layer = layers.all;
+        layers.all = layer->all;
+        free(layer->path);
+        free(layer);
+    }
+    pthread_cond_destroy(&layers.cond);
+    pthread_mutex_destroy(&layers.lock);
+
+    /* As with configfile_init(), files without modules are not an error and errno is left as it was. */
+    if (layers.error != 0 || head == NULL) {
+        free(heads);
+        CONFIGFILE_STATS_UNBIND();
+        configfile_root_discard(layers.root);
+        errno = layers.error != 0 ? layers.error : errno_backup;
+        return NULL;
+    }
+
+    if (configfile_root_finish(layers.root, head, heads, layer_count, options, threads) != 0) {
+        errno_backup = errno;
+        free(heads);
+        CONFIGFILE_STATS_UNBIND();
+        configfile_root_discard(layers.root);
+        errno = errno_backup;
+        return NULL;
+    }
+    free(heads);
+    CONFIGFILE_STATS_STOP(load_ns, start);
+    CONFIGFILE_STATS_UNBIND();
+
+    errno = errno_backup;
+    return head;
+}
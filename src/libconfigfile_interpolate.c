@@ -0,0 +1,790 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_interpolate.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Interpolation. At load every value holding references gets an expansion in the list's arena, listing the bytes
+ * each reference replaces and the module or environment variable it names, which makes the references the edges
+ * of a dependency graph checked for cycles once. The expanded value is computed on first read and published with
+ * a compare and swap, threads racing on the same module agree on the first one published. Expanded values are
+ * the only memory of a list outside its arena and are freed with it. An edit replaces the expansion of the module
+ * it changes and frees the expanded values of the modules depending on it, found by walking the graph backwards.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libconfigfile_private.h"
+
+#define CONFIGFILE_ENV_PREFIX "ENV:"
+
+/* States of an expansion, for the cycle check at load and then for configfile_interpolate_inherit(). */
+#define CONFIGFILE_EXPANSION_NEW 0
+#define CONFIGFILE_EXPANSION_VISITING 1
+#define CONFIGFILE_EXPANSION_CHECKED 2
+#define CONFIGFILE_EXPANSION_UNCHANGED 3
+#define CONFIGFILE_EXPANSION_CHANGED 4
+
+typedef struct _configfile_expanded {
+    size_t length;
+    char value[];
+} configfile_expanded;
+
+typedef struct _configfile_reference {
+    /* Bytes of module_value replaced, from "${" to '}' included. */
+    size_t start;
+    size_t end;
+    /* Module named, NULL for an environment variable. */
+    configfile *target;
+    /* Name of the environment variable, terminated. */
+    const char *variable;
+} configfile_reference;
+
+struct _configfile_expansion {
+    /* Published once, only accessed atomically. Forgotten only by edits, see configfile_interpolate_replace(). */
+    configfile_expanded *expanded;
+    /* Every expansion of the list, so the expanded values are freed with it. */
+    configfile_expansion *next;
+    /* Module holding the expansion, NULL once an edit replaced it. */
+    configfile *module;
+    int state;
+    size_t reference_count;
+    configfile_reference references[];
+};
+
+/* A replacement computed while expanding. */
+typedef struct _configfile_piece {
+    const char *value;
+    size_t length;
+} configfile_piece;
+
+/**
+ * Finds the next reference in a value.
+ * @param value Bytes to search.
+ * @param length Number of bytes in value.
+ * @param name Receives the first byte of the name.
+ * @param name_length Receives the length of the name.
+ * @return Returns the offset of the "${" of the reference, or length if there is none. A "${" without a closing
+ * '}', or with an empty name, is not a reference.
+ */
+static size_t configfile_reference_next(const char *value, size_t length, const char **name, size_t *name_length) {
+    const char *dollar, *close;
+    size_t position = 0;
+
+    while ((dollar = memchr(&value[position], '$', length - position)) != NULL) {
+        position = dollar - value;
+        if (position + 2 < length && dollar[1] == '{') {
+            close = memchr(&dollar[2], '}', length - position - 2);
+            if (close == NULL) {
+                break;
+            }
+            if (close > &dollar[2]) {
+                *name = &dollar[2];
+                *name_length = close - &dollar[2];
+                return position;
+            }
+        }
+        position++;
+    }
+
+    return length;
+}
+
+/**
+ * Counts the references of a value.
+ */
+static size_t configfile_reference_count(const char *value, size_t length) {
+    size_t reference_count, position, offset, name_length;
+    const char *name;
+
+    reference_count = 0;
+    for (position = 0; (offset = configfile_reference_next(&value[position], length - position, &name, &name_length)) < length - position;
+            reference_count++) {
+        position = (name - value) + name_length + 1;
+    }
+
+    return reference_count;
+}
+
+/**
+ * Allocates an expansion in the arena of a root, not yet linked to its module nor to the root.
+ * @return Returns the expansion or NULL on failure, errno is set to ENOMEM.
+ */
+static configfile_expansion *configfile_expansion_new(configfile_root *root, size_t reference_count) {
+    configfile_expansion *expansion;
+
+    expansion = configfile_arena_alloc(&root->arena, sizeof (configfile_expansion) + reference_count * sizeof (configfile_reference),
+            sizeof (void *));
+    if (expansion == NULL) {
+        return NULL;
+    }
+    expansion->expanded = NULL;
+    expansion->next = NULL;
+    expansion->module = NULL;
+    expansion->state = CONFIGFILE_EXPANSION_NEW;
+    expansion->reference_count = reference_count;
+
+    return expansion;
+}
+
+/**
+ * Fills the references of a value, resolving the module names in the list.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOENT if a name is not in the list,
+ * or ENOMEM.
+ */
+static int configfile_expansion_fill(configfile *config_struct, const char *value, size_t length, configfile_expansion *expansion) {
+    const size_t prefix_length = sizeof (CONFIGFILE_ENV_PREFIX) - 1;
+    size_t position, offset, name_length, i;
+    configfile_reference *reference;
+    const char *name;
+    char *variable;
+
+    position = 0;
+    for (i = 0; i < expansion->reference_count; i++) {
+        offset = configfile_reference_next(&value[position], length - position, &name, &name_length);
+        reference = &expansion->references[i];
+        reference->start = position + offset;
+        reference->end = (name - value) + name_length + 1;
+        reference->target = NULL;
+        reference->variable = NULL;
+        position = reference->end;
+
+        if (name_length > prefix_length && memcmp(name, CONFIGFILE_ENV_PREFIX, prefix_length) == 0) {
+            variable = configfile_arena_alloc(&config_struct->root->arena, name_length - prefix_length + 1, 1);
+            if (variable == NULL) {
+                return -1;
+            }
+            memcpy(variable, &name[prefix_length], name_length - prefix_length);
+            variable[name_length - prefix_length] = '\0';
+            reference->variable = variable;
+            continue;
+        }
+
+        reference->target = configfile_get_hashed(config_struct, name, name_length, configfile_hash(name, name_length));
+        if (reference->target == NULL) {
+            errno = ENOENT;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Checks that no module references itself, directly or not, with a depth first walk of the references.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ELOOP, or ENOMEM.
+ */
+static int configfile_interpolate_check(configfile_root *root, size_t expansion_count) {
+    struct {
+        configfile_expansion *expansion;
+        size_t reference;
+    } *stack;
+    configfile_expansion *expansion, *target;
+    size_t depth;
+
+    stack = malloc(expansion_count * sizeof (*stack));
+    if (stack == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    for (expansion = root->expansions; expansion != NULL; expansion = expansion->next) {
+        if (expansion->state != CONFIGFILE_EXPANSION_NEW) {
+            continue;
+        }
+
+        expansion->state = CONFIGFILE_EXPANSION_VISITING;
+        stack[0].expansion = expansion;
+        stack[0].reference = 0;
+        depth = 1;
+
+        while (depth > 0) {
+            if (stack[depth - 1].reference == stack[depth - 1].expansion->reference_count) {
+                stack[--depth].expansion->state = CONFIGFILE_EXPANSION_CHECKED;
+                continue;
+            }
+
+            target = NULL;
+            if (stack[depth - 1].expansion->references[stack[depth - 1].reference].target != NULL) {
+                target = stack[depth - 1].expansion->references[stack[depth - 1].reference].target->module_expansion;
+            }
+            stack[depth - 1].reference++;
+
+            if (target == NULL || target->state == CONFIGFILE_EXPANSION_CHECKED) {
+                continue;
+            }
+            if (target->state == CONFIGFILE_EXPANSION_VISITING) {
+                free(stack);
+                errno = ELOOP;
+                return -1;
+            }
+
+            target->state = CONFIGFILE_EXPANSION_VISITING;
+            stack[depth].expansion = target;
+            stack[depth].reference = 0;
+            depth++;
+        }
+    }
+
+    free(stack);
+    return 0;
+}
+
+int configfile_interpolate_build(configfile *config_struct) {
+    configfile_root *root = config_struct->root;
+    size_t reference_count, expansion_count;
+    configfile_expansion *expansion;
+    configfile *next;
+
+    expansion_count = 0;
+    for (next = config_struct; next != NULL; next = next->next) {
+        reference_count = configfile_reference_count(next->module_value, next->module_value_length);
+        if (reference_count == 0) {
+            continue;
+        }
+
+        expansion = configfile_expansion_new(root, reference_count);
+        if (expansion == NULL) {
+            return -1;
+        }
+        expansion->module = next;
+        expansion->next = root->expansions;
+        root->expansions = expansion;
+        next->module_expansion = expansion;
+        expansion_count++;
+    }
+
+    /* Names are resolved once every module knows whether it has references, for the cycle check. */
+    for (next = config_struct; next != NULL; next = next->next) {
+        if (next->module_expansion != NULL &&
+                configfile_expansion_fill(config_struct, next->module_value, next->module_value_length, next->module_expansion) != 0) {
+            return -1;
+        }
+    }
+
+    return expansion_count > 0 ? configfile_interpolate_check(root, expansion_count) : 0;
+}
+
+/**
+ * Publishes the expanded value of a module, unless another thread did first.
+ * @return Returns the value published.
+ */
+static configfile_expanded *configfile_expansion_publish(configfile_expansion *expansion, configfile_expanded *expanded) {
+    configfile_expanded *expected = NULL;
+
+    if (!__atomic_compare_exchange_n(&expansion->expanded, &expected, expanded, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(expanded);
+        return expected;
+    }
+
+    return expanded;
+}
+
+/**
+ * Computes the expanded value of a module whose references are expanded, see configfile_expansion_resolve().
+ * @return Returns the published value or NULL on failure, errno is set to ENOMEM.
+ */
+static configfile_expanded *configfile_expansion_compute(configfile *module) {
+    configfile_expansion *expansion = module->module_expansion;
+    const configfile_reference *reference;
+    configfile_expanded *expanded;
+    configfile_piece *pieces;
+    size_t length, position, i;
+    char *value;
+
+    pieces = malloc(expansion->reference_count * sizeof (configfile_piece));
+    if (pieces == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Every variable is read once, the environment may change between two reads. */
+    length = module->module_value_length;
+    for (i = 0; i < expansion->reference_count; i++) {
+        reference = &expansion->references[i];
+        if (reference->target != NULL) {
+            pieces[i].value = configfile_value_expand(reference->target, &pieces[i].length);
+            if (pieces[i].value == NULL) {
+                free(pieces);
+                return NULL;
+            }
+        } else {
+            pieces[i].value = getenv(reference->variable);
+            if (pieces[i].value == NULL) {
+                pieces[i].value = "";
+            }
+            pieces[i].length = strlen(pieces[i].value);
+        }
+        length += pieces[i].length - (reference->end - reference->start);
+    }
+
+    expanded = malloc(sizeof (configfile_expanded) + length + 1);
+    if (expanded == NULL) {
+        free(pieces);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    value = expanded->value;
+    position = 0;
+    for (i = 0; i < expansion->reference_count; i++) {
+        reference = &expansion->references[i];
+        memcpy(value, &module->module_value[position], reference->start - position);
+        value += reference->start - position;
+        memcpy(value, pieces[i].value, pieces[i].length);
+        value += pieces[i].length;
+        position = reference->end;
+    }
+    memcpy(value, &module->module_value[position], module->module_value_length - position);
+    value[module->module_value_length - position] = '\0';
+    expanded->length = length;
+
+    free(pieces);
+
+    return configfile_expansion_publish(expansion, expanded);
+}
+
+/**
+ * Tells whether the module a reference names is still to be expanded.
+ */
+static int configfile_reference_pending(const configfile_reference *reference) {
+    return reference->target != NULL && reference->target->module_expansion != NULL &&
+            __atomic_load_n(&reference->target->module_expansion->expanded, __ATOMIC_ACQUIRE) == NULL;
+}
+
+/**
+ * Expands a module after the modules it references, deepest first. Chains of references are as long as the file
+ * makes them, so they are followed with a stack on the heap like the cycle check, not by recursion.
+ * @return Returns the published value or NULL on failure, errno is set to ENOMEM.
+ */
+static configfile_expanded *configfile_expansion_resolve(configfile *module) {
+    struct {
+        configfile *module;
+        size_t reference;
+    } *stack, *grown;
+    configfile_expansion *expansion;
+    configfile_expanded *expanded = NULL;
+    size_t depth, capacity;
+
+    capacity = 16;
+    stack = malloc(capacity * sizeof (*stack));
+    if (stack == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    stack[0].module = module;
+    stack[0].reference = 0;
+    depth = 1;
+
+    while (depth > 0) {
+        expansion = stack[depth - 1].module->module_expansion;
+        while (stack[depth - 1].reference < expansion->reference_count &&
+                !configfile_reference_pending(&expansion->references[stack[depth - 1].reference])) {
+            stack[depth - 1].reference++;
+        }
+
+        if (stack[depth - 1].reference == expansion->reference_count) {
+            expanded = __atomic_load_n(&expansion->expanded, __ATOMIC_ACQUIRE);
+            if (expanded == NULL && (expanded = configfile_expansion_compute(stack[depth - 1].module)) == NULL) {
+                free(stack);
+                return NULL;
+            }
+            depth--;
+            continue;
+        }
+
+        if (depth == capacity) {
+            grown = realloc(stack, 2 * capacity * sizeof (*stack));
+            if (grown == NULL) {
+                free(stack);
+                errno = ENOMEM;
+                return NULL;
+            }
+            stack = grown;
+            capacity *= 2;
+        }
+
+        stack[depth].module = expansion->references[stack[depth - 1].reference++].target;
+        stack[depth].reference = 0;
+        depth++;
+    }
+
+    free(stack);
+    return expanded;
+}
+
+const char *configfile_value_expand(configfile *module, size_t *length) {
+    configfile_expanded *expanded;
+
+    if (module == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (module->module_expansion == NULL) {
+        if (length != NULL) {
+            *length = module->module_value_length;
+        }
+        return module->module_value;
+    }
+
+    expanded = __atomic_load_n(&module->module_expansion->expanded, __ATOMIC_ACQUIRE);
+    if (expanded == NULL && (expanded = configfile_expansion_resolve(module)) == NULL) {
+        return NULL;
+    }
+
+    if (length != NULL) {
+        *length = expanded->length;
+    }
+    return expanded->value;
+}
+
+/**
+ * Compares a module of a new list with the module of the same name in the old list, leaving its references aside.
+ * @param old_module Receives the old module when the references decide.
+ * @return Returns 0 if changed, 1 if unchanged, or 2 if the module is unchanged unless a module it references
+ * changed. The expansion is then marked changed until they are checked.
+ */
+static int configfile_interpolate_compare(configfile *module, configfile *old_config, configfile **old_module) {
+    configfile_expansion *expansion = module->module_expansion;
+
+    if (expansion != NULL && expansion->state >= CONFIGFILE_EXPANSION_UNCHANGED) {
+        return expansion->state == CONFIGFILE_EXPANSION_UNCHANGED;
+    }
+
+    *old_module = configfile_get_hashed(old_config, module->module_name, module->module_name_length, module->module_hash);
+    if (*old_module == NULL || (*old_module)->module_value_length != module->module_value_length ||
+            memcmp((*old_module)->module_value, module->module_value, module->module_value_length) != 0 ||
+            ((*old_module)->module_expansion == NULL) != (expansion == NULL)) {
+        if (expansion != NULL) {
+            expansion->state = CONFIGFILE_EXPANSION_CHANGED;
+        }
+        return 0;
+    }
+    if (expansion == NULL) {
+        return 1;
+    }
+
+    expansion->state = CONFIGFILE_EXPANSION_CHANGED;
+    return 2;
+}
+
+/**
+ * Marks a module unchanged and gives it the expanded value of the old module, if computed.
+ */
+static void configfile_interpolate_keep(configfile *module, configfile *old_module) {
+    configfile_expansion *expansion = module->module_expansion;
+    configfile_expanded *expanded, *copy;
+
+    expansion->state = CONFIGFILE_EXPANSION_UNCHANGED;
+
+    expanded = __atomic_load_n(&old_module->module_expansion->expanded, __ATOMIC_ACQUIRE);
+    if (expanded != NULL && (copy = malloc(sizeof (configfile_expanded) + expanded->length + 1)) != NULL) {
+        memcpy(copy, expanded, sizeof (configfile_expanded) + expanded->length + 1);
+        configfile_expansion_publish(expansion, copy);
+    }
+}
+
+/**
+ * Tells whether a module of a new list expands to what the module of the same name expanded to in the old list,
+ * because it has the same value and every module it references did not change either. Environment variables
+ * count as changed, so reloading picks up new values. Decisions are kept in the expansions of the new list.
+ * References are followed with a stack on the heap, as by configfile_expansion_resolve().
+ * @return Returns 1 if unchanged, otherwise 0. Without memory for the stack the module counts as changed.
+ */
+static int configfile_interpolate_unchanged(configfile *module, configfile *old_config) {
+    struct {
+        configfile *module;
+        configfile *old_module;
+        size_t reference;
+    } *stack, *grown;
+    configfile_expansion *expansion;
+    configfile *old_module, *target;
+    size_t depth, capacity;
+    int result;
+
+    result = configfile_interpolate_compare(module, old_config, &old_module);
+    if (result != 2) {
+        return result;
+    }
+
+    capacity = 16;
+    stack = malloc(capacity * sizeof (*stack));
+    if (stack == NULL) {
+        return 0;
+    }
+
+    stack[0].module = module;
+    stack[0].old_module = old_module;
+    stack[0].reference = 0;
+    depth = 1;
+
+    /* The references are acyclic, checked at load. A changed one leaves every module on the stack changed. */
+    while (depth > 0) {
+        expansion = stack[depth - 1].module->module_expansion;
+        if (stack[depth - 1].reference == expansion->reference_count) {
+            configfile_interpolate_keep(stack[depth - 1].module, stack[depth - 1].old_module);
+            depth--;
+            continue;
+        }
+
+        target = expansion->references[stack[depth - 1].reference++].target;
+        result = target != NULL ? configfile_interpolate_compare(target, old_config, &old_module) : 0;
+        if (result == 0) {
+            free(stack);
+            return 0;
+        }
+        if (result == 1) {
+            continue;
+        }
+
+        if (depth == capacity) {
+            grown = realloc(stack, 2 * capacity * sizeof (*stack));
+            if (grown == NULL) {
+                free(stack);
+                return 0;
+            }
+            stack = grown;
+            capacity *= 2;
+        }
+
+        stack[depth].module = target;
+        stack[depth].old_module = old_module;
+        stack[depth].reference = 0;
+        depth++;
+    }
+
+    free(stack);
+    return 1;
+}
+
+void configfile_interpolate_inherit(configfile *config_struct, configfile *old_config) {
+    configfile *next;
+
+    if (config_struct == NULL || config_struct->root == NULL || old_config == NULL) {
+        return;
+    }
+
+    for (next = config_struct; next != NULL; next = next->next) {
+        if (next->module_expansion != NULL) {
+            configfile_interpolate_unchanged(next, old_config);
+        }
+    }
+}
+
+void configfile_interpolate_release(configfile_root *root) {
+    configfile_expansion *expansion;
+
+    for (expansion = root->expansions; expansion != NULL; expansion = expansion->next) {
+        free(expansion->expanded);
+    }
+}
+
+/**
+ * Tells whether the references of an expansion lead to a module, walking them breadth first.
+ * @return Returns 1 if they do, 0 if not, or -1 with errno set to ENOMEM.
+ */
+static int configfile_expansion_reaches(configfile_root *root, configfile_expansion *expansion, const configfile *module) {
+    configfile_expansion **seen, *next, *target;
+    size_t count, found, i, j;
+
+    count = 1;
+    for (next = root->expansions; next != NULL; next = next->next) {
+        count++;
+    }
+
+    seen = malloc(count * sizeof (configfile_expansion *));
+    if (seen == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* Seen expansions are marked visiting, the states only matter while a list is loaded. */
+    seen[0] = expansion;
+    expansion->state = CONFIGFILE_EXPANSION_VISITING;
+    count = 1;
+    found = 0;
+    for (i = 0; i < count && !found; i++) {
+        for (j = 0; j < seen[i]->reference_count; j++) {
+            if (seen[i]->references[j].target == NULL) {
+                continue;
+            }
+            if (seen[i]->references[j].target == module) {
+                found = 1;
+                break;
+            }
+
+            target = seen[i]->references[j].target->module_expansion;
+            if (target != NULL && target->state != CONFIGFILE_EXPANSION_VISITING) {
+                target->state = CONFIGFILE_EXPANSION_VISITING;
+                seen[count++] = target;
+            }
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        seen[i]->state = CONFIGFILE_EXPANSION_CHECKED;
+    }
+    free(seen);
+
+    return found;
+}
+
+int configfile_interpolate_prepare(configfile *config_struct, configfile *module, const char *value, size_t length,
+        configfile_expansion **expansion) {
+    configfile_expansion *created;
+    size_t reference_count;
+    int loop;
+
+    *expansion = NULL;
+
+    reference_count = configfile_reference_count(value, length);
+    if (reference_count == 0) {
+        return 0;
+    }
+
+    /* An expansion that fails stays unused in the arena. */
+    created = configfile_expansion_new(config_struct->root, reference_count);
+    if (created == NULL || configfile_expansion_fill(config_struct, value, length, created) != 0) {
+        return -1;
+    }
+
+    loop = configfile_expansion_reaches(config_struct->root, created, module);
+    if (loop != 0) {
+        if (loop > 0) {
+            errno = ELOOP;
+        }
+        return -1;
+    }
+
+    *expansion = created;
+    return 0;
+}
+
+/**
+ * Forgets the expanded and converted values computed from the value of a module, following the references
+ * backwards. An expansion without an expanded value has no dependent with one, as expanding a value expands the
+ * values it references first, so the walk stops there and forgets each expansion once.
+ */
+static void configfile_interpolate_forget(configfile_root *root, configfile *module) {
+    configfile_expansion *expansion;
+    configfile **pending;
+    size_t count, i;
+
+    count = 1;
+    for (expansion = root->expansions; expansion != NULL; expansion = expansion->next) {
+        count++;
+    }
+
+    pending = malloc(count * sizeof (configfile *));
+    if (pending == NULL) {
+        /* Forgetting every expanded value is always correct, they are computed again on the next read. */
+        for (expansion = root->expansions; expansion != NULL; expansion = expansion->next) {
+            if (expansion->module != NULL && expansion->expanded != NULL) {
+                free(expansion->expanded);
+                expansion->expanded = NULL;
+                expansion->module->module_cache_state = 0;
+            }
+        }
+        return;
+    }
+
+    pending[0] = module;
+    count = 1;
+    while (count > 0) {
+        module = pending[--count];
+        for (expansion = root->expansions; expansion != NULL; expansion = expansion->next) {
+            if (expansion->module == NULL || expansion->expanded == NULL) {
+                continue;
+            }
+            for (i = 0; i < expansion->reference_count; i++) {
+                if (expansion->references[i].target == module) {
+                    free(expansion->expanded);
+                    expansion->expanded = NULL;
+                    expansion->module->module_cache_state = 0;
+                    pending[count++] = expansion->module;
+                    break;
+                }
+            }
+        }
+    }
+
+    free(pending);
+}
+
+void configfile_interpolate_replace(configfile *config_struct, configfile *module, configfile_expansion *expansion) {
+    configfile_root *root = config_struct->root;
+    configfile_expansion *old_expansion = module->module_expansion;
+
+    /* The old expansion stays in the root's list, without a module or an expanded value. */
+    if (old_expansion != NULL) {
+        free(old_expansion->expanded);
+        old_expansion->expanded = NULL;
+        old_expansion->module = NULL;
+    }
+
+    if (expansion != NULL) {
+        expansion->module = module;
+        expansion->next = root->expansions;
+        root->expansions = expansion;
+    }
+    module->module_expansion = expansion;
+
+    configfile_interpolate_forget(root, module);
+}
+
+int configfile_interpolate_referenced(configfile *config_struct, const configfile *module) {
+    configfile_expansion *expansion;
+    size_t i;
+
+    for (expansion = config_struct->root->expansions; expansion != NULL; expansion = expansion->next) {
+        if (expansion->module == NULL) {
+            continue;
+        }
+        for (i = 0; i < expansion->reference_count; i++) {
+            if (expansion->references[i].target == module) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+void configfile_interpolate_move(configfile *config_struct, configfile *from, configfile *to) {
+    configfile_expansion *expansion;
+    size_t i;
+
+    for (expansion = config_struct->root->expansions; expansion != NULL; expansion = expansion->next) {
+        if (expansion->module == NULL) {
+            continue;
+        }
+        if (expansion->module == from) {
+            expansion->module = to;
+        }
+        for (i = 0; i < expansion->reference_count; i++) {
+            if (expansion->references[i].target == from) {
+                expansion->references[i].target = to;
+            }
+        }
+    }
+}
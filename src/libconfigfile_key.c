@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_key.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Interned key handles. A registry gives every interned name a slot, a slot only ever holds one name so its name,
+ * length and hash never change once published. Slots are stored in chunks of growing size that never move, so
+ * lookups read them without locking while other threads intern. Binding a registry to a list resolves every slot
+ * into a table of the list's arena, swapped atomically. Tables replaced by a later bind stay in the arena until the
+ * list is killed, readers may still hold them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "libconfigfile_private.h"
+
+/* Chunk c holds CONFIGFILE_KEYS_CHUNK << c slots, 27 chunks hold over two billion slots. */
+#define CONFIGFILE_KEYS_CHUNK 16
+#define CONFIGFILE_KEYS_CHUNKS 27
+
+typedef struct _configfile_keys_slot {
+    char *name;
+    size_t name_length;
+    uint64_t hash;
+    /* Generation of the current handle, bumped on release. Starts at 1 so zeroed handles never match. */
+    atomic_uint generation;
+    /* Whether the name is interned, only accessed with lock held. */
+    int live;
+} configfile_keys_slot;
+
+struct _configfile_keys {
+    pthread_mutex_t lock;
+    configfile_keys_slot *chunks[CONFIGFILE_KEYS_CHUNKS];
+    /* Slots in use, published after the slot is filled. */
+    atomic_uint count;
+};
+
+/**
+ * Locates a slot in the chunks of a registry.
+ * @param keys Registry.
+ * @param slot Slot number, below the number of slots of the allocated chunks.
+ * @return Returns the slot.
+ */
+static configfile_keys_slot *configfile_keys_slot_at(const configfile_keys *keys, uint32_t slot) {
+    unsigned int chunk = 31 - __builtin_clz(slot / CONFIGFILE_KEYS_CHUNK + 1);
+
+    return &keys->chunks[chunk][slot - CONFIGFILE_KEYS_CHUNK * ((1U << chunk) - 1)];
+}
+
+configfile_keys *configfile_keys_new(void) {
+    configfile_keys *keys;
+
+    keys = calloc(1, sizeof (configfile_keys));
+    if (keys == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&keys->lock, NULL);
+    atomic_init(&keys->count, 0);
+
+    return keys;
+}
+
+int configfile_keys_intern(configfile_keys *keys, const char *module_name, configfile_key *key) {
+    configfile_keys_slot *slot;
+    size_t name_length;
+    uint32_t count, i;
+    unsigned int chunk;
+    uint64_t hash;
+
+    if (keys == NULL || module_name == NULL || key == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    name_length = strlen(module_name);
+    hash = configfile_hash(module_name, name_length);
+
+    pthread_mutex_lock(&keys->lock);
+
+    count = atomic_load_explicit(&keys->count, memory_order_relaxed);
+    for (i = 0; i < count; i++) {
+        slot = configfile_keys_slot_at(keys, i);
+        if (slot->hash == hash && slot->name_length == name_length && memcmp(slot->name, module_name, name_length) == 0) {
+            slot->live = 1;
+            key->slot = i;
+            key->generation = atomic_load_explicit(&slot->generation, memory_order_relaxed);
+            pthread_mutex_unlock(&keys->lock);
+            return 0;
+        }
+    }
+
+    chunk = 31 - __builtin_clz(count / CONFIGFILE_KEYS_CHUNK + 1);
+    if (chunk >= CONFIGFILE_KEYS_CHUNKS) {
+        pthread_mutex_unlock(&keys->lock);
+        errno = ENOSPC;
+        return -1;
+    }
+
+    if (keys->chunks[chunk] == NULL) {
+        keys->chunks[chunk] = calloc((size_t) CONFIGFILE_KEYS_CHUNK << chunk, sizeof (configfile_keys_slot));
+        if (keys->chunks[chunk] == NULL) {
+            pthread_mutex_unlock(&keys->lock);
+            return -1;
+        }
+    }
+
+    slot = configfile_keys_slot_at(keys, count);
+    slot->name = malloc(name_length + 1);
+    if (slot->name == NULL) {
+        pthread_mutex_unlock(&keys->lock);
+        return -1;
+    }
+    memcpy(slot->name, module_name, name_length + 1);
+    slot->name_length = name_length;
+    slot->hash = hash;
+    slot->live = 1;
+    atomic_init(&slot->generation, 1);
+
+    atomic_store_explicit(&keys->count, count + 1, memory_order_release);
+
+    key->slot = count;
+    key->generation = 1;
+
+    pthread_mutex_unlock(&keys->lock);
+    return 0;
+}
+
+void configfile_keys_release(configfile_keys *keys, configfile_key key) {
+    configfile_keys_slot *slot;
+
+    if (keys == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&keys->lock);
+    if (key.slot < atomic_load_explicit(&keys->count, memory_order_relaxed)) {
+        slot = configfile_keys_slot_at(keys, key.slot);
+        if (slot->live && atomic_load_explicit(&slot->generation, memory_order_relaxed) == key.generation) {
+            slot->live = 0;
+            atomic_store_explicit(&slot->generation, key.generation + 1, memory_order_release);
+        }
+    }
+    pthread_mutex_unlock(&keys->lock);
+}
+
+int configfile_keys_bind(configfile *config, configfile_keys *keys) {
+    configfile_key_table *table;
+    configfile_keys_slot *slot;
+    configfile_root *root;
+    uint32_t count, i;
+
+    if (config == NULL || config->root == NULL || keys == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    root = config->root;
+    if (__atomic_load_n(&root->keys, __ATOMIC_ACQUIRE) != NULL && __atomic_load_n(&root->keys, __ATOMIC_ACQUIRE) != keys) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* The lock also serializes allocations from the arena of a list bound from several threads. */
+    pthread_mutex_lock(&keys->lock);
+    __atomic_store_n(&root->keys, keys, __ATOMIC_RELEASE);
+
+    count = atomic_load_explicit(&keys->count, memory_order_relaxed);
+    table = configfile_arena_alloc(&root->arena, sizeof (configfile_key_table) + count * sizeof (table->slots[0]), CONFIGFILE_ARENA_ALIGN);
+    if (table == NULL) {
+        pthread_mutex_unlock(&keys->lock);
+        return -1;
+    }
+
+    table->count = count;
+    for (i = 0; i < count; i++) {
+        slot = configfile_keys_slot_at(keys, i);
+        if (slot->live) {
+            table->slots[i].entry = configfile_get_hashed(config, slot->name, slot->name_length, slot->hash);
+            table->slots[i].generation = atomic_load_explicit(&slot->generation, memory_order_relaxed);
+        } else {
+            table->slots[i].entry = NULL;
+            table->slots[i].generation = 0;
+        }
+    }
+
+    __atomic_store_n(&root->key_table, table, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&keys->lock);
+
+    return 0;
+}
+
+void configfile_keys_kill(configfile_keys *keys) {
+    uint32_t count, i;
+    unsigned int chunk;
+
+    if (keys == NULL) {
+        return;
+    }
+
+    count = atomic_load(&keys->count);
+    for (i = 0; i < count; i++) {
+        free(configfile_keys_slot_at(keys, i)->name);
+    }
+    for (chunk = 0; chunk < CONFIGFILE_KEYS_CHUNKS; chunk++) {
+        free(keys->chunks[chunk]);
+    }
+
+    pthread_mutex_destroy(&keys->lock);
+    free(keys);
+}
+
+/**
+ * Resolves a handle through the registry bound to a list, for names interned or interned again after the last bind.
+ * @param config Head of the list.
+ * @param key Handle to resolve.
+ * @return Returns the module or NULL.
+ */
+static configfile *configfile_key_find(configfile *config, configfile_key key) {
+    configfile_keys_slot *slot;
+    configfile_keys *keys;
+
+    keys = __atomic_load_n(&config->root->keys, __ATOMIC_ACQUIRE);
+    if (keys == NULL || key.slot >= atomic_load_explicit(&keys->count, memory_order_acquire)) {
+        return NULL;
+    }
+
+    slot = configfile_keys_slot_at(keys, key.slot);
+    if (atomic_load_explicit(&slot->generation, memory_order_acquire) != key.generation) {
+        return NULL;
+    }
+
+    return configfile_get_hashed(config, slot->name, slot->name_length, slot->hash);
+}
+
+configfile *configfile_key_get(configfile *config, configfile_key key) {
+    const configfile_key_table *table;
+
+    if (config == NULL || config->root == NULL) {
+        return NULL;
+    }
+
+    table = __atomic_load_n(&config->root->key_table, __ATOMIC_ACQUIRE);
+    if (table != NULL && key.slot < table->count && table->slots[key.slot].generation == key.generation) {
+#ifdef CONFIGFILE_STATS
+        configfile_stats_lookup(config->root, table->slots[key.slot].entry, 0);
+#endif
+        return table->slots[key.slot].entry;
+    }
+
+    return configfile_key_find(config, key);
+}
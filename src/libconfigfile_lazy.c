@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_lazy.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Lazily parsed files. Loading maps the file, runs the scanner once and unmaps it, keeping for every module a
+ * single 64-bit slot of an open addressing table (linear probing):
+ *
+ *   bits 63..40  top 24 bits of the hash of the name
+ *   bits 39..1   offset of the name in the file + 1, zero meaning an empty slot
+ *   bit 0        zero
+ *
+ * Nothing else is stored. The first lookup of a name reads its line back with pread(2), parses it and replaces
+ * the slot with the address of the module built from it, with bit 0 set. The table is an anonymous mapping and
+ * modules are allocated one by one, so the resident set holds 8 bytes per slot plus the modules actually used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "libconfigfile_private.h"
+
+#define CONFIGFILE_LAZY_OFFSET_MASK ((1ULL << 40) - 2)
+#define CONFIGFILE_LAZY_TAG(hash) ((hash) & ~((1ULL << 40) - 1))
+#define CONFIGFILE_LAZY_OFFSET(slot) ((((slot) & CONFIGFILE_LAZY_OFFSET_MASK) >> 1) - 1)
+#define CONFIGFILE_LAZY_BUILT 1ULL
+/* Bytes read at once when reading a line back, doubled until the line fits. */
+#define CONFIGFILE_LAZY_LINE 256
+
+struct _configfile_lazy {
+    int fd;
+    /* Size of the file when it was scanned. */
+    size_t length;
+    uint64_t *slots;
+    size_t slots_mask;
+    size_t count;
+};
+
+/*
+ * State of the scan filling the slots.
+ */
+typedef struct _configfile_lazy_scan {
+    configfile_lazy *lazy;
+    const char *mapping;
+} configfile_lazy_scan;
+
+/*
+ * A module read back from its line.
+ */
+typedef struct _configfile_lazy_line {
+    const char *module_name;
+    const char *module_value;
+    size_t module_name_length;
+    size_t module_value_length;
+} configfile_lazy_line;
+
+static int configfile_lazy_insert(const char *module_name, size_t module_name_length, const char *module_value,
+        size_t module_value_length, size_t line, void *user_data) {
+    configfile_lazy_scan *scan = user_data;
+    configfile_lazy *lazy = scan->lazy;
+    uint64_t hash = configfile_hash(module_name, module_name_length);
+    size_t slot;
+
+    (void) module_value;
+    (void) module_value_length;
+    (void) line;
+
+    /* Later modules of a name land further along the probe sequence, so lookups find the first one. */
+    for (slot = hash & lazy->slots_mask; lazy->slots[slot] != 0; slot = (slot + 1) & lazy->slots_mask);
+    lazy->slots[slot] = CONFIGFILE_LAZY_TAG(hash) | (uint64_t) (module_name - scan->mapping + 1) << 1;
+    lazy->count++;
+
+    return 0;
+}
+
+static int configfile_lazy_read(const char *module_name, size_t module_name_length, const char *module_value,
+        size_t module_value_length, size_t line, void *user_data) {
+    configfile_lazy_line *read = user_data;
+
+    (void) line;
+
+    read->module_name = module_name;
+    read->module_name_length = module_name_length;
+    read->module_value = module_value;
+    read->module_value_length = module_value_length;
+
+    return 1;
+}
+
+/**
+ * Reads the line of a slot back from the file and parses it, from the name to the end of the line.
+ * @param buffer Buffer of CONFIGFILE_LAZY_LINE bytes, holding the line if it fits.
+ * @param line Receives the bytes read: buffer, or a block to free if the line is longer.
+ * @return Returns zero on success, on failure returns -1 and errno is set according to pread(2) or malloc(3), or to
+ * EIO if the line holds no module, meaning the file changed.
+ */
+static int configfile_lazy_line_read(const configfile_lazy *lazy, uint64_t slot_value, char *buffer, char **line,
+        configfile_lazy_line *read) {
+    size_t offset = CONFIGFILE_LAZY_OFFSET(slot_value), size = CONFIGFILE_LAZY_LINE, count = 0, available;
+    const char *end;
+    char *grown;
+    ssize_t result;
+
+    *line = buffer;
+    available = offset < lazy->length ? lazy->length - offset : 0;
+
+    for (;;) {
+        if (size > available) {
+            size = available;
+        }
+
+        while (count < size) {
+            result = pread(lazy->fd, *line + count, size - count, offset + count);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result < 0) {
+                return -1;
+            }
+            if (result == 0) {
+                break;
+            }
+            count += result;
+        }
+
+        end = memchr(*line, '\n', count);
+        if (end != NULL || count < size || size == available) {
+            break;
+        }
+
+        size *= 2;
+        grown = *line == buffer ? malloc(size) : realloc(*line, size);
+        if (grown == NULL) {
+            return -1;
+        }
+        if (*line == buffer) {
+            memcpy(grown, buffer, count);
+        }
+        *line = grown;
+    }
+
+    read->module_name = NULL;
+    configfile_parse_buffer(*line, end != NULL ? (size_t) (end - *line) : count, configfile_lazy_read, read);
+    if (read->module_name == NULL) {
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Builds the module of a line in a single block, name and value terminated after it.
+ * @return Returns the module or NULL with errno set to ENOMEM.
+ */
+static configfile *configfile_lazy_module(const configfile_lazy_line *read, uint64_t hash) {
+    configfile *module;
+    char *strings;
+
+    module = malloc(sizeof (configfile) + read->module_name_length + read->module_value_length + 2);
+    if (module == NULL) {
+        return NULL;
+    }
+    memset(module, 0, sizeof (configfile));
+
+    strings = (char *) (module + 1);
+    memcpy(strings, read->module_name, read->module_name_length);
+    strings[read->module_name_length] = '\0';
+    memcpy(&strings[read->module_name_length + 1], read->module_value, read->module_value_length);
+    strings[read->module_name_length + 1 + read->module_value_length] = '\0';
+
+    module->module_name = strings;
+    module->module_name_length = read->module_name_length;
+    module->module_value = &strings[read->module_name_length + 1];
+    module->module_value_length = read->module_value_length;
+    module->module_hash = hash;
+
+    return module;
+}
+
+const configfile_lazy *configfile_lazy_open(const char *filename) {
+    configfile_lazy_scan scan;
+    configfile_lazy *lazy;
+    size_t lines, slot_count, position, mapping_length;
+    const char *newline;
+    char *mapping;
+    int errno_backup;
+
+    if (filename == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    lazy = calloc(1, sizeof (configfile_lazy));
+    if (lazy == NULL) {
+        return NULL;
+    }
+
+    lazy->fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (lazy->fd < 0) {
+        free(lazy);
+        return NULL;
+    }
+
+    mapping = configfile_map(lazy->fd, &lazy->length, &mapping_length);
+    if (mapping == NULL) {
+        goto error_00;
+    }
+
+    if (lazy->length >= CONFIGFILE_LAZY_OFFSET_MASK >> 1) {
+        errno = EFBIG;
+        goto error_01;
+    }
+
+    /* Every module takes a line, so counting lines bounds the table before it is filled. */
+    lines = lazy->length > 0 && mapping[lazy->length - 1] != '\n';
+    for (position = 0; (newline = memchr(&mapping[position], '\n', lazy->length - position)) != NULL; position = newline - mapping + 1) {
+        lines++;
+    }
+
+    for (slot_count = 16; slot_count < lines + lines / 2; slot_count <<= 1);
+    lazy->slots_mask = slot_count - 1;
+
+    lazy->slots = mmap(NULL, slot_count * sizeof (uint64_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (lazy->slots == MAP_FAILED) {
+        lazy->slots = NULL;
+        goto error_01;
+    }
+
+    scan.lazy = lazy;
+    scan.mapping = mapping;
+    configfile_parse_buffer(mapping, lazy->length, configfile_lazy_insert, &scan);
+
+    /* Lines are read back one at a time from now on, the file leaves the resident set. */
+    munmap(mapping, mapping_length);
+
+    return lazy;
+
+error_01:
+    errno_backup = errno;
+    munmap(mapping, mapping_length);
+    errno = errno_backup;
+
+error_00:
+    errno_backup = errno;
+    configfile_lazy_kill(lazy);
+    errno = errno_backup;
+    return NULL;
+}
+
+configfile *configfile_lazy_get_hashed(const configfile_lazy *lazy, const char *module_name, size_t module_name_length, uint64_t hash) {
+    char buffer[CONFIGFILE_LAZY_LINE], *line;
+    configfile_lazy_line read;
+    configfile *module;
+    uint64_t slot_value, built;
+    size_t slot;
+    int matched;
+
+    if (lazy == NULL || module_name == NULL) {
+        return NULL;
+    }
+
+    for (slot = hash & lazy->slots_mask; (slot_value = __atomic_load_n(&lazy->slots[slot], __ATOMIC_ACQUIRE)) != 0;
+            slot = (slot + 1) & lazy->slots_mask) {
+        if (slot_value & CONFIGFILE_LAZY_BUILT) {
+            module = (configfile *) (uintptr_t) (slot_value & ~CONFIGFILE_LAZY_BUILT);
+            if (module->module_hash == hash && module->module_name_length == module_name_length &&
+                    memcmp(module->module_name, module_name, module_name_length) == 0) {
+                return module;
+            }
+            continue;
+        }
+
+        if (CONFIGFILE_LAZY_TAG(slot_value) != CONFIGFILE_LAZY_TAG(hash)) {
+            continue;
+        }
+
+        if (configfile_lazy_line_read(lazy, slot_value, buffer, &line, &read) != 0) {
+            if (line != buffer) {
+                free(line);
+            }
+            return NULL;
+        }
+
+        matched = read.module_name_length == module_name_length && memcmp(read.module_name, module_name, module_name_length) == 0;
+        module = matched ? configfile_lazy_module(&read, hash) : NULL;
+        if (line != buffer) {
+            free(line);
+        }
+
+        if (!matched) {
+            continue;
+        }
+        if (module == NULL) {
+            return NULL;
+        }
+
+        /* Threads racing on the first lookup of a name all return the module published first. */
+        built = (uintptr_t) module | CONFIGFILE_LAZY_BUILT;
+        if (!__atomic_compare_exchange_n(&lazy->slots[slot], &slot_value, built, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            free(module);
+            module = (configfile *) (uintptr_t) (slot_value & ~CONFIGFILE_LAZY_BUILT);
+        }
+
+        return module;
+    }
+
+    return NULL;
+}
+
+configfile *configfile_lazy_get(const configfile_lazy *lazy, const char *module_name) {
+    size_t module_name_length;
+
+    if (module_name == NULL) {
+        return NULL;
+    }
+
+    module_name_length = strlen(module_name);
+    return configfile_lazy_get_hashed(lazy, module_name, module_name_length, configfile_hash(module_name, module_name_length));
+}
+
+size_t configfile_lazy_count(const configfile_lazy *lazy) {
+    return lazy != NULL ? lazy->count : 0;
+}
+
+size_t configfile_lazy_loaded(const configfile_lazy *lazy) {
+    size_t slot, loaded = 0;
+
+    if (lazy == NULL) {
+        return 0;
+    }
+
+    for (slot = 0; slot <= lazy->slots_mask; slot++) {
+        loaded += __atomic_load_n(&lazy->slots[slot], __ATOMIC_ACQUIRE) & CONFIGFILE_LAZY_BUILT;
+    }
+
+    return loaded;
+}
+
+void configfile_lazy_kill(const configfile_lazy *lazy) {
+    configfile_lazy *owned = (configfile_lazy *) lazy;
+    size_t slot;
+
+    if (owned == NULL) {
+        return;
+    }
+
+    if (owned->slots != NULL) {
+        for (slot = 0; slot <= owned->slots_mask; slot++) {
+            if (owned->slots[slot] & CONFIGFILE_LAZY_BUILT) {
+                free((void *) (uintptr_t) (owned->slots[slot] & ~CONFIGFILE_LAZY_BUILT));
+            }
+        }
+        munmap(owned->slots, (owned->slots_mask + 1) * sizeof (uint64_t));
+    }
+
+    close(owned->fd);
+    free(owned);
+}
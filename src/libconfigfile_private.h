@@ -0,0 +1,536 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_private.h
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Internals shared by the translation units of the library. Not installed, not part of the API.
+ */
+
+#ifndef LIBCONFIGFILE_PRIVATE_H
+#define LIBCONFIGFILE_PRIVATE_H
+
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "libconfigfile.h"
+
+#define CONFIGFILE_FNV_OFFSET 0xcbf29ce484222325ULL
+#define CONFIGFILE_FNV_PRIME 0x100000001b3ULL
+
+#define CONFIGFILE_ARENA_ALIGN 16
+
+typedef struct _configfile_slot configfile_slot;
+typedef struct _configfile_arena configfile_arena;
+typedef struct _configfile_arena_block configfile_arena_block;
+typedef struct _configfile_key_table configfile_key_table;
+typedef struct _configfile_mapping configfile_mapping;
+typedef struct _configfile_builder configfile_builder;
+typedef struct _configfile_locked_allocator configfile_locked_allocator;
+typedef struct _configfile_stats_state configfile_stats_state;
+typedef struct _configfile_edits configfile_edits;
+
+/**
+ * Called by configfile_parse_lines() for lines holding a token but no delimiter.
+ * @param line Line from its first token byte up to its newline, not terminated.
+ * @param length Number of bytes in line.
+ * @param line_number Number of the line, starting at 1.
+ * @param user_data Pointer given to the parser.
+ * @return Returns zero to continue, anything else stops the parse.
+ */
+typedef int (*configfile_directive_callback)(const char *line, size_t length, size_t line_number, void *user_data);
+
+struct _configfile_slot {
+    uint64_t hash;
+    configfile *entry;
+};
+
+struct _configfile_arena_block {
+    configfile_arena_block *next;
+    size_t size;
+    size_t used;
+};
+
+/*
+ * Keys of a registry resolved for one list, indexed by key slot. A slot whose generation differs from the handle's,
+ * or past count, is resolved through the registry instead, see libconfigfile_key.c.
+ */
+struct _configfile_key_table {
+    size_t count;
+    struct {
+        configfile *entry;
+        uint32_t generation;
+    } slots[];
+};
+
+/*
+ * A mapping a list points into besides the one of its main file, unmapped when the list is killed.
+ */
+struct _configfile_mapping {
+    char *address;
+    size_t length;
+    configfile_mapping *next;
+};
+
+/*
+ * Bump allocator holding every node and string of a list. Blocks come from the allocator callbacks and are only
+ * given back all at once, when the list is killed.
+ */
+struct _configfile_arena {
+    configfile_allocator allocator;
+    configfile_arena_block *blocks;
+    size_t block_size;
+};
+
+#ifdef CONFIGFILE_STATS
+/*
+ * Instrumentation of a list. Counters are updated atomically by every thread, hot keys with the lock held. Hot
+ * keys are counted with the space saving algorithm: a sampled module missing from a full table replaces the least
+ * counted one and inherits its count plus one.
+ */
+typedef struct _configfile_stats_hot {
+    const configfile *entry;
+    uint64_t samples;
+} configfile_stats_hot;
+
+struct _configfile_stats_state {
+    configfile_stats counters;
+    pthread_mutex_t hot_lock;
+    configfile_stats_hot hot[CONFIGFILE_STATS_HOT];
+};
+
+/* Counters of the load running on the calling thread, NULL outside loads. */
+extern __thread configfile_stats *configfile_stats_load;
+
+static inline uint64_t configfile_stats_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * configfile_get_hashed() on a list loaded from a file, counting the lookup.
+ */
+configfile *configfile_stats_find(configfile *config, const char *module_name, size_t module_name_length, uint64_t hash);
+
+/**
+ * Counts a lookup of a list and samples hot keys.
+ * @param root Root of the list.
+ * @param entry Module found or NULL.
+ * @param comparisons Slots or nodes examined.
+ */
+void configfile_stats_lookup(configfile_root *root, const configfile *entry, size_t comparisons);
+
+#define CONFIGFILE_STATS_BIND(root) (configfile_stats_load = &(root)->stats.counters)
+#define CONFIGFILE_STATS_UNBIND() (configfile_stats_load = NULL)
+#define CONFIGFILE_STATS_ADD(field, value) \
+    do { if (configfile_stats_load != NULL) __atomic_fetch_add(&configfile_stats_load->field, (uint64_t) (value), __ATOMIC_RELAXED); } while (0)
+#define CONFIGFILE_STATS_START(start) uint64_t start = configfile_stats_load != NULL ? configfile_stats_now() : 0
+#define CONFIGFILE_STATS_STOP(field, start) CONFIGFILE_STATS_ADD(field, configfile_stats_now() - (start))
+#else
+#define CONFIGFILE_STATS_BIND(root) ((void) 0)
+#define CONFIGFILE_STATS_UNBIND() ((void) 0)
+#define CONFIGFILE_STATS_ADD(field, value) ((void) 0)
+#define CONFIGFILE_STATS_START(start) ((void) 0)
+#define CONFIGFILE_STATS_STOP(field, start) ((void) 0)
+#endif
+
+/*
+ * State shared by a whole list, owned by its head and stored in the list's own arena. The slots are an open
+ * addressing table (linear probing) that only holds the first module of each name, so indexed lookups return
+ * the same module as the linear walk, or in layered lists the first one of the last layer holding the name. Lists
+ * loaded from a mapping also keep the mapping their strings point into.
+ * The sections are the tree of key prefixes, see libconfigfile_section.c.
+ */
+struct _configfile_root {
+    configfile_arena arena;
+    configfile_slot *slots;
+    size_t slots_mask;
+    /* Probes wrap within aligned ranges of this many slots minus one, so threads can fill the ranges separately. */
+    size_t slots_shard_mask;
+    /* Distinct names in the index and modules in the list, they differ when names are repeated. */
+    size_t entries;
+    size_t modules;
+    char *mapping;
+    size_t mapping_length;
+    /* Mappings of the other files of a list loaded by configfile_init_layers(). */
+    configfile_mapping *mappings;
+    configfile_section *sections;
+    configfile_section **section_slots;
+    size_t section_slots_mask;
+    size_t section_count;
+    /* Registry bound by configfile_keys_bind() and its table, replaced atomically while readers may use it. */
+    configfile_keys *keys;
+    configfile_key_table *key_table;
+    /* Modules holding references, see libconfigfile_interpolate.c. */
+    configfile_expansion *expansions;
+    /* Structure filled by configfile_bind_version(), published atomically. */
+    void *bound;
+    /* CONFIGFILE_* flags the list was loaded with. */
+    unsigned int flags;
+    /* File read by configfile_init_ex() and its signature when read or last saved, NULL for layered lists. */
+    const char *file;
+    struct stat file_stat;
+    /* Changes since the last save, see libconfigfile_edit.c. NULL until the first one. */
+    configfile_edits *edits;
+#ifdef CONFIGFILE_STATS
+    configfile_stats_state stats;
+#endif
+};
+
+/*
+ * List under construction, appended to by configfile_builder_callback().
+ */
+struct _configfile_builder {
+    configfile_root *root;
+    /* Arena nodes are allocated from, the root's or one of a thread. */
+    configfile_arena *arena;
+    configfile *head;
+    configfile **next;
+    /* Whether names and values are copied, otherwise they are terminated in place. */
+    int copy;
+    /* errno of a failed append. */
+    int error;
+    /* Stored as module_file, owned by the root's arena. */
+    const char *file;
+};
+
+/*
+ * Allocator callbacks wrapped in a lock, for arenas filled by several threads whose user callbacks must not run
+ * concurrently.
+ */
+struct _configfile_locked_allocator {
+    configfile_allocator allocator;
+    pthread_mutex_t lock;
+};
+
+/**
+ * Allocates memory from an arena, adding a block when the current one is full.
+ * @param arena Arena to allocate from.
+ * @param size Number of bytes to allocate.
+ * @param align Alignment of the returned pointer, must be a power of two not greater than CONFIGFILE_ARENA_ALIGN.
+ * @return Returns a pointer to the allocated memory, on failure returns NULL and errno is set to ENOMEM.
+ */
+void *configfile_arena_alloc(configfile_arena *arena, size_t size, size_t align);
+
+/**
+ * Releases every block of an arena. The arena itself may live in one of them.
+ * @param arena Arena to release.
+ */
+void configfile_arena_kill(configfile_arena *arena);
+
+/**
+ * Moves every block of an arena into another one, after its current block so that block keeps serving allocations.
+ * @param arena Arena receiving the blocks, must hold at least one block.
+ * @param other Arena to empty, its blocks must be released with the same callbacks as those of arena.
+ */
+void configfile_arena_splice(configfile_arena *arena, configfile_arena *other);
+
+/**
+ * Wraps an allocator in a lock, see configfile_locked_arena().
+ * @param locked Lock and allocator to initialize, destroyed with pthread_mutex_destroy(3) once unused.
+ * @param allocator Callbacks to wrap.
+ */
+void configfile_locked_init(configfile_locked_allocator *locked, const configfile_allocator *allocator);
+
+/**
+ * Initializes an empty arena whose blocks come from a locked allocator, so several of them fill concurrently and
+ * can later be spliced into an arena of the wrapped allocator.
+ * @param arena Arena to initialize.
+ * @param locked Allocator to use.
+ * @param block_size Size of the first block.
+ */
+void configfile_locked_arena(configfile_arena *arena, configfile_locked_allocator *locked, size_t block_size);
+
+/**
+ * Allocates a root in its own arena, set up from the allocator and block size of the options.
+ * @param options Options of the load, may be NULL.
+ * @return Returns the zeroed root or NULL on failure, errno is set to ENOMEM.
+ */
+configfile_root *configfile_root_new(const configfile_options *options);
+
+/**
+ * Returns the threads option of a load capped at the number of online processors, at least 1.
+ * @param options Options of the load, may be NULL.
+ */
+unsigned int configfile_threads(const configfile_options *options);
+
+/**
+ * Attaches a root to the head of a loaded list and builds its index, section tree, references and conversions as
+ * the options ask.
+ * @param root Root holding the list.
+ * @param head Head of the list.
+ * @param layers Heads of the layers of the list in increasing precedence, see configfile_index_build(). May be NULL.
+ * @param layer_count Number of layers.
+ * @param options Options of the load, may be NULL.
+ * @param threads Threads filling the index.
+ * @return Returns zero on success, on failure returns -1 and errno is set as by configfile_interpolate_build(),
+ * the root is then to be discarded.
+ */
+int configfile_root_finish(configfile_root *root, configfile *head, configfile *const *layers, size_t layer_count,
+        const configfile_options *options, unsigned int threads);
+
+/**
+ * Parses every line of a buffer in one pass of the scanner. A module is the text between the first and the last
+ * token byte on each side of the first delimiter of a line, lines missing either side are skipped.
+ * @param buffer Lines to parse, the last one may lack its newline.
+ * @param length Number of bytes in buffer.
+ * @param line Number of lines before buffer, advanced past every line parsed.
+ * @param flags CONFIGFILE_* flags of the load, CONFIGFILE_INTERPOLATE keeps references whole when trimming.
+ * @param callback Called for every module.
+ * @param directive Called for lines holding a token but no delimiter, may be NULL.
+ * @param user_data Passed unchanged to both callbacks.
+ * @return Returns zero once the whole buffer is parsed, or 1 if a callback stopped the parse.
+ */
+int configfile_parse_lines(const char *buffer, size_t length, size_t *line, unsigned int flags, configfile_callback callback,
+        configfile_directive_callback directive, void *user_data);
+
+/**
+ * Parses every line of a writable buffer in the extended syntax, see CONFIGFILE_EXTENDED. Values are unescaped and
+ * continued lines joined in place, names and values passed to the callback are slices of buffer. The byte
+ * following a name or a value has been read and may be overwritten, buffer[length] included.
+ * @param buffer Lines to parse, the last one may lack its newline.
+ * @param length Number of bytes in buffer.
+ * @param line Number of lines before buffer, advanced past every line parsed.
+ * @param callback Called for every module, with the line it starts on.
+ * @param directive Called for lines holding a name but no delimiter, with the name. May be NULL.
+ * @param user_data Passed unchanged to both callbacks.
+ * @return Returns zero once the whole buffer is parsed, or 1 if a callback stopped the parse.
+ */
+int configfile_tokenize(char *buffer, size_t length, size_t *line, configfile_callback callback,
+        configfile_directive_callback directive, void *user_data);
+
+/**
+ * Appends a module to the builder given as user_data, a configfile_callback. Names and values are copied or
+ * terminated in place as the builder says.
+ * @return Returns zero, or 1 on failure with the builder's error set.
+ */
+int configfile_builder_callback(const char *module_name, size_t module_name_length, const char *module_value,
+        size_t module_value_length, size_t line, void *user_data);
+
+/**
+ * Maps a file privately, one byte larger than the file so the last module can always be terminated. The file is
+ * mapped over the start of an anonymous reservation, the bytes past its end are zero either way.
+ * @param fd Open file descriptor.
+ * @param length Receives the size of the file.
+ * @param mapping_length Receives the size of the mapping, to be passed to munmap(2).
+ * @return Returns the mapping or NULL on failure, errno is set according to mmap(2) or fstat(2).
+ */
+char *configfile_map(int fd, size_t *length, size_t *mapping_length);
+
+/**
+ * Continues a hash computed by configfile_hash() over more bytes, so the hash of a key can be derived from the
+ * hash of its prefix.
+ * @param hash Hash of the bytes preceding string.
+ * @param string Bytes to add.
+ * @param length Number of bytes in string.
+ * @return Returns the hash of the concatenation.
+ */
+static inline uint64_t configfile_hash_update(uint64_t hash, const char *string, size_t length) {
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char) string[i];
+        hash *= CONFIGFILE_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/**
+ * Looks a module up in the hash index.
+ * @param root Index to search.
+ * @param module_name Name to search for.
+ * @param module_name_length Number of bytes in module_name.
+ * @param hash Value of configfile_hash() for module_name.
+ * @return Returns the first module with that name or NULL if not found.
+ */
+configfile *configfile_index_find(const configfile_root *root, const char *module_name, size_t module_name_length, uint64_t hash);
+
+/**
+ * Returns the slot probed after position in the hash index, wrapping within the range of position.
+ */
+static inline size_t configfile_index_next(const configfile_root *root, size_t position) {
+    return (position & ~root->slots_shard_mask) | ((position + 1) & root->slots_shard_mask);
+}
+
+/**
+ * Points the hash index entry of a name at a module, adding the name if it is not indexed. The index grows as
+ * needed, keeping its load factor at or below one half.
+ * @param root Index to update.
+ * @param module Module the name now resolves to.
+ * @return Returns zero on success, on failure returns -1, errno is set to ENOMEM and the index is unchanged.
+ */
+int configfile_index_insert(configfile_root *root, configfile *module);
+
+/**
+ * Removes the name of a module from the hash index, keeping the probe sequences of the other names intact.
+ * @param root Index to update.
+ * @param module Module the name resolves to, nothing is done otherwise.
+ */
+void configfile_index_remove(configfile_root *root, configfile *module);
+
+/**
+ * Builds the hash index for a list inside the root attached to its head.
+ * @param config_struct Head of the list to be indexed.
+ * @param layers Heads of consecutive parts of the list, the first being config_struct. A name is indexed to its
+ * first module in the last layer holding it. NULL indexes the first module of each name in the whole list.
+ * @param layer_count Number of layers.
+ * @param threads Number of threads filling the index, the calling one included. Each fills its own range of slots.
+ * @return Returns zero on success, on failure returns -1 and the list stays usable through the linear search. errno is set to ENOMEM.
+ */
+int configfile_index_build(configfile *config_struct, configfile *const *layers, size_t layer_count, unsigned int threads);
+
+/**
+ * Builds the section tree of an indexed list.
+ * @param config_struct Head of the list, its hash index must be built.
+ * @return Returns zero on success, on failure returns -1 and section queries find nothing. errno is set to ENOMEM.
+ */
+int configfile_sections_build(configfile *config_struct);
+
+/**
+ * Adds a module appended to an indexed list to its section, creating the sections its name introduces. On failure
+ * the tree is dropped and section queries find nothing, as when it fails to build.
+ * @param root Root of the list.
+ * @param module Module added, the one the index finds for its name.
+ */
+void configfile_sections_add(configfile_root *root, configfile *module);
+
+/**
+ * Replaces a module in its section, keeping its place, or removes it from the section.
+ * @param root Root of the list.
+ * @param from Module held by a section, whose name is still readable.
+ * @param to Module of the same name to hold instead, NULL to remove from.
+ */
+void configfile_sections_replace(configfile_root *root, const configfile *from, configfile *to);
+
+/**
+ * Converts every module of a list to the type its value looks like and caches the result, see CONFIGFILE_CONVERT.
+ * @param config_struct Head of the list, not yet shared with other threads.
+ */
+void configfile_convert_all(configfile *config_struct);
+
+/**
+ * Finds the references in the values of an indexed list and checks them, see CONFIGFILE_INTERPOLATE.
+ * @param config_struct Head of the list, not yet shared with other threads.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOENT if a reference names no
+ * module, ELOOP if references loop, or ENOMEM.
+ */
+int configfile_interpolate_build(configfile *config_struct);
+
+/**
+ * Carries the expanded values of an old list over to a new one, for the modules whose value and references did
+ * not change, so a reload only invalidates the values it affects.
+ * @param config_struct Head of the new list, not yet shared with other threads.
+ * @param old_config Head of the old list, may be read by other threads.
+ */
+void configfile_interpolate_inherit(configfile *config_struct, configfile *old_config);
+
+/**
+ * Frees the expanded values of a root, before its arena is released.
+ */
+void configfile_interpolate_release(configfile_root *root);
+
+/**
+ * Finds and resolves the references of a value about to be given to a module of an interpolated list, checking
+ * that none of them leads back to the module. The list is not changed.
+ * @param config_struct Head of the list.
+ * @param module Module the value is for.
+ * @param value New value, terminated and owned by the list's arena.
+ * @param length Number of bytes in value.
+ * @param expansion Receives the expansion to pass to configfile_interpolate_replace(), NULL if the value holds
+ * no reference.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOENT if a reference names no
+ * module, ELOOP if one leads back to module, or ENOMEM.
+ */
+int configfile_interpolate_prepare(configfile *config_struct, configfile *module, const char *value, size_t length,
+        configfile_expansion **expansion);
+
+/**
+ * Gives a module the expansion of its new value, and forgets the expanded and converted values of every module
+ * whose expansion used the old one, directly or not. No other thread may read the list meanwhile.
+ * @param config_struct Head of the list.
+ * @param module Module whose value changed.
+ * @param expansion Expansion returned by configfile_interpolate_prepare() for the new value, may be NULL.
+ */
+void configfile_interpolate_replace(configfile *config_struct, configfile *module, configfile_expansion *expansion);
+
+/**
+ * Tells whether the value of another module references a module.
+ * @return Returns 1 if referenced, otherwise 0.
+ */
+int configfile_interpolate_referenced(configfile *config_struct, const configfile *module);
+
+/**
+ * Moves everything pointing at a module of an interpolated list to another one holding the same name and value,
+ * used when a node is reused for the module that follows it.
+ */
+void configfile_interpolate_move(configfile *config_struct, configfile *from, configfile *to);
+
+/**
+ * Frees the changes recorded by configfile_set() and configfile_delete(), before the arena of a root is released.
+ */
+void configfile_edits_release(configfile_root *root);
+
+/**
+ * Allocates a structure in the arena of a list, fills it with configfile_bind() and attaches it to the list, where
+ * configfile_bound() finds it. Nothing is attached if a field fails. Allocations from the arena must be serialized.
+ * @param config Head of a list returned by one of the loaders.
+ * @return Returns the number of fields that failed, zero once attached, or -1 with errno set.
+ */
+int configfile_bind_version(configfile *config, const configfile_field *fields, size_t count, size_t size,
+        configfile_bind_callback callback, void *user_data);
+
+/**
+ * Builds a snapshot image of a list in an anonymous mapping, with the values expanded.
+ * @param config Head of the list.
+ * @param source Signature of the text file, may be NULL.
+ * @return Returns the image, unmapped with configfile_snapshot_close(), or NULL on failure with errno set.
+ */
+configfile_snapshot *configfile_snapshot_build(configfile *config, const struct stat *source);
+
+/**
+ * Writes a whole image to a file descriptor at its current offset.
+ * @return Returns zero on success, on failure returns -1 and errno is set according to write(2).
+ */
+int configfile_snapshot_put(const configfile_snapshot *snapshot, int fd);
+
+/**
+ * Checks the header of an image against the size it was read with, then its checksum, then that every entry and
+ * slot stays inside the image.
+ * @return Returns zero if the image is usable, otherwise -1 with errno set to EINVAL.
+ */
+int configfile_snapshot_validate(const configfile_snapshot *snapshot, size_t size);
+
+/**
+ * Unmaps the files of a root and releases its arena, the root included.
+ * @param root Root to discard.
+ */
+void configfile_root_discard(configfile_root *root);
+
+/**
+ * Frees the state attached to the head of a list, if any. The nodes of lists built by the loaders live in the
+ * root's arena, so this also frees every node, including config_struct itself.
+ * @param config_struct Head of the list.
+ * @return Returns 1 if the nodes were freed along with the root, otherwise 0.
+ */
+int configfile_root_kill(configfile *config_struct);
+
+#endif /* LIBCONFIGFILE_PRIVATE_H */
@@ -0,0 +1,638 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_reload.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Reloadable configuration handle. Snapshots are published with an atomic pointer swap and reclaimed with
+ * epochs: every reader announces the epoch it entered in, and a retired snapshot is freed once no reader is
+ * still inside an epoch older than its retirement. Subscribers are told which names changed between the retired
+ * snapshot and the published one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "libconfigfile_private.h"
+
+#define CONFIGFILE_RELOAD_INTERVAL 1000
+
+typedef struct _configfile_retired configfile_retired;
+typedef struct _configfile_subscriber configfile_subscriber;
+
+struct _configfile_reader {
+    /* Epoch the reader entered in, zero while it is outside. */
+    _Atomic uint64_t epoch;
+    atomic_int in_use;
+    /* Records are pushed once and never unlinked before the reloader is killed. */
+    configfile_reader *next;
+    configfile_reloader *reloader;
+};
+
+struct _configfile_retired {
+    configfile *config;
+    uint64_t epoch;
+    configfile_retired *next;
+};
+
+struct _configfile_subscriber {
+    char *name;
+    size_t name_length;
+    uint64_t hash;
+    int prefix;
+    int id;
+    configfile_diff_callback callback;
+    void *user_data;
+    configfile_subscriber *next;
+};
+
+struct _configfile_reloader {
+    char *filename;
+    configfile_options options;
+    configfile_allocator allocator;
+    _Atomic(configfile *) current;
+    _Atomic uint64_t epoch;
+    _Atomic(configfile_reader *) readers;
+    atomic_ulong version;
+    /* Names interned by configfile_reloader_key(), bound to every version before it is published. */
+    configfile_keys *keys;
+
+    /* Everything below belongs to writers, serialized by write_lock. */
+    pthread_mutex_t write_lock;
+    configfile_retired *retired;
+    struct stat signature;
+    configfile_subscriber *subscribers;
+    int next_subscriber;
+    /* Binding set by configfile_reloader_bind(), applied to every version before it is published. */
+    const configfile_field *fields;
+    size_t field_count;
+    size_t bound_size;
+    configfile_bind_callback bind_callback;
+    void *bind_user_data;
+    int bound;
+
+    pthread_t watcher;
+    int watching;
+    int interval;
+    int inotify_fd;
+    int wake_pipe[2];
+};
+
+/**
+ * Frees every retired snapshot no reader can still be using. Must be called with write_lock held.
+ * @param reloader Reloader owning the snapshots.
+ */
+static void configfile_reloader_reclaim(configfile_reloader *reloader) {
+    configfile_retired **retired, *free_retired;
+    configfile_reader *reader;
+    uint64_t oldest, epoch;
+
+    oldest = UINT64_MAX;
+    for (reader = atomic_load(&reloader->readers); reader != NULL; reader = reader->next) {
+        epoch = atomic_load(&reader->epoch);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+
+    retired = &reloader->retired;
+    while (*retired != NULL) {
+        if ((*retired)->epoch <= oldest) {
+            free_retired = *retired;
+            *retired = free_retired->next;
+            configfile_kill(free_retired->config);
+            free(free_retired);
+        } else {
+            retired = &(*retired)->next;
+        }
+    }
+}
+
+/**
+ * Records the identity of the file, used to tell whether it changed since the last load.
+ * @return Returns 1 if the file differs from the recorded signature, 0 if not and -1 if it cannot be read.
+ */
+static int configfile_reloader_changed(configfile_reloader *reloader, struct stat *file_stat) {
+    if (stat(reloader->filename, file_stat) != 0) {
+        return -1;
+    }
+
+    return file_stat->st_ino != reloader->signature.st_ino || file_stat->st_dev != reloader->signature.st_dev ||
+            file_stat->st_size != reloader->signature.st_size ||
+            file_stat->st_mtim.tv_sec != reloader->signature.st_mtim.tv_sec ||
+            file_stat->st_mtim.tv_nsec != reloader->signature.st_mtim.tv_nsec;
+}
+
+/**
+ * Calls the subscribers matching a changed name, passed to configfile_diff() by the reloader.
+ */
+static int configfile_reloader_notify(configfile_change change, configfile *old_module, configfile *new_module, void *user_data) {
+    configfile_reloader *reloader = user_data;
+    configfile_subscriber *subscriber;
+    configfile *module;
+
+    module = new_module != NULL ? new_module : old_module;
+    for (subscriber = reloader->subscribers; subscriber != NULL; subscriber = subscriber->next) {
+        if (subscriber->prefix) {
+            if (module->module_name_length < subscriber->name_length ||
+                    memcmp(module->module_name, subscriber->name, subscriber->name_length) != 0) {
+                continue;
+            }
+        } else if (module->module_hash != subscriber->hash || module->module_name_length != subscriber->name_length ||
+                memcmp(module->module_name, subscriber->name, subscriber->name_length) != 0) {
+            continue;
+        }
+
+        subscriber->callback(change, old_module, new_module, subscriber->user_data);
+    }
+
+    return 0;
+}
+
+/**
+ * Parses the file and publishes it. Must be called with write_lock held.
+ * @return Returns zero on success, on failure returns -1, errno is set and the current snapshot stays published.
+ */
+static int configfile_reloader_load(configfile_reloader *reloader, const struct stat *file_stat) {
+    configfile *config, *old_config;
+    configfile_retired *retired;
+    int failed, errno_backup;
+
+    retired = malloc(sizeof (configfile_retired));
+    if (retired == NULL) {
+        return -1;
+    }
+
+    errno = 0;
+    config = configfile_init_ex(reloader->filename, &reloader->options);
+    if (config == NULL) {
+        free(retired);
+        if (errno == 0) {
+            errno = ENODATA;
+        }
+        return -1;
+    }
+
+    /* Without a table handles are resolved by name, a failure here only makes them slower. */
+    configfile_keys_bind(config, reloader->keys);
+    configfile_interpolate_inherit(config, atomic_load(&reloader->current));
+
+    if (reloader->bound) {
+        failed = configfile_bind_version(config, reloader->fields, reloader->field_count, reloader->bound_size,
+                reloader->bind_callback, reloader->bind_user_data);
+        if (failed != 0) {
+            /* The watcher retries a file that failed to parse, one that parsed but failed to bind waits for an edit. */
+            if (failed > 0) {
+                reloader->signature = *file_stat;
+            }
+            errno_backup = failed > 0 ? EINVAL : errno;
+            configfile_kill(config);
+            free(retired);
+            errno = errno_backup;
+            return -1;
+        }
+    }
+
+    reloader->signature = *file_stat;
+
+    old_config = atomic_exchange(&reloader->current, config);
+    atomic_fetch_add(&reloader->version, 1);
+
+    /*
+     * A reader still holding old_config loaded it before the exchange, so it announced an epoch older than the
+     * one started here. Readers announcing this epoch or a newer one can only see config.
+     */
+    retired->config = old_config;
+    retired->epoch = atomic_fetch_add(&reloader->epoch, 1) + 1;
+    retired->next = reloader->retired;
+    reloader->retired = retired;
+
+    /* The old version is only freed by the reclaim below, after the subscribers are done with it. */
+    if (old_config != NULL && reloader->subscribers != NULL) {
+        configfile_diff(old_config, config, configfile_reloader_notify, reloader);
+    }
+
+    configfile_reloader_reclaim(reloader);
+
+    return 0;
+}
+
+int configfile_reloader_reload(configfile_reloader *reloader) {
+    struct stat file_stat;
+    int result;
+
+    if (reloader == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&reloader->write_lock);
+    result = stat(reloader->filename, &file_stat);
+    if (result == 0) {
+        result = configfile_reloader_load(reloader, &file_stat);
+    }
+    pthread_mutex_unlock(&reloader->write_lock);
+
+    return result;
+}
+
+/**
+ * Reloads the file if it changed since the last load and frees what readers released meanwhile.
+ */
+static void configfile_reloader_check(configfile_reloader *reloader) {
+    struct stat file_stat;
+
+    pthread_mutex_lock(&reloader->write_lock);
+    if (configfile_reloader_changed(reloader, &file_stat) == 1) {
+        configfile_reloader_load(reloader, &file_stat);
+    }
+    configfile_reloader_reclaim(reloader);
+    pthread_mutex_unlock(&reloader->write_lock);
+}
+
+/**
+ * Watcher thread. Wakes up on inotify events for the file's directory, which also catches editors replacing the
+ * file with a rename, or every interval milliseconds, and reloads when the file's signature changed.
+ */
+static void *configfile_reloader_watch(void *argument) {
+    configfile_reloader *reloader = argument;
+    char events[4096];
+    struct pollfd fds[2];
+    nfds_t nfds;
+
+    fds[0].fd = reloader->wake_pipe[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = reloader->inotify_fd;
+    fds[1].events = POLLIN;
+    nfds = reloader->inotify_fd >= 0 ? 2 : 1;
+
+    for (;;) {
+        if (poll(fds, nfds, reloader->interval) < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            break;
+        }
+
+        if (nfds == 2 && (fds[1].revents & POLLIN)) {
+            /* The events only say that something happened, the signature check decides whether to reload. */
+            while (read(reloader->inotify_fd, events, sizeof (events)) > 0);
+        }
+
+        configfile_reloader_check(reloader);
+    }
+
+    return NULL;
+}
+
+/**
+ * Starts watching the directory of the file with inotify, leaving inotify_fd at -1 when it is not available so
+ * the watcher falls back to polling.
+ */
+static void configfile_reloader_inotify(configfile_reloader *reloader) {
+    char *directory, *slash;
+
+    reloader->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (reloader->inotify_fd < 0) {
+        return;
+    }
+
+    directory = strdup(reloader->filename);
+    if (directory != NULL) {
+        slash = strrchr(directory, '/');
+        if (slash == NULL) {
+            strcpy(directory, ".");
+        } else if (slash == directory) {
+            slash[1] = '\0';
+        } else {
+            slash[0] = '\0';
+        }
+
+        if (inotify_add_watch(reloader->inotify_fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) >= 0) {
+            free(directory);
+            return;
+        }
+        free(directory);
+    }
+
+    close(reloader->inotify_fd);
+    reloader->inotify_fd = -1;
+}
+
+configfile_reloader *configfile_reloader_new(const char *filename, const configfile_options *options, int interval) {
+    configfile_reloader *reloader;
+    struct stat file_stat;
+    int errno_backup;
+
+    if (filename == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    reloader = calloc(1, sizeof (configfile_reloader));
+    if (reloader == NULL) {
+        return NULL;
+    }
+
+    reloader->filename = strdup(filename);
+    if (reloader->filename == NULL) {
+        free(reloader);
+        return NULL;
+    }
+
+    if (options != NULL) {
+        reloader->options = *options;
+        if (options->allocator != NULL) {
+            reloader->allocator = *options->allocator;
+            reloader->options.allocator = &reloader->allocator;
+        }
+    }
+
+    atomic_init(&reloader->current, NULL);
+    atomic_init(&reloader->epoch, 1);
+    atomic_init(&reloader->readers, NULL);
+    atomic_init(&reloader->version, 0);
+    pthread_mutex_init(&reloader->write_lock, NULL);
+    reloader->keys = configfile_keys_new();
+    reloader->interval = interval > 0 ? interval : CONFIGFILE_RELOAD_INTERVAL;
+    reloader->inotify_fd = -1;
+    reloader->wake_pipe[0] = -1;
+    reloader->wake_pipe[1] = -1;
+
+    if (reloader->keys == NULL || stat(filename, &file_stat) != 0 || configfile_reloader_load(reloader, &file_stat) != 0) {
+        goto error_00;
+    }
+
+    if (pipe(reloader->wake_pipe) != 0) {
+        reloader->wake_pipe[0] = -1;
+        goto error_00;
+    }
+    fcntl(reloader->wake_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(reloader->wake_pipe[1], F_SETFD, FD_CLOEXEC);
+
+    configfile_reloader_inotify(reloader);
+
+    errno = pthread_create(&reloader->watcher, NULL, configfile_reloader_watch, reloader);
+    if (errno != 0) {
+        goto error_00;
+    }
+    reloader->watching = 1;
+
+    return reloader;
+
+error_00:
+    errno_backup = errno;
+    configfile_reloader_kill(reloader);
+    errno = errno_backup;
+    return NULL;
+}
+
+void configfile_reloader_kill(configfile_reloader *reloader) {
+    configfile_subscriber *subscriber;
+    configfile_retired *retired;
+    configfile_reader *reader;
+
+    if (reloader == NULL) {
+        return;
+    }
+
+    if (reloader->watching) {
+        while (write(reloader->wake_pipe[1], "", 1) < 0 && errno == EINTR);
+        pthread_join(reloader->watcher, NULL);
+    }
+
+    if (reloader->inotify_fd >= 0) {
+        close(reloader->inotify_fd);
+    }
+    if (reloader->wake_pipe[0] >= 0) {
+        close(reloader->wake_pipe[0]);
+        close(reloader->wake_pipe[1]);
+    }
+
+    while (reloader->retired != NULL) {
+        retired = reloader->retired;
+        reloader->retired = retired->next;
+        configfile_kill(retired->config);
+        free(retired);
+    }
+
+    configfile_kill(atomic_load(&reloader->current));
+
+    reader = atomic_load(&reloader->readers);
+    while (reader != NULL) {
+        configfile_reader *next = reader->next;
+        free(reader);
+        reader = next;
+    }
+
+    while (reloader->subscribers != NULL) {
+        subscriber = reloader->subscribers;
+        reloader->subscribers = subscriber->next;
+        free(subscriber->name);
+        free(subscriber);
+    }
+
+    configfile_keys_kill(reloader->keys);
+    pthread_mutex_destroy(&reloader->write_lock);
+    free(reloader->filename);
+    free(reloader);
+}
+
+int configfile_reloader_key(configfile_reloader *reloader, const char *module_name, configfile_key *key) {
+    int result;
+
+    if (reloader == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Holding write_lock keeps the current version from being replaced by one bound before the name was interned. */
+    pthread_mutex_lock(&reloader->write_lock);
+    result = configfile_keys_intern(reloader->keys, module_name, key);
+    if (result == 0) {
+        configfile_keys_bind(atomic_load(&reloader->current), reloader->keys);
+    }
+    pthread_mutex_unlock(&reloader->write_lock);
+
+    return result;
+}
+
+int configfile_reloader_bind(configfile_reloader *reloader, const configfile_field *fields, size_t count, size_t size,
+        configfile_bind_callback callback, void *user_data) {
+    int failed;
+
+    if (reloader == NULL || (fields == NULL && count > 0)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&reloader->write_lock);
+    if (reloader->bound) {
+        pthread_mutex_unlock(&reloader->write_lock);
+        errno = EBUSY;
+        return -1;
+    }
+
+    /* Holding write_lock serializes this allocation from the arena of the current version with the other writers. */
+    failed = configfile_bind_version(atomic_load(&reloader->current), fields, count, size, callback, user_data);
+    if (failed == 0) {
+        reloader->fields = fields;
+        reloader->field_count = count;
+        reloader->bound_size = size;
+        reloader->bind_callback = callback;
+        reloader->bind_user_data = user_data;
+        reloader->bound = 1;
+    }
+    pthread_mutex_unlock(&reloader->write_lock);
+
+    return failed;
+}
+
+int configfile_reloader_subscribe(configfile_reloader *reloader, const char *name, int prefix, configfile_diff_callback callback, void *user_data) {
+    configfile_subscriber *subscriber, **last;
+    int id;
+
+    if (reloader == NULL || name == NULL || callback == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    subscriber = malloc(sizeof (configfile_subscriber));
+    if (subscriber == NULL) {
+        return -1;
+    }
+
+    subscriber->name = strdup(name);
+    if (subscriber->name == NULL) {
+        free(subscriber);
+        return -1;
+    }
+    subscriber->name_length = strlen(name);
+    subscriber->hash = configfile_hash(name, subscriber->name_length);
+    subscriber->prefix = prefix != 0;
+    subscriber->callback = callback;
+    subscriber->user_data = user_data;
+    subscriber->next = NULL;
+
+    /* Appended, so subscribers matching the same name are called in the order they subscribed. */
+    pthread_mutex_lock(&reloader->write_lock);
+    id = subscriber->id = reloader->next_subscriber++;
+    for (last = &reloader->subscribers; *last != NULL; last = &(*last)->next);
+    *last = subscriber;
+    pthread_mutex_unlock(&reloader->write_lock);
+
+    return id;
+}
+
+int configfile_reloader_unsubscribe(configfile_reloader *reloader, int subscription) {
+    configfile_subscriber **subscriber, *found;
+
+    if (reloader == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&reloader->write_lock);
+    for (subscriber = &reloader->subscribers; *subscriber != NULL && (*subscriber)->id != subscription; subscriber = &(*subscriber)->next);
+    found = *subscriber;
+    if (found != NULL) {
+        *subscriber = found->next;
+    }
+    pthread_mutex_unlock(&reloader->write_lock);
+
+    if (found == NULL) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    free(found->name);
+    free(found);
+    return 0;
+}
+
+unsigned long configfile_reloader_version(configfile_reloader *reloader) {
+    return atomic_load_explicit(&reloader->version, memory_order_relaxed);
+}
+
+configfile_reader *configfile_reader_new(configfile_reloader *reloader) {
+    configfile_reader *reader, *head;
+    int unused;
+
+    if (reloader == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* Reuse a record released by a thread that exited, records are never unlinked. */
+    for (reader = atomic_load(&reloader->readers); reader != NULL; reader = reader->next) {
+        unused = 0;
+        if (atomic_compare_exchange_strong(&reader->in_use, &unused, 1)) {
+            return reader;
+        }
+    }
+
+    reader = malloc(sizeof (configfile_reader));
+    if (reader == NULL) {
+        return NULL;
+    }
+
+    atomic_init(&reader->epoch, 0);
+    atomic_init(&reader->in_use, 1);
+    reader->reloader = reloader;
+
+    head = atomic_load(&reloader->readers);
+    do {
+        reader->next = head;
+    } while (!atomic_compare_exchange_weak(&reloader->readers, &head, reader));
+
+    return reader;
+}
+
+void configfile_reader_kill(configfile_reader *reader) {
+    if (reader == NULL) {
+        return;
+    }
+
+    atomic_store(&reader->epoch, 0);
+    atomic_store(&reader->in_use, 0);
+}
+
+configfile *configfile_reader_enter(configfile_reader *reader) {
+    configfile_reloader *reloader = reader->reloader;
+
+    /*
+     * The announcement must be visible before the snapshot is loaded, both accesses are sequentially consistent
+     * so the writer either sees this reader or this reader sees the writer's new snapshot.
+     */
+    atomic_store(&reader->epoch, atomic_load(&reloader->epoch));
+    return atomic_load(&reloader->current);
+}
+
+void configfile_reader_leave(configfile_reader *reader) {
+    atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+}
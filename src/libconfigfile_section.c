@@ -0,0 +1,644 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_section.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Tree of the key prefixes of a list. Every proper prefix of a module name ending before a '.' or a '[' is a
+ * section, "client[0].user" gives "client" and "client[0]". Sections are linked to their parent and to their
+ * subsections in file order, and each holds the modules directly below it, so a section is walked without looking
+ * at the rest of the file. Sections are also kept in an open addressing table keyed by the hash of their full
+ * name. As FNV-1a is computed byte by byte, the hash of a name below a section is the section's hash continued
+ * over the relative part, and the module index of the root finds modules the same way.
+ * Subsections named "[n]" are additionally stored in a dense array indexed by n.
+ * Names and segments point into the module names, nothing is copied. Everything lives in the list's arena.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libconfigfile_private.h"
+
+#define CONFIGFILE_SECTION_NO_INDEX SIZE_MAX
+/* Indices longer than this many digits are not treated as array elements. */
+#define CONFIGFILE_SECTION_INDEX_DIGITS 9
+/* Arrays are stored densely while their length is at most this many times their number of elements, plus slack. */
+#define CONFIGFILE_SECTION_SPARSENESS 4
+#define CONFIGFILE_SECTION_SLACK 16
+
+typedef struct _configfile_section_module configfile_section_module;
+
+struct _configfile_section_module {
+    configfile *module;
+    configfile_section_module *next;
+};
+
+struct _configfile_section {
+    const configfile_root *root;
+    /* Full name, a prefix of the name of the first module below the section. */
+    const char *name;
+    size_t name_length;
+    /* Offset of the last segment in name. */
+    size_t segment;
+    /* configfile_hash() of name. */
+    uint64_t hash;
+    /* n for a section named "[n]", otherwise CONFIGFILE_SECTION_NO_INDEX. */
+    size_t index;
+    configfile_section *parent;
+    configfile_section *first;
+    configfile_section *last;
+    configfile_section *next;
+    configfile_section_module *modules;
+    configfile_section_module **modules_next;
+    /* Subsections "[n]" by n, NULL when the indices are too sparse. */
+    configfile_section **elements;
+    size_t element_count;
+    size_t length;
+    /* Some subsection "[n]" is written with leading zeros, such as "[01]", and is not found by the name "[1]". */
+    int padded;
+};
+
+/**
+ * Parses the segment of a section as an array index.
+ * @param segment Segment of the name, including the brackets.
+ * @param length Number of bytes in segment.
+ * @return Returns the index or CONFIGFILE_SECTION_NO_INDEX if segment is not "[n]".
+ */
+static size_t configfile_section_index(const char *segment, size_t length) {
+    size_t index = 0, i;
+
+    if (length < 3 || length > CONFIGFILE_SECTION_INDEX_DIGITS + 2 || segment[0] != '[' || segment[length - 1] != ']') {
+        return CONFIGFILE_SECTION_NO_INDEX;
+    }
+
+    for (i = 1; i < length - 1; i++) {
+        if (segment[i] < '0' || segment[i] > '9') {
+            return CONFIGFILE_SECTION_NO_INDEX;
+        }
+        index = index * 10 + (segment[i] - '0');
+    }
+
+    return index;
+}
+
+/**
+ * Searches the section table for a full name.
+ * @param root Root holding the table.
+ * @param name Full name of the section.
+ * @param name_length Number of bytes in name.
+ * @param hash configfile_hash() of name.
+ * @return Returns the section or NULL if not found.
+ */
+static configfile_section *configfile_section_lookup(const configfile_root *root, const char *name, size_t name_length, uint64_t hash) {
+    size_t position = hash & root->section_slots_mask;
+    configfile_section *section;
+
+    for (section = root->section_slots[position]; section != NULL; section = root->section_slots[position]) {
+        if (section->hash == hash && section->name_length == name_length && memcmp(section->name, name, name_length) == 0) {
+            return section;
+        }
+        position = (position + 1) & root->section_slots_mask;
+    }
+
+    return NULL;
+}
+
+/**
+ * Stores a section in the table of its root, doubling the table when it would become more than half full. The
+ * previous table stays in the arena until the list is killed.
+ * @param root Root holding the table.
+ * @param section Section to store, its name must not be in the table.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOMEM.
+ */
+static int configfile_section_insert(configfile_root *root, configfile_section *section) {
+    configfile_section **slots, **previous = root->section_slots;
+    size_t capacity, position, i;
+
+    if ((root->section_count + 1) * 2 > root->section_slots_mask + 1) {
+        capacity = (root->section_slots_mask + 1) * 2;
+        slots = configfile_arena_alloc(&root->arena, capacity * sizeof (configfile_section *), CONFIGFILE_ARENA_ALIGN);
+        if (slots == NULL) {
+            return -1;
+        }
+        memset(slots, 0, capacity * sizeof (configfile_section *));
+
+        root->section_slots = slots;
+        for (i = 0; i <= root->section_slots_mask; i++) {
+            if (previous[i] != NULL) {
+                for (position = previous[i]->hash & (capacity - 1); slots[position] != NULL; position = (position + 1) & (capacity - 1));
+                slots[position] = previous[i];
+            }
+        }
+        root->section_slots_mask = capacity - 1;
+    }
+
+    for (position = section->hash & root->section_slots_mask; root->section_slots[position] != NULL;
+            position = (position + 1) & root->section_slots_mask);
+    root->section_slots[position] = section;
+    root->section_count++;
+
+    return 0;
+}
+
+/**
+ * Allocates a section and links it below its parent.
+ * @param root Root of the list.
+ * @param parent Parent section, NULL for the root section.
+ * @param name Full name of the section.
+ * @param name_length Number of bytes in name.
+ * @param segment Offset of the last segment in name.
+ * @param hash configfile_hash() of name.
+ * @return Returns the section, on failure returns NULL and errno is set to ENOMEM.
+ */
+static configfile_section *configfile_section_new(configfile_root *root, configfile_section *parent, const char *name, size_t name_length,
+        size_t segment, uint64_t hash) {
+    configfile_section *section;
+
+    section = configfile_arena_alloc(&root->arena, sizeof (configfile_section), sizeof (void *));
+    if (section == NULL) {
+        return NULL;
+    }
+
+    memset(section, 0, sizeof (configfile_section));
+    section->root = root;
+    section->name = name;
+    section->name_length = name_length;
+    section->segment = segment;
+    section->hash = hash;
+    section->index = configfile_section_index(name + segment, name_length - segment);
+    section->parent = parent;
+    section->modules_next = &section->modules;
+
+    if (parent == NULL) {
+        return section;
+    }
+
+    if (configfile_section_insert(root, section) != 0) {
+        return NULL;
+    }
+
+    if (parent->last != NULL) {
+        parent->last->next = section;
+    } else {
+        parent->first = section;
+    }
+    parent->last = section;
+
+    if (section->index != CONFIGFILE_SECTION_NO_INDEX) {
+        if (name[segment + 1] == '0' && name_length - segment > 3) {
+            parent->padded = 1;
+        }
+        parent->element_count++;
+        if (section->index >= parent->length) {
+            parent->length = section->index + 1;
+        }
+    }
+
+    return section;
+}
+
+/**
+ * Fills the dense array of a section from its subsections, unless the indices are too sparse for it.
+ * @param root Root of the list.
+ * @param section Section holding an array.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOMEM.
+ */
+static int configfile_section_array(configfile_root *root, configfile_section *section) {
+    configfile_section *next;
+
+    if (section->length > section->element_count * CONFIGFILE_SECTION_SPARSENESS + CONFIGFILE_SECTION_SLACK) {
+        return 0;
+    }
+
+    section->elements = configfile_arena_alloc(&root->arena, section->length * sizeof (configfile_section *), sizeof (void *));
+    if (section->elements == NULL) {
+        return -1;
+    }
+    memset(section->elements, 0, section->length * sizeof (configfile_section *));
+
+    /* "[1]" and "[01]" have the same index, the first one in the file wins. */
+    for (next = section->first; next != NULL; next = next->next) {
+        if (next->index != CONFIGFILE_SECTION_NO_INDEX && section->elements[next->index] == NULL) {
+            section->elements[next->index] = next;
+        }
+    }
+
+    return 0;
+}
+
+int configfile_sections_build(configfile *config_struct) {
+    configfile_section *parent, *section;
+    configfile_section_module *module;
+    configfile_root *root;
+    configfile *next, *previous;
+    size_t capacity, start, segment, i;
+    uint64_t hash;
+
+    if (config_struct == NULL || config_struct->root == NULL || config_struct->root->slots == NULL) {
+        return -1;
+    }
+
+    /* Most files have fewer sections than modules, sizing the table for as many avoids growing it. */
+    root = config_struct->root;
+    for (capacity = 16; capacity < root->entries * 2; capacity <<= 1);
+
+    root->section_count = 0;
+    root->section_slots_mask = capacity - 1;
+    root->section_slots = configfile_arena_alloc(&root->arena, capacity * sizeof (configfile_section *), CONFIGFILE_ARENA_ALIGN);
+    if (root->section_slots == NULL) {
+        return -1;
+    }
+    memset(root->section_slots, 0, capacity * sizeof (configfile_section *));
+
+    root->sections = configfile_section_new(root, NULL, "", 0, 0, CONFIGFILE_FNV_OFFSET);
+    if (root->sections == NULL) {
+        return -1;
+    }
+
+    previous = NULL;
+    parent = root->sections;
+
+    for (next = config_struct; next != NULL; next = next->next) {
+        /* Sections hold what configfile_get() returns, later modules with the same name are hidden. */
+        if (root->entries != root->modules &&
+                configfile_index_find(root, next->module_name, next->module_name_length, next->module_hash) != next) {
+            continue;
+        }
+
+        /*
+         * Related keys are usually written together. The sections of the previous module that are prefixes of this
+         * name, up to a segment boundary, are reused along with their hash instead of being looked up again.
+         */
+        if (previous != NULL) {
+            for (i = 0; i < previous->module_name_length && i < next->module_name_length && previous->module_name[i] == next->module_name[i]; i++);
+            while (parent != root->sections && (parent->name_length > i ||
+                    (next->module_name[parent->name_length] != '.' && next->module_name[parent->name_length] != '['))) {
+                parent = parent->parent;
+            }
+        }
+
+        if (parent != root->sections) {
+            hash = parent->hash;
+            start = parent->name_length;
+            segment = next->module_name[start] == '.' ? start + 1 : start;
+        } else {
+            hash = CONFIGFILE_FNV_OFFSET;
+            start = segment = 0;
+        }
+
+        for (i = start + 1; i < next->module_name_length; i++) {
+            if (next->module_name[i] != '.' && next->module_name[i] != '[') {
+                continue;
+            }
+
+            hash = configfile_hash_update(hash, next->module_name + start, i - start);
+            start = i;
+
+            section = configfile_section_lookup(root, next->module_name, i, hash);
+            if (section == NULL) {
+                section = configfile_section_new(root, parent, next->module_name, i, segment, hash);
+                if (section == NULL) {
+                    goto error_00;
+                }
+            }
+
+            parent = section;
+            segment = next->module_name[i] == '.' ? i + 1 : i;
+        }
+
+        module = configfile_arena_alloc(&root->arena, sizeof (configfile_section_module), sizeof (void *));
+        if (module == NULL) {
+            goto error_00;
+        }
+        module->module = next;
+        module->next = NULL;
+        *parent->modules_next = module;
+        parent->modules_next = &module->next;
+        previous = next;
+    }
+
+    if (root->sections->element_count > 0 && configfile_section_array(root, root->sections) != 0) {
+        goto error_00;
+    }
+    for (i = 0; i <= root->section_slots_mask; i++) {
+        section = root->section_slots[i];
+        if (section != NULL && section->element_count > 0 && configfile_section_array(root, section) != 0) {
+            goto error_00;
+        }
+    }
+
+    return 0;
+
+error_00:
+    /* The arena keeps what was allocated, a partial tree must just not be reachable. */
+    root->sections = NULL;
+    return -1;
+}
+
+void configfile_sections_add(configfile_root *root, configfile *module) {
+    configfile_section *parent, *section;
+    configfile_section_module *entry;
+    size_t start, segment, length, i;
+    uint64_t hash;
+
+    if (root->sections == NULL) {
+        return;
+    }
+
+    parent = root->sections;
+    hash = CONFIGFILE_FNV_OFFSET;
+    start = segment = 0;
+
+    for (i = 1; i < module->module_name_length; i++) {
+        if (module->module_name[i] != '.' && module->module_name[i] != '[') {
+            continue;
+        }
+
+        hash = configfile_hash_update(hash, module->module_name + start, i - start);
+        start = i;
+
+        section = configfile_section_lookup(root, module->module_name, i, hash);
+        if (section == NULL) {
+            length = parent->length;
+            section = configfile_section_new(root, parent, module->module_name, i, segment, hash);
+            if (section == NULL) {
+                goto error_00;
+            }
+
+            /* An element past the end of the dense array gets a new one, if still dense enough. */
+            if (section->index != CONFIGFILE_SECTION_NO_INDEX && parent->elements != NULL) {
+                if (section->index < length) {
+                    if (parent->elements[section->index] == NULL) {
+                        parent->elements[section->index] = section;
+                    }
+                } else {
+                    parent->elements = NULL;
+                    if (configfile_section_array(root, parent) != 0) {
+                        goto error_00;
+                    }
+                }
+            }
+        }
+
+        parent = section;
+        segment = module->module_name[i] == '.' ? i + 1 : i;
+    }
+
+    entry = configfile_arena_alloc(&root->arena, sizeof (configfile_section_module), sizeof (void *));
+    if (entry == NULL) {
+        goto error_00;
+    }
+    entry->module = module;
+    entry->next = NULL;
+    *parent->modules_next = entry;
+    parent->modules_next = &entry->next;
+
+    return;
+
+error_00:
+    root->sections = NULL;
+}
+
+void configfile_sections_replace(configfile_root *root, const configfile *from, configfile *to) {
+    configfile_section_module **entry;
+    configfile_section *section;
+    size_t last, i;
+
+    if (root->sections == NULL) {
+        return;
+    }
+
+    /* The section holding a module is the one named by its name up to its last segment. */
+    last = 0;
+    for (i = 1; i < from->module_name_length; i++) {
+        if (from->module_name[i] == '.' || from->module_name[i] == '[') {
+            last = i;
+        }
+    }
+    section = last == 0 ? root->sections :
+            configfile_section_lookup(root, from->module_name, last, configfile_hash(from->module_name, last));
+    if (section == NULL) {
+        return;
+    }
+
+    for (entry = &section->modules; *entry != NULL; entry = &(*entry)->next) {
+        if ((*entry)->module != from) {
+            continue;
+        }
+
+        if (to != NULL) {
+            (*entry)->module = to;
+        } else {
+            if (section->modules_next == &(*entry)->next) {
+                section->modules_next = entry;
+            }
+            *entry = (*entry)->next;
+        }
+        return;
+    }
+}
+
+/**
+ * Computes the full name hash of a name relative to a section and the separator joining them.
+ * @param section Section the name is relative to.
+ * @param name Relative name.
+ * @param name_length Number of bytes in name.
+ * @param separator Receives 1 if a '.' joins the section and name, otherwise 0.
+ * @return Returns configfile_hash() of the full name.
+ */
+static uint64_t configfile_section_join(const configfile_section *section, const char *name, size_t name_length, size_t *separator) {
+    uint64_t hash = section->hash;
+
+    *separator = 0;
+    if (section->name_length > 0 && name[0] != '[') {
+        hash = configfile_hash_update(hash, ".", 1);
+        *separator = 1;
+    }
+
+    return configfile_hash_update(hash, name, name_length);
+}
+
+/**
+ * Tests whether a full name is the name of a section joined with a relative name.
+ * @param full_name Full name to test.
+ * @param full_name_length Number of bytes in full_name.
+ * @param section Section the name is relative to.
+ * @param separator Separator returned by configfile_section_join().
+ * @param name Relative name.
+ * @param name_length Number of bytes in name.
+ * @return Returns 1 if the names match, otherwise 0.
+ */
+static int configfile_section_match(const char *full_name, size_t full_name_length, const configfile_section *section, size_t separator,
+        const char *name, size_t name_length) {
+    if (full_name_length != section->name_length + separator + name_length) {
+        return 0;
+    }
+
+    return (separator == 0 || full_name[section->name_length] == '.') &&
+            memcmp(full_name + section->name_length + separator, name, name_length) == 0 &&
+            memcmp(full_name, section->name, section->name_length) == 0;
+}
+
+const configfile_section *configfile_section_find(configfile *config, const char *section_name) {
+    if (config == NULL || config->root == NULL || config->root->sections == NULL) {
+        return NULL;
+    }
+
+    if (section_name == NULL || section_name[0] == '\0') {
+        return config->root->sections;
+    }
+
+    return configfile_section_child(config->root->sections, section_name);
+}
+
+const configfile_section *configfile_section_child(const configfile_section *section, const char *section_name) {
+    const configfile_root *root;
+    configfile_section *found;
+    size_t name_length, separator, position;
+    uint64_t hash;
+
+    if (section == NULL || section_name == NULL) {
+        return NULL;
+    }
+
+    root = section->root;
+    name_length = strlen(section_name);
+    hash = configfile_section_join(section, section_name, name_length, &separator);
+
+    position = hash & root->section_slots_mask;
+    for (found = root->section_slots[position]; found != NULL; found = root->section_slots[position]) {
+        if (found->hash == hash && configfile_section_match(found->name, found->name_length, section, separator, section_name, name_length)) {
+            return found;
+        }
+        position = (position + 1) & root->section_slots_mask;
+    }
+
+    return NULL;
+}
+
+configfile *configfile_section_get(const configfile_section *section, const char *module_name) {
+    const configfile_root *root;
+    const configfile_slot *slot;
+    size_t name_length, separator, position;
+    uint64_t hash;
+
+    if (section == NULL || module_name == NULL) {
+        return NULL;
+    }
+
+    root = section->root;
+    name_length = strlen(module_name);
+    hash = configfile_section_join(section, module_name, name_length, &separator);
+
+    position = hash & root->slots_mask;
+    for (slot = &root->slots[position]; slot->entry != NULL; slot = &root->slots[position]) {
+        if (slot->hash == hash &&
+                configfile_section_match(slot->entry->module_name, slot->entry->module_name_length, section, separator, module_name, name_length)) {
+            return slot->entry;
+        }
+        position = configfile_index_next(root, position);
+    }
+
+    return NULL;
+}
+
+const char *configfile_section_name(const configfile_section *section, size_t *length) {
+    if (section == NULL) {
+        return NULL;
+    }
+
+    if (length != NULL) {
+        *length = section->name_length - section->segment;
+    }
+
+    return section->name + section->segment;
+}
+
+const configfile_section *configfile_section_first(const configfile_section *section) {
+    return section != NULL ? section->first : NULL;
+}
+
+const configfile_section *configfile_section_next(const configfile_section *section) {
+    return section != NULL ? section->next : NULL;
+}
+
+size_t configfile_section_length(const configfile_section *section) {
+    return section != NULL ? section->length : 0;
+}
+
+const configfile_section *configfile_section_at(const configfile_section *section, size_t index) {
+    const configfile_section *next;
+    char segment[24];
+
+    if (section == NULL || index >= section->length) {
+        return NULL;
+    }
+
+    if (section->elements != NULL) {
+        return section->elements[index];
+    }
+
+    /* Too sparse for an array, the element is looked up by its name like any other subsection. */
+    if (!section->padded) {
+        snprintf(segment, sizeof (segment), "[%zu]", index);
+        return configfile_section_child(section, segment);
+    }
+
+    /* Unless the index may be written another way, then the first spelling in the file wins as in the array. */
+    for (next = section->first; next != NULL; next = next->next) {
+        if (next->index == index) {
+            return next;
+        }
+    }
+
+    return NULL;
+}
+
+int configfile_section_foreach(const configfile_section *section, int (*callback)(configfile *module, void *user_data), void *user_data) {
+    const configfile_section *current = section;
+    const configfile_section_module *module;
+    int result;
+
+    if (section == NULL || callback == NULL) {
+        return 0;
+    }
+
+    /* Depth first without recursion: down to the first subsection, else to the next one of the nearest ancestor. */
+    while (current != NULL) {
+        for (module = current->modules; module != NULL; module = module->next) {
+            result = callback(module->module, user_data);
+            if (result != 0) {
+                return result;
+            }
+        }
+
+        if (current->first != NULL) {
+            current = current->first;
+            continue;
+        }
+
+        while (current != section && current->next == NULL) {
+            current = current->parent;
+        }
+        current = current != section ? current->next : NULL;
+    }
+
+    return 0;
+}
@@ -0,0 +1,354 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_shared.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Publishing snapshot images between processes through POSIX shared memory. Under a name live two kinds of
+ * objects:
+ *
+ *   name               control: magic | generation
+ *   name.<generation>  a snapshot image, never modified once the generation points to it
+ *
+ * Images are position independent, so every process maps the same pages wherever they land. The publisher writes
+ * a whole image before storing its generation with release semantics, readers load the generation with acquire
+ * semantics and compare it with the one they mapped, which is all a lookup pays while nothing changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libconfigfile_private.h"
+
+#define CONFIGFILE_SHARED_MAGIC "CFGSHM"
+/* Longest name accepted, leaving room for the generation suffix within NAME_MAX. */
+#define CONFIGFILE_SHARED_NAME_MAX 200
+#define CONFIGFILE_SHARED_IMAGE_NAME_MAX (CONFIGFILE_SHARED_NAME_MAX + 24)
+
+typedef struct _configfile_shared_control {
+    char magic[8];
+    /* Generation of the current image, zero until the first publication. */
+    uint64_t generation;
+} configfile_shared_control;
+
+struct _configfile_shared {
+    configfile_shared_control *control;
+    /* Generation of the mapped image, zero if none. */
+    uint64_t generation;
+    const configfile_snapshot *snapshot;
+    char name[];
+};
+
+/**
+ * Checks a name is usable for the control object and the images.
+ * @return Returns zero if it is, otherwise -1 with errno set to EINVAL.
+ */
+static int configfile_shared_check(const char *shared_name) {
+    size_t length;
+
+    if (shared_name == NULL || shared_name[0] != '/' || strchr(&shared_name[1], '/') != NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    length = strlen(shared_name);
+    if (length < 2 || length > CONFIGFILE_SHARED_NAME_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void configfile_shared_image_name(char *image_name, const char *shared_name, uint64_t generation) {
+    snprintf(image_name, CONFIGFILE_SHARED_IMAGE_NAME_MAX, "%s.%" PRIu64, shared_name, generation);
+}
+
+/**
+ * Maps the control object of a name.
+ * @param create Non-zero to map it writable, creating it if needed.
+ * @return Returns the control or NULL on failure, errno is set.
+ */
+static configfile_shared_control *configfile_shared_control_map(const char *shared_name, int create) {
+    configfile_shared_control *control;
+    struct stat file_stat;
+    int fd, errno_backup;
+
+    fd = shm_open(shared_name, create ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &file_stat) != 0) {
+        goto error_00;
+    }
+
+    if (file_stat.st_size < (off_t) sizeof (configfile_shared_control)) {
+        if (!create) {
+            errno = ENOENT;
+            goto error_00;
+        }
+
+        /* Extended with zeroes: no generation yet. */
+        if (ftruncate(fd, sizeof (configfile_shared_control)) != 0) {
+            goto error_00;
+        }
+    }
+
+    control = mmap(NULL, sizeof (configfile_shared_control), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (control == MAP_FAILED) {
+        goto error_00;
+    }
+    close(fd);
+
+    return control;
+
+error_00:
+    errno_backup = errno;
+    close(fd);
+    errno = errno_backup;
+    return NULL;
+}
+
+/**
+ * Maps the image of a generation read-only and verifies it.
+ * @return Returns the snapshot or NULL on failure, errno is ENOENT if the image was unlinked or EINVAL if it is
+ * damaged.
+ */
+static const configfile_snapshot *configfile_shared_image_map(const char *shared_name, uint64_t generation) {
+    char image_name[CONFIGFILE_SHARED_IMAGE_NAME_MAX];
+    configfile_snapshot *snapshot;
+    struct stat file_stat;
+    int fd, errno_backup;
+
+    configfile_shared_image_name(image_name, shared_name, generation);
+    fd = shm_open(image_name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        errno_backup = errno ? errno : EINVAL;
+        close(fd);
+        errno = errno_backup;
+        return NULL;
+    }
+
+    snapshot = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    errno_backup = errno;
+    close(fd);
+    if (snapshot == MAP_FAILED) {
+        errno = errno_backup;
+        return NULL;
+    }
+
+    if (configfile_snapshot_validate(snapshot, file_stat.st_size) != 0) {
+        munmap(snapshot, file_stat.st_size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return snapshot;
+}
+
+int configfile_shared_publish(configfile *config, const char *shared_name, uint64_t *generation) {
+    char image_name[CONFIGFILE_SHARED_IMAGE_NAME_MAX];
+    configfile_shared_control *control;
+    configfile_snapshot *snapshot;
+    uint64_t next;
+    int fd, errno_backup;
+
+    if (config == NULL || configfile_shared_check(shared_name) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    control = configfile_shared_control_map(shared_name, 1);
+    if (control == NULL) {
+        return -1;
+    }
+
+    snapshot = configfile_snapshot_build(config, NULL);
+    if (snapshot == NULL) {
+        goto error_00;
+    }
+
+    /*
+     * The image of the next generation is not visible to readers yet, so a leftover of a publisher that failed
+     * before raising the generation is safely truncated.
+     */
+    next = __atomic_load_n(&control->generation, __ATOMIC_ACQUIRE) + 1;
+    configfile_shared_image_name(image_name, shared_name, next);
+    fd = shm_open(image_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        goto error_01;
+    }
+
+    if (configfile_snapshot_put(snapshot, fd) != 0) {
+        errno_backup = errno;
+        close(fd);
+        shm_unlink(image_name);
+        errno = errno_backup;
+        goto error_01;
+    }
+    close(fd);
+
+    memcpy(control->magic, CONFIGFILE_SHARED_MAGIC, sizeof (CONFIGFILE_SHARED_MAGIC));
+    __atomic_store_n(&control->generation, next, __ATOMIC_RELEASE);
+
+    /* Readers still mapping the previous image keep it until they unmap it. */
+    if (next > 1) {
+        configfile_shared_image_name(image_name, shared_name, next - 1);
+        shm_unlink(image_name);
+    }
+
+    configfile_snapshot_close(snapshot);
+    munmap(control, sizeof (configfile_shared_control));
+
+    if (generation != NULL) {
+        *generation = next;
+    }
+
+    return 0;
+
+error_01:
+    errno_backup = errno;
+    configfile_snapshot_close(snapshot);
+    errno = errno_backup;
+
+error_00:
+    errno_backup = errno;
+    munmap(control, sizeof (configfile_shared_control));
+    errno = errno_backup;
+    return -1;
+}
+
+configfile_shared *configfile_shared_open(const char *shared_name) {
+    configfile_shared *shared;
+    size_t length;
+
+    if (configfile_shared_check(shared_name) != 0) {
+        return NULL;
+    }
+
+    length = strlen(shared_name);
+    shared = malloc(sizeof (configfile_shared) + length + 1);
+    if (shared == NULL) {
+        return NULL;
+    }
+
+    shared->control = configfile_shared_control_map(shared_name, 0);
+    if (shared->control == NULL) {
+        free(shared);
+        return NULL;
+    }
+
+    shared->generation = 0;
+    shared->snapshot = NULL;
+    memcpy(shared->name, shared_name, length + 1);
+
+    return shared;
+}
+
+const configfile_snapshot *configfile_shared_snapshot(configfile_shared *shared, uint64_t *generation) {
+    const configfile_snapshot *snapshot;
+    uint64_t current;
+
+    if (shared == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (;;) {
+        current = __atomic_load_n(&shared->control->generation, __ATOMIC_ACQUIRE);
+        if (current == shared->generation) {
+            break;
+        }
+
+        if (current == 0) {
+            errno = ENOENT;
+            return NULL;
+        }
+
+        if (memcmp(shared->control->magic, CONFIGFILE_SHARED_MAGIC, sizeof (CONFIGFILE_SHARED_MAGIC)) != 0) {
+            errno = EINVAL;
+            return NULL;
+        }
+
+        snapshot = configfile_shared_image_map(shared->name, current);
+        if (snapshot != NULL) {
+            configfile_snapshot_close(shared->snapshot);
+            shared->snapshot = snapshot;
+            shared->generation = current;
+            break;
+        }
+
+        /* Unlinked by a newer publication between reading the generation and opening the image: try that one. */
+        if (errno != ENOENT || __atomic_load_n(&shared->control->generation, __ATOMIC_ACQUIRE) == current) {
+            return NULL;
+        }
+    }
+
+    if (shared->snapshot == NULL) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    if (generation != NULL) {
+        *generation = shared->generation;
+    }
+
+    return shared->snapshot;
+}
+
+void configfile_shared_close(configfile_shared *shared) {
+    if (shared != NULL) {
+        configfile_snapshot_close(shared->snapshot);
+        munmap(shared->control, sizeof (configfile_shared_control));
+        free(shared);
+    }
+}
+
+int configfile_shared_unlink(const char *shared_name) {
+    char image_name[CONFIGFILE_SHARED_IMAGE_NAME_MAX];
+    configfile_shared_control *control;
+    uint64_t current;
+
+    if (configfile_shared_check(shared_name) != 0) {
+        return -1;
+    }
+
+    control = configfile_shared_control_map(shared_name, 0);
+    if (control != NULL) {
+        current = __atomic_load_n(&control->generation, __ATOMIC_ACQUIRE);
+        munmap(control, sizeof (configfile_shared_control));
+        if (current != 0) {
+            configfile_shared_image_name(image_name, shared_name, current);
+            shm_unlink(image_name);
+        }
+    }
+
+    return shm_unlink(shared_name);
+}
@@ -0,0 +1,521 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_snapshot.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Precompiled binary snapshots. A snapshot is a single position independent image:
+ *
+ *   header | entries[entry_count] | slots[slot_count] | strings
+ *
+ * Entries keep the order of the list they were compiled from. Slots are an open addressing table (linear probing)
+ * of entry index + 1, zero meaning empty, holding the first entry of each name like the index of a parsed list.
+ * Strings are the names and values, each terminated, referenced by offset from the start of the string table.
+ * Every offset is relative, so the image is used as mapped, wherever it is mapped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libconfigfile_private.h"
+
+#define CONFIGFILE_SNAPSHOT_MAGIC "CFGSNAP"
+#define CONFIGFILE_SNAPSHOT_VERSION 1
+
+typedef struct _configfile_snapshot_entry {
+    uint64_t hash;
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t value_offset;
+    uint32_t value_length;
+} configfile_snapshot_entry;
+
+struct _configfile_snapshot {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    /* Size of the whole image, also what is unmapped by configfile_snapshot_close(). */
+    uint64_t image_size;
+    /* configfile_snapshot_checksum() of every byte following the header. */
+    uint64_t checksum;
+    /* Signature of the text file the snapshot was compiled from, all zero if unknown. */
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint32_t entry_count;
+    uint32_t slot_count;
+    uint64_t entries_offset;
+    uint64_t slots_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+};
+
+static const configfile_snapshot_entry *configfile_snapshot_entries(const configfile_snapshot *snapshot) {
+    return (const configfile_snapshot_entry *) ((const char *) snapshot + snapshot->entries_offset);
+}
+
+static const uint32_t *configfile_snapshot_slots(const configfile_snapshot *snapshot) {
+    return (const uint32_t *) ((const char *) snapshot + snapshot->slots_offset);
+}
+
+static const char *configfile_snapshot_strings(const configfile_snapshot *snapshot) {
+    return (const char *) snapshot + snapshot->strings_offset;
+}
+
+static void configfile_snapshot_view(const configfile_snapshot *snapshot, const configfile_snapshot_entry *entry, configfile_view *view) {
+    const char *strings = configfile_snapshot_strings(snapshot);
+
+    view->module_name = &strings[entry->name_offset];
+    view->module_name_length = entry->name_length;
+    view->module_value = &strings[entry->value_offset];
+    view->module_value_length = entry->value_length;
+}
+
+/**
+ * FNV-1a over 64-bit words instead of bytes, so verifying a large snapshot stays far cheaper than parsing it.
+ * @param data Bytes to checksum.
+ * @param size Number of bytes in data.
+ * @return Returns the checksum.
+ */
+static uint64_t configfile_snapshot_checksum(const char *data, size_t size) {
+    uint64_t checksum = configfile_hash(NULL, 0), word;
+    size_t i;
+
+    for (i = 0; i + sizeof (word) <= size; i += sizeof (word)) {
+        memcpy(&word, &data[i], sizeof (word));
+        checksum = (checksum ^ word) * 0x100000001b3ULL;
+    }
+
+    return checksum ^ configfile_hash(&data[i], size - i);
+}
+
+configfile_snapshot *configfile_snapshot_build(configfile *config, const struct stat *source) {
+    configfile_snapshot header, *snapshot;
+    configfile_snapshot_entry *entries, *stored;
+    uint32_t *slots, index;
+    size_t entry_count, strings_size, position, mask, slot, value_length;
+    const char *value;
+    char *strings, *image;
+    configfile *next;
+
+    memset(&header, 0, sizeof (header));
+
+    /* Values are stored expanded, the image holds no references to resolve. */
+    entry_count = 0;
+    strings_size = 0;
+    for (next = config; next != NULL; next = next->next) {
+        if (configfile_value_expand(next, &value_length) == NULL) {
+            return NULL;
+        }
+        entry_count++;
+        strings_size += next->module_name_length + value_length + 2;
+    }
+
+    if (entry_count >= UINT32_MAX / 2 || strings_size > UINT32_MAX) {
+        errno = EFBIG;
+        return NULL;
+    }
+
+    memcpy(header.magic, CONFIGFILE_SNAPSHOT_MAGIC, sizeof (CONFIGFILE_SNAPSHOT_MAGIC));
+    header.version = CONFIGFILE_SNAPSHOT_VERSION;
+    header.header_size = sizeof (configfile_snapshot);
+    for (header.slot_count = 16; header.slot_count < entry_count * 2; header.slot_count <<= 1);
+    header.entry_count = entry_count;
+    header.entries_offset = sizeof (configfile_snapshot);
+    header.slots_offset = header.entries_offset + entry_count * sizeof (configfile_snapshot_entry);
+    header.strings_offset = header.slots_offset + (size_t) header.slot_count * sizeof (uint32_t);
+    header.strings_size = strings_size;
+    header.image_size = header.strings_offset + strings_size;
+
+    if (source != NULL) {
+        header.source_size = source->st_size;
+        header.source_mtime_sec = source->st_mtim.tv_sec;
+        header.source_mtime_nsec = source->st_mtim.tv_nsec;
+    }
+
+    /* Anonymous memory is zeroed, which leaves every slot empty. */
+    image = mmap(NULL, header.image_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+
+    snapshot = (configfile_snapshot *) image;
+    *snapshot = header;
+    entries = (configfile_snapshot_entry *) (image + header.entries_offset);
+    slots = (uint32_t *) (image + header.slots_offset);
+    strings = image + header.strings_offset;
+    mask = header.slot_count - 1;
+
+    position = 0;
+    index = 0;
+    for (next = config; next != NULL; next = next->next, index++) {
+        entries[index].hash = next->module_hash;
+        entries[index].name_offset = position;
+        entries[index].name_length = next->module_name_length;
+        memcpy(&strings[position], next->module_name, next->module_name_length);
+        position += next->module_name_length + 1;
+
+        value = configfile_value_expand(next, &value_length);
+        entries[index].value_offset = position;
+        entries[index].value_length = value_length;
+        memcpy(&strings[position], value, value_length);
+        position += value_length + 1;
+
+        /*
+         * Only the module configfile_get() returns is reachable: the first of each name, or for layered lists the
+         * one of the last layer holding the name, which replaces the earlier ones.
+         */
+        for (slot = next->module_hash & mask; slots[slot] != 0; slot = (slot + 1) & mask) {
+            stored = &entries[slots[slot] - 1];
+            if (stored->hash == next->module_hash && stored->name_length == next->module_name_length &&
+                    memcmp(&strings[stored->name_offset], next->module_name, next->module_name_length) == 0) {
+                break;
+            }
+        }
+
+        if (slots[slot] == 0 || configfile_get_hashed(config, next->module_name, next->module_name_length, next->module_hash) == next) {
+            slots[slot] = index + 1;
+        }
+    }
+
+    snapshot->checksum = configfile_snapshot_checksum(image + header.header_size, header.image_size - header.header_size);
+
+    return snapshot;
+}
+
+int configfile_snapshot_put(const configfile_snapshot *snapshot, int fd) {
+    const char *image = (const char *) snapshot;
+    size_t written;
+    ssize_t count;
+
+    for (written = 0; written < snapshot->image_size; written += count) {
+        count = write(fd, &image[written], snapshot->image_size - written);
+        if (count < 0) {
+            if (errno == EINTR) {
+                count = 0;
+                continue;
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Writes an image to a file atomically, through a temporary file renamed over the destination.
+ * @return Returns zero on success, on failure returns -1 and errno is set.
+ */
+static int configfile_snapshot_save(const configfile_snapshot *snapshot, const char *snapshot_filename) {
+    char *temporary;
+    int fd, errno_backup;
+
+    temporary = malloc(strlen(snapshot_filename) + 8);
+    if (temporary == NULL) {
+        return -1;
+    }
+    sprintf(temporary, "%s.XXXXXX", snapshot_filename);
+
+    fd = mkstemp(temporary);
+    if (fd < 0) {
+        free(temporary);
+        return -1;
+    }
+
+    if (configfile_snapshot_put(snapshot, fd) != 0) {
+        goto error_00;
+    }
+
+    if (fchmod(fd, 0644) != 0 || fsync(fd) != 0) {
+        goto error_00;
+    }
+
+    if (close(fd) != 0) {
+        fd = -1;
+        goto error_00;
+    }
+    fd = -1;
+
+    if (rename(temporary, snapshot_filename) != 0) {
+        goto error_00;
+    }
+
+    free(temporary);
+    return 0;
+
+error_00:
+    errno_backup = errno;
+    if (fd >= 0) {
+        close(fd);
+    }
+    unlink(temporary);
+    free(temporary);
+    errno = errno_backup;
+    return -1;
+}
+
+int configfile_snapshot_write(configfile *config, const char *snapshot_filename, const char *source_filename) {
+    configfile_snapshot *snapshot;
+    struct stat source;
+    int result, errno_backup;
+
+    if (config == NULL || snapshot_filename == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (source_filename != NULL && stat(source_filename, &source) != 0) {
+        return -1;
+    }
+
+    snapshot = configfile_snapshot_build(config, source_filename != NULL ? &source : NULL);
+    if (snapshot == NULL) {
+        return -1;
+    }
+
+    result = configfile_snapshot_save(snapshot, snapshot_filename);
+
+    errno_backup = errno;
+    munmap(snapshot, snapshot->image_size);
+    errno = errno_backup;
+
+    return result;
+}
+
+int configfile_snapshot_validate(const configfile_snapshot *snapshot, size_t size) {
+    const configfile_snapshot_entry *entries;
+    const uint32_t *slots;
+    const char *strings;
+    size_t i, empty;
+
+    if (size < sizeof (configfile_snapshot) || memcmp(snapshot->magic, CONFIGFILE_SNAPSHOT_MAGIC, sizeof (CONFIGFILE_SNAPSHOT_MAGIC)) != 0 ||
+            snapshot->version != CONFIGFILE_SNAPSHOT_VERSION || snapshot->header_size != sizeof (configfile_snapshot) ||
+            snapshot->image_size != size) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (snapshot->entries_offset != sizeof (configfile_snapshot) ||
+            snapshot->slots_offset != snapshot->entries_offset + (uint64_t) snapshot->entry_count * sizeof (configfile_snapshot_entry) ||
+            snapshot->strings_offset != snapshot->slots_offset + (uint64_t) snapshot->slot_count * sizeof (uint32_t) ||
+            snapshot->strings_offset + snapshot->strings_size != size ||
+            snapshot->slot_count == 0 || (snapshot->slot_count & (snapshot->slot_count - 1)) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (configfile_snapshot_checksum((const char *) snapshot + snapshot->header_size, size - snapshot->header_size) != snapshot->checksum) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /*
+     * The checksum only catches accidents, an image built to match it must still not lead a lookup out of the
+     * image: every string ends inside the string table, every slot names an entry, and one slot at least is empty
+     * so a probe for a missing name stops.
+     */
+    entries = configfile_snapshot_entries(snapshot);
+    strings = configfile_snapshot_strings(snapshot);
+    for (i = 0; i < snapshot->entry_count; i++) {
+        if ((uint64_t) entries[i].name_offset + entries[i].name_length >= snapshot->strings_size ||
+                strings[entries[i].name_offset + entries[i].name_length] != '\0' ||
+                (uint64_t) entries[i].value_offset + entries[i].value_length >= snapshot->strings_size ||
+                strings[entries[i].value_offset + entries[i].value_length] != '\0') {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    slots = configfile_snapshot_slots(snapshot);
+    empty = 0;
+    for (i = 0; i < snapshot->slot_count; i++) {
+        if (slots[i] > snapshot->entry_count) {
+            errno = EINVAL;
+            return -1;
+        }
+        empty += slots[i] == 0;
+    }
+
+    if (empty == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+const configfile_snapshot *configfile_snapshot_open(const char *snapshot_filename, const char *source_filename) {
+    configfile_snapshot *snapshot;
+    struct stat file_stat, source;
+    int fd, errno_backup;
+
+    if (snapshot_filename == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    fd = open(snapshot_filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t) sizeof (configfile_snapshot)) {
+        errno_backup = errno ? errno : EINVAL;
+        close(fd);
+        errno = errno_backup;
+        return NULL;
+    }
+
+    snapshot = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    errno_backup = errno;
+    close(fd);
+    if (snapshot == MAP_FAILED) {
+        errno = errno_backup;
+        return NULL;
+    }
+
+    if (configfile_snapshot_validate(snapshot, file_stat.st_size) != 0) {
+        goto error_00;
+    }
+
+    if (source_filename != NULL) {
+        if (stat(source_filename, &source) != 0) {
+            goto error_00;
+        }
+
+        if ((uint64_t) source.st_size != snapshot->source_size || source.st_mtim.tv_sec != snapshot->source_mtime_sec ||
+                source.st_mtim.tv_nsec != snapshot->source_mtime_nsec) {
+            errno = ESTALE;
+            goto error_00;
+        }
+    }
+
+    return snapshot;
+
+error_00:
+    errno_backup = errno;
+    munmap(snapshot, file_stat.st_size);
+    errno = errno_backup;
+    return NULL;
+}
+
+const configfile_snapshot *configfile_snapshot_load(const char *source_filename, const char *snapshot_filename) {
+    const configfile_snapshot *snapshot;
+    configfile_snapshot *built;
+    configfile *config;
+    struct stat source;
+    int errno_backup;
+
+    if (source_filename == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    errno_backup = errno;
+
+    if (snapshot_filename != NULL) {
+        snapshot = configfile_snapshot_open(snapshot_filename, source_filename);
+        if (snapshot != NULL) {
+            return snapshot;
+        }
+    }
+
+    /* Missing, stale or damaged: parse the text and build the same image in memory. */
+    if (stat(source_filename, &source) != 0) {
+        return NULL;
+    }
+
+    config = configfile_init(source_filename);
+    if (config == NULL) {
+        return NULL;
+    }
+
+    built = configfile_snapshot_build(config, &source);
+    configfile_kill(config);
+    if (built == NULL) {
+        return NULL;
+    }
+
+    /* Refreshing the file only helps the next process, failing to do so is not an error. */
+    if (snapshot_filename != NULL) {
+        configfile_snapshot_save(built, snapshot_filename);
+    }
+
+    mprotect(built, built->image_size, PROT_READ);
+
+    errno = errno_backup;
+    return built;
+}
+
+void configfile_snapshot_close(const configfile_snapshot *snapshot) {
+    if (snapshot != NULL) {
+        munmap((void *) snapshot, snapshot->image_size);
+    }
+}
+
+int configfile_snapshot_get(const configfile_snapshot *snapshot, const char *module_name, configfile_view *view) {
+    const configfile_snapshot_entry *entries, *entry;
+    const uint32_t *slots;
+    const char *strings;
+    size_t module_name_length, position, mask;
+    uint64_t hash;
+
+    if (snapshot == NULL || module_name == NULL) {
+        return -1;
+    }
+
+    module_name_length = strlen(module_name);
+    hash = configfile_hash(module_name, module_name_length);
+
+    entries = configfile_snapshot_entries(snapshot);
+    slots = configfile_snapshot_slots(snapshot);
+    strings = configfile_snapshot_strings(snapshot);
+    mask = snapshot->slot_count - 1;
+
+    for (position = hash & mask; slots[position] != 0; position = (position + 1) & mask) {
+        entry = &entries[slots[position] - 1];
+        if (entry->hash == hash && entry->name_length == module_name_length &&
+                memcmp(&strings[entry->name_offset], module_name, module_name_length) == 0) {
+            if (view != NULL) {
+                configfile_snapshot_view(snapshot, entry, view);
+            }
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+size_t configfile_snapshot_count(const configfile_snapshot *snapshot) {
+    return snapshot != NULL ? snapshot->entry_count : 0;
+}
+
+int configfile_snapshot_at(const configfile_snapshot *snapshot, size_t index, configfile_view *view) {
+    if (snapshot == NULL || index >= snapshot->entry_count || view == NULL) {
+        return -1;
+    }
+
+    configfile_snapshot_view(snapshot, &configfile_snapshot_entries(snapshot)[index], view);
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_stats.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Instrumentation, compiled only with CONFIGFILE_STATS defined. Loads bind their counters to the loading threads,
+ * so the parser records into them without being passed the list. Lookups of a list count into its root and sample
+ * one lookup in CONFIGFILE_STATS_SAMPLE per thread for the hot keys. Without CONFIGFILE_STATS the functions only
+ * report that nothing was recorded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libconfigfile_private.h"
+
+#ifdef CONFIGFILE_STATS
+
+/* Lookups per hot key sample, a power of two. */
+#define CONFIGFILE_STATS_SAMPLE 64
+
+__thread configfile_stats *configfile_stats_load;
+
+/* Lookups of the calling thread, whatever the list. */
+static __thread unsigned int configfile_stats_ticks;
+
+configfile *configfile_stats_find(configfile *config, const char *module_name, size_t module_name_length, uint64_t hash) {
+    configfile_root *root = config->root;
+    const configfile_slot *slot;
+    size_t position, comparisons;
+    configfile *next;
+
+    comparisons = 0;
+    if (root->slots != NULL) {
+        position = hash & root->slots_mask;
+        for (slot = &root->slots[position]; slot->entry != NULL; slot = &root->slots[position]) {
+            comparisons++;
+            if (slot->hash == hash && slot->entry->module_name_length == module_name_length &&
+                    memcmp(slot->entry->module_name, module_name, module_name_length) == 0) {
+                configfile_stats_lookup(root, slot->entry, comparisons);
+                return slot->entry;
+            }
+            position = configfile_index_next(root, position);
+        }
+        configfile_stats_lookup(root, NULL, comparisons + 1);
+        return NULL;
+    }
+
+    for (next = config; next != NULL; next = next->next) {
+        comparisons++;
+        if (next->module_name_length == module_name_length && memcmp(next->module_name, module_name, module_name_length) == 0) {
+            break;
+        }
+    }
+    configfile_stats_lookup(root, next, comparisons);
+
+    return next;
+}
+
+/**
+ * Records a sampled module in the hot keys of a list.
+ */
+static void configfile_stats_sample(configfile_stats_state *stats, const configfile *entry) {
+    size_t i, least;
+
+    pthread_mutex_lock(&stats->hot_lock);
+
+    least = 0;
+    for (i = 0; i < CONFIGFILE_STATS_HOT && stats->hot[i].entry != NULL; i++) {
+        if (stats->hot[i].entry == entry) {
+            break;
+        }
+        if (stats->hot[i].samples < stats->hot[least].samples) {
+            least = i;
+        }
+    }
+
+    if (i < CONFIGFILE_STATS_HOT) {
+        stats->hot[i].entry = entry;
+        stats->hot[i].samples++;
+    } else {
+        stats->hot[least].entry = entry;
+        stats->hot[least].samples++;
+    }
+
+    pthread_mutex_unlock(&stats->hot_lock);
+}
+
+void configfile_stats_lookup(configfile_root *root, const configfile *entry, size_t comparisons) {
+    configfile_stats *counters = &root->stats.counters;
+
+    __atomic_fetch_add(entry != NULL ? &counters->hits : &counters->misses, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counters->comparisons, comparisons, __ATOMIC_RELAXED);
+
+    if (entry != NULL && (++configfile_stats_ticks & (CONFIGFILE_STATS_SAMPLE - 1)) == 0) {
+        configfile_stats_sample(&root->stats, entry);
+    }
+}
+
+static int configfile_stats_compare(const void *a, const void *b) {
+    uint64_t first = ((const configfile_stats_hot *) a)->samples, second = ((const configfile_stats_hot *) b)->samples;
+
+    return first < second ? 1 : first > second ? -1 : 0;
+}
+
+int configfile_stats_get(configfile *config, configfile_stats *stats) {
+    configfile_stats_hot hot[CONFIGFILE_STATS_HOT];
+    configfile_stats_state *state;
+    const uint64_t *source;
+    uint64_t *target;
+    size_t i;
+
+    if (config == NULL || config->root == NULL || stats == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* Every counter is a 64 bit word updated atomically, they are read one at a time. */
+    state = &config->root->stats;
+    source = (const uint64_t *) &state->counters;
+    target = (uint64_t *) stats;
+    for (i = 0; i < offsetof(configfile_stats, hot_count) / sizeof (uint64_t); i++) {
+        target[i] = __atomic_load_n(&source[i], __ATOMIC_RELAXED);
+    }
+    stats->skipped_lines = stats->lines - stats->entries;
+
+    pthread_mutex_lock(&state->hot_lock);
+    memcpy(hot, state->hot, sizeof (hot));
+    pthread_mutex_unlock(&state->hot_lock);
+
+    for (stats->hot_count = 0; stats->hot_count < CONFIGFILE_STATS_HOT && hot[stats->hot_count].entry != NULL; stats->hot_count++);
+    qsort(hot, stats->hot_count, sizeof (hot[0]), configfile_stats_compare);
+    for (i = 0; i < stats->hot_count; i++) {
+        stats->hot[i].module_name = hot[i].entry->module_name;
+        stats->hot[i].lookups = hot[i].samples * CONFIGFILE_STATS_SAMPLE;
+    }
+
+    return 0;
+}
+
+void configfile_stats_reset(configfile *config) {
+    configfile_stats_state *state;
+
+    if (config == NULL || config->root == NULL) {
+        return;
+    }
+
+    state = &config->root->stats;
+    __atomic_store_n(&state->counters.hits, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&state->counters.misses, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&state->counters.comparisons, 0, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&state->hot_lock);
+    memset(state->hot, 0, sizeof (state->hot));
+    pthread_mutex_unlock(&state->hot_lock);
+}
+
+#else
+
+int configfile_stats_get(configfile *config, configfile_stats *stats) {
+    (void) config;
+    (void) stats;
+
+    errno = ENOTSUP;
+    return -1;
+}
+
+void configfile_stats_reset(configfile *config) {
+    (void) config;
+}
+
+#endif
+
+int configfile_stats_dump(configfile *config, FILE *stream) {
+    configfile_stats stats;
+    uint64_t lookups;
+    size_t i;
+
+    if (stream == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (configfile_stats_get(config, &stats) != 0) {
+        return -1;
+    }
+
+    lookups = stats.hits + stats.misses;
+    fprintf(stream, "load: %llu bytes, %llu lines, %llu entries (%llu unique), %llu skipped lines\n",
+            (unsigned long long) stats.bytes, (unsigned long long) stats.lines, (unsigned long long) stats.entries,
+            (unsigned long long) stats.unique_entries, (unsigned long long) stats.skipped_lines);
+    fprintf(stream, "memory: %llu allocations, %llu bytes, %llu arena allocations\n", (unsigned long long) stats.allocations,
+            (unsigned long long) stats.allocated_bytes, (unsigned long long) stats.arena_allocations);
+    fprintf(stream, "time: load %.3f ms, io %.3f ms, scan %.3f ms, trim %.3f ms, build %.3f ms, index %.3f ms, sections %.3f ms\n",
+            stats.load_ns / 1e6, stats.io_ns / 1e6, stats.scan_ns / 1e6, stats.trim_ns / 1e6, stats.build_ns / 1e6,
+            stats.index_ns / 1e6, stats.sections_ns / 1e6);
+    fprintf(stream, "lookups: %llu hits, %llu misses, %.2f comparisons per lookup\n", (unsigned long long) stats.hits,
+            (unsigned long long) stats.misses, lookups > 0 ? (double) stats.comparisons / lookups : 0.0);
+    for (i = 0; i < stats.hot_count; i++) {
+        fprintf(stream, "hot %2zu: %s ~%llu lookups\n", i + 1, stats.hot[i].module_name, (unsigned long long) stats.hot[i].lookups);
+    }
+
+    return ferror(stream) ? -1 : 0;
+}
@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_table.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Tables, lists stored as columns. Module i is described by hashes[i], name_offsets[i] and name_lengths[i],
+ * value_lengths[i], every string lives in one pool and a value is stored right after its terminated name, so
+ * its offset needs no column. Iterating reads each column and the pool front to back. The index is an open
+ * addressing table of module numbers plus one, zero marking a free slot.
+ * Iterators give lists and tables the same interface, see configfile_iterator_next().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "libconfigfile.h"
+
+#define CONFIGFILE_TABLE_CAPACITY 1024
+#define CONFIGFILE_TABLE_STRINGS (64 * 1024)
+
+struct _configfile_table {
+    size_t count;
+    size_t capacity;
+    uint64_t *hashes;
+    uint32_t *name_offsets;
+    uint32_t *name_lengths;
+    uint32_t *value_lengths;
+    char *strings;
+    size_t strings_length;
+    size_t strings_capacity;
+    uint32_t *slots;
+    size_t slots_mask;
+    /* errno of a failed append. */
+    int error;
+};
+
+static void *configfile_table_grow(void *array, size_t size) {
+    void *grown = realloc(array, size);
+
+    if (grown == NULL && size > 0) {
+        errno = ENOMEM;
+    }
+
+    return grown;
+}
+
+/**
+ * Resizes every column to hold capacity modules. On failure the columns already resized stay valid.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOMEM.
+ */
+static int configfile_table_reserve(configfile_table *table, size_t capacity) {
+    void *grown;
+
+    if ((grown = configfile_table_grow(table->hashes, capacity * sizeof (uint64_t))) == NULL) {
+        return -1;
+    }
+    table->hashes = grown;
+    if ((grown = configfile_table_grow(table->name_offsets, capacity * sizeof (uint32_t))) == NULL) {
+        return -1;
+    }
+    table->name_offsets = grown;
+    if ((grown = configfile_table_grow(table->name_lengths, capacity * sizeof (uint32_t))) == NULL) {
+        return -1;
+    }
+    table->name_lengths = grown;
+    if ((grown = configfile_table_grow(table->value_lengths, capacity * sizeof (uint32_t))) == NULL) {
+        return -1;
+    }
+    table->value_lengths = grown;
+    table->capacity = capacity;
+
+    return 0;
+}
+
+/**
+ * Appends a module, copying its name and value into the pool.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOMEM, or EOVERFLOW once the pool
+ * or the number of modules no longer fits in 32 bits.
+ */
+static int configfile_table_append(configfile_table *table, const char *module_name, size_t module_name_length,
+        const char *module_value, size_t module_value_length, uint64_t hash) {
+    size_t length = module_name_length + module_value_length + 2, capacity;
+    char *name, *strings;
+
+    if (table->count >= UINT32_MAX - 1 || length > UINT32_MAX - table->strings_length) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    if (table->count == table->capacity &&
+            configfile_table_reserve(table, table->capacity > 0 ? table->capacity * 2 : CONFIGFILE_TABLE_CAPACITY) != 0) {
+        return -1;
+    }
+
+    if (length > table->strings_capacity - table->strings_length) {
+        for (capacity = table->strings_capacity > 0 ? table->strings_capacity : CONFIGFILE_TABLE_STRINGS;
+                length > capacity - table->strings_length; capacity *= 2);
+        if ((strings = configfile_table_grow(table->strings, capacity)) == NULL) {
+            return -1;
+        }
+        table->strings = strings;
+        table->strings_capacity = capacity;
+    }
+
+    name = &table->strings[table->strings_length];
+    memcpy(name, module_name, module_name_length);
+    name[module_name_length] = '\0';
+    memcpy(&name[module_name_length + 1], module_value, module_value_length);
+    name[module_name_length + 1 + module_value_length] = '\0';
+
+    table->hashes[table->count] = hash;
+    table->name_offsets[table->count] = table->strings_length;
+    table->name_lengths[table->count] = module_name_length;
+    table->value_lengths[table->count] = module_value_length;
+    table->strings_length += length;
+    table->count++;
+
+    return 0;
+}
+
+/**
+ * Appends a module parsed by configfile_parse_fd(), a configfile_callback.
+ */
+static int configfile_table_callback(const char *module_name, size_t module_name_length, const char *module_value,
+        size_t module_value_length, size_t line, void *user_data) {
+    configfile_table *table = user_data;
+
+    (void) line;
+
+    if (configfile_table_append(table, module_name, module_name_length, module_value, module_value_length,
+            configfile_hash(module_name, module_name_length)) != 0) {
+        table->error = errno;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Searches the index for a name.
+ * @return Returns the number of the module or -1 if not found.
+ */
+static ssize_t configfile_table_find(const configfile_table *table, const char *module_name, size_t module_name_length, uint64_t hash) {
+    size_t position, index;
+    uint32_t slot;
+
+    if (table->slots == NULL) {
+        return -1;
+    }
+
+    for (position = hash & table->slots_mask; (slot = table->slots[position]) != 0; position = (position + 1) & table->slots_mask) {
+        index = slot - 1;
+        if (table->hashes[index] == hash && table->name_lengths[index] == module_name_length &&
+                memcmp(&table->strings[table->name_offsets[index]], module_name, module_name_length) == 0) {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Adds a module to the index unless its name is already there.
+ */
+static void configfile_table_insert(configfile_table *table, size_t index) {
+    size_t position;
+    uint32_t slot;
+
+    for (position = table->hashes[index] & table->slots_mask; (slot = table->slots[position]) != 0; position = (position + 1) & table->slots_mask) {
+        if (table->hashes[slot - 1] == table->hashes[index] && table->name_lengths[slot - 1] == table->name_lengths[index] &&
+                memcmp(&table->strings[table->name_offsets[slot - 1]], &table->strings[table->name_offsets[index]], table->name_lengths[index]) == 0) {
+            return;
+        }
+    }
+
+    table->slots[position] = index + 1;
+}
+
+/**
+ * Trims the columns and the pool to their length and allocates the index, at most half full.
+ * @return Returns zero on success, on failure returns -1 and errno is set to ENOMEM.
+ */
+static int configfile_table_finish(configfile_table *table) {
+    size_t slot_count;
+    void *trimmed;
+
+    if (table->count == 0) {
+        return 0;
+    }
+
+    if (configfile_table_reserve(table, table->count) != 0) {
+        return -1;
+    }
+    if ((trimmed = configfile_table_grow(table->strings, table->strings_length)) == NULL) {
+        return -1;
+    }
+    table->strings = trimmed;
+    table->strings_capacity = table->strings_length;
+
+    for (slot_count = 8; slot_count < table->count * 2; slot_count *= 2);
+    table->slots = calloc(slot_count, sizeof (uint32_t));
+    if (table->slots == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    table->slots_mask = slot_count - 1;
+
+    return 0;
+}
+
+configfile_table *configfile_table_load(const char *filename) {
+    configfile_table *table;
+    int fd, result;
+    size_t i;
+
+    if (filename == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    table = calloc(1, sizeof (configfile_table));
+    if (table == NULL) {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    result = configfile_parse_fd(fd, configfile_table_callback, table);
+    close(fd);
+
+    /* Only a failed append stops the parse. */
+    if (result == 1) {
+        errno = table->error;
+        result = -1;
+    }
+
+    if (result != 0 || configfile_table_finish(table) != 0) {
+        configfile_table_kill(table);
+        return NULL;
+    }
+
+    for (i = 0; i < table->count; i++) {
+        configfile_table_insert(table, i);
+    }
+
+    return table;
+}
+
+configfile_table *configfile_table_build(configfile *config) {
+    size_t value_length, i;
+    configfile_table *table;
+    const char *value;
+    configfile *next;
+
+    if (config == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    table = calloc(1, sizeof (configfile_table));
+    if (table == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Values are copied expanded, the table does not interpolate. */
+    for (next = config; next != NULL; next = next->next) {
+        if ((value = configfile_value_expand(next, &value_length)) == NULL ||
+                configfile_table_append(table, next->module_name, next->module_name_length, value, value_length, next->module_hash) != 0) {
+            configfile_table_kill(table);
+            return NULL;
+        }
+    }
+
+    if (configfile_table_finish(table) != 0) {
+        configfile_table_kill(table);
+        return NULL;
+    }
+
+    /* Only the module configfile_get() returns for each name is indexed, which in layered lists is not the first. */
+    for (next = config, i = 0; next != NULL; next = next->next, i++) {
+        if (configfile_get_hashed(config, next->module_name, next->module_name_length, next->module_hash) == next) {
+            configfile_table_insert(table, i);
+        }
+    }
+
+    return table;
+}
+
+int configfile_table_get_hashed(const configfile_table *table, const char *module_name, size_t module_name_length,
+        uint64_t hash, configfile_view *view) {
+    ssize_t index;
+
+    if (table == NULL || module_name == NULL) {
+        return -1;
+    }
+
+    index = configfile_table_find(table, module_name, module_name_length, hash);
+    if (index < 0) {
+        return -1;
+    }
+
+    return view != NULL ? configfile_table_at(table, index, view) : 0;
+}
+
+int configfile_table_get(const configfile_table *table, const char *module_name, configfile_view *view) {
+    size_t module_name_length;
+
+    if (module_name == NULL) {
+        return -1;
+    }
+
+    module_name_length = strlen(module_name);
+
+    return configfile_table_get_hashed(table, module_name, module_name_length, configfile_hash(module_name, module_name_length), view);
+}
+
+size_t configfile_table_count(const configfile_table *table) {
+    return table != NULL ? table->count : 0;
+}
+
+int configfile_table_at(const configfile_table *table, size_t index, configfile_view *view) {
+    const char *name;
+
+    if (table == NULL || index >= table->count || view == NULL) {
+        return -1;
+    }
+
+    name = &table->strings[table->name_offsets[index]];
+    view->module_name = name;
+    view->module_name_length = table->name_lengths[index];
+    view->module_value = &name[view->module_name_length + 1];
+    view->module_value_length = table->value_lengths[index];
+
+    return 0;
+}
+
+size_t configfile_table_size(const configfile_table *table) {
+    if (table == NULL) {
+        return 0;
+    }
+
+    return sizeof (configfile_table) + table->capacity * (sizeof (uint64_t) + 3 * sizeof (uint32_t)) + table->strings_capacity +
+            (table->slots != NULL ? (table->slots_mask + 1) * sizeof (uint32_t) : 0);
+}
+
+void configfile_table_kill(configfile_table *table) {
+    if (table == NULL) {
+        return;
+    }
+
+    free(table->hashes);
+    free(table->name_offsets);
+    free(table->name_lengths);
+    free(table->value_lengths);
+    free(table->strings);
+    free(table->slots);
+    free(table);
+}
+
+void configfile_iterate(configfile_iterator *iterator, configfile *config) {
+    iterator->module = config;
+    iterator->table = NULL;
+    iterator->index = 0;
+}
+
+void configfile_table_iterate(configfile_iterator *iterator, const configfile_table *table) {
+    iterator->module = NULL;
+    iterator->table = table;
+    iterator->index = 0;
+}
+
+int configfile_iterator_next(configfile_iterator *iterator, configfile_view *view) {
+    configfile *module;
+
+    if (iterator->table != NULL) {
+        return configfile_table_at(iterator->table, iterator->index++, view);
+    }
+
+    module = iterator->module;
+    if (module == NULL || view == NULL) {
+        return -1;
+    }
+
+    view->module_value = configfile_value_expand(module, &view->module_value_length);
+    if (view->module_value == NULL) {
+        return -1;
+    }
+    view->module_name = module->module_name;
+    view->module_name_length = module->module_name_length;
+    iterator->module = module->next;
+
+    return 0;
+}
@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2021 Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * File:   libconfigfile_tokenize.c
+ * Author: Murilo Morais Marques <muriloglix@gmail.com>
+ *
+ * Tokenizer of the extended syntax, see CONFIGFILE_EXTENDED. A state machine reads every byte once: the class of
+ * the byte and the current state index a table giving the next state and an action. Values are written back
+ * into the buffer as they are read, at a position that never passes the one being read, so unescaping and joining
+ * continued lines need no copy and no allocation. Comments are skipped with memchr(3).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "libconfigfile_private.h"
+
+/* Byte classes. */
+enum {
+    CONFIGFILE_TOKEN_OTHER,
+    CONFIGFILE_TOKEN_NEWLINE,
+    CONFIGFILE_TOKEN_SPACE,
+    CONFIGFILE_TOKEN_RETURN,
+    CONFIGFILE_TOKEN_EQUALS,
+    CONFIGFILE_TOKEN_COMMENT,
+    CONFIGFILE_TOKEN_DOUBLE,
+    CONFIGFILE_TOKEN_SINGLE,
+    CONFIGFILE_TOKEN_BACKSLASH,
+    CONFIGFILE_TOKEN_CLASSES
+};
+
+/* States. */
+enum {
+    /* Before the first byte of a line. */
+    CONFIGFILE_STATE_START,
+    CONFIGFILE_STATE_COMMENT,
+    /* In a name, up to the delimiter. */
+    CONFIGFILE_STATE_NAME,
+    /* After the delimiter, before the value. */
+    CONFIGFILE_STATE_VALUE_START,
+    /* In an unquoted value, after a byte that is not a blank or after blanks. */
+    CONFIGFILE_STATE_VALUE,
+    CONFIGFILE_STATE_VALUE_BLANK,
+    /* After a backslash in an unquoted value, after a return following it, and on the line it continues onto. */
+    CONFIGFILE_STATE_BACKSLASH,
+    CONFIGFILE_STATE_BACKSLASH_RETURN,
+    CONFIGFILE_STATE_CONTINUE,
+    CONFIGFILE_STATE_DOUBLE,
+    CONFIGFILE_STATE_DOUBLE_ESCAPE,
+    CONFIGFILE_STATE_SINGLE,
+    /* After the closing quote. */
+    CONFIGFILE_STATE_QUOTED,
+    /* In a malformed line, up to its end. */
+    CONFIGFILE_STATE_SKIP,
+    CONFIGFILE_STATES
+};
+
+/* Actions, run before moving to the next state. */
+enum {
+    CONFIGFILE_ACTION_NONE,
+    CONFIGFILE_ACTION_NAME_BEGIN,
+    CONFIGFILE_ACTION_NAME_MARK,
+    CONFIGFILE_ACTION_DIRECTIVE,
+    /* Starts a value at this byte without writing it. */
+    CONFIGFILE_ACTION_VALUE_BEGIN,
+    /* Starts a value with this byte. */
+    CONFIGFILE_ACTION_VALUE_FIRST,
+    CONFIGFILE_ACTION_COPY,
+    CONFIGFILE_ACTION_COPY_MARK,
+    CONFIGFILE_ACTION_EMIT,
+    CONFIGFILE_ACTION_CLOSE,
+    CONFIGFILE_ACTION_ESCAPE,
+    /* Writes a backslash that escaped nothing, then reads this byte again in the next state. */
+    CONFIGFILE_ACTION_BACKSLASH,
+    /* Same with the return that followed the backslash, which was not the end of a CRLF newline. */
+    CONFIGFILE_ACTION_BACKSLASH_RETURN
+};
+
+#define CONFIGFILE_TRANSITION(state, action) ((unsigned char) ((state) | (action) << 4))
+#define CONFIGFILE_TRANSITION_STATE(transition) ((transition) & 0xf)
+#define CONFIGFILE_TRANSITION_ACTION(transition) ((transition) >> 4)
+
+static const unsigned char configfile_token_classes[256] = {
+    ['\n'] = CONFIGFILE_TOKEN_NEWLINE,
+    [' '] = CONFIGFILE_TOKEN_SPACE,
+    ['\t'] = CONFIGFILE_TOKEN_SPACE,
+    ['\v'] = CONFIGFILE_TOKEN_SPACE,
+    ['\f'] = CONFIGFILE_TOKEN_SPACE,
+    ['\r'] = CONFIGFILE_TOKEN_RETURN,
+    ['='] = CONFIGFILE_TOKEN_EQUALS,
+    ['#'] = CONFIGFILE_TOKEN_COMMENT,
+    [';'] = CONFIGFILE_TOKEN_COMMENT,
+    ['"'] = CONFIGFILE_TOKEN_DOUBLE,
+    ['\''] = CONFIGFILE_TOKEN_SINGLE,
+    ['\\'] = CONFIGFILE_TOKEN_BACKSLASH,
+};
+
+#define T CONFIGFILE_TRANSITION
+#define S(name) CONFIGFILE_STATE_##name
+#define A(name) CONFIGFILE_ACTION_##name
+
+/* Columns: other, newline, space, return, equals, comment, double quote, single quote, backslash. */
+static const unsigned char configfile_token_transitions[CONFIGFILE_STATES][CONFIGFILE_TOKEN_CLASSES] = {
+    [S(START)] = {T(S(NAME), A(NAME_BEGIN)), T(S(START), A(NONE)), T(S(START), A(NONE)), T(S(START), A(NONE)),
+        T(S(SKIP), A(NONE)), T(S(COMMENT), A(NONE)), T(S(NAME), A(NAME_BEGIN)), T(S(NAME), A(NAME_BEGIN)), T(S(NAME), A(NAME_BEGIN))},
+    [S(COMMENT)] = {T(S(COMMENT), A(NONE)), T(S(START), A(NONE)), T(S(COMMENT), A(NONE)), T(S(COMMENT), A(NONE)),
+        T(S(COMMENT), A(NONE)), T(S(COMMENT), A(NONE)), T(S(COMMENT), A(NONE)), T(S(COMMENT), A(NONE)), T(S(COMMENT), A(NONE))},
+    [S(NAME)] = {T(S(NAME), A(NAME_MARK)), T(S(START), A(DIRECTIVE)), T(S(NAME), A(NONE)), T(S(NAME), A(NONE)),
+        T(S(VALUE_START), A(NONE)), T(S(NAME), A(NAME_MARK)), T(S(NAME), A(NAME_MARK)), T(S(NAME), A(NAME_MARK)), T(S(NAME), A(NAME_MARK))},
+    [S(VALUE_START)] = {T(S(VALUE), A(VALUE_FIRST)), T(S(START), A(NONE)), T(S(VALUE_START), A(NONE)), T(S(VALUE_START), A(NONE)),
+        T(S(VALUE), A(VALUE_FIRST)), T(S(COMMENT), A(NONE)), T(S(DOUBLE), A(VALUE_BEGIN)), T(S(SINGLE), A(VALUE_BEGIN)),
+        T(S(BACKSLASH), A(VALUE_BEGIN))},
+    [S(VALUE)] = {T(S(VALUE), A(COPY_MARK)), T(S(START), A(EMIT)), T(S(VALUE_BLANK), A(COPY)), T(S(VALUE_BLANK), A(COPY)),
+        T(S(VALUE), A(COPY_MARK)), T(S(VALUE), A(COPY_MARK)), T(S(VALUE), A(COPY_MARK)), T(S(VALUE), A(COPY_MARK)), T(S(BACKSLASH), A(NONE))},
+    [S(VALUE_BLANK)] = {T(S(VALUE), A(COPY_MARK)), T(S(START), A(EMIT)), T(S(VALUE_BLANK), A(COPY)), T(S(VALUE_BLANK), A(COPY)),
+        T(S(VALUE), A(COPY_MARK)), T(S(COMMENT), A(EMIT)), T(S(VALUE), A(COPY_MARK)), T(S(VALUE), A(COPY_MARK)), T(S(BACKSLASH), A(NONE))},
+    [S(BACKSLASH)] = {T(S(VALUE), A(BACKSLASH)), T(S(CONTINUE), A(NONE)), T(S(VALUE), A(BACKSLASH)), T(S(BACKSLASH_RETURN), A(NONE)),
+        T(S(VALUE), A(BACKSLASH)), T(S(VALUE), A(BACKSLASH)), T(S(VALUE), A(BACKSLASH)), T(S(VALUE), A(BACKSLASH)), T(S(VALUE), A(BACKSLASH))},
+    [S(BACKSLASH_RETURN)] = {T(S(VALUE), A(BACKSLASH_RETURN)), T(S(CONTINUE), A(NONE)), T(S(VALUE), A(BACKSLASH_RETURN)),
+        T(S(VALUE), A(BACKSLASH_RETURN)), T(S(VALUE), A(BACKSLASH_RETURN)), T(S(VALUE), A(BACKSLASH_RETURN)),
+        T(S(VALUE), A(BACKSLASH_RETURN)), T(S(VALUE), A(BACKSLASH_RETURN)), T(S(VALUE), A(BACKSLASH_RETURN))},
+    [S(CONTINUE)] = {T(S(VALUE), A(COPY_MARK)), T(S(START), A(EMIT)), T(S(CONTINUE), A(NONE)), T(S(CONTINUE), A(NONE)),
+        T(S(VALUE), A(COPY_MARK)), T(S(VALUE), A(COPY_MARK)), T(S(VALUE), A(COPY_MARK)), T(S(VALUE), A(COPY_MARK)), T(S(BACKSLASH), A(NONE))},
+    [S(DOUBLE)] = {T(S(DOUBLE), A(COPY)), T(S(START), A(NONE)), T(S(DOUBLE), A(COPY)), T(S(DOUBLE), A(COPY)),
+        T(S(DOUBLE), A(COPY)), T(S(DOUBLE), A(COPY)), T(S(QUOTED), A(CLOSE)), T(S(DOUBLE), A(COPY)), T(S(DOUBLE_ESCAPE), A(NONE))},
+    [S(DOUBLE_ESCAPE)] = {T(S(DOUBLE), A(ESCAPE)), T(S(DOUBLE), A(NONE)), T(S(DOUBLE), A(ESCAPE)), T(S(DOUBLE), A(ESCAPE)),
+        T(S(DOUBLE), A(ESCAPE)), T(S(DOUBLE), A(ESCAPE)), T(S(DOUBLE), A(ESCAPE)), T(S(DOUBLE), A(ESCAPE)), T(S(DOUBLE), A(ESCAPE))},
+    [S(SINGLE)] = {T(S(SINGLE), A(COPY)), T(S(START), A(NONE)), T(S(SINGLE), A(COPY)), T(S(SINGLE), A(COPY)),
+        T(S(SINGLE), A(COPY)), T(S(SINGLE), A(COPY)), T(S(SINGLE), A(COPY)), T(S(QUOTED), A(CLOSE)), T(S(SINGLE), A(COPY))},
+    [S(QUOTED)] = {T(S(SKIP), A(NONE)), T(S(START), A(EMIT)), T(S(QUOTED), A(NONE)), T(S(QUOTED), A(NONE)),
+        T(S(SKIP), A(NONE)), T(S(COMMENT), A(EMIT)), T(S(SKIP), A(NONE)), T(S(SKIP), A(NONE)), T(S(SKIP), A(NONE))},
+    [S(SKIP)] = {T(S(SKIP), A(NONE)), T(S(START), A(NONE)), T(S(SKIP), A(NONE)), T(S(SKIP), A(NONE)),
+        T(S(SKIP), A(NONE)), T(S(SKIP), A(NONE)), T(S(SKIP), A(NONE)), T(S(SKIP), A(NONE)), T(S(SKIP), A(NONE))},
+};
+
+#undef T
+#undef S
+#undef A
+
+/*
+ * Bytes ending a run of bytes that leave the state unchanged, by state. Runs are consumed in a tight loop, the
+ * byte ending one goes through the transition table.
+ */
+#define CONFIGFILE_STOP_NAME 0x1
+#define CONFIGFILE_STOP_VALUE 0x2
+#define CONFIGFILE_STOP_DOUBLE 0x4
+#define CONFIGFILE_STOP_SINGLE 0x8
+#define CONFIGFILE_STOP_BLANK (CONFIGFILE_STOP_NAME | CONFIGFILE_STOP_VALUE)
+
+static const unsigned char configfile_token_stops[256] = {
+    ['\n'] = CONFIGFILE_STOP_NAME | CONFIGFILE_STOP_VALUE | CONFIGFILE_STOP_DOUBLE | CONFIGFILE_STOP_SINGLE,
+    [' '] = CONFIGFILE_STOP_BLANK,
+    ['\t'] = CONFIGFILE_STOP_BLANK,
+    ['\v'] = CONFIGFILE_STOP_BLANK,
+    ['\f'] = CONFIGFILE_STOP_BLANK,
+    ['\r'] = CONFIGFILE_STOP_BLANK,
+    ['='] = CONFIGFILE_STOP_NAME,
+    ['"'] = CONFIGFILE_STOP_DOUBLE,
+    ['\''] = CONFIGFILE_STOP_SINGLE,
+    ['\\'] = CONFIGFILE_STOP_VALUE | CONFIGFILE_STOP_DOUBLE,
+};
+
+/* Byte written for an escape sequence in double quotes, other bytes stand for themselves. */
+static const char configfile_token_escapes[256] = {
+    ['n'] = '\n',
+    ['t'] = '\t',
+    ['r'] = '\r',
+};
+
+/**
+ * Returns the end of the run starting at position, the first byte having one of the stop bits or length.
+ */
+static inline size_t configfile_token_run(const char *buffer, size_t position, size_t length, unsigned char stop) {
+    while (position < length && !(configfile_token_stops[(unsigned char) buffer[position]] & stop)) {
+        position++;
+    }
+
+    return position;
+}
+
+/**
+ * Returns the end of the run of blanks starting at position.
+ */
+static inline size_t configfile_token_blanks(const char *buffer, size_t position, size_t length) {
+    while (position < length && (configfile_token_stops[(unsigned char) buffer[position]] & CONFIGFILE_STOP_BLANK) == CONFIGFILE_STOP_BLANK &&
+            buffer[position] != '\n') {
+        position++;
+    }
+
+    return position;
+}
+
+static inline int configfile_token_blank(char byte) {
+    unsigned char token_class = configfile_token_classes[(unsigned char) byte];
+
+    return token_class == CONFIGFILE_TOKEN_SPACE || token_class == CONFIGFILE_TOKEN_RETURN;
+}
+
+/**
+ * Returns the end of the text of a line without a delimiter, which like a value ends at a '#' or ';' following a
+ * blank, trimmed of the blanks before it.
+ */
+static size_t configfile_token_directive_end(const char *buffer, size_t name, size_t name_end) {
+    size_t position;
+
+    for (position = name + 1; position < name_end; position++) {
+        if (configfile_token_classes[(unsigned char) buffer[position]] == CONFIGFILE_TOKEN_COMMENT && configfile_token_blank(buffer[position - 1])) {
+            for (name_end = position - 1; configfile_token_blank(buffer[name_end - 1]); name_end--);
+            break;
+        }
+    }
+
+    return name_end;
+}
+
+int configfile_tokenize(char *buffer, size_t length, size_t *line, configfile_callback callback,
+        configfile_directive_callback directive, void *user_data) {
+    size_t position, end, name, name_end, value, value_end, write, module_line;
+    unsigned char byte, token_class, transition;
+    const char *newline;
+    int state, next;
+
+    CONFIGFILE_STATS_ADD(bytes, length);
+#ifdef CONFIGFILE_STATS
+    size_t first_line = *line;
+#endif
+
+    name = name_end = value = value_end = write = module_line = 0;
+    state = CONFIGFILE_STATE_START;
+
+    /* The end of the buffer is read as one more newline, or two to end a line continued onto it. */
+    for (position = 0; position < length || state != CONFIGFILE_STATE_START; position++) {
+        /* Runs that only extend a name or copy a value, moved only once an escape or a continuation shifted it. */
+        switch (state) {
+            case CONFIGFILE_STATE_NAME:
+                end = configfile_token_run(buffer, position, length, CONFIGFILE_STOP_NAME);
+                if (end > position) {
+                    name_end = end;
+                }
+                position = end;
+                break;
+            case CONFIGFILE_STATE_VALUE:
+            case CONFIGFILE_STATE_DOUBLE:
+            case CONFIGFILE_STATE_SINGLE:
+                end = configfile_token_run(buffer, position, length, state == CONFIGFILE_STATE_VALUE ? CONFIGFILE_STOP_VALUE :
+                        state == CONFIGFILE_STATE_DOUBLE ? CONFIGFILE_STOP_DOUBLE : CONFIGFILE_STOP_SINGLE);
+                if (write != position) {
+                    memmove(&buffer[write], &buffer[position], end - position);
+                }
+                write += end - position;
+                if (state == CONFIGFILE_STATE_VALUE) {
+                    value_end = write;
+                }
+                position = end;
+                break;
+            case CONFIGFILE_STATE_START:
+            case CONFIGFILE_STATE_VALUE_START:
+            case CONFIGFILE_STATE_CONTINUE:
+            case CONFIGFILE_STATE_QUOTED:
+                position = configfile_token_blanks(buffer, position, length);
+                break;
+        }
+
+        if (position >= length) {
+            byte = '\n';
+        } else if (state == CONFIGFILE_STATE_COMMENT || state == CONFIGFILE_STATE_SKIP) {
+            newline = memchr(&buffer[position], '\n', length - position);
+            position = newline != NULL ? (size_t) (newline - buffer) : length;
+            byte = '\n';
+        } else {
+            byte = buffer[position];
+        }
+
+        token_class = configfile_token_classes[byte];
+        transition = configfile_token_transitions[state][token_class];
+        next = CONFIGFILE_TRANSITION_STATE(transition);
+
+        switch (CONFIGFILE_TRANSITION_ACTION(transition)) {
+            case CONFIGFILE_ACTION_NAME_BEGIN:
+                name = position;
+                name_end = position + 1;
+                module_line = *line + 1;
+                break;
+            case CONFIGFILE_ACTION_NAME_MARK:
+                name_end = position + 1;
+                break;
+            case CONFIGFILE_ACTION_DIRECTIVE:
+                if (directive != NULL && directive(&buffer[name], configfile_token_directive_end(buffer, name, name_end) - name,
+                        module_line, user_data) != 0) {
+                    CONFIGFILE_STATS_ADD(lines, *line + 1 - first_line);
+                    return 1;
+                }
+                break;
+            case CONFIGFILE_ACTION_VALUE_BEGIN:
+                value = value_end = write = position;
+                break;
+            case CONFIGFILE_ACTION_VALUE_FIRST:
+                value = write = position;
+                buffer[write++] = byte;
+                value_end = write;
+                break;
+            case CONFIGFILE_ACTION_COPY:
+                buffer[write++] = byte;
+                break;
+            case CONFIGFILE_ACTION_COPY_MARK:
+                buffer[write++] = byte;
+                value_end = write;
+                break;
+            case CONFIGFILE_ACTION_EMIT:
+                if (callback(&buffer[name], name_end - name, &buffer[value], value_end - value, module_line, user_data) != 0) {
+                    CONFIGFILE_STATS_ADD(lines, *line + 1 - first_line);
+                    return 1;
+                }
+                break;
+            case CONFIGFILE_ACTION_CLOSE:
+                value_end = write;
+                break;
+            case CONFIGFILE_ACTION_ESCAPE:
+                buffer[write++] = configfile_token_escapes[byte] != '\0' ? configfile_token_escapes[byte] : (char) byte;
+                break;
+            case CONFIGFILE_ACTION_BACKSLASH:
+                buffer[write++] = '\\';
+                value_end = write;
+                position--;
+                break;
+            case CONFIGFILE_ACTION_BACKSLASH_RETURN:
+                buffer[write++] = '\\';
+                buffer[write++] = '\r';
+                value_end = write;
+                position--;
+                break;
+        }
+
+        if (token_class == CONFIGFILE_TOKEN_NEWLINE && position < length) {
+            (*line)++;
+        }
+        state = next;
+    }
+
+    /* A last line without a newline counts as a line. */
+    if (length > 0 && buffer[length - 1] != '\n') {
+        (*line)++;
+    }
+    CONFIGFILE_STATS_ADD(lines, *line - first_line);
+
+    return 0;
+}